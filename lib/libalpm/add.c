@@ -46,6 +46,7 @@
 #include "db.h"
 #include "remove.h"
 #include "handle.h"
+#include "workers.h"
 
 int SYMEXPORT alpm_add_pkg(alpm_handle_t *handle, alpm_pkg_t *pkg)
 {
@@ -110,10 +111,11 @@ int SYMEXPORT alpm_add_pkg(alpm_handle_t *handle, alpm_pkg_t *pkg)
 	return 0;
 }
 
-static int perform_extraction(alpm_handle_t *handle, struct archive *archive,
-		struct archive_entry *entry, const char *filename)
+/* One disk writer is used for all entries of a package. Like bsdtar it holds
+ * back the modes and times of directories until it is closed, so these are
+ * applied once all files inside them are extracted. */
+static struct archive *disk_writer_new(alpm_handle_t *handle)
 {
-	int ret;
 	struct archive *archive_writer;
 	const int archive_flags = ARCHIVE_EXTRACT_OWNER |
 	                          ARCHIVE_EXTRACT_PERM |
@@ -122,21 +124,53 @@ static int perform_extraction(alpm_handle_t *handle, struct archive *archive,
 	                          ARCHIVE_EXTRACT_XATTR |
 	                          ARCHIVE_EXTRACT_SECURE_SYMLINKS;
 
-	archive_entry_set_pathname(entry, filename);
-
 	archive_writer = archive_write_disk_new();
 	if (archive_writer == NULL) {
 		_alpm_log(handle, ALPM_LOG_ERROR, _("cannot allocate disk archive object"));
 		alpm_logaction(handle, ALPM_CALLER_PREFIX,
 				"error: cannot allocate disk archive object");
-		return 1;
+		return NULL;
 	}
 
 	archive_write_disk_set_options(archive_writer, archive_flags);
+	return archive_writer;
+}
 
-	ret = archive_read_extract2(archive, entry, archive_writer);
-
+static void disk_writer_free(alpm_handle_t *handle, struct archive *archive_writer)
+{
+	if(archive_writer == NULL) {
+		return;
+	}
+	/* applies the deferred directory metadata */
+	if(archive_write_close(archive_writer) != ARCHIVE_OK) {
+		_alpm_log(handle, ALPM_LOG_WARNING,
+				_("could not restore directory metadata (%s)\n"),
+				archive_error_string(archive_writer));
+	}
 	archive_write_free(archive_writer);
+}
+
+static int perform_extraction(alpm_handle_t *handle, struct archive *archive,
+		struct archive **archive_writer, struct archive_entry *entry,
+		const char *filename)
+{
+	int ret;
+
+	archive_entry_set_pathname(entry, filename);
+
+	if(*archive_writer == NULL) {
+		/* creating the disk writer failed */
+		return 1;
+	}
+
+	ret = archive_read_extract2(archive, entry, *archive_writer);
+
+	if(ret == ARCHIVE_FATAL) {
+		/* the writer can not be used any more, the next entry gets a new one,
+		 * see commit_extract() */
+		disk_writer_free(handle, *archive_writer);
+		*archive_writer = NULL;
+	}
 
 	if(ret == ARCHIVE_WARN && archive_errno(archive) != ENOSPC) {
 		/* operation succeeded but a "non-critical" error was encountered */
@@ -166,7 +200,8 @@ static int try_rename(alpm_handle_t *handle, const char *src, const char *dest)
 }
 
 static int extract_db_file(alpm_handle_t *handle, struct archive *archive,
-		struct archive_entry *entry, alpm_pkg_t *newpkg, const char *entryname)
+		struct archive **archive_writer, struct archive_entry *entry,
+		alpm_pkg_t *newpkg, const char *entryname)
 {
 	char filename[PATH_MAX]; /* the actual file we're extracting */
 	const char *dbfile = NULL;
@@ -185,11 +220,12 @@ static int extract_db_file(alpm_handle_t *handle, struct archive *archive,
 	archive_entry_set_perm(entry, 0644);
 	snprintf(filename, PATH_MAX, "%s%s-%s/%s",
 			_alpm_db_path(handle->db_local), newpkg->name, newpkg->version, dbfile);
-	return perform_extraction(handle, archive, entry, filename);
+	return perform_extraction(handle, archive, archive_writer, entry, filename);
 }
 
 static int extract_single_file(alpm_handle_t *handle, struct archive *archive,
-		struct archive_entry *entry, alpm_pkg_t *newpkg, alpm_pkg_t *oldpkg)
+		struct archive **archive_writer, struct archive_entry *entry,
+		alpm_pkg_t *newpkg, alpm_pkg_t *oldpkg)
 {
 	const char *entryname = archive_entry_pathname(entry);
 	mode_t entrymode = archive_entry_mode(entry);
@@ -202,7 +238,8 @@ static int extract_single_file(alpm_handle_t *handle, struct archive *archive,
 	size_t filename_len;
 
 	if(*entryname == '.') {
-		return extract_db_file(handle, archive, entry, newpkg, entryname);
+		return extract_db_file(handle, archive, archive_writer, entry, newpkg,
+				entryname);
 	}
 
 	if (!alpm_filelist_contains(&newpkg->files, entryname)) {
@@ -221,7 +258,7 @@ static int extract_single_file(alpm_handle_t *handle, struct archive *archive,
 	}
 
 	/* if a file is in NoExtract then we never extract it */
-	if(_alpm_fnmatch_patterns(handle->noextract, entryname) == 0) {
+	if(alpm_option_match_noextract(handle, entryname) == 0) {
 		_alpm_log(handle, ALPM_LOG_DEBUG, "%s is in NoExtract,"
 				" skipping extraction of %s\n",
 				entryname, filename);
@@ -300,7 +337,7 @@ static int extract_single_file(alpm_handle_t *handle, struct archive *archive,
 	} else {
 		/* case 3: trying to overwrite file with file */
 		/* if file is in NoUpgrade, don't touch it */
-		if(_alpm_fnmatch_patterns(handle->noupgrade, entryname) == 0) {
+		if(alpm_option_match_noupgrade(handle, entryname) == 0) {
 			notouch = 1;
 		} else {
 			alpm_backup_t *oldbackup;
@@ -325,7 +362,7 @@ static int extract_single_file(alpm_handle_t *handle, struct archive *archive,
 	}
 
 	_alpm_log(handle, ALPM_LOG_DEBUG, "extracting %s\n", filename);
-	if(perform_extraction(handle, archive, entry, filename)) {
+	if(perform_extraction(handle, archive, archive_writer, entry, filename)) {
 		errors++;
 		return errors;
 	}
@@ -412,53 +449,92 @@ static int extract_single_file(alpm_handle_t *handle, struct archive *archive,
 	return errors;
 }
 
-static int commit_single_pkg(alpm_handle_t *handle, alpm_pkg_t *newpkg,
-		size_t pkg_current, size_t pkg_count)
+/* A package being committed */
+struct commit_target {
+	alpm_pkg_t *newpkg;
+	alpm_pkg_t *oldpkg;
+	alpm_progress_t progress;
+	alpm_event_package_operation_t event;
+	int is_upgrade;
+	size_t pkg_current;
+	size_t pkg_count;
+	struct archive *archive;
+	int fd;
+	struct archive *archive_writer;
+	/* entry read but not extracted yet, see commit_extract() */
+	struct archive_entry *entry;
+	/* number of files that could not be extracted */
+	int errors;
+	/* private handle while extracted on a worker thread */
+	alpm_handle_t *worker;
+};
+
+static void commit_close_archive(alpm_handle_t *handle,
+		struct commit_target *target)
 {
-	int ret = 0, errors = 0;
-	int is_upgrade = 0;
+	disk_writer_free(handle, target->archive_writer);
+	target->archive_writer = NULL;
+	if(target->archive) {
+		_alpm_archive_read_free(target->archive);
+		close(target->fd);
+		target->archive = NULL;
+	}
+}
+
+/* Everything up to opening the package file: start event, pre_install
+ * scriptlet, removal of the old version and the database entry. Without
+ * announce, the caller sends the start event right before finishing the
+ * package, so that events of different packages do not interleave. */
+static int commit_prepare(alpm_handle_t *handle, struct commit_target *target,
+		int announce)
+{
+	alpm_pkg_t *newpkg = target->newpkg;
 	alpm_pkg_t *oldpkg = NULL;
 	alpm_db_t *db = handle->db_local;
 	alpm_trans_t *trans = handle->trans;
-	alpm_progress_t progress = ALPM_PROGRESS_ADD_START;
-	alpm_event_package_operation_t event;
 	const char *log_msg = "adding";
 	const char *pkgfile;
-	struct archive *archive;
-	struct archive_entry *entry;
-	int fd, cwdfd;
 	struct stat buf;
 
 	ASSERT(trans != NULL, return -1);
 
+	target->progress = ALPM_PROGRESS_ADD_START;
+	target->archive = NULL;
+	target->fd = -1;
+	target->archive_writer = NULL;
+	target->errors = 0;
+
 	/* see if this is an upgrade. if so, remove the old package first */
 	if(_alpm_db_get_pkgfromcache(db, newpkg->name) && (oldpkg = newpkg->oldpkg)) {
 		int cmp = _alpm_pkg_compare_versions(newpkg, oldpkg);
 		if(cmp < 0) {
 			log_msg = "downgrading";
-			progress = ALPM_PROGRESS_DOWNGRADE_START;
-			event.operation = ALPM_PACKAGE_DOWNGRADE;
+			target->progress = ALPM_PROGRESS_DOWNGRADE_START;
+			target->event.operation = ALPM_PACKAGE_DOWNGRADE;
 		} else if(cmp == 0) {
 			log_msg = "reinstalling";
-			progress = ALPM_PROGRESS_REINSTALL_START;
-			event.operation = ALPM_PACKAGE_REINSTALL;
+			target->progress = ALPM_PROGRESS_REINSTALL_START;
+			target->event.operation = ALPM_PACKAGE_REINSTALL;
 		} else {
 			log_msg = "upgrading";
-			progress = ALPM_PROGRESS_UPGRADE_START;
-			event.operation = ALPM_PACKAGE_UPGRADE;
+			target->progress = ALPM_PROGRESS_UPGRADE_START;
+			target->event.operation = ALPM_PACKAGE_UPGRADE;
 		}
-		is_upgrade = 1;
+		target->is_upgrade = 1;
 
 		/* copy over the install reason */
 		newpkg->reason = alpm_pkg_get_reason(oldpkg);
 	} else {
-		event.operation = ALPM_PACKAGE_INSTALL;
+		target->event.operation = ALPM_PACKAGE_INSTALL;
 	}
+	target->oldpkg = oldpkg;
 
-	event.type = ALPM_EVENT_PACKAGE_OPERATION_START;
-	event.oldpkg = oldpkg;
-	event.newpkg = newpkg;
-	EVENT(handle, &event);
+	target->event.type = ALPM_EVENT_PACKAGE_OPERATION_START;
+	target->event.oldpkg = oldpkg;
+	target->event.newpkg = newpkg;
+	if(announce) {
+		EVENT(handle, &target->event);
+	}
 
 	pkgfile = newpkg->origin_data.file;
 
@@ -467,10 +543,10 @@ static int commit_single_pkg(alpm_handle_t *handle, alpm_pkg_t *newpkg,
 		/* pre_install/pre_upgrade scriptlet */
 	if(alpm_pkg_has_scriptlet(newpkg) &&
 			!(trans->flags & ALPM_TRANS_FLAG_NOSCRIPTLET)) {
-		const char *scriptlet_name = is_upgrade ? "pre_upgrade" : "pre_install";
+		const char *scriptlet_name = target->is_upgrade ? "pre_upgrade" : "pre_install";
 
 		_alpm_runscriptlet(handle, pkgfile, scriptlet_name,
-				newpkg->version, oldpkg ? oldpkg->version : NULL, 1);
+				newpkg->version, oldpkg ? oldpkg->version : NULL, newpkg);
 	}
 
 	/* we override any pre-set reason if we have alldeps or allexplicit set */
@@ -498,84 +574,110 @@ static int commit_single_pkg(alpm_handle_t *handle, alpm_pkg_t *newpkg,
 		return -1;
 	}
 
-	fd = _alpm_open_archive(db->handle, pkgfile, &buf,
-			&archive, ALPM_ERR_PKG_OPEN);
-	if(fd < 0) {
+	target->fd = _alpm_open_archive(db->handle, pkgfile, &buf,
+			&target->archive, ALPM_ERR_PKG_OPEN);
+	if(target->fd < 0) {
+		target->archive = NULL;
 		return -1;
 	}
 
-	/* save the cwd so we can restore it later */
-	OPEN(cwdfd, ".", O_RDONLY | O_CLOEXEC);
-	if(cwdfd < 0) {
-		_alpm_log(handle, ALPM_LOG_ERROR, _("could not get current working directory\n"));
-	}
+	/* archive_write_disk_new() briefly changes the umask of the process, so
+	 * this must not happen while other packages are extracted */
+	target->archive_writer = disk_writer_new(handle);
 
-	/* libarchive requires this for extracting hard links */
-	if(chdir(handle->root) != 0) {
-		_alpm_log(handle, ALPM_LOG_ERROR, _("could not change directory to %s (%s)\n"),
-				handle->root, strerror(errno));
-		_alpm_archive_read_free(archive);
-		if(cwdfd >= 0) {
-			close(cwdfd);
+	return 0;
+}
+
+/* Extract the package file, which may happen on a worker thread. The
+ * working directory has to be the root directory. If the disk writer had to
+ * be replaced on a worker thread, the archive is left open at the pending
+ * entry and the extraction has to be resumed on the main thread. */
+static void commit_extract(alpm_handle_t *handle, struct commit_target *target)
+{
+	alpm_pkg_t *newpkg = target->newpkg;
+	struct archive *archive = target->archive;
+	struct archive_entry *entry;
+	int dbonly = handle->trans->flags & ALPM_TRANS_FLAG_DBONLY;
+
+	if(target->entry == NULL) {
+		if(dbonly) {
+			_alpm_log(handle, ALPM_LOG_DEBUG, "extracting db files\n");
+		} else {
+			_alpm_log(handle, ALPM_LOG_DEBUG, "extracting files\n");
+
+			/* call PROGRESS once with 0 percent, as we sort-of skip that here */
+			PROGRESS(handle, target->progress, newpkg->name, 0,
+					target->pkg_count, target->pkg_current);
 		}
-		close(fd);
-		return -1;
 	}
 
-	if(trans->flags & ALPM_TRANS_FLAG_DBONLY) {
-		_alpm_log(handle, ALPM_LOG_DEBUG, "extracting db files\n");
-		while(archive_read_next_header(archive, &entry) == ARCHIVE_OK) {
-			const char *entryname = archive_entry_pathname(entry);
-			if(entryname[0] == '.') {
-				errors += extract_db_file(handle, archive, entry, newpkg, entryname);
-			} else {
-				archive_read_data_skip(archive);
-			}
+	while(target->entry != NULL
+			|| archive_read_next_header(archive, &target->entry) == ARCHIVE_OK) {
+		const char *entryname = archive_entry_pathname(target->entry);
+		int percent;
+
+		if(dbonly && entryname[0] != '.') {
+			target->entry = NULL;
+			archive_read_data_skip(archive);
+			continue;
 		}
-	} else {
-		_alpm_log(handle, ALPM_LOG_DEBUG, "extracting files\n");
-
-		/* call PROGRESS once with 0 percent, as we sort-of skip that here */
-		PROGRESS(handle, progress, newpkg->name, 0, pkg_count, pkg_current);
-
-		while(archive_read_next_header(archive, &entry) == ARCHIVE_OK) {
-			int percent;
-
-			if(newpkg->size != 0) {
-				/* Using compressed size for calculations here, as newpkg->isize is not
-				 * exact when it comes to comparing to the ACTUAL uncompressed size
-				 * (missing metadata sizes) */
-				int64_t pos = _alpm_archive_compressed_ftell(archive);
-				percent = (pos * 100) / newpkg->size;
-				if(percent >= 100) {
-					percent = 100;
-				}
-			} else {
-				percent = 0;
+
+		if(target->archive_writer == NULL) {
+			if(handle->worker) {
+				/* archive_write_disk_new() briefly changes the umask of the
+				 * process, which other packages are being extracted with */
+				_alpm_log(handle, ALPM_LOG_DEBUG,
+						"resuming extraction of %s after the other packages\n", newpkg->name);
+				return;
 			}
+			target->archive_writer = disk_writer_new(handle);
+		}
+		entry = target->entry;
+		target->entry = NULL;
 
-			PROGRESS(handle, progress, newpkg->name, percent, pkg_count, pkg_current);
+		if(dbonly) {
+			target->errors += extract_db_file(handle, archive, &target->archive_writer,
+					entry, newpkg, entryname);
+			continue;
+		}
 
-			/* extract the next file from the archive */
-			errors += extract_single_file(handle, archive, entry, newpkg, oldpkg);
+		if(newpkg->size != 0) {
+			/* Using compressed size for calculations here, as newpkg->isize is not
+			 * exact when it comes to comparing to the ACTUAL uncompressed size
+			 * (missing metadata sizes) */
+			int64_t pos = _alpm_archive_compressed_ftell(archive);
+			percent = (pos * 100) / newpkg->size;
+			if(percent >= 100) {
+				percent = 100;
+			}
+		} else {
+			percent = 0;
 		}
-	}
 
-	_alpm_archive_read_free(archive);
-	close(fd);
+		PROGRESS(handle, target->progress, newpkg->name, percent,
+				target->pkg_count, target->pkg_current);
 
-	/* restore the old cwd if we have it */
-	if(cwdfd >= 0) {
-		if(fchdir(cwdfd) != 0) {
-			_alpm_log(handle, ALPM_LOG_ERROR,
-					_("could not restore working directory (%s)\n"), strerror(errno));
-		}
-		close(cwdfd);
+		/* extract the next file from the archive */
+		target->errors += extract_single_file(handle, archive, &target->archive_writer,
+				entry, newpkg, target->oldpkg);
 	}
 
-	if(errors) {
+	commit_close_archive(handle, target);
+}
+
+/* Everything after extraction: database entry, post_install scriptlet and
+ * done event. */
+static int commit_finish(alpm_handle_t *handle, struct commit_target *target)
+{
+	alpm_pkg_t *newpkg = target->newpkg;
+	alpm_pkg_t *oldpkg = target->oldpkg;
+	alpm_db_t *db = handle->db_local;
+	alpm_trans_t *trans = handle->trans;
+	int ret = 0;
+
+	if(target->errors) {
 		ret = -1;
-		if(is_upgrade) {
+		if(target->is_upgrade) {
 			_alpm_log(handle, ALPM_LOG_ERROR, _("problem occurred while upgrading %s\n"),
 					newpkg->name);
 			alpm_logaction(handle, ALPM_CALLER_PREFIX,
@@ -611,9 +713,10 @@ static int commit_single_pkg(alpm_handle_t *handle, alpm_pkg_t *newpkg,
 				newpkg->name);
 	}
 
-	PROGRESS(handle, progress, newpkg->name, 100, pkg_count, pkg_current);
+	PROGRESS(handle, target->progress, newpkg->name, 100,
+			target->pkg_count, target->pkg_current);
 
-	switch(event.operation) {
+	switch(target->event.operation) {
 		case ALPM_PACKAGE_INSTALL:
 			alpm_logaction(handle, ALPM_CALLER_PREFIX, "installed %s (%s)\n",
 					newpkg->name, newpkg->version);
@@ -639,19 +742,415 @@ static int commit_single_pkg(alpm_handle_t *handle, alpm_pkg_t *newpkg,
 	if(alpm_pkg_has_scriptlet(newpkg)
 			&& !(trans->flags & ALPM_TRANS_FLAG_NOSCRIPTLET)) {
 		char *scriptlet = _alpm_local_db_pkgpath(db, newpkg, "install");
-		const char *scriptlet_name = is_upgrade ? "post_upgrade" : "post_install";
+		const char *scriptlet_name = target->is_upgrade ? "post_upgrade" : "post_install";
 
 		_alpm_runscriptlet(handle, scriptlet, scriptlet_name,
-				newpkg->version, oldpkg ? oldpkg->version : NULL, 0);
+				newpkg->version, oldpkg ? oldpkg->version : NULL, NULL);
 		free(scriptlet);
 	}
 
-	event.type = ALPM_EVENT_PACKAGE_OPERATION_DONE;
-	EVENT(handle, &event);
+	target->event.type = ALPM_EVENT_PACKAGE_OPERATION_DONE;
+	EVENT(handle, &target->event);
 
 	return ret;
 }
 
+static int enter_root(alpm_handle_t *handle, int *cwdfd)
+{
+	/* save the cwd so we can restore it later */
+	OPEN(*cwdfd, ".", O_RDONLY | O_CLOEXEC);
+	if(*cwdfd < 0) {
+		_alpm_log(handle, ALPM_LOG_ERROR, _("could not get current working directory\n"));
+	}
+
+	/* libarchive requires this for extracting hard links */
+	if(chdir(handle->root) != 0) {
+		_alpm_log(handle, ALPM_LOG_ERROR, _("could not change directory to %s (%s)\n"),
+				handle->root, strerror(errno));
+		if(*cwdfd >= 0) {
+			close(*cwdfd);
+		}
+		return -1;
+	}
+	return 0;
+}
+
+static void leave_root(alpm_handle_t *handle, int cwdfd)
+{
+	/* restore the old cwd if we have it */
+	if(cwdfd >= 0) {
+		if(fchdir(cwdfd) != 0) {
+			_alpm_log(handle, ALPM_LOG_ERROR,
+					_("could not restore working directory (%s)\n"), strerror(errno));
+		}
+		close(cwdfd);
+	}
+}
+
+static int commit_single_pkg(alpm_handle_t *handle, alpm_pkg_t *newpkg,
+		size_t pkg_current, size_t pkg_count)
+{
+	struct commit_target target = {
+		.newpkg = newpkg,
+		.pkg_current = pkg_current,
+		.pkg_count = pkg_count
+	};
+	int cwdfd;
+
+	if(commit_prepare(handle, &target, 1) != 0) {
+		commit_close_archive(handle, &target);
+		return -1;
+	}
+
+	if(enter_root(handle, &cwdfd) != 0) {
+		commit_close_archive(handle, &target);
+		return -1;
+	}
+	commit_extract(handle, &target);
+	leave_root(handle, cwdfd);
+
+	return commit_finish(handle, &target);
+}
+
+/* Paths of a group of packages extracted together. Keys are stored without
+ * the trailing slash of directories. */
+struct batch_path {
+	const char *name;
+	size_t len;
+	unsigned long hash;
+	/* every package has the path as a directory */
+	int dir;
+	/* the directory might be removed along with an old package */
+	int removable;
+	/* -1 until checked, then whether the directory exists */
+	int ondisk;
+	struct batch_path *next;
+};
+
+struct batch_paths {
+	struct batch_path **buckets;
+	size_t mask;
+	size_t count;
+	/* arrays of entries, one per package */
+	alpm_list_t *chunks;
+};
+
+static unsigned long batch_path_hash(const char *path, size_t len)
+{
+	unsigned long hash = 0;
+	size_t i;
+
+	for(i = 0; i < len; i++) {
+		hash = (unsigned char)path[i] + hash * 65599;
+	}
+	return hash;
+}
+
+static struct batch_path *batch_paths_find(struct batch_paths *paths,
+		struct batch_path *key)
+{
+	struct batch_path *entry;
+
+	if(paths->buckets == NULL) {
+		return NULL;
+	}
+	for(entry = paths->buckets[key->hash & paths->mask]; entry; entry = entry->next) {
+		if(entry->hash == key->hash && entry->len == key->len
+				&& memcmp(entry->name, key->name, key->len) == 0) {
+			return entry;
+		}
+	}
+	return NULL;
+}
+
+static int batch_paths_grow(struct batch_paths *paths, size_t count)
+{
+	struct batch_path **buckets;
+	size_t size = paths->buckets ? paths->mask + 1 : 64;
+	alpm_list_t *i;
+
+	if(paths->buckets && count * 2 <= size) {
+		return 0;
+	}
+	while(count * 2 > size) {
+		size *= 2;
+	}
+	CALLOC(buckets, size, sizeof(struct batch_path *), return -1);
+	free(paths->buckets);
+	paths->buckets = buckets;
+	paths->mask = size - 1;
+
+	/* the entries of all previous packages are unique */
+	for(i = paths->chunks; i; i = i->next) {
+		struct batch_path *entry;
+		for(entry = i->data; entry->name; entry++) {
+			if(entry->len != (size_t)-1) {
+				struct batch_path **bucket = &paths->buckets[entry->hash & paths->mask];
+				entry->next = *bucket;
+				*bucket = entry;
+			}
+		}
+	}
+	return 0;
+}
+
+static void batch_paths_free(struct batch_paths *paths)
+{
+	FREELIST(paths->chunks);
+	FREE(paths->buckets);
+}
+
+static void batch_path_init(struct batch_path *entry, const char *name,
+		int removable)
+{
+	size_t len = strlen(name);
+
+	entry->name = name;
+	entry->dir = len > 1 && name[len - 1] == '/';
+	if(entry->dir) {
+		len--;
+	}
+	entry->len = len;
+	entry->hash = batch_path_hash(name, len);
+	entry->removable = entry->dir && removable;
+	entry->ondisk = -1;
+	entry->next = NULL;
+}
+
+/* Whether two packages sharing a path can be extracted at the same time. This
+ * is only the case for directories which exist and stay in place. */
+static int batch_path_shareable(alpm_handle_t *handle, struct batch_path *entry,
+		struct batch_path *other)
+{
+	if(!entry->dir || !other->dir || entry->removable || other->removable) {
+		return 0;
+	}
+	if(entry->ondisk == -1) {
+		char path[PATH_MAX];
+		struct stat buf;
+
+		snprintf(path, PATH_MAX, "%s%.*s", handle->root, (int)entry->len,
+				entry->name);
+		entry->ondisk = lstat(path, &buf) == 0 && S_ISDIR(buf.st_mode);
+	}
+	return entry->ondisk;
+}
+
+/**
+ * @brief Adds a package to a group of packages extracted together.
+ *
+ * @param handle the context handle
+ * @param paths paths of the packages in the group
+ * @param newpkg package to add
+ *
+ * @return 1 if the package was added, 0 if it has to be extracted on its own
+ */
+static int batch_add(alpm_handle_t *handle, struct batch_paths *paths,
+		alpm_pkg_t *newpkg)
+{
+	alpm_filelist_t *newfiles = alpm_pkg_get_files(newpkg);
+	alpm_filelist_t *oldfiles = NULL;
+	struct batch_path *entries;
+	size_t count, i;
+
+	/* scriptlets may depend on the packages before */
+	if(alpm_pkg_has_scriptlet(newpkg)
+			&& !(handle->trans->flags & ALPM_TRANS_FLAG_NOSCRIPTLET)) {
+		return 0;
+	}
+
+	/* files of the old version get removed before the group is extracted */
+	if(_alpm_db_get_pkgfromcache(handle->db_local, newpkg->name) && newpkg->oldpkg) {
+		oldfiles = alpm_pkg_get_files(newpkg->oldpkg);
+	}
+
+	count = newfiles->count + (oldfiles ? oldfiles->count : 0);
+	CALLOC(entries, count + 1, sizeof(struct batch_path), return 0);
+	for(i = 0; i < newfiles->count; i++) {
+		batch_path_init(&entries[i], newfiles->files[i].name, 0);
+	}
+	for(i = 0; oldfiles && i < oldfiles->count; i++) {
+		const char *name = oldfiles->files[i].name;
+		batch_path_init(&entries[newfiles->count + i], name,
+				!alpm_filelist_contains(newfiles, name));
+	}
+
+	for(i = 0; i < count; i++) {
+		struct batch_path *other = batch_paths_find(paths, &entries[i]);
+		if(other && !batch_path_shareable(handle, other, &entries[i])) {
+			_alpm_log(handle, ALPM_LOG_DEBUG,
+					"not extracting %s along with the previous packages (%s)\n",
+					newpkg->name, entries[i].name);
+			free(entries);
+			return 0;
+		}
+	}
+
+	if(batch_paths_grow(paths, paths->count + count) != 0) {
+		free(entries);
+		return 0;
+	}
+	paths->chunks = alpm_list_add(paths->chunks, entries);
+
+	for(i = 0; i < count; i++) {
+		struct batch_path *entry = &entries[i];
+		struct batch_path *other = batch_paths_find(paths, entry);
+
+		if(other) {
+			/* merge with the entry of a previous package, or of the other
+			 * version of this one */
+			other->dir = other->dir && entry->dir;
+			other->removable = other->removable || entry->removable;
+			entry->len = (size_t)-1;
+		} else {
+			struct batch_path **bucket = &paths->buckets[entry->hash & paths->mask];
+			entry->next = *bucket;
+			*bucket = entry;
+			paths->count++;
+		}
+	}
+	return 1;
+}
+
+struct batch {
+	struct commit_target *targets;
+	size_t count;
+};
+
+static void batch_extract(void *ctx, size_t index)
+{
+	struct batch *batch = ctx;
+	struct commit_target *target = &batch->targets[index];
+	alpm_handle_t *handle = target->newpkg->handle;
+
+	/* package accessors reset the error of the package's handle */
+	target->newpkg->handle = target->worker;
+	if(target->oldpkg) {
+		target->oldpkg->handle = target->worker;
+	}
+	commit_extract(target->worker, target);
+	target->newpkg->handle = handle;
+	if(target->oldpkg) {
+		target->oldpkg->handle = handle;
+	}
+}
+
+/**
+ * @brief Commits a group of packages, extracting them on several threads.
+ *
+ * @details All packages are prepared in order on the calling thread, then
+ * extracted at the same time and finally announced and written to the
+ * database in order, with everything the workers logged passed on just
+ * before.
+ *
+ * @param handle the context handle
+ * @param pkgs the packages to commit
+ * @param count number of packages
+ * @param pkg_current transaction index of the first package
+ * @param pkg_count number of packages in the transaction
+ * @param committed set to the number of packages processed
+ *
+ * @return 0 on success, -1 if a package failed
+ */
+static int commit_batch(alpm_handle_t *handle, alpm_list_t *pkgs, size_t count,
+		size_t pkg_current, size_t pkg_count, size_t *committed)
+{
+	struct batch batch;
+	alpm_list_t *i;
+	size_t n;
+	int cwdfd, ret = 0;
+
+	*committed = 0;
+	CALLOC(batch.targets, count, sizeof(struct commit_target), return 0);
+	batch.count = 0;
+
+	for(n = 0, i = pkgs; n < count; n++, i = i->next) {
+		struct commit_target *target = &batch.targets[n];
+
+		target->newpkg = i->data;
+		target->pkg_current = pkg_current + n;
+		target->pkg_count = pkg_count;
+		if((target->worker = _alpm_worker_handle_new(handle)) == NULL) {
+			/* leave the rest to a later group */
+			break;
+		}
+		batch.count++;
+		if(commit_prepare(handle, target, 0) != 0) {
+			ret = -1;
+			break;
+		}
+	}
+	*committed = batch.count;
+
+	/* the last package was not prepared */
+	if(ret != 0) {
+		struct commit_target *target = &batch.targets[--batch.count];
+		commit_close_archive(handle, target);
+		_alpm_worker_handle_free(handle, target->worker);
+	}
+
+	if(batch.count > 0 && enter_root(handle, &cwdfd) != 0) {
+		for(n = 0; n < batch.count; n++) {
+			commit_close_archive(handle, &batch.targets[n]);
+			_alpm_worker_handle_free(handle, batch.targets[n].worker);
+		}
+		batch.count = 0;
+		ret = -1;
+	}
+
+	if(batch.count > 0) {
+		_alpm_log(handle, ALPM_LOG_DEBUG, "extracting %zu packages on %u threads\n",
+				batch.count, handle->extract_threads);
+		_alpm_workers_run(handle, handle->extract_threads, batch.count,
+				batch_extract, NULL, &batch);
+		leave_root(handle, cwdfd);
+
+		for(n = 0; n < batch.count; n++) {
+			struct commit_target *target = &batch.targets[n];
+
+			EVENT(handle, &target->event);
+			PROGRESS(handle, target->progress, target->newpkg->name, 0,
+					target->pkg_count, target->pkg_current);
+			_alpm_worker_handle_free(handle, target->worker);
+			if(target->archive && enter_root(handle, &cwdfd) == 0) {
+				commit_extract(handle, target);
+				leave_root(handle, cwdfd);
+			}
+			if(target->archive) {
+				/* the root directory could not be entered */
+				commit_close_archive(handle, target);
+				target->errors++;
+			}
+			if(commit_finish(handle, target) != 0) {
+				ret = -1;
+			}
+		}
+	}
+
+	free(batch.targets);
+	return ret;
+}
+
+/* Count the packages from pkgs on that can be extracted together. */
+static size_t plan_batch(alpm_handle_t *handle, alpm_list_t *pkgs)
+{
+	struct batch_paths paths = { 0 };
+	/* keep groups small enough for progress to move on and for an
+	 * interruption to leave few packages in between */
+	size_t max = handle->extract_threads * 4;
+	size_t count = 0;
+	alpm_list_t *i;
+
+	for(i = pkgs; i && count < max; i = i->next) {
+		if(!batch_add(handle, &paths, i->data)) {
+			break;
+		}
+		count++;
+	}
+	batch_paths_free(&paths);
+	return count;
+}
+
 int _alpm_upgrade_packages(alpm_handle_t *handle)
 {
 	size_t pkg_count, pkg_current;
@@ -666,15 +1165,32 @@ int _alpm_upgrade_packages(alpm_handle_t *handle)
 	pkg_count = alpm_list_count(trans->add);
 	pkg_current = 1;
 
-	/* loop through our package list adding/upgrading one at a time */
-	for(targ = trans->add; targ; targ = targ->next) {
+	/* loop through our package list adding/upgrading one at a time, or
+	 * several at once where they are independent */
+	for(targ = trans->add; targ; ) {
 		alpm_pkg_t *newpkg = targ->data;
+		size_t count = 0, committed = 1;
+		int err;
 
 		if(handle->trans->state == STATE_INTERRUPTED) {
 			return ret;
 		}
 
-		if(commit_single_pkg(handle, newpkg, pkg_current, pkg_count)) {
+		if(handle->extract_threads > 1) {
+			count = plan_batch(handle, targ);
+		}
+		if(count > 1) {
+			err = commit_batch(handle, targ, count, pkg_current, pkg_count,
+					&committed);
+			if(committed == 0) {
+				err = commit_single_pkg(handle, newpkg, pkg_current, pkg_count);
+				committed = 1;
+			}
+		} else {
+			err = commit_single_pkg(handle, newpkg, pkg_current, pkg_count);
+		}
+
+		if(err) {
 			/* something screwed up on the commit, abort the trans */
 			trans->state = STATE_INTERRUPTED;
 			handle->pm_errno = ALPM_ERR_TRANS_ABORT;
@@ -683,7 +1199,10 @@ int _alpm_upgrade_packages(alpm_handle_t *handle)
 			ret = -1;
 		}
 
-		pkg_current++;
+		for(; committed > 0 && targ; committed--) {
+			targ = targ->next;
+			pkg_current++;
+		}
 	}
 
 	if(!skip_ldconfig) {
@@ -77,6 +77,8 @@ alpm_handle_t SYMEXPORT *alpm_initialize(const char *root, const char *dbpath,
 #endif
 
 	myhandle->parallel_downloads = 1;
+	myhandle->verify_threads = 1;
+	myhandle->extract_threads = 1;
 
 #ifdef ENABLE_NLS
 	bindtextdomain("libalpm", LOCALEDIR);
@@ -149,6 +149,14 @@ typedef struct _alpm_filelist_t {
        alpm_file_t *files;
 } alpm_filelist_t;
 
+/** A file of a package database, as found by a file search */
+typedef struct _alpm_fileowner_t {
+       /** Path of the file, relative to the root */
+       const char *path;
+       /** The package owning the file */
+       alpm_pkg_t *pkg;
+} alpm_fileowner_t;
+
 /** Local package or package file backup entry */
 typedef struct _alpm_backup_t {
        /** Name of the file (without .pacsave extension) */
@@ -1446,6 +1454,70 @@ alpm_list_t *alpm_db_get_groupcache(alpm_db_t *db);
 int alpm_db_search(alpm_db_t *db, const alpm_list_t *needles,
 		alpm_list_t **ret);
 
+/** Find the packages of a database owning a file.
+ * Directories are matched with a trailing slash. The lookup uses an index
+ * of all file lists of the database which is built on first use.
+ * @param db pointer to the package database to search in
+ * @param path path of the file, relative to the root
+ * @return a list of packages owning the file, sorted by name.
+ * The list must be freed by the caller, the packages must not be.
+ */
+alpm_list_t *alpm_db_find_file_owners(alpm_db_t *db, const char *path);
+
+/** File search flags */
+typedef enum _alpm_filesearch_t {
+       /** Match the whole path rather than the last path component only.
+        * Directories can only be found by path. */
+       ALPM_FILESEARCH_PATH = 1,
+       /** The needle is an extended regular expression, matched without
+        * regard to case */
+       ALPM_FILESEARCH_REGEX = (1 << 1)
+} alpm_filesearch_t;
+
+/** Search the file lists of a database.
+ * The search uses an index of the file lists, which is read from the cache
+ * written when the database is updated whenever possible, so the file lists
+ * of the packages do not need to be loaded.
+ * @param db pointer to the package database to search in
+ * @param needle the file name, path or regular expression to look for
+ * @param flags a bitfield of alpm_filesearch_t
+ * @param ret pointer to list for storing the matched files, sorted by
+ * package name and then path. It must point to an empty (NULL) alpm_list_t *.
+ * The list and its entries must be freed by the caller; the entries stay
+ * valid until the package cache of the database is changed.
+ * @return 0 on success, -1 on error (pm_errno is set accordingly)
+ */
+int alpm_db_find_files(alpm_db_t *db, const char *needle, int flags,
+		alpm_list_t **ret);
+
+/** The packages depending on a package of a database */
+typedef struct _alpm_pkg_revdeps_t {
+	/** The package */
+	alpm_pkg_t *pkg;
+	/** Names of the packages requiring pkg */
+	alpm_list_t *requiredby;
+	/** Names of the packages optionally requiring pkg */
+	alpm_list_t *optionalfor;
+} alpm_pkg_revdeps_t;
+
+/** Compute the reverse dependencies of all packages of a database at once.
+ * The results are the same as those of alpm_pkg_compute_requiredby() and
+ * alpm_pkg_compute_optionalfor() for each package. The dependency lists of
+ * the searched databases are indexed once up front, so this is much cheaper
+ * than walking them for every package.
+ * @param db pointer to the package database
+ * @param ret pointer to list for storing an alpm_pkg_revdeps_t for each
+ * package, in package cache order. It must point to an empty (NULL)
+ * alpm_list_t *. The entries must be freed with alpm_pkg_revdeps_free().
+ * @return 0 on success, -1 on error (pm_errno is set accordingly)
+ */
+int alpm_db_compute_revdeps(alpm_db_t *db, alpm_list_t **ret);
+
+/** Free the reverse dependencies of a package and their members.
+ * @param revdeps the reverse dependencies to free
+ */
+void alpm_pkg_revdeps_free(alpm_pkg_revdeps_t *revdeps);
+
 /** The usage level of a database. */
 typedef enum _alpm_db_usage_t {
        /** Enable refreshes for this database */
@@ -1558,6 +1630,20 @@ void *alpm_option_get_logcb_ctx(alpm_handle_t *handle);
  */
 int alpm_option_set_logcb(alpm_handle_t *handle, alpm_cb_log cb, void *ctx);
 
+/** Returns the levels passed to the log callback.
+ * @param handle the context handle
+ * @return a bitfield of alpm_loglevel_t levels
+ */
+int alpm_option_get_logmask(alpm_handle_t *handle);
+
+/** Sets the levels passed to the log callback. Messages of other levels
+ * are dropped before they are formatted; by default all levels are passed.
+ * @param handle the context handle
+ * @param mask a bitfield of alpm_loglevel_t levels
+ * @return 0 on success, -1 on error (pm_errno is set accordingly)
+ */
+int alpm_option_set_logmask(alpm_handle_t *handle, int mask);
+
 /** Returns the callback used to report download progress.
  * @param handle the context handle
  * @return the currently set download callback
@@ -1871,6 +1957,32 @@ int alpm_option_set_gpgdir(alpm_handle_t *handle, const char *gpgdir);
 /** @} */
 
 
+/** @name Accessors to the keyring snapshot
+ *
+ * When a keyring snapshot is set, signatures are checked in-process against
+ * the keys it contains instead of through GnuPG. The snapshot is a binary
+ * keyring as written by 'gpg --export'; every key in it is trusted. Only RSA
+ * and Ed25519 signatures are supported and keys can not be imported.
+ * @{
+ */
+
+/** Returns the path to the keyring snapshot.
+ * @param handle the context handle
+ * @return the path to the keyring snapshot, NULL if GnuPG is used
+ */
+const char *alpm_option_get_keyring_snapshot(alpm_handle_t *handle);
+
+/** Sets the path to the keyring snapshot.
+ * @param handle the context handle
+ * @param keyring_snapshot the path to the snapshot, NULL to use GnuPG
+ * @return 0 on success, -1 on error (pm_errno is set accordingly)
+ */
+int alpm_option_set_keyring_snapshot(alpm_handle_t *handle,
+		const char *keyring_snapshot);
+/* End of keyring snapshot accessors */
+/** @} */
+
+
 /** @name Accessors for use sandboxuser
  *
  *  This controls the user that libalpm will use for sensitive operations like
@@ -2301,6 +2413,88 @@ int alpm_option_set_parallel_downloads(alpm_handle_t *handle, unsigned int num_s
 /* End of parallel_downloads accessors */
 /** @} */
 
+/** @name Accessors for the number of package verification threads
+ *
+ * This setting configures how many packages have their checksums and
+ * signatures verified, and their metadata loaded, in parallel before a
+ * transaction is committed.
+ *
+ * By default this value is set to 1, meaning packages are processed
+ * sequentially.
+ *
+ * @{
+ */
+
+/** Gets the number of threads used to verify packages.
+ * @param handle the context handle
+ * @return the number of threads used to verify packages
+ */
+int alpm_option_get_verify_threads(alpm_handle_t *handle);
+
+/** Sets the number of threads used to verify packages.
+ * @param handle the context handle
+ * @param num_threads number of verification threads
+ * @return 0 on success, -1 on error
+ */
+int alpm_option_set_verify_threads(alpm_handle_t *handle, unsigned int num_threads);
+/* End of verify_threads accessors */
+/** @} */
+
+/** @name Accessors for pipelined downloads
+ *
+ * When enabled, packages are verified and loaded as soon as they finish
+ * downloading, while the remaining downloads are still running. Nothing is
+ * installed before every package of the transaction has passed.
+ *
+ * Packages downloaded by a sandboxed process are only verified once all
+ * downloads are complete.
+ * @{
+ */
+
+/** Returns whether packages are verified while downloading.
+ * @param handle the context handle
+ * @return 0 for disabled, 1 for enabled
+ */
+int alpm_option_get_pipeline_downloads(alpm_handle_t *handle);
+
+/** Enables/disables verifying packages while downloading.
+ * @param handle the context handle
+ * @param pipeline_downloads 0 for disabled, 1 for enabled
+ * @return 0 on success, -1 on error (pm_errno is set accordingly)
+ */
+int alpm_option_set_pipeline_downloads(alpm_handle_t *handle, int pipeline_downloads);
+/* End of pipeline_downloads accessors */
+/** @} */
+
+/** @name Accessors for the number of package extraction threads
+ *
+ * This setting configures how many packages are extracted in parallel when
+ * a transaction is committed. Only consecutive packages without install
+ * scriptlets whose files do not overlap are extracted together. Database
+ * entries are still written in transaction order, and the start events of
+ * such a group of packages are raised before the done events.
+ *
+ * By default this value is set to 1, meaning packages are extracted
+ * sequentially.
+ *
+ * @{
+ */
+
+/** Gets the number of threads used to extract packages.
+ * @param handle the context handle
+ * @return the number of threads used to extract packages
+ */
+int alpm_option_get_extract_threads(alpm_handle_t *handle);
+
+/** Sets the number of threads used to extract packages.
+ * @param handle the context handle
+ * @param num_threads number of extraction threads
+ * @return 0 on success, -1 on error
+ */
+int alpm_option_set_extract_threads(alpm_handle_t *handle, unsigned int num_threads);
+/* End of extract_threads accessors */
+/** @} */
+
 /** @name Accessors for sandbox
  *
  * By default, libalpm will sandbox the downloader process.
@@ -530,6 +530,117 @@ version_error:
 	return -1;
 }
 
+/* Note: the return value must be freed by the caller */
+static char *local_db_index_path(alpm_db_t *db)
+{
+	const char *dbpath = _alpm_db_path(db);
+	size_t len;
+	char *path;
+
+	if(dbpath == NULL) {
+		return NULL;
+	}
+	/* the index lives next to the database directory rather than inside it,
+	 * so that writing it does not change the directory it is stamped with */
+	len = strlen(dbpath);
+	MALLOC(path, len + 7, RET_ERR(db->handle, ALPM_ERR_MEMORY, NULL));
+	snprintf(path, len + 7, "%.*s.cache", (int)(len - 1), dbpath);
+	return path;
+}
+
+/* The index is stamped with the database directory, which changes whenever a
+ * package entry is added or removed. In-place changes of an entry invalidate
+ * the index explicitly through local_db_invalidate_index(). */
+static alpm_dbcache_t *local_db_open_index(alpm_db_t *db)
+{
+	alpm_dbcache_stamp_t stamp;
+	alpm_dbcache_t *index;
+	char *path;
+
+	if(_alpm_dbcache_stamp_file(_alpm_db_path(db), &stamp, 0) != 0) {
+		return NULL;
+	}
+	if((path = local_db_index_path(db)) == NULL) {
+		return NULL;
+	}
+	index = _alpm_dbcache_open(db->handle, path, &stamp, NULL, DBCACHE_FIELDS_ALL);
+	free(path);
+	return index;
+}
+
+static void local_db_invalidate_index(alpm_db_t *db)
+{
+	char *path;
+
+	if(db->status & DB_STATUS_INDEX_DIRTY) {
+		return;
+	}
+	db->status |= DB_STATUS_INDEX_DIRTY;
+	if((path = local_db_index_path(db)) == NULL) {
+		return;
+	}
+	if(unlink(path) != 0 && errno != ENOENT) {
+		_alpm_log(db->handle, ALPM_LOG_WARNING, _("could not remove %s: %s\n"),
+				path, strerror(errno));
+	}
+	free(path);
+}
+
+static int local_db_populate_index(alpm_db_t *db)
+{
+	alpm_dbcache_t *index;
+	uint64_t n;
+
+	if((index = local_db_open_index(db)) == NULL) {
+		return -1;
+	}
+
+	db->pkgcache = _alpm_pkghash_create(index->header->pkg_count);
+	if(db->pkgcache == NULL) {
+		_alpm_dbcache_close(index);
+		return -1;
+	}
+	db->dbcache = index;
+
+	/* records are sorted by name, so the cache list needs no sorting */
+	for(n = 0; n < index->header->pkg_count; n++) {
+		alpm_pkg_t *pkg = _alpm_pkg_new();
+		if(pkg == NULL) {
+			goto error;
+		}
+		pkg->origin = ALPM_PKG_FROM_LOCALDB;
+		pkg->origin_data.db = db;
+		pkg->ops = &local_pkg_ops;
+		pkg->handle = db->handle;
+
+		/* only name and version, accessors will handle the rest */
+		if(_alpm_dbcache_read_pkg(index, index->pkgs + n, pkg, 0) != 0) {
+			_alpm_pkg_free(pkg);
+			goto error;
+		}
+
+		/* treat local metadata errors as warning-only,
+		 * they are already installed and otherwise they can't be operated on */
+		_alpm_pkg_check_meta(pkg);
+
+		if(_alpm_pkghash_add(&db->pkgcache, pkg) == NULL) {
+			_alpm_pkg_free(pkg);
+			goto error;
+		}
+	}
+
+	_alpm_log(db->handle, ALPM_LOG_DEBUG, "added %ju packages to package cache for db '%s'\n",
+			(uintmax_t)index->header->pkg_count, db->treename);
+	return 0;
+
+error:
+	_alpm_log(db->handle, ALPM_LOG_DEBUG, "could not load index of db '%s'\n",
+			db->treename);
+	/* also closes the index */
+	_alpm_db_free_pkgcache(db);
+	return -1;
+}
+
 static int local_db_populate(alpm_db_t *db)
 {
 	size_t est_count;
@@ -552,6 +663,12 @@ static int local_db_populate(alpm_db_t *db)
 		return -1;
 	}
 
+	if(!(db->status & DB_STATUS_INDEX_DIRTY) && local_db_populate_index(db) == 0) {
+		db->status |= DB_STATUS_EXISTS;
+		db->status &= ~DB_STATUS_MISSING;
+		return 0;
+	}
+
 	dbdir = opendir(dbpath);
 	if(dbdir == NULL) {
 		RET_ERR(db->handle, ALPM_ERR_DB_OPEN, -1);
@@ -710,6 +827,46 @@ char *_alpm_local_db_pkgpath(alpm_db_t *db, alpm_pkg_t *info,
 	f = alpm_list_add(f, alpm_dep_from_string(line)); \
 } while(1) /* note the while(1) and not (0) */
 
+/* Load package data from the local database index.
+ * Returns 1 if the index has no record of this package. */
+static int local_db_read_index(alpm_pkg_t *info, int inforeq)
+{
+	alpm_db_t *db = info->origin_data.db;
+	const alpm_dbcache_pkg_t *rec;
+	const char *version;
+	int fields = 0;
+
+	rec = _alpm_dbcache_find(db->dbcache, info->name);
+	if(rec == NULL || (version = _alpm_dbcache_str(db->dbcache, rec->version)) == NULL
+			|| strcmp(version, info->version) != 0) {
+		return 1;
+	}
+
+	if(inforeq & INFRQ_DESC && !(info->infolevel & INFRQ_DESC)) {
+		fields |= DBCACHE_FIELDS_META | DBCACHE_FIELDS_DESC;
+	}
+	if(inforeq & INFRQ_FILES && !(info->infolevel & INFRQ_FILES)) {
+		fields |= DBCACHE_FIELDS_FILES;
+	}
+	if(_alpm_dbcache_read_pkg(db->dbcache, rec, info, fields) != 0) {
+		_alpm_log(db->handle, ALPM_LOG_ERROR,
+				_("could not read %s from the local database index\n"), info->name);
+		info->infolevel |= INFRQ_ERROR;
+		return -1;
+	}
+	if(fields & DBCACHE_FIELDS_DESC) {
+		info->infolevel |= INFRQ_DESC;
+	}
+	if(fields & DBCACHE_FIELDS_FILES) {
+		info->infolevel |= INFRQ_FILES;
+	}
+	if(inforeq & INFRQ_SCRIPTLET && !(info->infolevel & INFRQ_SCRIPTLET)) {
+		info->scriptlet = rec->scriptlet;
+		info->infolevel |= INFRQ_SCRIPTLET;
+	}
+	return 0;
+}
+
 static int local_db_read(alpm_pkg_t *info, int inforeq)
 {
 	FILE *fp = NULL;
@@ -736,6 +893,14 @@ static int local_db_read(alpm_pkg_t *info, int inforeq)
 			"loading package data for %s : level=0x%x\n",
 			info->name, inforeq);
 
+	if(db->dbcache) {
+		int ret = local_db_read_index(info, inforeq);
+		if(ret <= 0) {
+			return ret;
+		}
+		/* not in the index, read the database entry */
+	}
+
 	/* DESC */
 	if(inforeq & INFRQ_DESC && !(info->infolevel & INFRQ_DESC)) {
 		char *path = _alpm_local_db_pkgpath(db, info, "desc");
@@ -939,6 +1104,7 @@ int _alpm_local_db_prepare(alpm_db_t *db, alpm_pkg_t *info)
 	if(checkdbdir(db) != 0) {
 		return -1;
 	}
+	local_db_invalidate_index(db);
 
 	oldmask = umask(0000);
 	pkgpath = _alpm_local_db_pkgpath(db, info, NULL);
@@ -982,6 +1148,8 @@ int _alpm_local_db_write(alpm_db_t *db, alpm_pkg_t *info, int inforeq)
 		return -1;
 	}
 
+	local_db_invalidate_index(db);
+
 	/* make sure we have a sane umask */
 	oldmask = umask(0022);
 
@@ -1144,6 +1312,8 @@ int _alpm_local_db_remove(alpm_db_t *db, alpm_pkg_t *info)
 	char *pkgpath;
 	size_t pkgpath_len;
 
+	local_db_invalidate_index(db);
+
 	pkgpath = _alpm_local_db_pkgpath(db, info, NULL);
 	if(!pkgpath) {
 		return -1;
@@ -1181,6 +1351,64 @@ int _alpm_local_db_remove(alpm_db_t *db, alpm_pkg_t *info)
 	return ret;
 }
 
+/** Rewrite the local database index if the database was modified or the
+ * index could not be used. Must only be called with the database locked.
+ * @param db the local database
+ * @return 0 on success, -1 if the index could not be written
+ */
+int _alpm_local_db_write_index(alpm_db_t *db)
+{
+	const int inforeq = INFRQ_DESC | INFRQ_FILES | INFRQ_SCRIPTLET;
+	alpm_dbcache_stamp_t stamp;
+	alpm_dbcache_writer_t *writer;
+	alpm_list_t *i;
+	char *path;
+	int ret = -1;
+
+	if(db == NULL || !(db->status & DB_STATUS_PKGCACHE)) {
+		return 0;
+	}
+	if(db->dbcache && !(db->status & DB_STATUS_INDEX_DIRTY)) {
+		/* the index in use is still current */
+		return 0;
+	}
+
+	_alpm_log(db->handle, ALPM_LOG_DEBUG, "writing index of db '%s'\n", db->treename);
+	if(_alpm_dbcache_stamp_file(_alpm_db_path(db), &stamp, 0) != 0
+			|| (path = local_db_index_path(db)) == NULL) {
+		return -1;
+	}
+	if((writer = _alpm_dbcache_writer_new(DBCACHE_FIELDS_ALL)) == NULL) {
+		free(path);
+		return -1;
+	}
+
+	for(i = db->pkgcache->list; i; i = i->next) {
+		alpm_pkg_t *pkg = i->data;
+		if((pkg->infolevel & inforeq) != inforeq) {
+			pkg->ops->force_load(pkg);
+		}
+		if((pkg->infolevel & inforeq) != inforeq || pkg->infolevel & INFRQ_ERROR
+				|| _alpm_dbcache_writer_add(writer, pkg) != 0) {
+			_alpm_log(db->handle, ALPM_LOG_DEBUG,
+					"could not add %s to index of db '%s'\n", pkg->name, db->treename);
+			goto cleanup;
+		}
+	}
+	if(_alpm_dbcache_writer_commit(writer, db->handle, path, &stamp) == 0) {
+		/* the package cache now mirrors the new index rather than the one it
+		 * was populated from */
+		_alpm_db_set_dbcache(db, local_db_open_index(db));
+		db->status &= ~DB_STATUS_INDEX_DIRTY;
+		ret = 0;
+	}
+
+cleanup:
+	_alpm_dbcache_writer_free(writer);
+	free(path);
+	return ret;
+}
+
 int SYMEXPORT alpm_pkg_set_reason(alpm_pkg_t *pkg, alpm_pkgreason_t reason)
 {
 	ASSERT(pkg != NULL, return -1);
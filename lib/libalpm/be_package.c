@@ -25,6 +25,7 @@
 #include <sys/stat.h>
 #include <fcntl.h>
 #include <limits.h>
+#include <pthread.h>
 
 /* libarchive */
 #include <archive.h>
@@ -45,6 +46,10 @@
 struct package_changelog {
 	struct archive *archive;
 	int fd;
+	/* when served from the package session instead of the archive */
+	const char *data;
+	size_t len;
+	size_t pos;
 };
 
 /**
@@ -64,6 +69,19 @@ static void *_package_changelog_open(alpm_pkg_t *pkg)
 	struct stat buf;
 	int fd;
 
+	if(pkg->session) {
+		if(!pkg->session->changelog) {
+			errno = ENOENT;
+			return NULL;
+		}
+		CALLOC(changelog, 1, sizeof(struct package_changelog),
+				pkg->handle->pm_errno = ALPM_ERR_MEMORY; return NULL);
+		changelog->fd = -1;
+		changelog->data = pkg->session->changelog;
+		changelog->len = pkg->session->changelog_len;
+		return changelog;
+	}
+
 	fd = _alpm_open_archive(pkg->handle, pkgfile, &buf,
 			&archive, ALPM_ERR_PKG_OPEN);
 	if(fd < 0) {
@@ -74,7 +92,7 @@ static void *_package_changelog_open(alpm_pkg_t *pkg)
 		const char *entry_name = archive_entry_pathname(entry);
 
 		if(strcmp(entry_name, ".CHANGELOG") == 0) {
-			changelog = malloc(sizeof(struct package_changelog));
+			changelog = calloc(1, sizeof(struct package_changelog));
 			if(!changelog) {
 				pkg->handle->pm_errno = ALPM_ERR_MEMORY;
 				_alpm_archive_read_free(archive);
@@ -107,7 +125,18 @@ static size_t _package_changelog_read(void *ptr, size_t size,
 		const alpm_pkg_t UNUSED *pkg, void *fp)
 {
 	struct package_changelog *changelog = fp;
-	ssize_t sret = archive_read_data(changelog->archive, ptr, size);
+	ssize_t sret;
+
+	if(changelog->data) {
+		if(size > changelog->len - changelog->pos) {
+			size = changelog->len - changelog->pos;
+		}
+		memcpy(ptr, changelog->data + changelog->pos, size);
+		changelog->pos += size;
+		return size;
+	}
+
+	sret = archive_read_data(changelog->archive, ptr, size);
 	/* Report error (negative values) */
 	if(sret < 0) {
 		RET_ERR(pkg->handle, ALPM_ERR_LIBARCHIVE, 0);
@@ -125,29 +154,35 @@ static size_t _package_changelog_read(void *ptr, size_t size,
  */
 static int _package_changelog_close(const alpm_pkg_t UNUSED *pkg, void *fp)
 {
-	int ret;
+	int ret = 0;
 	struct package_changelog *changelog = fp;
-	ret = _alpm_archive_read_free(changelog->archive);
-	close(changelog->fd);
+	if(changelog->archive) {
+		ret = _alpm_archive_read_free(changelog->archive);
+		close(changelog->fd);
+	}
 	free(changelog);
 	return ret;
 }
 
+static struct pkg_operations file_pkg_ops;
+static pthread_once_t file_pkg_ops_once = PTHREAD_ONCE_INIT;
+
+static void init_file_pkg_ops(void)
+{
+	file_pkg_ops = default_pkg_ops;
+	file_pkg_ops.changelog_open  = _package_changelog_open;
+	file_pkg_ops.changelog_read  = _package_changelog_read;
+	file_pkg_ops.changelog_close = _package_changelog_close;
+}
+
 /** Package file operations struct accessor. We implement this as a method
  * because we want to reuse the majority of the default_pkg_ops struct and
- * add only a few operations of our own on top.
+ * add only a few operations of our own on top. Packages are loaded on
+ * worker threads, so the struct is filled in exactly once.
  */
 static const struct pkg_operations *get_file_pkg_ops(void)
 {
-	static struct pkg_operations file_pkg_ops;
-	static int file_pkg_ops_initialized = 0;
-	if(!file_pkg_ops_initialized) {
-		file_pkg_ops = default_pkg_ops;
-		file_pkg_ops.changelog_open  = _package_changelog_open;
-		file_pkg_ops.changelog_read  = _package_changelog_read;
-		file_pkg_ops.changelog_close = _package_changelog_close;
-		file_pkg_ops_initialized = 1;
-	}
+	pthread_once(&file_pkg_ops_once, init_file_pkg_ops);
 	return &file_pkg_ops;
 }
 
@@ -326,7 +361,12 @@ int _alpm_pkg_validate_internal(alpm_handle_t *handle,
 			}
 		}
 
-		if(syncpkg->sha256sum) {
+		if(syncpkg->sha256sum && syncpkg->download_verified) {
+			_alpm_log(handle, ALPM_LOG_DEBUG, "sha256sum for %s verified during download\n", pkgfile);
+			if(validation) {
+				*validation |= ALPM_PKG_VALIDATION_SHA256SUM;
+			}
+		} else if(syncpkg->sha256sum) {
 			_alpm_log(handle, ALPM_LOG_DEBUG, "sha256sum: %s\n", syncpkg->sha256sum);
 			_alpm_log(handle, ALPM_LOG_DEBUG, "checking sha256sum for %s\n", pkgfile);
 			if(_alpm_test_checksum(pkgfile, syncpkg->sha256sum, ALPM_PKG_VALIDATION_SHA256SUM) != 0) {
@@ -432,6 +472,51 @@ static int add_entry_to_files_list(alpm_filelist_t *filelist,
 	return 0;
 }
 
+/**
+ * Read the data of the current archive entry into memory.
+ * @param handle the context handle
+ * @param archive archive positioned at the entry
+ * @param pkgfile the package file, used for messages
+ * @param data where to store the data, NUL terminated for convenience
+ * @param len where to store the length of the data
+ * @return 0 on success, -1 on error
+ */
+static int read_entry_data(alpm_handle_t *handle, struct archive *archive,
+		const char *pkgfile, char **data, size_t *len)
+{
+	size_t maxsize = 0;
+	size_t cursize = 0;
+	char *buf = NULL;
+
+	while(1) {
+		ssize_t size;
+
+		if(!_alpm_greedy_grow((void **)&buf, &maxsize, cursize + ALPM_BUFFER_SIZE + 1)) {
+			free(buf);
+			RET_ERR(handle, ALPM_ERR_MEMORY, -1);
+		}
+
+		size = archive_read_data(archive, buf + cursize, ALPM_BUFFER_SIZE);
+
+		if(size < 0) {
+			_alpm_log(handle, ALPM_LOG_DEBUG, _("error while reading package %s: %s\n"),
+					pkgfile, archive_error_string(archive));
+			free(buf);
+			RET_ERR(handle, ALPM_ERR_LIBARCHIVE, -1);
+		}
+		if(size == 0) {
+			break;
+		}
+
+		cursize += size;
+	}
+
+	buf[cursize] = '\0';
+	*data = buf;
+	*len = cursize;
+	return 0;
+}
+
 /**
  * Generate a new file list from an mtree file and add it to the package.
  * An existing file list will be free()d first.
@@ -448,8 +533,7 @@ static int build_filelist_from_mtree(alpm_handle_t *handle, alpm_pkg_t *pkg, str
 {
 	int ret = 0;
 	size_t i;
-	size_t mtree_maxsize = 0;
-	size_t mtree_cursize = 0;
+	size_t mtree_size = 0;
 	size_t files_size = 0; /* we clean up the existing array so this is fine */
 	char *mtree_data = NULL;
 	struct archive *mtree;
@@ -468,29 +552,11 @@ static int build_filelist_from_mtree(alpm_handle_t *handle, alpm_pkg_t *pkg, str
 	_alpm_archive_read_support_filter_all(mtree);
 	archive_read_support_format_mtree(mtree);
 
-	/* TODO: split this into a function */
-	while(1) {
-		ssize_t size;
-
-		if(!_alpm_greedy_grow((void **)&mtree_data, &mtree_maxsize, mtree_cursize + ALPM_BUFFER_SIZE)) {
-			goto error;
-		}
-
-		size = archive_read_data(archive, mtree_data + mtree_cursize, ALPM_BUFFER_SIZE);
-
-		if(size < 0) {
-			_alpm_log(handle, ALPM_LOG_DEBUG, _("error while reading package %s: %s\n"),
-					pkg->filename, archive_error_string(archive));
-			GOTO_ERR(handle, ALPM_ERR_LIBARCHIVE, error);
-		}
-		if(size == 0) {
-			break;
-		}
-
-		mtree_cursize += size;
+	if(read_entry_data(handle, archive, pkg->filename, &mtree_data, &mtree_size) != 0) {
+		goto error;
 	}
 
-	if(archive_read_open_memory(mtree, mtree_data, mtree_cursize)) {
+	if(archive_read_open_memory(mtree, mtree_data, mtree_size)) {
 		_alpm_log(handle, ALPM_LOG_DEBUG,
 				_("error while reading mtree of package %s: %s\n"),
 				pkg->filename, archive_error_string(mtree));
@@ -545,6 +611,50 @@ error:
 	return -1;
 }
 
+void _alpm_pkgsession_free(alpm_pkgsession_t *session)
+{
+	if(session == NULL) {
+		return;
+	}
+	free(session->install);
+	free(session->changelog);
+	free(session);
+}
+
+/**
+ * Write the install scriptlet of a package file to prefix/.INSTALL. The
+ * archive is only read again if the scriptlet was not kept while loading.
+ * @param pkg the package file
+ * @param prefix directory to write the scriptlet to
+ * @return 0 on success, 1 on failure
+ */
+int _alpm_pkg_extract_scriptlet(alpm_pkg_t *pkg, const char *prefix)
+{
+	alpm_handle_t *handle = pkg->handle;
+	alpm_pkgsession_t *session = pkg->session;
+	char path[PATH_MAX];
+	size_t written;
+	FILE *fp;
+
+	if(!session || !session->install) {
+		return _alpm_unpack_single(handle, pkg->origin_data.file, prefix, ".INSTALL");
+	}
+
+	snprintf(path, PATH_MAX, "%s/.INSTALL", prefix);
+	if((fp = fopen(path, "wb")) == NULL) {
+		_alpm_log(handle, ALPM_LOG_ERROR, _("could not open file %s: %s\n"),
+				path, strerror(errno));
+		return 1;
+	}
+	written = fwrite(session->install, 1, session->install_len, fp);
+	if(fclose(fp) != 0 || written != session->install_len) {
+		_alpm_log(handle, ALPM_LOG_ERROR, _("could not write to file %s: %s\n"),
+				path, strerror(errno));
+		return 1;
+	}
+	return 0;
+}
+
 /**
  * Load a package and create the corresponding alpm_pkg_t struct.
  * @param handle the context handle
@@ -561,6 +671,7 @@ alpm_pkg_t *_alpm_pkg_load_internal(alpm_handle_t *handle,
 	struct archive *archive;
 	struct archive_entry *entry;
 	alpm_pkg_t *newpkg;
+	alpm_pkgsession_t *session;
 	struct stat st;
 	size_t files_size = 0;
 
@@ -585,16 +696,25 @@ alpm_pkg_t *_alpm_pkg_load_internal(alpm_handle_t *handle,
 		GOTO_ERR(handle, ALPM_ERR_MEMORY, error);
 	}
 	STRDUP(newpkg->filename, pkgfile, GOTO_ERR(handle, ALPM_ERR_MEMORY, error));
+	CALLOC(session, 1, sizeof(alpm_pkgsession_t), GOTO_ERR(handle, ALPM_ERR_MEMORY, error));
+	newpkg->session = session;
 	newpkg->size = st.st_size;
 
 	_alpm_log(handle, ALPM_LOG_DEBUG, "starting package load for %s\n", pkgfile);
 
 	/* If full is false, only read through the archive until we find our needed
 	 * metadata. If it is true, read through the entire archive, which serves
-	 * as a verification of integrity and allows us to create the filelist. */
+	 * as a verification of integrity and allows us to create the filelist.
+	 * The metadata entries are stored ahead of the package files, so once
+	 * the first file is reached the session holds all of them. */
 	while((ret = archive_read_next_header(archive, &entry)) == ARCHIVE_OK) {
 		const char *entry_name = archive_entry_pathname(entry);
 
+		/* if we are not doing a full read, see if we have all we need */
+		if(*entry_name != '.' && (!full || hit_mtree) && config) {
+			break;
+		}
+
 		if(strcmp(entry_name, ".PKGINFO") == 0) {
 			/* parse the info file */
 			if(parse_descfile(handle, archive, newpkg) != 0) {
@@ -622,6 +742,19 @@ alpm_pkg_t *_alpm_pkg_load_internal(alpm_handle_t *handle,
 			 * the whole archive  */
 			hit_mtree = build_filelist_from_mtree(handle, newpkg, archive) == 0;
 			continue;
+		} else if(strcmp(entry_name, ".INSTALL") == 0) {
+			newpkg->scriptlet = 1;
+			if(read_entry_data(handle, archive, pkgfile,
+						&session->install, &session->install_len) != 0) {
+				goto error;
+			}
+			continue;
+		} else if(strcmp(entry_name, ".CHANGELOG") == 0) {
+			if(read_entry_data(handle, archive, pkgfile,
+						&session->changelog, &session->changelog_len) != 0) {
+				goto error;
+			}
+			continue;
 		} else if(handle_simple_path(newpkg, entry_name)) {
 			continue;
 		} else if(full && !hit_mtree) {
@@ -636,11 +769,6 @@ alpm_pkg_t *_alpm_pkg_load_internal(alpm_handle_t *handle,
 					pkgfile, archive_error_string(archive));
 			GOTO_ERR(handle, ALPM_ERR_LIBARCHIVE, error);
 		}
-
-		/* if we are not doing a full read, see if we have all we need */
-		if((!full || hit_mtree) && config) {
-			break;
-		}
 	}
 
 	if(ret != ARCHIVE_EOF && ret != ARCHIVE_OK) { /* An error occurred */
@@ -40,6 +40,7 @@
 #include "deps.h"
 #include "dload.h"
 #include "filelist.h"
+#include "dbcache.h"
 
 static char *get_sync_dir(alpm_handle_t *handle)
 {
@@ -136,6 +137,10 @@ valid:
 	return 0;
 }
 
+static void sync_db_write_cache(alpm_db_t *db);
+static int sync_db_populate_archive(alpm_db_t *db, const char *dbpath,
+		int load_files);
+
 int SYMEXPORT alpm_db_update(alpm_handle_t *handle, alpm_list_t *dbs, int force) {
 	char *syncpath;
 	char *temporary_syncpath;
@@ -250,6 +255,8 @@ int SYMEXPORT alpm_db_update(alpm_handle_t *handle, alpm_list_t *dbs, int force)
 					db->treename);
 			/* pm_errno should be set */
 			ret = -1;
+		} else if(db->status & DB_STATUS_EXISTS) {
+			sync_db_write_cache(db);
 		}
 	}
 
@@ -277,7 +284,127 @@ cleanup:
 
 /* Forward decl so I don't reorganize the whole file right now */
 static int sync_db_read(alpm_db_t *db, struct archive *archive,
-		struct archive_entry *entry, alpm_pkg_t **likely_pkg);
+		struct archive_entry *entry, alpm_pkg_t **likely_pkg, int load_files);
+static int sync_db_load_files(alpm_db_t *db);
+static int is_files_db(alpm_db_t *db);
+
+/** Read the descriptive fields of a package populated from the binary
+ * database cache. These are not needed for dependency resolution, so they
+ * are only loaded when one of them is requested. */
+static int sync_pkg_load_desc(alpm_pkg_t *pkg)
+{
+	alpm_db_t *db = pkg->origin_data.db;
+	const alpm_dbcache_pkg_t *rec;
+
+	if(pkg->infolevel & INFRQ_DESC) {
+		return 0;
+	}
+	if(pkg->infolevel & INFRQ_ERROR) {
+		return -1;
+	}
+
+	_alpm_log(pkg->handle, ALPM_LOG_FUNCTION,
+			"loading description of %s from database cache of %s\n",
+			pkg->name, db->treename);
+	if(db->dbcache == NULL
+			|| (rec = _alpm_dbcache_find(db->dbcache, pkg->name)) == NULL
+			|| _alpm_dbcache_read_pkg(db->dbcache, rec, pkg, DBCACHE_FIELDS_DESC) != 0) {
+		_alpm_log(pkg->handle, ALPM_LOG_ERROR,
+				_("could not read description of %s from db '%s'\n"),
+				pkg->name, db->treename);
+		pkg->infolevel |= INFRQ_ERROR;
+		return -1;
+	}
+	pkg->infolevel |= INFRQ_DESC;
+	return 0;
+}
+
+/** Read the file list of a package. Without a database cache the file lists
+ * of all packages are parsed from the database archive at once, as it can
+ * only be read sequentially. */
+static int sync_pkg_load_files(alpm_pkg_t *pkg)
+{
+	alpm_db_t *db = pkg->origin_data.db;
+	const alpm_dbcache_pkg_t *rec;
+
+	if(pkg->infolevel & INFRQ_FILES) {
+		return 0;
+	}
+	if(db->dbcache == NULL) {
+		return sync_db_load_files(db);
+	}
+
+	_alpm_log(pkg->handle, ALPM_LOG_FUNCTION,
+			"loading file list of %s from database cache of %s\n",
+			pkg->name, db->treename);
+	if((rec = _alpm_dbcache_find(db->dbcache, pkg->name)) == NULL
+			|| _alpm_dbcache_read_pkg(db->dbcache, rec, pkg, DBCACHE_FIELDS_FILES) != 0) {
+		_alpm_log(pkg->handle, ALPM_LOG_ERROR,
+				_("could not read file list of %s from db '%s'\n"),
+				pkg->name, db->treename);
+		pkg->infolevel |= INFRQ_FILES | INFRQ_ERROR;
+		return -1;
+	}
+	pkg->infolevel |= INFRQ_FILES;
+	return 0;
+}
+
+static const char *_sync_get_base(alpm_pkg_t *pkg)
+{
+	sync_pkg_load_desc(pkg);
+	return pkg->base;
+}
+
+static const char *_sync_get_desc(alpm_pkg_t *pkg)
+{
+	sync_pkg_load_desc(pkg);
+	return pkg->desc;
+}
+
+static const char *_sync_get_url(alpm_pkg_t *pkg)
+{
+	sync_pkg_load_desc(pkg);
+	return pkg->url;
+}
+
+static alpm_time_t _sync_get_builddate(alpm_pkg_t *pkg)
+{
+	sync_pkg_load_desc(pkg);
+	return pkg->builddate;
+}
+
+static const char *_sync_get_packager(alpm_pkg_t *pkg)
+{
+	sync_pkg_load_desc(pkg);
+	return pkg->packager;
+}
+
+static alpm_list_t *_sync_get_licenses(alpm_pkg_t *pkg)
+{
+	sync_pkg_load_desc(pkg);
+	return pkg->licenses;
+}
+
+static alpm_list_t *_sync_get_xdata(alpm_pkg_t *pkg)
+{
+	sync_pkg_load_desc(pkg);
+	return pkg->xdata;
+}
+
+static alpm_filelist_t *_sync_get_files(alpm_pkg_t *pkg)
+{
+	sync_pkg_load_files(pkg);
+	return &(pkg->files);
+}
+
+static int _sync_force_load(alpm_pkg_t *pkg)
+{
+	int ret = sync_pkg_load_desc(pkg);
+	if(sync_pkg_load_files(pkg) != 0) {
+		ret = -1;
+	}
+	return ret;
+}
 
 static int _sync_get_validation(alpm_pkg_t *pkg)
 {
@@ -312,7 +439,16 @@ static const struct pkg_operations *get_sync_pkg_ops(void)
 	static int sync_pkg_ops_initalized = 0;
 	if(!sync_pkg_ops_initalized) {
 		sync_pkg_ops = default_pkg_ops;
+		sync_pkg_ops.get_base = _sync_get_base;
+		sync_pkg_ops.get_desc = _sync_get_desc;
+		sync_pkg_ops.get_url = _sync_get_url;
+		sync_pkg_ops.get_builddate = _sync_get_builddate;
+		sync_pkg_ops.get_packager = _sync_get_packager;
+		sync_pkg_ops.get_licenses = _sync_get_licenses;
+		sync_pkg_ops.get_xdata = _sync_get_xdata;
+		sync_pkg_ops.get_files = _sync_get_files;
 		sync_pkg_ops.get_validation = _sync_get_validation;
+		sync_pkg_ops.force_load = _sync_force_load;
 		sync_pkg_ops_initalized = 1;
 	}
 	return &sync_pkg_ops;
@@ -360,6 +496,11 @@ static alpm_pkg_t *load_pkg_for_entry(alpm_db_t *db, const char *entryname,
 		pkg->origin_data.db = db;
 		pkg->ops = get_sync_pkg_ops();
 		pkg->handle = db->handle;
+		pkg->infolevel = INFRQ_BASE | INFRQ_DESC;
+		if(!is_files_db(db)) {
+			/* nothing to load later on */
+			pkg->infolevel |= INFRQ_FILES;
+		}
 
 		if(_alpm_pkg_check_meta(pkg) != 0) {
 			_alpm_pkg_free(pkg);
@@ -417,17 +558,157 @@ static size_t estimate_package_count(struct stat *st, struct archive *archive)
 	return (size_t)((st->st_size / per_package) + 1);
 }
 
+static int is_files_db(alpm_db_t *db)
+{
+	/* currently only .files dbs contain file lists - make flexible when required*/
+	return strcmp(db->handle->dbext, ".files") == 0;
+}
+
+static int sync_db_cache_fields(alpm_db_t *db)
+{
+	int fields = DBCACHE_FIELDS_META | DBCACHE_FIELDS_DESC;
+	if(is_files_db(db)) {
+		fields |= DBCACHE_FIELDS_FILES;
+	}
+	return fields;
+}
+
+static char *sync_db_cache_path(alpm_db_t *db, const char *dbpath)
+{
+	size_t len = strlen(dbpath) + 7;
+	char *cachepath;
+
+	MALLOC(cachepath, len, RET_ERR(db->handle, ALPM_ERR_MEMORY, NULL));
+	snprintf(cachepath, len, "%s.cache", dbpath);
+	return cachepath;
+}
+
+/* Open the binary cache of a database if it was generated from the current
+ * database file. With exact set, the cache also has to carry the current
+ * file attributes of the database rather than just its contents. */
+static alpm_dbcache_t *sync_db_open_cache(alpm_db_t *db, const char *dbpath,
+		const alpm_dbcache_stamp_t *exact)
+{
+	alpm_dbcache_t *cache;
+	char *cachepath;
+
+	if((cachepath = sync_db_cache_path(db, dbpath)) == NULL) {
+		return NULL;
+	}
+	cache = _alpm_dbcache_open(db->handle, cachepath, exact,
+			exact ? NULL : dbpath, sync_db_cache_fields(db));
+	free(cachepath);
+	return cache;
+}
+
+/* Write the binary cache of a freshly downloaded database. Failure is not an
+ * error, the database will just be parsed from the archive. */
+static void sync_db_write_cache(alpm_db_t *db)
+{
+	alpm_dbcache_stamp_t stamp;
+	alpm_dbcache_writer_t *writer;
+	alpm_dbcache_t *cache;
+	alpm_list_t *i;
+	const char *dbpath;
+	char *cachepath;
+	int fields = sync_db_cache_fields(db);
+
+	dbpath = _alpm_db_path(db);
+	if(!dbpath) {
+		return;
+	}
+	if(_alpm_dbcache_stamp_file(dbpath, &stamp, 1) != 0) {
+		return;
+	}
+	/* a database downloaded again unchanged gets a new cache as well, so that
+	 * populating does not have to hash it every time */
+	if((cache = sync_db_open_cache(db, dbpath, &stamp)) != NULL) {
+		/* up to date */
+		_alpm_dbcache_close(cache);
+		return;
+	}
+
+	_alpm_db_free_pkgcache(db);
+	if(sync_db_populate_archive(db, dbpath, 1) != 0) {
+		return;
+	}
+	db->status |= DB_STATUS_PKGCACHE;
+
+	if((cachepath = sync_db_cache_path(db, dbpath)) == NULL
+			|| (writer = _alpm_dbcache_writer_new(fields)) == NULL) {
+		free(cachepath);
+		return;
+	}
+	for(i = db->pkgcache->list; i; i = i->next) {
+		if(_alpm_dbcache_writer_add(writer, i->data) != 0) {
+			break;
+		}
+	}
+	if(i == NULL) {
+		_alpm_dbcache_writer_commit(writer, db->handle, cachepath, &stamp);
+	} else {
+		_alpm_log(db->handle, ALPM_LOG_DEBUG,
+				"could not generate database cache for %s\n", db->treename);
+	}
+	_alpm_dbcache_writer_free(writer);
+	free(cachepath);
+}
+
+static int sync_db_populate_cache(alpm_db_t *db, const char *dbpath)
+{
+	alpm_dbcache_t *cache;
+	int infolevel = INFRQ_BASE;
+	uint64_t n;
+
+	if((cache = sync_db_open_cache(db, dbpath, NULL)) == NULL) {
+		return -1;
+	}
+	if(!is_files_db(db)) {
+		infolevel |= INFRQ_FILES;
+	}
+
+	db->pkgcache = _alpm_pkghash_create(cache->header->pkg_count);
+	if(db->pkgcache == NULL) {
+		_alpm_dbcache_close(cache);
+		return -1;
+	}
+	db->dbcache = cache;
+
+	/* records are sorted by name, so the cache list needs no sorting */
+	for(n = 0; n < cache->header->pkg_count; n++) {
+		alpm_pkg_t *pkg = _alpm_pkg_new();
+		if(pkg == NULL) {
+			goto error;
+		}
+		pkg->origin = ALPM_PKG_FROM_SYNCDB;
+		pkg->origin_data.db = db;
+		pkg->ops = get_sync_pkg_ops();
+		pkg->handle = db->handle;
+		pkg->infolevel = infolevel;
+
+		if(_alpm_dbcache_read_pkg(cache, cache->pkgs + n, pkg, DBCACHE_FIELDS_META) != 0
+				|| _alpm_pkghash_add(&db->pkgcache, pkg) == NULL) {
+			_alpm_pkg_free(pkg);
+			goto error;
+		}
+	}
+
+	_alpm_log(db->handle, ALPM_LOG_DEBUG,
+			"added %ju packages to package cache for db '%s'\n",
+			(uintmax_t)cache->header->pkg_count, db->treename);
+	return 0;
+
+error:
+	_alpm_log(db->handle, ALPM_LOG_DEBUG,
+			"could not load database cache for %s\n", db->treename);
+	/* also closes the database cache */
+	_alpm_db_free_pkgcache(db);
+	return -1;
+}
+
 static int sync_db_populate(alpm_db_t *db)
 {
 	const char *dbpath;
-	size_t est_count, count;
-	int fd;
-	int ret = 0;
-	int archive_ret;
-	struct stat buf;
-	struct archive *archive;
-	struct archive_entry *entry;
-	alpm_pkg_t *pkg = NULL;
 
 	if(db->status & DB_STATUS_INVALID) {
 		RET_ERR(db->handle, ALPM_ERR_DB_INVALID, -1);
@@ -441,6 +722,26 @@ static int sync_db_populate(alpm_db_t *db)
 		return -1;
 	}
 
+	if(sync_db_populate_cache(db, dbpath) == 0) {
+		return 0;
+	}
+	return sync_db_populate_archive(db, dbpath, 0);
+}
+
+/* Populate the package cache from the database archive. File lists are
+ * skipped unless load_files is set, they are loaded on first access. */
+static int sync_db_populate_archive(alpm_db_t *db, const char *dbpath,
+		int load_files)
+{
+	size_t est_count, count;
+	int fd;
+	int ret = 0;
+	int archive_ret;
+	struct stat buf;
+	struct archive *archive;
+	struct archive_entry *entry;
+	alpm_pkg_t *pkg = NULL;
+
 	fd = _alpm_open_archive(db->handle, dbpath, &buf,
 			&archive, ALPM_ERR_DB_OPEN);
 	if(fd < 0) {
@@ -450,8 +751,7 @@ static int sync_db_populate(alpm_db_t *db)
 	}
 	est_count = estimate_package_count(&buf, archive);
 
-	/* currently only .files dbs contain file lists - make flexible when required*/
-	if(strcmp(db->handle->dbext, ".files") == 0) {
+	if(is_files_db(db)) {
 		/* files databases are about four times larger on average */
 		est_count /= 4;
 	}
@@ -466,7 +766,7 @@ static int sync_db_populate(alpm_db_t *db)
 		mode_t mode = archive_entry_mode(entry);
 		if(!S_ISDIR(mode)) {
 			/* we have desc or depends - parse it */
-			if(sync_db_read(db, archive, entry, &pkg) != 0) {
+			if(sync_db_read(db, archive, entry, &pkg, load_files) != 0) {
 				_alpm_log(db->handle, ALPM_LOG_ERROR,
 						_("could not parse package description file '%s' from db '%s'\n"),
 						archive_entry_pathname(entry), db->treename);
@@ -490,6 +790,13 @@ static int sync_db_populate(alpm_db_t *db)
 		GOTO_ERR(db->handle, ALPM_ERR_LIBARCHIVE, cleanup);
 	}
 
+	if(load_files) {
+		alpm_list_t *i;
+		for(i = db->pkgcache->list; i; i = i->next) {
+			((alpm_pkg_t *)i->data)->infolevel |= INFRQ_FILES;
+		}
+	}
+
 	count = alpm_list_count(db->pkgcache->list);
 	if(count > 0) {
 		db->pkgcache->list = alpm_list_msort(db->pkgcache->list,
@@ -507,6 +814,74 @@ cleanup:
 	return ret;
 }
 
+/* Read the file lists of all packages of a database populated from its
+ * archive, in a single pass over the archive. */
+static int sync_db_load_files(alpm_db_t *db)
+{
+	const char *dbpath;
+	int fd, ret = 0, archive_ret;
+	struct stat buf;
+	struct archive *archive;
+	struct archive_entry *entry;
+	alpm_list_t *i;
+	alpm_pkg_t *pkg = NULL;
+
+	dbpath = _alpm_db_path(db);
+	if(!dbpath) {
+		return -1;
+	}
+
+	_alpm_log(db->handle, ALPM_LOG_DEBUG, "loading file lists of db '%s'\n",
+			db->treename);
+	fd = _alpm_open_archive(db->handle, dbpath, &buf, &archive, ALPM_ERR_DB_OPEN);
+	if(fd < 0) {
+		ret = -1;
+	} else {
+		while((archive_ret = archive_read_next_header(archive, &entry)) == ARCHIVE_OK) {
+			const char *entryname = archive_entry_pathname(entry);
+			const char *filename;
+			char *pkgname = NULL;
+			int known;
+
+			if(S_ISDIR(archive_entry_mode(entry)) || entryname == NULL
+					|| (filename = strrchr(entryname, '/')) == NULL
+					|| strcmp(filename + 1, "files") != 0
+					|| _alpm_splitname(entryname, &pkgname, NULL, NULL) != 0) {
+				continue;
+			}
+			/* the package cache is complete, do not add to it */
+			known = _alpm_pkghash_find(db->pkgcache, pkgname) != NULL;
+			free(pkgname);
+			if(!known) {
+				continue;
+			}
+			if(sync_db_read(db, archive, entry, &pkg, 1) != 0) {
+				_alpm_log(db->handle, ALPM_LOG_ERROR,
+						_("could not parse package description file '%s' from db '%s'\n"),
+						entryname, db->treename);
+				ret = -1;
+			}
+		}
+		if(archive_ret != ARCHIVE_EOF) {
+			_alpm_log(db->handle, ALPM_LOG_ERROR, _("could not read db '%s' (%s)\n"),
+					db->treename, archive_error_string(archive));
+			ret = -1;
+		}
+		_alpm_archive_read_free(archive);
+		close(fd);
+	}
+
+	/* do not try again for each package */
+	for(i = db->pkgcache->list; i; i = i->next) {
+		pkg = i->data;
+		pkg->infolevel |= INFRQ_FILES;
+		if(ret != 0) {
+			pkg->infolevel |= INFRQ_ERROR;
+		}
+	}
+	return ret;
+}
+
 /* This function validates %FILENAME%. filename must be between 3 and
  * PATH_MAX characters and cannot be contain a path */
 static int _alpm_validate_filename(alpm_db_t *db, const char *pkgname,
@@ -560,7 +935,7 @@ static int _alpm_validate_filename(alpm_db_t *db, const char *pkgname,
 } while(1) /* note the while(1) and not (0) */
 
 static int sync_db_read(alpm_db_t *db, struct archive *archive,
-		struct archive_entry *entry, alpm_pkg_t **likely_pkg)
+		struct archive_entry *entry, alpm_pkg_t **likely_pkg, int load_files)
 {
 	const char *entryname, *filename;
 	alpm_pkg_t *pkg;
@@ -596,7 +971,11 @@ static int sync_db_read(alpm_db_t *db, struct archive *archive,
 		return 0;
 	}
 
-	if(strcmp(filename, "desc") == 0 || strcmp(filename, "depends") == 0
+	if(strcmp(filename, "files") == 0
+			&& (!load_files || pkg->infolevel & INFRQ_FILES)) {
+		/* file lists are loaded on demand by sync_db_load_files() */
+		*likely_pkg = pkg;
+	} else if(strcmp(filename, "desc") == 0 || strcmp(filename, "depends") == 0
 			|| strcmp(filename, "files") == 0) {
 		int ret;
 		while((ret = _alpm_archive_fgets(archive, &buf)) == ARCHIVE_OK) {
@@ -667,7 +1046,6 @@ static int sync_db_read(alpm_db_t *db, struct archive *archive,
 			} else if(strcmp(line, "%PROVIDES%") == 0) {
 				READ_AND_SPLITDEP(pkg->provides);
 			} else if(strcmp(line, "%FILES%") == 0) {
-				/* TODO: this could lazy load if there is future demand */
 				size_t files_count = 0, files_size = 0;
 				alpm_file_t *files = NULL;
 
@@ -696,6 +1074,7 @@ static int sync_db_read(alpm_db_t *db, struct archive *archive,
 				pkg->files.count = files_count;
 				pkg->files.files = files;
 				_alpm_filelist_sort(&pkg->files);
+				pkg->infolevel |= INFRQ_FILES;
 			} else if(strcmp(line, "%DATA%") == 0) {
 				alpm_list_t *i, *lines = NULL;
 				READ_AND_STORE_ALL(lines);
@@ -744,11 +1123,10 @@ alpm_db_t *_alpm_db_register_sync(alpm_handle_t *handle, const char *treename,
 
 	_alpm_log(handle, ALPM_LOG_DEBUG, "registering sync database '%s'\n", treename);
 
-#ifndef HAVE_LIBGPGME
-	if(level != 0 && level != ALPM_SIG_USE_DEFAULT) {
+	if(level != 0 && level != ALPM_SIG_USE_DEFAULT
+			&& !_alpm_signing_available(handle)) {
 		RET_ERR(handle, ALPM_ERR_MISSING_CAPABILITY_SIGNATURES, NULL);
 	}
-#endif
 
 	db = _alpm_db_new(treename, 0);
 	if(db == NULL) {
@@ -39,6 +39,7 @@
 #include "log.h"
 #include "deps.h"
 #include "filelist.h"
+#include "db.h"
 
 /**
  * @brief Creates a new conflict.
@@ -360,32 +361,275 @@ static int dir_belongsto_pkgs(alpm_handle_t *handle, const char *dirpath,
 	return 1;
 }
 
-static alpm_list_t *alpm_db_find_file_owners(alpm_db_t* db, const char *path)
+static int _alpm_can_overwrite_file(alpm_handle_t *handle, const char *path, const char *rootedpath)
 {
-	alpm_list_t *i, *owners = NULL;
-	for(i = alpm_db_get_pkgcache(db); i; i = i->next) {
-		if(alpm_filelist_contains(alpm_pkg_get_files(i->data), path)) {
-			owners = alpm_list_add(owners, i->data);
-		}
+	return _alpm_option_match_overwrite_file(handle, path) == 0
+		|| _alpm_option_match_overwrite_file(handle, rootedpath) == 0;
+}
+
+/* Where a path in the transaction index comes from */
+enum path_source {
+	/* file list of an upgrade target */
+	PATH_TARGET,
+	/* file list of the installed version of an upgrade target */
+	PATH_INSTALLED,
+	/* file list of a package being removed */
+	PATH_REMOVED
+};
+
+struct path_entry {
+	const char *name;
+	/* length of the name without a trailing slash */
+	size_t len;
+	unsigned long hash;
+	/* index of the upgrade target, unused for removed packages */
+	size_t target;
+	/* index of the file in its file list */
+	size_t file;
+	enum path_source source;
+	struct path_entry *next;
+};
+
+/* Every path touched by a transaction, keyed without the trailing slash of
+ * directories so a file and a directory of the same name share a chain. */
+struct path_index {
+	struct path_entry *entries;
+	size_t count;
+	struct path_entry **buckets;
+	size_t mask;
+};
+
+/* A target-target file conflict found through the path index */
+struct target_conflict {
+	size_t target1;
+	size_t target2;
+	size_t file;
+	const char *name;
+	alpm_pkg_t *pkg1;
+	alpm_pkg_t *pkg2;
+};
+
+static unsigned long path_hash(const char *path, size_t len)
+{
+	unsigned long hash = 0;
+	size_t i;
+
+	for(i = 0; i < len; i++) {
+		hash = (unsigned char)path[i] + hash * 65599;
+	}
+	return hash;
+}
+
+static size_t path_keylen(const char *path)
+{
+	size_t len = strlen(path);
+	if(len > 1 && path[len - 1] == '/') {
+		len--;
+	}
+	return len;
+}
+
+static int path_entry_isdir(const struct path_entry *entry)
+{
+	return entry->name[entry->len] == '/';
+}
+
+static int path_entry_samekey(const struct path_entry *a,
+		const struct path_entry *b)
+{
+	return a->hash == b->hash && a->len == b->len
+		&& memcmp(a->name, b->name, a->len) == 0;
+}
+
+static void path_index_add(struct path_index *index, alpm_filelist_t *files,
+		enum path_source source, size_t target)
+{
+	size_t i;
+
+	for(i = 0; i < files->count; i++) {
+		struct path_entry *entry = &index->entries[index->count++];
+		struct path_entry **bucket;
+
+		entry->name = files->files[i].name;
+		entry->len = path_keylen(entry->name);
+		entry->hash = path_hash(entry->name, entry->len);
+		entry->target = target;
+		entry->file = i;
+		entry->source = source;
+
+		bucket = &index->buckets[entry->hash & index->mask];
+		entry->next = *bucket;
+		*bucket = entry;
 	}
-	return owners;
 }
 
-static alpm_pkg_t *_alpm_find_file_owner(alpm_handle_t *handle, const char *path)
+static int path_index_build(alpm_handle_t *handle, struct path_index *index,
+		alpm_list_t *upgrade, alpm_list_t *rem)
 {
 	alpm_list_t *i;
-	for(i = alpm_db_get_pkgcache(handle->db_local); i; i = i->next) {
-		if(alpm_filelist_contains(alpm_pkg_get_files(i->data), path)) {
-			return i->data;
+	size_t total = 0, buckets = 16, target;
+
+	memset(index, 0, sizeof(struct path_index));
+
+	for(i = upgrade; i; i = i->next) {
+		alpm_pkg_t *pkg = i->data;
+		alpm_pkg_t *dbpkg = _alpm_db_get_pkgfromcache(handle->db_local, pkg->name);
+		total += alpm_pkg_get_files(pkg)->count;
+		if(dbpkg) {
+			total += alpm_pkg_get_files(dbpkg)->count;
 		}
 	}
-	return NULL;
+	for(i = rem; i; i = i->next) {
+		if(i->data) {
+			total += alpm_pkg_get_files(i->data)->count;
+		}
+	}
+
+	while(buckets < total * 2) {
+		buckets *= 2;
+	}
+	CALLOC(index->entries, total + 1, sizeof(struct path_entry),
+			RET_ERR(handle, ALPM_ERR_MEMORY, -1));
+	CALLOC(index->buckets, buckets, sizeof(struct path_entry *),
+			FREE(index->entries); RET_ERR(handle, ALPM_ERR_MEMORY, -1));
+	index->mask = buckets - 1;
+
+	for(target = 0, i = upgrade; i; i = i->next, target++) {
+		alpm_pkg_t *pkg = i->data;
+		alpm_pkg_t *dbpkg = _alpm_db_get_pkgfromcache(handle->db_local, pkg->name);
+		path_index_add(index, alpm_pkg_get_files(pkg), PATH_TARGET, target);
+		if(dbpkg) {
+			path_index_add(index, alpm_pkg_get_files(dbpkg), PATH_INSTALLED, target);
+		}
+	}
+	for(i = rem; i; i = i->next) {
+		if(i->data) {
+			path_index_add(index, alpm_pkg_get_files(i->data), PATH_REMOVED, 0);
+		}
+	}
+
+	return 0;
 }
 
-static int _alpm_can_overwrite_file(alpm_handle_t *handle, const char *path, const char *rootedpath)
+static void path_index_free(struct path_index *index)
+{
+	FREE(index->entries);
+	FREE(index->buckets);
+}
+
+/**
+ * @brief Checks if a path is in a file list of the given source.
+ *
+ * @param index the path index
+ * @param path path to look for, without a trailing slash
+ * @param source where the path has to come from
+ * @param skip_target target to ignore for PATH_INSTALLED entries
+ *
+ * @return 1 if a file list contains exactly path, 0 otherwise
+ */
+static int path_index_contains(struct path_index *index, const char *path,
+		enum path_source source, size_t skip_target)
+{
+	size_t len = strlen(path);
+	unsigned long hash = path_hash(path, len);
+	struct path_entry *entry;
+
+	for(entry = index->buckets[hash & index->mask]; entry; entry = entry->next) {
+		if(entry->source != source || entry->hash != hash || entry->len != len
+				|| path_entry_isdir(entry) || memcmp(entry->name, path, len) != 0) {
+			continue;
+		}
+		if(source == PATH_INSTALLED && entry->target == skip_target) {
+			continue;
+		}
+		return 1;
+	}
+	return 0;
+}
+
+static int target_conflict_cmp(const void *p1, const void *p2)
+{
+	const struct target_conflict *a = p1, *b = p2;
+
+	if(a->target1 != b->target1) {
+		return a->target1 < b->target1 ? -1 : 1;
+	}
+	if(a->target2 != b->target2) {
+		return a->target2 < b->target2 ? -1 : 1;
+	}
+	if(a->file != b->file) {
+		return a->file < b->file ? -1 : 1;
+	}
+	return 0;
+}
+
+/**
+ * @brief Finds all paths shared by two upgrade targets.
+ *
+ * @details A pair of entries only conflicts if at least one of them is not a
+ * directory. The result is sorted the way the targets would be compared
+ * pairwise, so conflicts are reported in the same order.
+ *
+ * @param handle the context handle
+ * @param index the path index
+ * @param targets upgrade targets by index
+ * @param conflicts set to the conflicts found
+ * @param count set to the number of conflicts found
+ *
+ * @return 0 on success, -1 on error
+ */
+static int find_target_conflicts(alpm_handle_t *handle,
+		struct path_index *index, alpm_pkg_t **targets,
+		struct target_conflict **conflicts, size_t *count)
 {
-	return _alpm_fnmatch_patterns(handle->overwrite_files, path) == 0
-		|| _alpm_fnmatch_patterns(handle->overwrite_files, rootedpath) == 0;
+	struct target_conflict *found = NULL;
+	size_t found_size = 0, b;
+
+	*conflicts = NULL;
+	*count = 0;
+	for(b = 0; b <= index->mask; b++) {
+		struct path_entry *x, *y;
+
+		for(x = index->buckets[b]; x; x = x->next) {
+			if(x->source != PATH_TARGET || path_entry_isdir(x)) {
+				continue;
+			}
+			for(y = index->buckets[b]; y; y = y->next) {
+				struct path_entry *first, *second;
+				struct target_conflict *c;
+
+				if(y->source != PATH_TARGET || y->target == x->target
+						|| !path_entry_samekey(x, y)) {
+					continue;
+				}
+				/* two files are seen from both sides, only count them once */
+				if(!path_entry_isdir(y) && y->target < x->target) {
+					continue;
+				}
+				if(!_alpm_greedy_grow((void **)&found, &found_size,
+							(*count + 1) * sizeof(struct target_conflict))) {
+					free(found);
+					*count = 0;
+					RET_ERR(handle, ALPM_ERR_MEMORY, -1);
+				}
+				first = x->target < y->target ? x : y;
+				second = first == x ? y : x;
+				c = &found[(*count)++];
+				c->target1 = first->target;
+				c->target2 = second->target;
+				c->file = first->file;
+				c->name = first->name;
+				c->pkg1 = targets[first->target];
+				c->pkg2 = targets[second->target];
+			}
+		}
+	}
+
+	if(*count > 1) {
+		qsort(found, *count, sizeof(struct target_conflict), target_conflict_cmp);
+	}
+	*conflicts = found;
+	return 0;
 }
 
 /**
@@ -408,6 +652,10 @@ alpm_list_t *_alpm_db_find_fileconflicts(alpm_handle_t *handle,
 	size_t numtargs = alpm_list_count(upgrade);
 	size_t current;
 	size_t rootlen;
+	struct path_index index;
+	struct target_conflict *targetconflicts = NULL;
+	size_t targetconflict_count = 0, next_targetconflict = 0;
+	alpm_pkg_t **targets = NULL;
 
 	if(!upgrade) {
 		return NULL;
@@ -415,6 +663,22 @@ alpm_list_t *_alpm_db_find_fileconflicts(alpm_handle_t *handle,
 
 	rootlen = strlen(handle->root);
 
+	/* index every path of the transaction once instead of comparing the file
+	 * lists of all targets, removals and installed packages pairwise */
+	CALLOC(targets, numtargs, sizeof(alpm_pkg_t *),
+			RET_ERR(handle, ALPM_ERR_MEMORY, NULL));
+	for(current = 0, i = upgrade; i; i = i->next, current++) {
+		targets[current] = i->data;
+	}
+	if(path_index_build(handle, &index, upgrade, rem) != 0) {
+		free(targets);
+		return NULL;
+	}
+	if(find_target_conflicts(handle, &index, targets, &targetconflicts,
+				&targetconflict_count) != 0) {
+		goto error;
+	}
+
 	/* TODO this whole function needs a huge change, which hopefully will
 	 * be possible with real transactions. Right now we only do half as much
 	 * here as we do when we actually extract files in add.c with our 12
@@ -432,45 +696,31 @@ alpm_list_t *_alpm_db_find_fileconflicts(alpm_handle_t *handle,
 		/* CHECK 1: check every target against every target */
 		_alpm_log(handle, ALPM_LOG_DEBUG, "searching for file conflicts: %s\n",
 				p1->name);
-		for(j = i->next; j; j = j->next) {
-			alpm_list_t *common_files;
-			alpm_pkg_t *p2 = j->data;
-
-			alpm_filelist_t *p1_files = alpm_pkg_get_files(p1);
-			alpm_filelist_t *p2_files = alpm_pkg_get_files(p2);
-
-			common_files = _alpm_filelist_intersection(p1_files, p2_files);
-
-			if(common_files) {
-				alpm_list_t *k;
-				char path[PATH_MAX];
-				for(k = common_files; k; k = k->next) {
-					char *filename = k->data;
-					snprintf(path, PATH_MAX, "%s%s", handle->root, filename);
-
-					/* can skip file-file conflicts when forced *
-					 * checking presence in p2_files detects dir-file or file-dir
-					 * conflicts as the path from p1 is returned */
-					if(_alpm_can_overwrite_file(handle, filename, path)
-							&& alpm_filelist_contains(p2_files, filename)) {
-						_alpm_log(handle, ALPM_LOG_DEBUG,
-							"%s exists in both '%s' and '%s'\n", filename,
-							p1->name, p2->name);
-						_alpm_log(handle, ALPM_LOG_DEBUG,
-							"file-file conflict being forced\n");
-						continue;
-					}
+		for(; next_targetconflict < targetconflict_count
+				&& targetconflicts[next_targetconflict].target1 == current;
+				next_targetconflict++) {
+			struct target_conflict *c = &targetconflicts[next_targetconflict];
+			alpm_pkg_t *p2 = c->pkg2;
+			char path[PATH_MAX];
 
-					conflicts = add_fileconflict(handle, conflicts, path, p1, p2);
-					if(handle->pm_errno == ALPM_ERR_MEMORY) {
-						alpm_list_free_inner(conflicts,
-								(alpm_list_fn_free) alpm_conflict_free);
-						alpm_list_free(conflicts);
-						alpm_list_free(common_files);
-						return NULL;
-					}
-				}
-				alpm_list_free(common_files);
+			snprintf(path, PATH_MAX, "%s%s", handle->root, c->name);
+
+			/* can skip file-file conflicts when forced *
+			 * a directory in p2 means a file-dir or dir-file conflict, the path
+			 * from p1 is the one reported */
+			if(_alpm_can_overwrite_file(handle, c->name, path)
+					&& alpm_filelist_contains(alpm_pkg_get_files(p2), c->name)) {
+				_alpm_log(handle, ALPM_LOG_DEBUG,
+					"%s exists in both '%s' and '%s'\n", c->name,
+					p1->name, p2->name);
+				_alpm_log(handle, ALPM_LOG_DEBUG,
+					"file-file conflict being forced\n");
+				continue;
+			}
+
+			conflicts = add_fileconflict(handle, conflicts, path, p1, p2);
+			if(handle->pm_errno == ALPM_ERR_MEMORY) {
+				goto error;
 			}
 		}
 
@@ -500,7 +750,6 @@ alpm_list_t *_alpm_db_find_fileconflicts(alpm_handle_t *handle,
 		for(j = newfiles; j; j = j->next) {
 			const char *filestr = j->data;
 			const char *relative_path;
-			alpm_list_t *k;
 			/* have we acted on this conflict? */
 			int resolved_conflict = 0;
 			struct stat lsbuf;
@@ -549,61 +798,53 @@ alpm_list_t *_alpm_db_find_fileconflicts(alpm_handle_t *handle,
 			}
 
 			/* Check remove list (will we remove the conflicting local file?) */
-			for(k = rem; k && !resolved_conflict; k = k->next) {
-				alpm_pkg_t *rempkg = k->data;
-				if(rempkg && alpm_filelist_contains(alpm_pkg_get_files(rempkg),
-							relative_path)) {
-					_alpm_log(handle, ALPM_LOG_DEBUG,
-							"local file will be removed, not a conflict\n");
-					resolved_conflict = 1;
-					if(pfile_isdir) {
-						/* go ahead and skip any files inside filestr as they will
-						 * necessarily be resolved by replacing the file with a dir
-						 * NOTE: afterward, j will point to the last file inside filestr */
-						size_t fslen = strlen(filestr);
-						for( ; j->next; j = j->next) {
-							const char *filestr2 = j->next->data;
-							if(strncmp(filestr, filestr2, fslen) != 0) {
-								break;
-							}
+			if(!resolved_conflict && path_index_contains(&index, relative_path,
+						PATH_REMOVED, 0)) {
+				_alpm_log(handle, ALPM_LOG_DEBUG,
+						"local file will be removed, not a conflict\n");
+				resolved_conflict = 1;
+				if(pfile_isdir) {
+					/* go ahead and skip any files inside filestr as they will
+					 * necessarily be resolved by replacing the file with a dir
+					 * NOTE: afterward, j will point to the last file inside filestr */
+					size_t fslen = strlen(filestr);
+					for( ; j->next; j = j->next) {
+						const char *filestr2 = j->next->data;
+						if(strncmp(filestr, filestr2, fslen) != 0) {
+							break;
 						}
 					}
 				}
 			}
 
-			/* Look at all the targets to see if file has changed hands */
-			for(k = upgrade; k && !resolved_conflict; k = k->next) {
-				alpm_pkg_t *localp2, *p2 = k->data;
-				if(!p2 || p1 == p2) {
-					/* skip p1; both p1 and p2 come directly from the upgrade list
-					 * so they can be compared directly */
-					continue;
+			/* Look at all the targets to see if file has changed hands; the
+			 * installed files of other targets will be removed (target conflicts
+			 * are handled by CHECK 1) */
+			if(!resolved_conflict && path_index_contains(&index, relative_path,
+						PATH_INSTALLED, current)) {
+				size_t fslen = strlen(filestr);
+
+				/* skip removal of file, but not add. this will prevent a second
+				 * package from removing the file when it was already installed
+				 * by its new owner (whether the file is in backup array or not */
+				if(_alpm_strset_add(handle->trans->skip_remove, relative_path) != 0) {
+					handle->pm_errno = ALPM_ERR_MEMORY;
+					alpm_list_free(newfiles);
+					goto error;
 				}
-				localp2 = _alpm_db_get_pkgfromcache(handle->db_local, p2->name);
-
-				/* localp2->files will be removed (target conflicts are handled by CHECK 1) */
-				if(localp2 && alpm_filelist_contains(alpm_pkg_get_files(localp2), relative_path)) {
-					size_t fslen = strlen(filestr);
-
-					/* skip removal of file, but not add. this will prevent a second
-					 * package from removing the file when it was already installed
-					 * by its new owner (whether the file is in backup array or not */
-					handle->trans->skip_remove =
-						alpm_list_add(handle->trans->skip_remove, strdup(relative_path));
-					_alpm_log(handle, ALPM_LOG_DEBUG,
-							"file changed packages, adding to remove skiplist\n");
-					resolved_conflict = 1;
+				_alpm_log(handle, ALPM_LOG_DEBUG,
+						"file changed packages, adding to remove skiplist\n");
+				resolved_conflict = 1;
 
-					if(filestr[fslen - 1] == '/') {
-						/* replacing a file with a directory:
-						 * go ahead and skip any files inside filestr as they will
-						 * necessarily be resolved by replacing the file with a dir
-						 * NOTE: afterward, j will point to the last file inside filestr */
-						for( ; j->next; j = j->next) {
-							const char *filestr2 = j->next->data;
-							if(strncmp(filestr, filestr2, fslen) != 0) {
-								break;
-							}
+				if(filestr[fslen - 1] == '/') {
+					/* replacing a file with a directory:
+					 * go ahead and skip any files inside filestr as they will
+					 * necessarily be resolved by replacing the file with a dir
+					 * NOTE: afterward, j will point to the last file inside filestr */
+					for( ; j->next; j = j->next) {
+						const char *filestr2 = j->next->data;
+						if(strncmp(filestr, filestr2, fslen) != 0) {
+							break;
 						}
 					}
 				}
@@ -616,7 +857,7 @@ alpm_list_t *_alpm_db_find_fileconflicts(alpm_handle_t *handle,
 				char *dir = malloc(dir_len);
 				snprintf(dir, dir_len, "%s/", relative_path);
 
-				owners = alpm_db_find_file_owners(handle->db_local, dir);
+				owners = _alpm_db_find_file_owners(handle->db_local, dir);
 				if(owners) {
 					alpm_list_t *pkgs = NULL, *diff;
 
@@ -643,14 +884,7 @@ alpm_list_t *_alpm_db_find_fileconflicts(alpm_handle_t *handle,
 
 			/* is the file unowned and in the backup list of the new package? */
 			if(!resolved_conflict && _alpm_needbackup(relative_path, p1)) {
-				alpm_list_t *local_pkgs = _alpm_db_get_pkgcache(handle->db_local);
-				int found = 0;
-				for(k = local_pkgs; k && !found; k = k->next) {
-					if(alpm_filelist_contains(alpm_pkg_get_files(k->data), relative_path)) {
-							found = 1;
-					}
-				}
-				if(!found) {
+				if(_alpm_db_find_file_owner(handle->db_local, relative_path) == NULL) {
 					_alpm_log(handle, ALPM_LOG_DEBUG,
 							"file was unowned but in new backup list\n");
 					resolved_conflict = 1;
@@ -667,13 +901,10 @@ alpm_list_t *_alpm_db_find_fileconflicts(alpm_handle_t *handle,
 
 			if(!resolved_conflict) {
 				conflicts = add_fileconflict(handle, conflicts, path, p1,
-						_alpm_find_file_owner(handle, relative_path));
+						_alpm_db_find_file_owner(handle->db_local, relative_path));
 				if(handle->pm_errno == ALPM_ERR_MEMORY) {
-					alpm_list_free_inner(conflicts,
-							(alpm_list_fn_free) alpm_conflict_free);
-					alpm_list_free(conflicts);
 					alpm_list_free(newfiles);
-					return NULL;
+					goto error;
 				}
 			}
 		}
@@ -682,5 +913,16 @@ alpm_list_t *_alpm_db_find_fileconflicts(alpm_handle_t *handle,
 	PROGRESS(handle, ALPM_PROGRESS_CONFLICTS_START, "", 100,
 			numtargs, current);
 
+	free(targetconflicts);
+	free(targets);
+	path_index_free(&index);
 	return conflicts;
+
+error:
+	alpm_list_free_inner(conflicts, (alpm_list_fn_free) alpm_fileconflict_free);
+	alpm_list_free(conflicts);
+	free(targetconflicts);
+	free(targets);
+	path_index_free(&index);
+	return NULL;
 }
@@ -353,6 +353,27 @@ int SYMEXPORT alpm_db_search(alpm_db_t *db, const alpm_list_t *needles,
 	return _alpm_db_search(db, needles, ret);
 }
 
+alpm_list_t SYMEXPORT *alpm_db_find_file_owners(alpm_db_t *db, const char *path)
+{
+	ASSERT(db != NULL, return NULL);
+	db->handle->pm_errno = ALPM_ERR_OK;
+	ASSERT(path != NULL, RET_ERR(db->handle, ALPM_ERR_WRONG_ARGS, NULL));
+
+	return _alpm_db_find_file_owners(db, path);
+}
+
+int SYMEXPORT alpm_db_find_files(alpm_db_t *db, const char *needle, int flags,
+		alpm_list_t **ret)
+{
+	ASSERT(db != NULL, return -1);
+	db->handle->pm_errno = ALPM_ERR_OK;
+	ASSERT(needle != NULL && ret != NULL && *ret == NULL,
+			RET_ERR(db->handle, ALPM_ERR_WRONG_ARGS, -1));
+
+	*ret = _alpm_db_find_files(db, needle, flags);
+	return db->handle->pm_errno == ALPM_ERR_OK ? 0 : -1;
+}
+
 int SYMEXPORT alpm_db_set_usage(alpm_db_t *db, int usage)
 {
 	ASSERT(db != NULL, return -1);
@@ -561,6 +582,49 @@ static void free_groupcache(alpm_db_t *db)
 	db->status &= ~DB_STATUS_GRPCACHE;
 }
 
+static void free_namecache(alpm_db_t *db)
+{
+	FREE(db->namecache);
+	db->namecache_count = 0;
+	db->status &= ~DB_STATUS_NAMECACHE;
+}
+
+static void free_ownercache(alpm_db_t *db)
+{
+	if(db == NULL || !(db->status & DB_STATUS_OWNERCACHE)) {
+		return;
+	}
+
+	_alpm_log(db->handle, ALPM_LOG_DEBUG,
+			"freeing file owner cache for repository '%s'\n", db->treename);
+
+	free_namecache(db);
+	FREE(db->ownercache);
+	db->ownercache_count = 0;
+	db->status &= ~DB_STATUS_OWNERCACHE;
+}
+
+static const int depcache_status[DEPLIST_COUNT] = {
+	DB_STATUS_PROVIDECACHE,
+	DB_STATUS_DEPENDCACHE,
+	DB_STATUS_OPTDEPENDCACHE
+};
+
+static void free_depcache(alpm_db_t *db)
+{
+	int i;
+
+	if(db == NULL) {
+		return;
+	}
+
+	for(i = 0; i < DEPLIST_COUNT; i++) {
+		FREE(db->depcache[i]);
+		db->depcache_count[i] = 0;
+		db->status &= ~depcache_status[i];
+	}
+}
+
 void _alpm_db_free_pkgcache(alpm_db_t *db)
 {
 	if(db == NULL || db->pkgcache == NULL) {
@@ -570,10 +634,14 @@ void _alpm_db_free_pkgcache(alpm_db_t *db)
 	_alpm_log(db->handle, ALPM_LOG_DEBUG,
 			"freeing package cache for repository '%s'\n", db->treename);
 
+	free_ownercache(db);
+	free_depcache(db);
 	alpm_list_free_inner(db->pkgcache->list,
 			(alpm_list_fn_free)_alpm_pkg_free);
 	_alpm_pkghash_free(db->pkgcache);
 	db->pkgcache = NULL;
+	_alpm_dbcache_close(db->dbcache);
+	db->dbcache = NULL;
 	db->status &= ~DB_STATUS_PKGCACHE;
 
 	free_groupcache(db);
@@ -610,6 +678,276 @@ alpm_list_t *_alpm_db_get_pkgcache(alpm_db_t *db)
 	return hash->list;
 }
 
+static int pkgdep_cmp(const void *p1, const void *p2)
+{
+	const alpm_pkgdep_t *d1 = p1, *d2 = p2;
+	int cmp = strcmp(d1->dep->name, d2->dep->name);
+	if(cmp == 0) {
+		cmp = (d1->index > d2->index) - (d1->index < d2->index);
+	}
+	return cmp;
+}
+
+static alpm_list_t *get_deplist(alpm_pkg_t *pkg, alpm_deplist_t list)
+{
+	switch(list) {
+		case DEPLIST_PROVIDES:
+			return alpm_pkg_get_provides(pkg);
+		case DEPLIST_DEPENDS:
+			return alpm_pkg_get_depends(pkg);
+		case DEPLIST_OPTDEPENDS:
+			return alpm_pkg_get_optdepends(pkg);
+		default:
+			return NULL;
+	}
+}
+
+static int load_depcache(alpm_db_t *db, alpm_deplist_t list)
+{
+	static const char *names[DEPLIST_COUNT] = {
+		"provides", "depends", "optdepends"
+	};
+	alpm_pkgdep_t *cache;
+	alpm_list_t *lp;
+	size_t count = 0, size = 0, index = 0;
+
+	if(_alpm_db_get_pkgcache_hash(db) == NULL) {
+		return -1;
+	}
+
+	_alpm_log(db->handle, ALPM_LOG_DEBUG, "loading %s cache for repository '%s'\n",
+			names[list], db->treename);
+
+	for(lp = db->pkgcache->list; lp; lp = lp->next) {
+		size += alpm_list_count(get_deplist(lp->data, list));
+	}
+	CALLOC(cache, size + 1, sizeof(alpm_pkgdep_t),
+			RET_ERR(db->handle, ALPM_ERR_MEMORY, -1));
+
+	for(lp = db->pkgcache->list; lp; lp = lp->next, index++) {
+		alpm_pkg_t *pkg = lp->data;
+		alpm_list_t *i;
+
+		for(i = get_deplist(pkg, list); i; i = i->next) {
+			cache[count].dep = i->data;
+			cache[count].pkg = pkg;
+			cache[count].index = index;
+			count++;
+		}
+	}
+	if(count > 0) {
+		qsort(cache, count, sizeof(alpm_pkgdep_t), pkgdep_cmp);
+	}
+	db->depcache[list] = cache;
+	db->depcache_count[list] = count;
+	db->status |= depcache_status[list];
+	return 0;
+}
+
+/** Look up the entries of a dependency list of a database by name.
+ * @param db the database
+ * @param list the dependency list of the packages to search
+ * @param name the dependency name, regardless of version
+ * @param entries set to the first of count entries named name, ordered like
+ * the package cache, or NULL
+ * @param count set to the number of entries found
+ * @return 0 on success, -1 if the dependency list could not be indexed
+ * (pm_errno is set accordingly)
+ */
+int _alpm_db_find_deps(alpm_db_t *db, alpm_deplist_t list,
+		const char *name, alpm_pkgdep_t **entries, size_t *count)
+{
+	alpm_pkgdep_t *cache;
+	size_t lo = 0, hi, end;
+
+	*entries = NULL;
+	*count = 0;
+	if(db == NULL || name == NULL) {
+		return 0;
+	}
+	if(!(db->status & depcache_status[list]) && load_depcache(db, list) != 0) {
+		return -1;
+	}
+
+	cache = db->depcache[list];
+	hi = db->depcache_count[list];
+	while(lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+		if(strcmp(cache[mid].dep->name, name) < 0) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+	end = lo;
+	while(end < db->depcache_count[list]
+			&& strcmp(cache[end].dep->name, name) == 0) {
+		end++;
+	}
+	if(end > lo) {
+		*entries = cache + lo;
+		*count = end - lo;
+	}
+	return 0;
+}
+
+/* index the dependency lists searched for dependents */
+static int load_dependent_lists(alpm_db_t *db)
+{
+	if(!(db->status & DB_STATUS_DEPENDCACHE)
+			&& load_depcache(db, DEPLIST_DEPENDS) != 0) {
+		return -1;
+	}
+	if(!(db->status & DB_STATUS_OPTDEPENDCACHE)
+			&& load_depcache(db, DEPLIST_OPTDEPENDS) != 0) {
+		return -1;
+	}
+	return 0;
+}
+
+int SYMEXPORT alpm_db_compute_revdeps(alpm_db_t *db, alpm_list_t **ret)
+{
+	alpm_list_t *i, *revdeps = NULL;
+	alpm_handle_t *handle;
+
+	ASSERT(db != NULL, return -1);
+	handle = db->handle;
+	handle->pm_errno = ALPM_ERR_OK;
+	ASSERT(ret != NULL && *ret == NULL, RET_ERR(handle, ALPM_ERR_WRONG_ARGS, -1));
+
+	/* the same databases _alpm_pkg_compute_requiredby() searches */
+	if(db->status & DB_STATUS_LOCAL) {
+		if(load_dependent_lists(db) != 0) {
+			return -1;
+		}
+	} else {
+		for(i = handle->dbs_sync; i; i = i->next) {
+			if(load_dependent_lists(i->data) != 0) {
+				return -1;
+			}
+		}
+	}
+
+	for(i = _alpm_db_get_pkgcache(db); i; i = i->next) {
+		alpm_pkg_revdeps_t *entry;
+
+		CALLOC(entry, 1, sizeof(alpm_pkg_revdeps_t), goto error);
+		entry->pkg = i->data;
+		/* answered from the dependency indexes loaded above */
+		entry->requiredby = _alpm_pkg_compute_requiredby(entry->pkg, 0);
+		if(handle->pm_errno == ALPM_ERR_OK) {
+			entry->optionalfor = _alpm_pkg_compute_requiredby(entry->pkg, 1);
+		}
+		if(handle->pm_errno != ALPM_ERR_OK || alpm_list_append(&revdeps, entry) == NULL) {
+			alpm_pkg_revdeps_free(entry);
+			goto error;
+		}
+	}
+	if(handle->pm_errno != ALPM_ERR_OK) {
+		/* the package cache could not be loaded */
+		return -1;
+	}
+
+	*ret = revdeps;
+	return 0;
+
+error:
+	alpm_list_free_inner(revdeps, (alpm_list_fn_free)alpm_pkg_revdeps_free);
+	alpm_list_free(revdeps);
+	if(handle->pm_errno == ALPM_ERR_OK) {
+		handle->pm_errno = ALPM_ERR_MEMORY;
+	}
+	return -1;
+}
+
+void SYMEXPORT alpm_pkg_revdeps_free(alpm_pkg_revdeps_t *revdeps)
+{
+	ASSERT(revdeps != NULL, return);
+	FREELIST(revdeps->requiredby);
+	FREELIST(revdeps->optionalfor);
+	free(revdeps);
+}
+
+static int owner_cmp(const void *p1, const void *p2)
+{
+	const alpm_fileowner_t *o1 = p1, *o2 = p2;
+	int cmp = strcmp(o1->path, o2->path);
+	if(cmp == 0) {
+		cmp = strcmp(o1->pkg->name, o2->pkg->name);
+	}
+	return cmp;
+}
+
+/* Insert the files of a package added to the package cache into the file
+ * owner cache, if there is one. */
+static int ownercache_add_pkg(alpm_db_t *db, alpm_pkg_t *pkg)
+{
+	alpm_filelist_t *files;
+	alpm_fileowner_t *owners, *added;
+	size_t i, j, k;
+
+	if(!(db->status & DB_STATUS_OWNERCACHE)) {
+		return 0;
+	}
+	if((files = alpm_pkg_get_files(pkg)) == NULL) {
+		return -1;
+	}
+	if(files->count == 0) {
+		return 0;
+	}
+
+	MALLOC(added, files->count * sizeof(alpm_fileowner_t), return -1);
+	for(j = 0; j < files->count; j++) {
+		added[j].path = files->files[j].name;
+		added[j].pkg = pkg;
+	}
+	qsort(added, files->count, sizeof(alpm_fileowner_t), owner_cmp);
+
+	owners = realloc(db->ownercache,
+			(db->ownercache_count + files->count + 1) * sizeof(alpm_fileowner_t));
+	if(owners == NULL) {
+		free(added);
+		return -1;
+	}
+	db->ownercache = owners;
+
+	/* merge from the back, so entries only move into space already free */
+	i = db->ownercache_count;
+	j = files->count;
+	k = i + j;
+	while(j > 0) {
+		if(i > 0 && owner_cmp(owners + i - 1, added + j - 1) > 0) {
+			owners[--k] = owners[--i];
+		} else {
+			owners[--k] = added[--j];
+		}
+	}
+	db->ownercache_count += files->count;
+	free(added);
+
+	/* the file name index points into the owner cache */
+	free_namecache(db);
+	return 0;
+}
+
+/* Drop the entries of a package leaving the package cache from the file
+ * owner cache, if there is one. */
+static void ownercache_remove_pkg(alpm_db_t *db, alpm_pkg_t *pkg)
+{
+	size_t i, k = 0;
+
+	if(!(db->status & DB_STATUS_OWNERCACHE)) {
+		return;
+	}
+	for(i = 0; i < db->ownercache_count; i++) {
+		if(db->ownercache[i].pkg != pkg) {
+			db->ownercache[k++] = db->ownercache[i];
+		}
+	}
+	db->ownercache_count = k;
+	free_namecache(db);
+}
+
 /* "duplicate" pkg then add it to pkgcache */
 int _alpm_db_add_pkgincache(alpm_db_t *db, alpm_pkg_t *pkg)
 {
@@ -640,6 +978,11 @@ int _alpm_db_add_pkgincache(alpm_db_t *db, alpm_pkg_t *pkg)
 	}
 
 	free_groupcache(db);
+	free_depcache(db);
+	if(ownercache_add_pkg(db, newpkg) != 0) {
+		/* rebuilt on the next query instead */
+		free_ownercache(db);
+	}
 
 	return 0;
 }
@@ -663,9 +1006,11 @@ int _alpm_db_remove_pkgfromcache(alpm_db_t *db, alpm_pkg_t *pkg)
 		return -1;
 	}
 
+	ownercache_remove_pkg(db, data);
 	_alpm_pkg_free(data);
 
 	free_groupcache(db);
+	free_depcache(db);
 
 	return 0;
 }
@@ -771,3 +1116,308 @@ alpm_group_t *_alpm_db_get_groupfromcache(alpm_db_t *db, const char *target)
 
 	return NULL;
 }
+
+/* Build the file owner cache from the ownership records of the binary cache
+ * the package cache was populated from, without loading any file list. */
+static int load_ownercache_from_dbcache(alpm_db_t *db)
+{
+	alpm_dbcache_t *cache = db->dbcache;
+	uint64_t n, pkg_count = cache->header->pkg_count;
+	uint64_t owner_count = cache->header->owner_count;
+	alpm_pkg_t **pkgs;
+	alpm_list_t *i;
+
+	if(!(cache->header->fields & DBCACHE_FIELDS_FILES)
+			|| db->status & DB_STATUS_INDEX_DIRTY
+			|| alpm_list_count(db->pkgcache->list) != pkg_count) {
+		return -1;
+	}
+
+	/* the package cache has to mirror the cache records one to one */
+	CALLOC(pkgs, pkg_count + 1, sizeof(alpm_pkg_t *), return -1);
+	for(i = db->pkgcache->list, n = 0; i; i = i->next, n++) {
+		alpm_pkg_t *pkg = i->data;
+		const char *name = _alpm_dbcache_str(cache, cache->pkgs[n].name);
+		const char *version = _alpm_dbcache_str(cache, cache->pkgs[n].version);
+		if(name == NULL || version == NULL || strcmp(name, pkg->name) != 0
+				|| strcmp(version, pkg->version) != 0) {
+			free(pkgs);
+			return -1;
+		}
+		pkgs[n] = pkg;
+	}
+
+	CALLOC(db->ownercache, owner_count + 1, sizeof(alpm_fileowner_t),
+			free(pkgs); return -1);
+	for(n = 0; n < owner_count; n++) {
+		const alpm_dbcache_owner_t *owner = cache->owners + n;
+		const char *path = _alpm_dbcache_str(cache, owner->path);
+		if(path == NULL || owner->pkg >= pkg_count) {
+			FREE(db->ownercache);
+			free(pkgs);
+			return -1;
+		}
+		db->ownercache[n].path = path;
+		db->ownercache[n].pkg = pkgs[owner->pkg];
+	}
+	db->ownercache_count = owner_count;
+	free(pkgs);
+
+	/* the file name index refers to the ownership records by position */
+	if(cache->header->name_count > 0) {
+		uint64_t name_count = cache->header->name_count;
+		MALLOC(db->namecache, name_count * sizeof(alpm_fileowner_t *), return 0);
+		for(n = 0; n < name_count; n++) {
+			if(cache->names[n] >= owner_count) {
+				FREE(db->namecache);
+				return 0;
+			}
+			db->namecache[n] = db->ownercache + cache->names[n];
+		}
+		db->namecache_count = name_count;
+	}
+	db->status |= DB_STATUS_NAMECACHE;
+	return 0;
+}
+
+static int load_ownercache(alpm_db_t *db)
+{
+	alpm_list_t *lp;
+	size_t count = 0, size = 0;
+
+	if(_alpm_db_get_pkgcache_hash(db) == NULL) {
+		return -1;
+	}
+
+	_alpm_log(db->handle, ALPM_LOG_DEBUG, "loading file owner cache for repository '%s'\n",
+			db->treename);
+
+	if(db->dbcache && load_ownercache_from_dbcache(db) == 0) {
+		db->status |= DB_STATUS_OWNERCACHE;
+		return 0;
+	}
+
+	for(lp = db->pkgcache->list; lp; lp = lp->next) {
+		alpm_filelist_t *files = alpm_pkg_get_files(lp->data);
+		if(files) {
+			size += files->count;
+		}
+	}
+	CALLOC(db->ownercache, size + 1, sizeof(alpm_fileowner_t),
+			RET_ERR(db->handle, ALPM_ERR_MEMORY, -1));
+
+	for(lp = db->pkgcache->list; lp; lp = lp->next) {
+		alpm_pkg_t *pkg = lp->data;
+		alpm_filelist_t *files = alpm_pkg_get_files(pkg);
+		size_t i;
+
+		if(files == NULL) {
+			continue;
+		}
+		for(i = 0; i < files->count; i++) {
+			db->ownercache[count].path = files->files[i].name;
+			db->ownercache[count].pkg = pkg;
+			count++;
+		}
+	}
+	if(count > 0) {
+		qsort(db->ownercache, count, sizeof(alpm_fileowner_t), owner_cmp);
+	}
+	db->ownercache_count = count;
+	db->status |= DB_STATUS_OWNERCACHE;
+	return 0;
+}
+
+/* returns the first file owner cache entry for path, or NULL */
+static alpm_fileowner_t *find_first_owner(alpm_db_t *db, const char *path)
+{
+	size_t lo = 0, hi;
+
+	if(!(db->status & DB_STATUS_OWNERCACHE) && load_ownercache(db) != 0) {
+		return NULL;
+	}
+
+	hi = db->ownercache_count;
+	while(lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+		if(strcmp(db->ownercache[mid].path, path) < 0) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+	if(lo < db->ownercache_count && strcmp(db->ownercache[lo].path, path) == 0) {
+		return db->ownercache + lo;
+	}
+	return NULL;
+}
+
+alpm_list_t *_alpm_db_find_file_owners(alpm_db_t *db, const char *path)
+{
+	alpm_fileowner_t *owner, *end;
+	alpm_list_t *owners = NULL;
+
+	if(db == NULL || (owner = find_first_owner(db, path)) == NULL) {
+		return NULL;
+	}
+	end = db->ownercache + db->ownercache_count;
+	for(; owner < end && strcmp(owner->path, path) == 0; owner++) {
+		owners = alpm_list_add(owners, owner->pkg);
+	}
+	return owners;
+}
+
+alpm_pkg_t *_alpm_db_find_file_owner(alpm_db_t *db, const char *path)
+{
+	alpm_fileowner_t *owner;
+
+	if(db == NULL || (owner = find_first_owner(db, path)) == NULL) {
+		return NULL;
+	}
+	return owner->pkg;
+}
+
+static const char *file_basename(const char *path)
+{
+	const char *name = strrchr(path, '/');
+	return name ? name + 1 : path;
+}
+
+static int name_cmp(const void *p1, const void *p2)
+{
+	const alpm_fileowner_t *o1 = *(alpm_fileowner_t * const *)p1;
+	const alpm_fileowner_t *o2 = *(alpm_fileowner_t * const *)p2;
+	int cmp = strcmp(file_basename(o1->path), file_basename(o2->path));
+	if(cmp == 0) {
+		cmp = (o1 > o2) - (o1 < o2);
+	}
+	return cmp;
+}
+
+static int load_namecache(alpm_db_t *db)
+{
+	size_t i, count = 0;
+
+	if(!(db->status & DB_STATUS_OWNERCACHE) && load_ownercache(db) != 0) {
+		return -1;
+	}
+	if(db->status & DB_STATUS_NAMECACHE) {
+		return 0;
+	}
+
+	MALLOC(db->namecache, (db->ownercache_count + 1) * sizeof(alpm_fileowner_t *),
+			RET_ERR(db->handle, ALPM_ERR_MEMORY, -1));
+	for(i = 0; i < db->ownercache_count; i++) {
+		if(*file_basename(db->ownercache[i].path) != '\0') {
+			db->namecache[count++] = db->ownercache + i;
+		}
+	}
+	if(count > 0) {
+		qsort(db->namecache, count, sizeof(alpm_fileowner_t *), name_cmp);
+	}
+	db->namecache_count = count;
+	db->status |= DB_STATUS_NAMECACHE;
+	return 0;
+}
+
+static int filematch_cmp(const void *p1, const void *p2)
+{
+	const alpm_fileowner_t *m1 = p1, *m2 = p2;
+	int cmp = strcmp(m1->pkg->name, m2->pkg->name);
+	if(cmp == 0) {
+		cmp = strcmp(m1->path, m2->path);
+	}
+	return cmp;
+}
+
+static int add_filematch(alpm_list_t **matches, const alpm_fileowner_t *owner)
+{
+	alpm_fileowner_t *match;
+
+	MALLOC(match, sizeof(alpm_fileowner_t), return -1);
+	*match = *owner;
+	if(alpm_list_append(matches, match) == NULL) {
+		free(match);
+		return -1;
+	}
+	return 0;
+}
+
+#define FILE_ENTRY(i) (by_path ? db->ownercache + (i) : db->namecache[(i)])
+#define FILE_KEY(i) (by_path ? FILE_ENTRY(i)->path : file_basename(FILE_ENTRY(i)->path))
+
+/* Search the file owner cache by path or its file name index by name. Both
+ * keep entries with the same key next to each other. */
+alpm_list_t *_alpm_db_find_files(alpm_db_t *db, const char *needle, int flags)
+{
+	alpm_list_t *matches = NULL;
+	const char *key, *prevkey = NULL;
+	regex_t reg;
+	size_t i, lo = 0, hi, count;
+	int match = 0, by_path = flags & ALPM_FILESEARCH_PATH;
+
+	if(by_path) {
+		if(!(db->status & DB_STATUS_OWNERCACHE) && load_ownercache(db) != 0) {
+			return NULL;
+		}
+		count = db->ownercache_count;
+	} else {
+		if(load_namecache(db) != 0) {
+			return NULL;
+		}
+		count = db->namecache_count;
+	}
+
+	if(flags & ALPM_FILESEARCH_REGEX) {
+		if(regcomp(&reg, needle, REG_EXTENDED | REG_NOSUB | REG_ICASE | REG_NEWLINE) != 0) {
+			RET_ERR(db->handle, ALPM_ERR_INVALID_REGEX, NULL);
+		}
+		for(i = 0; i < count; i++) {
+			/* only match each distinct key once */
+			key = FILE_KEY(i);
+			if(prevkey == NULL || strcmp(key, prevkey) != 0) {
+				match = regexec(&reg, key, 0, 0, 0) == 0;
+				prevkey = key;
+			}
+			if(match && add_filematch(&matches, FILE_ENTRY(i)) != 0) {
+				regfree(&reg);
+				goto error;
+			}
+		}
+		regfree(&reg);
+	} else {
+		hi = count;
+		while(lo < hi) {
+			size_t mid = lo + (hi - lo) / 2;
+			if(strcmp(FILE_KEY(mid), needle) < 0) {
+				lo = mid + 1;
+			} else {
+				hi = mid;
+			}
+		}
+		for(i = lo; i < count && strcmp(FILE_KEY(i), needle) == 0; i++) {
+			if(add_filematch(&matches, FILE_ENTRY(i)) != 0) {
+				goto error;
+			}
+		}
+	}
+
+	return alpm_list_msort(matches, alpm_list_count(matches), filematch_cmp);
+
+error:
+	FREELIST(matches);
+	RET_ERR(db->handle, ALPM_ERR_MEMORY, NULL);
+}
+
+#undef FILE_KEY
+#undef FILE_ENTRY
+
+/* Replace the binary cache backing the package cache. Anything pointing
+ * into the old mapping is dropped with it. */
+void _alpm_db_set_dbcache(alpm_db_t *db, alpm_dbcache_t *cache)
+{
+	free_ownercache(db);
+	free_depcache(db);
+	_alpm_dbcache_close(db->dbcache);
+	db->dbcache = cache;
+}
@@ -27,6 +27,7 @@
 #include <archive_entry.h>
 
 #include "alpm.h"
+#include "dbcache.h"
 #include "pkghash.h"
 #include "signing.h"
 
@@ -52,9 +53,32 @@ enum _alpm_dbstatus_t {
 
 	DB_STATUS_LOCAL = (1 << 10),
 	DB_STATUS_PKGCACHE = (1 << 11),
-	DB_STATUS_GRPCACHE = (1 << 12)
+	DB_STATUS_GRPCACHE = (1 << 12),
+	/* local db entries changed since its index was written */
+	DB_STATUS_INDEX_DIRTY = (1 << 13),
+	DB_STATUS_OWNERCACHE = (1 << 14),
+	DB_STATUS_NAMECACHE = (1 << 15),
+	DB_STATUS_PROVIDECACHE = (1 << 16),
+	DB_STATUS_DEPENDCACHE = (1 << 17),
+	DB_STATUS_OPTDEPENDCACHE = (1 << 18)
 };
 
+/** Dependency lists indexed by the package cache */
+typedef enum _alpm_deplist_t {
+	DEPLIST_PROVIDES = 0,
+	DEPLIST_DEPENDS,
+	DEPLIST_OPTDEPENDS,
+	DEPLIST_COUNT
+} alpm_deplist_t;
+
+/* An entry of a dependency list of a package in the package cache */
+typedef struct _alpm_pkgdep_t {
+	alpm_depend_t *dep;
+	alpm_pkg_t *pkg;
+	/* position of pkg in the package cache */
+	size_t index;
+} alpm_pkgdep_t;
+
 struct db_operations {
 	int (*validate) (alpm_db_t *);
 	int (*populate) (alpm_db_t *);
@@ -68,7 +92,19 @@ struct _alpm_db_t {
 	/* do not access directly, use _alpm_db_path(db) for lazy access */
 	char *_path;
 	alpm_pkghash_t *pkgcache;
+	/* binary cache the pkgcache was populated from, if any */
+	alpm_dbcache_t *dbcache;
 	alpm_list_t *grpcache;
+	/* all files of the package cache, sorted by path and then package name */
+	alpm_fileowner_t *ownercache;
+	size_t ownercache_count;
+	/* ownercache entries of everything but directories, sorted by file name */
+	alpm_fileowner_t **namecache;
+	size_t namecache_count;
+	/* dependency lists of the package cache, sorted by name and then
+	 * position, see _alpm_db_find_deps() */
+	alpm_pkgdep_t *depcache[DEPLIST_COUNT];
+	size_t depcache_count[DEPLIST_COUNT];
 	alpm_list_t *cache_servers;
 	alpm_list_t *servers;
 	const struct db_operations *ops;
@@ -99,6 +135,7 @@ void _alpm_db_unregister(alpm_db_t *db);
 int _alpm_local_db_prepare(alpm_db_t *db, alpm_pkg_t *info);
 int _alpm_local_db_write(alpm_db_t *db, alpm_pkg_t *info, int inforeq);
 int _alpm_local_db_remove(alpm_db_t *db, alpm_pkg_t *info);
+int _alpm_local_db_write_index(alpm_db_t *db);
 char *_alpm_local_db_pkgpath(alpm_db_t *db, alpm_pkg_t *info, const char *filename);
 
 /* cache bullshit */
@@ -109,8 +146,16 @@ int _alpm_db_remove_pkgfromcache(alpm_db_t *db, alpm_pkg_t *pkg);
 alpm_pkghash_t *_alpm_db_get_pkgcache_hash(alpm_db_t *db);
 alpm_list_t *_alpm_db_get_pkgcache(alpm_db_t *db);
 alpm_pkg_t *_alpm_db_get_pkgfromcache(alpm_db_t *db, const char *target);
+void _alpm_db_set_dbcache(alpm_db_t *db, alpm_dbcache_t *cache);
 /* groups */
 alpm_list_t *_alpm_db_get_groupcache(alpm_db_t *db);
 alpm_group_t *_alpm_db_get_groupfromcache(alpm_db_t *db, const char *target);
+/* dependency lists */
+int _alpm_db_find_deps(alpm_db_t *db, alpm_deplist_t list,
+		const char *name, alpm_pkgdep_t **entries, size_t *count);
+/* file owners */
+alpm_list_t *_alpm_db_find_file_owners(alpm_db_t *db, const char *path);
+alpm_pkg_t *_alpm_db_find_file_owner(alpm_db_t *db, const char *path);
+alpm_list_t *_alpm_db_find_files(alpm_db_t *db, const char *needle, int flags);
 
 #endif /* ALPM_DB_H */
@@ -0,0 +1,1010 @@
+/*
+ *  dbcache.c
+ *
+ *  Copyright (c) 2024 Pacman Development Team <pacman-dev@lists.archlinux.org>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/* libalpm */
+#include "dbcache.h"
+#include "alpm_list.h"
+#include "backup.h"
+#include "filelist.h"
+#include "handle.h"
+#include "log.h"
+#include "package.h"
+#include "util.h"
+
+/* The cache file is laid out as a header followed by the package records,
+ * the dependency records, the string reference array, the file ownership
+ * records, the file name index and the string table, each starting on an
+ * 8 byte boundary. All integers are stored in host byte order; the cache is
+ * never shared between machines. String offset 0 is reserved to represent
+ * NULL. */
+
+static const char dbcache_magic[8] = "ALPMDBC";
+
+struct _alpm_dbcache_writer_t {
+	int fields;
+	int unsorted;
+
+	alpm_dbcache_pkg_t *pkgs;
+	size_t pkg_count;
+	size_t pkgs_size;
+
+	alpm_dbcache_dep_t *deps;
+	size_t dep_count;
+	size_t deps_size;
+
+	uint64_t *refs;
+	size_t ref_count;
+	size_t refs_size;
+
+	alpm_dbcache_owner_t *owners;
+	size_t owner_count;
+
+	uint64_t *names;
+	size_t name_count;
+
+	char *strtab;
+	size_t strtab_len;
+	size_t strtab_size;
+
+	/* open addressing table of string table offsets, used to store
+	 * repeated strings (dependency names, versions...) only once */
+	uint64_t *strhash;
+	size_t strhash_buckets;
+	size_t strhash_entries;
+};
+
+static uint64_t dbcache_checksum(uint64_t hash, const void *data, size_t len)
+{
+	const unsigned char *p = data;
+	size_t i;
+
+	/* FNV-1a over 64 bit words, all sections are padded to 8 bytes */
+	for(i = 0; i + 8 <= len; i += 8) {
+		uint64_t word;
+		memcpy(&word, p + i, sizeof(word));
+		hash ^= word;
+		hash *= 1099511628211ULL;
+	}
+	return hash;
+}
+
+#define DBCACHE_CHECKSUM_INIT 14695981039346656037ULL
+
+/* grows a buffer geometrically, unlike _alpm_greedy_grow this copes with
+ * requests of more than twice the current size */
+static int dbcache_grow(void **data, size_t *size, size_t required)
+{
+	size_t newsize = *size ? *size : 4096;
+	void *newdata;
+
+	if(*size >= required) {
+		return 1;
+	}
+	while(newsize < required) {
+		if(newsize > SIZE_MAX / 2) {
+			return 0;
+		}
+		newsize *= 2;
+	}
+	newdata = realloc(*data, newsize);
+	if(newdata == NULL) {
+		_alpm_alloc_fail(newsize);
+		return 0;
+	}
+	*data = newdata;
+	*size = newsize;
+	return 1;
+}
+
+static size_t dbcache_pad(size_t len)
+{
+	return (len + 7) & ~(size_t)7;
+}
+
+int _alpm_dbcache_stamp_file(const char *path, alpm_dbcache_stamp_t *stamp,
+		int digest)
+{
+	struct stat buf;
+
+	memset(stamp, 0, sizeof(*stamp));
+	if(stat(path, &buf) != 0) {
+		return -1;
+	}
+	stamp->mtime = buf.st_mtim.tv_sec;
+	stamp->mtime_nsec = buf.st_mtim.tv_nsec;
+	stamp->size = buf.st_size;
+	stamp->ino = buf.st_ino;
+	if(digest && _alpm_sha256_file(path, stamp->digest) != 0) {
+		return -1;
+	}
+	return 0;
+}
+
+/* reader */
+
+static int dbcache_section_valid(const alpm_dbcache_header_t *header,
+		uint64_t offset, uint64_t count, size_t size)
+{
+	if(offset % 8 != 0 || offset < sizeof(alpm_dbcache_header_t)
+			|| offset > header->file_size) {
+		return 0;
+	}
+	if(count > (header->file_size - offset) / size) {
+		return 0;
+	}
+	return 1;
+}
+
+/* Check the stamp of a cache against the file it was generated from. The
+ * file is only hashed if its size, modification time or inode changed. */
+static int dbcache_source_current(alpm_handle_t *handle,
+		const alpm_dbcache_stamp_t *cached, const char *source)
+{
+	alpm_dbcache_stamp_t stamp;
+
+	if(_alpm_dbcache_stamp_file(source, &stamp, 0) != 0) {
+		return 0;
+	}
+	if(stamp.mtime == cached->mtime && stamp.mtime_nsec == cached->mtime_nsec
+			&& stamp.size == cached->size && stamp.ino == cached->ino) {
+		return 1;
+	}
+	if(stamp.size != cached->size || _alpm_sha256_file(source, stamp.digest) != 0) {
+		return 0;
+	}
+	_alpm_log(handle, ALPM_LOG_DEBUG, "%s changed on disk, comparing contents\n", source);
+	return memcmp(stamp.digest, cached->digest, sizeof(stamp.digest)) == 0;
+}
+
+/** Map a binary database cache.
+ * @param handle the context handle
+ * @param path path of the cache file
+ * @param stamp stamp of the data the cache must have been generated from,
+ * ignored if source is given
+ * @param source file the cache must have been generated from, or NULL to
+ * require the stamps to match exactly
+ * @param fields field groups the cache is required to contain
+ * @return the mapped cache, or NULL if it is missing, stale or damaged
+ */
+alpm_dbcache_t *_alpm_dbcache_open(alpm_handle_t *handle, const char *path,
+		const alpm_dbcache_stamp_t *stamp, const char *source, int fields)
+{
+	alpm_dbcache_t *cache = NULL;
+	const alpm_dbcache_header_t *header;
+	struct stat buf;
+	void *map;
+	int fd;
+
+	OPEN(fd, path, O_RDONLY | O_CLOEXEC);
+	if(fd < 0) {
+		return NULL;
+	}
+	if(fstat(fd, &buf) != 0 || buf.st_size < (off_t)sizeof(alpm_dbcache_header_t)) {
+		close(fd);
+		return NULL;
+	}
+	map = mmap(NULL, buf.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if(map == MAP_FAILED) {
+		_alpm_log(handle, ALPM_LOG_DEBUG, "could not map database cache %s: %s\n",
+				path, strerror(errno));
+		return NULL;
+	}
+
+	header = map;
+	if(memcmp(header->magic, dbcache_magic, sizeof(dbcache_magic)) != 0
+			|| header->version != ALPM_DBCACHE_VERSION
+			|| header->file_size != (uint64_t)buf.st_size) {
+		_alpm_log(handle, ALPM_LOG_DEBUG, "ignoring invalid database cache %s\n", path);
+		goto error;
+	}
+	if((header->fields & fields) != fields
+			|| (source ? !dbcache_source_current(handle, &header->stamp, source)
+				: memcmp(&header->stamp, stamp, sizeof(*stamp)) != 0)) {
+		_alpm_log(handle, ALPM_LOG_DEBUG, "ignoring outdated database cache %s\n", path);
+		goto error;
+	}
+	if(!dbcache_section_valid(header, header->pkgs_offset, header->pkg_count,
+				sizeof(alpm_dbcache_pkg_t))
+			|| !dbcache_section_valid(header, header->deps_offset, header->dep_count,
+				sizeof(alpm_dbcache_dep_t))
+			|| !dbcache_section_valid(header, header->refs_offset, header->ref_count,
+				sizeof(uint64_t))
+			|| !dbcache_section_valid(header, header->owners_offset, header->owner_count,
+				sizeof(alpm_dbcache_owner_t))
+			|| !dbcache_section_valid(header, header->names_offset, header->name_count,
+				sizeof(uint64_t))
+			|| !dbcache_section_valid(header, header->strtab_offset, header->strtab_size, 1)
+			|| header->strtab_size == 0
+			|| ((const char *)map)[header->strtab_offset + header->strtab_size - 1] != '\0') {
+		_alpm_log(handle, ALPM_LOG_DEBUG, "ignoring invalid database cache %s\n", path);
+		goto error;
+	}
+	if(dbcache_checksum(DBCACHE_CHECKSUM_INIT, (const char *)map + sizeof(*header),
+				header->file_size - sizeof(*header)) != header->checksum) {
+		_alpm_log(handle, ALPM_LOG_DEBUG, "ignoring corrupted database cache %s\n", path);
+		goto error;
+	}
+
+	CALLOC(cache, 1, sizeof(alpm_dbcache_t), goto error);
+	cache->map = map;
+	cache->map_size = buf.st_size;
+	cache->header = header;
+	cache->pkgs = (const void *)((const char *)map + header->pkgs_offset);
+	cache->deps = (const void *)((const char *)map + header->deps_offset);
+	cache->refs = (const void *)((const char *)map + header->refs_offset);
+	cache->owners = (const void *)((const char *)map + header->owners_offset);
+	cache->names = (const void *)((const char *)map + header->names_offset);
+	cache->strtab = (const char *)map + header->strtab_offset;
+
+	_alpm_log(handle, ALPM_LOG_DEBUG, "using database cache %s (%ju packages)\n",
+			path, (uintmax_t)header->pkg_count);
+	return cache;
+
+error:
+	munmap(map, buf.st_size);
+	return NULL;
+}
+
+void _alpm_dbcache_close(alpm_dbcache_t *cache)
+{
+	if(cache == NULL) {
+		return;
+	}
+	munmap(cache->map, cache->map_size);
+	free(cache);
+}
+
+/** Look up a string of a cache.
+ * @param cache the mapped cache
+ * @param offset offset of the string in the string table
+ * @return the string, or NULL for offset 0 or an invalid offset
+ */
+const char *_alpm_dbcache_str(alpm_dbcache_t *cache, uint64_t offset)
+{
+	if(offset == 0 || offset >= cache->header->strtab_size) {
+		return NULL;
+	}
+	return cache->strtab + offset;
+}
+
+static int dbcache_range_valid(const alpm_dbcache_range_t *range, uint64_t max)
+{
+	return range->first <= max && range->count <= max - range->first;
+}
+
+/** Look up the record of a package by name.
+ * @param cache the mapped cache
+ * @param name the package name
+ * @return the package record, or NULL if it is not in the cache
+ */
+const alpm_dbcache_pkg_t *_alpm_dbcache_find(alpm_dbcache_t *cache,
+		const char *name)
+{
+	uint64_t lo = 0, hi = cache->header->pkg_count;
+
+	/* records are sorted by package name */
+	while(lo < hi) {
+		uint64_t mid = lo + (hi - lo) / 2;
+		const char *recname = _alpm_dbcache_str(cache, cache->pkgs[mid].name);
+		int cmp;
+
+		if(recname == NULL) {
+			return NULL;
+		}
+		cmp = strcmp(name, recname);
+		if(cmp == 0) {
+			return cache->pkgs + mid;
+		} else if(cmp < 0) {
+			hi = mid;
+		} else {
+			lo = mid + 1;
+		}
+	}
+	return NULL;
+}
+
+static int dbcache_read_strlist(alpm_dbcache_t *cache,
+		const alpm_dbcache_range_t *range, alpm_list_t **list)
+{
+	uint64_t i;
+
+	if(!dbcache_range_valid(range, cache->header->ref_count)) {
+		return -1;
+	}
+	for(i = 0; i < range->count; i++) {
+		const char *str = _alpm_dbcache_str(cache, cache->refs[range->first + i]);
+		char *dup;
+		STRDUP(dup, str, return -1);
+		if(dup == NULL || alpm_list_append(list, dup) == NULL) {
+			free(dup);
+			return -1;
+		}
+	}
+	return 0;
+}
+
+static int dbcache_read_deplist(alpm_dbcache_t *cache,
+		const alpm_dbcache_range_t *range, alpm_list_t **list)
+{
+	uint64_t i;
+
+	if(!dbcache_range_valid(range, cache->header->dep_count)) {
+		return -1;
+	}
+	for(i = 0; i < range->count; i++) {
+		const alpm_dbcache_dep_t *rec = cache->deps + range->first + i;
+		alpm_depend_t *dep;
+
+		CALLOC(dep, 1, sizeof(alpm_depend_t), return -1);
+		STRDUP(dep->name, _alpm_dbcache_str(cache, rec->name), goto error);
+		STRDUP(dep->version, _alpm_dbcache_str(cache, rec->version), goto error);
+		STRDUP(dep->desc, _alpm_dbcache_str(cache, rec->desc), goto error);
+		dep->name_hash = rec->name_hash;
+		dep->mod = rec->mod;
+		if(dep->name == NULL || alpm_list_append(list, dep) == NULL) {
+			goto error;
+		}
+		continue;
+error:
+		alpm_dep_free(dep);
+		return -1;
+	}
+	return 0;
+}
+
+static int dbcache_read_files(alpm_dbcache_t *cache,
+		const alpm_dbcache_range_t *range, alpm_filelist_t *filelist)
+{
+	alpm_file_t *files;
+	uint64_t i;
+
+	if(!dbcache_range_valid(range, cache->header->ref_count)) {
+		return -1;
+	}
+	if(range->count == 0) {
+		return 0;
+	}
+	CALLOC(files, range->count, sizeof(alpm_file_t), return -1);
+	for(i = 0; i < range->count; i++) {
+		const char *name = _alpm_dbcache_str(cache, cache->refs[range->first + i]);
+		STRDUP(files[i].name, name, goto error);
+		if(files[i].name == NULL) {
+			goto error;
+		}
+	}
+	filelist->files = files;
+	filelist->count = range->count;
+	_alpm_filelist_sort(filelist);
+	return 0;
+
+error:
+	while(i > 0) {
+		free(files[--i].name);
+	}
+	free(files);
+	return -1;
+}
+
+static int dbcache_read_backup(alpm_dbcache_t *cache,
+		const alpm_dbcache_range_t *range, alpm_list_t **list)
+{
+	uint64_t i;
+
+	/* backup entries are stored as name/hash reference pairs */
+	if(!dbcache_range_valid(range, cache->header->ref_count) || range->count % 2) {
+		return -1;
+	}
+	for(i = 0; i < range->count; i += 2) {
+		alpm_backup_t *backup;
+		CALLOC(backup, 1, sizeof(alpm_backup_t), return -1);
+		STRDUP(backup->name, _alpm_dbcache_str(cache, cache->refs[range->first + i]),
+				_alpm_backup_free(backup); return -1);
+		STRDUP(backup->hash, _alpm_dbcache_str(cache, cache->refs[range->first + i + 1]),
+				_alpm_backup_free(backup); return -1);
+		if(backup->name == NULL || alpm_list_append(list, backup) == NULL) {
+			_alpm_backup_free(backup);
+			return -1;
+		}
+	}
+	return 0;
+}
+
+static int dbcache_read_xdata(alpm_dbcache_t *cache,
+		const alpm_dbcache_range_t *range, alpm_list_t **list)
+{
+	alpm_list_t *i, *lines = NULL;
+	int ret = 0;
+
+	if(dbcache_read_strlist(cache, range, &lines) != 0) {
+		FREELIST(lines);
+		return -1;
+	}
+	for(i = lines; i; i = i->next) {
+		alpm_pkg_xdata_t *pd = _alpm_pkg_parse_xdata(i->data);
+		if(pd == NULL || !alpm_list_append(list, pd)) {
+			_alpm_pkg_xdata_free(pd);
+			ret = -1;
+			break;
+		}
+	}
+	FREELIST(lines);
+	return ret;
+}
+
+#define READ_STR(f) do { \
+	STRDUP(pkg->f, _alpm_dbcache_str(cache, rec->f), return -1); \
+} while(0)
+
+/** Fill in package fields from a cache record.
+ * @param cache the mapped cache
+ * @param rec the package record
+ * @param pkg the package to fill in
+ * @param fields bitfield of alpm_dbcache_fields_t to read
+ * @return 0 on success, -1 on error
+ */
+int _alpm_dbcache_read_pkg(alpm_dbcache_t *cache,
+		const alpm_dbcache_pkg_t *rec, alpm_pkg_t *pkg, int fields)
+{
+	if(pkg->name == NULL) {
+		READ_STR(name);
+		READ_STR(version);
+		if(pkg->name == NULL || pkg->version == NULL) {
+			return -1;
+		}
+		pkg->name_hash = rec->name_hash;
+	}
+
+	if(fields & DBCACHE_FIELDS_META) {
+		READ_STR(filename);
+		READ_STR(md5sum);
+		READ_STR(sha256sum);
+		READ_STR(base64_sig);
+		READ_STR(arch);
+		pkg->size = rec->size;
+		pkg->isize = rec->isize;
+		if(dbcache_read_strlist(cache, &rec->groups, &pkg->groups) != 0
+				|| dbcache_read_deplist(cache, &rec->replaces, &pkg->replaces) != 0
+				|| dbcache_read_deplist(cache, &rec->depends, &pkg->depends) != 0
+				|| dbcache_read_deplist(cache, &rec->optdepends, &pkg->optdepends) != 0
+				|| dbcache_read_deplist(cache, &rec->makedepends, &pkg->makedepends) != 0
+				|| dbcache_read_deplist(cache, &rec->checkdepends, &pkg->checkdepends) != 0
+				|| dbcache_read_deplist(cache, &rec->conflicts, &pkg->conflicts) != 0
+				|| dbcache_read_deplist(cache, &rec->provides, &pkg->provides) != 0) {
+			return -1;
+		}
+	}
+
+	if(fields & DBCACHE_FIELDS_DESC) {
+		READ_STR(base);
+		READ_STR(desc);
+		READ_STR(url);
+		READ_STR(packager);
+		pkg->builddate = rec->builddate;
+		pkg->installdate = rec->installdate;
+		pkg->reason = rec->reason;
+		pkg->validation = rec->validation;
+		pkg->scriptlet = rec->scriptlet;
+		if(dbcache_read_strlist(cache, &rec->licenses, &pkg->licenses) != 0
+				|| dbcache_read_xdata(cache, &rec->xdata, &pkg->xdata) != 0) {
+			return -1;
+		}
+	}
+
+	if(fields & DBCACHE_FIELDS_FILES) {
+		if(dbcache_read_files(cache, &rec->files, &pkg->files) != 0
+				|| dbcache_read_backup(cache, &rec->backup, &pkg->backup) != 0) {
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+#undef READ_STR
+
+/* writer */
+
+alpm_dbcache_writer_t *_alpm_dbcache_writer_new(int fields)
+{
+	alpm_dbcache_writer_t *writer;
+
+	CALLOC(writer, 1, sizeof(alpm_dbcache_writer_t), return NULL);
+	writer->fields = fields;
+
+	/* offset 0 of the string table is the NULL string */
+	MALLOC(writer->strtab, 4096, free(writer); return NULL);
+	writer->strtab_size = 4096;
+	writer->strtab[0] = '\0';
+	writer->strtab_len = 1;
+
+	return writer;
+}
+
+void _alpm_dbcache_writer_free(alpm_dbcache_writer_t *writer)
+{
+	if(writer == NULL) {
+		return;
+	}
+	free(writer->pkgs);
+	free(writer->deps);
+	free(writer->refs);
+	free(writer->owners);
+	free(writer->names);
+	free(writer->strtab);
+	free(writer->strhash);
+	free(writer);
+}
+
+static int dbcache_strhash_grow(alpm_dbcache_writer_t *writer)
+{
+	uint64_t *old = writer->strhash;
+	size_t i, old_buckets = writer->strhash_buckets;
+	size_t buckets = old_buckets ? old_buckets * 2 : 4096;
+
+	CALLOC(writer->strhash, buckets, sizeof(uint64_t),
+			writer->strhash = old; return -1);
+	writer->strhash_buckets = buckets;
+	for(i = 0; i < old_buckets; i++) {
+		if(old[i]) {
+			size_t pos = _alpm_hash_sdbm(writer->strtab + old[i]) & (buckets - 1);
+			while(writer->strhash[pos]) {
+				pos = (pos + 1) & (buckets - 1);
+			}
+			writer->strhash[pos] = old[i];
+		}
+	}
+	free(old);
+	return 0;
+}
+
+/* returns the string table offset of str, adding it if needed */
+static int dbcache_intern(alpm_dbcache_writer_t *writer, const char *str,
+		uint64_t *offset)
+{
+	size_t pos, len;
+
+	if(str == NULL) {
+		*offset = 0;
+		return 0;
+	}
+	if((writer->strhash_entries + 1) * 2 > writer->strhash_buckets
+			&& dbcache_strhash_grow(writer) != 0) {
+		return -1;
+	}
+
+	pos = _alpm_hash_sdbm(str) & (writer->strhash_buckets - 1);
+	while(writer->strhash[pos]) {
+		if(strcmp(writer->strtab + writer->strhash[pos], str) == 0) {
+			*offset = writer->strhash[pos];
+			return 0;
+		}
+		pos = (pos + 1) & (writer->strhash_buckets - 1);
+	}
+
+	len = strlen(str) + 1;
+	if(!dbcache_grow((void **)&writer->strtab, &writer->strtab_size,
+				writer->strtab_len + len)) {
+		return -1;
+	}
+	memcpy(writer->strtab + writer->strtab_len, str, len);
+	*offset = writer->strtab_len;
+	writer->strtab_len += len;
+	writer->strhash[pos] = *offset;
+	writer->strhash_entries++;
+	return 0;
+}
+
+static int dbcache_add_ref(alpm_dbcache_writer_t *writer, const char *str)
+{
+	uint64_t offset;
+
+	if(dbcache_intern(writer, str, &offset) != 0
+			|| !dbcache_grow((void **)&writer->refs, &writer->refs_size,
+				(writer->ref_count + 1) * sizeof(uint64_t))) {
+		return -1;
+	}
+	writer->refs[writer->ref_count++] = offset;
+	return 0;
+}
+
+static int dbcache_add_strlist(alpm_dbcache_writer_t *writer,
+		alpm_list_t *list, alpm_dbcache_range_t *range)
+{
+	range->first = writer->ref_count;
+	for(; list; list = list->next) {
+		if(dbcache_add_ref(writer, list->data) != 0) {
+			return -1;
+		}
+	}
+	range->count = writer->ref_count - range->first;
+	return 0;
+}
+
+static int dbcache_add_deplist(alpm_dbcache_writer_t *writer,
+		alpm_list_t *list, alpm_dbcache_range_t *range)
+{
+	range->first = writer->dep_count;
+	for(; list; list = list->next) {
+		alpm_depend_t *dep = list->data;
+		alpm_dbcache_dep_t *rec;
+
+		if(!dbcache_grow((void **)&writer->deps, &writer->deps_size,
+					(writer->dep_count + 1) * sizeof(alpm_dbcache_dep_t))) {
+			return -1;
+		}
+		rec = writer->deps + writer->dep_count;
+		memset(rec, 0, sizeof(*rec));
+		if(dbcache_intern(writer, dep->name, &rec->name) != 0
+				|| dbcache_intern(writer, dep->version, &rec->version) != 0
+				|| dbcache_intern(writer, dep->desc, &rec->desc) != 0) {
+			return -1;
+		}
+		rec->name_hash = dep->name_hash;
+		rec->mod = dep->mod;
+		writer->dep_count++;
+	}
+	range->count = writer->dep_count - range->first;
+	return 0;
+}
+
+#define ADD_STR(f) do { \
+	if(dbcache_intern(writer, pkg->f, &rec.f) != 0) return -1; \
+} while(0)
+
+/** Append a package to a cache being written.
+ * Packages must be added in order of their names and must have all field
+ * groups the writer was created for loaded.
+ * @param writer the cache writer
+ * @param pkg the package to add
+ * @return 0 on success, -1 on error
+ */
+int _alpm_dbcache_writer_add(alpm_dbcache_writer_t *writer, alpm_pkg_t *pkg)
+{
+	alpm_dbcache_pkg_t rec;
+	alpm_list_t *i;
+
+	memset(&rec, 0, sizeof(rec));
+
+	if(writer->pkg_count > 0) {
+		const char *prev = writer->strtab + writer->pkgs[writer->pkg_count - 1].name;
+		if(strcmp(prev, pkg->name) >= 0) {
+			writer->unsorted = 1;
+		}
+	}
+
+	ADD_STR(name);
+	ADD_STR(version);
+	rec.name_hash = pkg->name_hash;
+
+	if(writer->fields & DBCACHE_FIELDS_META) {
+		ADD_STR(filename);
+		ADD_STR(md5sum);
+		ADD_STR(sha256sum);
+		ADD_STR(base64_sig);
+		ADD_STR(arch);
+		rec.size = pkg->size;
+		rec.isize = pkg->isize;
+		if(dbcache_add_strlist(writer, pkg->groups, &rec.groups) != 0
+				|| dbcache_add_deplist(writer, pkg->replaces, &rec.replaces) != 0
+				|| dbcache_add_deplist(writer, pkg->depends, &rec.depends) != 0
+				|| dbcache_add_deplist(writer, pkg->optdepends, &rec.optdepends) != 0
+				|| dbcache_add_deplist(writer, pkg->makedepends, &rec.makedepends) != 0
+				|| dbcache_add_deplist(writer, pkg->checkdepends, &rec.checkdepends) != 0
+				|| dbcache_add_deplist(writer, pkg->conflicts, &rec.conflicts) != 0
+				|| dbcache_add_deplist(writer, pkg->provides, &rec.provides) != 0) {
+			return -1;
+		}
+	}
+
+	if(writer->fields & DBCACHE_FIELDS_DESC) {
+		ADD_STR(base);
+		ADD_STR(desc);
+		ADD_STR(url);
+		ADD_STR(packager);
+		rec.builddate = pkg->builddate;
+		rec.installdate = pkg->installdate;
+		rec.reason = pkg->reason;
+		rec.validation = pkg->validation;
+		rec.scriptlet = pkg->scriptlet;
+		if(dbcache_add_strlist(writer, pkg->licenses, &rec.licenses) != 0) {
+			return -1;
+		}
+		rec.xdata.first = writer->ref_count;
+		for(i = pkg->xdata; i; i = i->next) {
+			alpm_pkg_xdata_t *pd = i->data;
+			size_t len = strlen(pd->name) + strlen(pd->value) + 2;
+			char *line;
+			int ret;
+
+			MALLOC(line, len, return -1);
+			snprintf(line, len, "%s=%s", pd->name, pd->value);
+			ret = dbcache_add_ref(writer, line);
+			free(line);
+			if(ret != 0) {
+				return -1;
+			}
+		}
+		rec.xdata.count = writer->ref_count - rec.xdata.first;
+	}
+
+	if(writer->fields & DBCACHE_FIELDS_FILES) {
+		size_t f;
+		rec.files.first = writer->ref_count;
+		for(f = 0; f < pkg->files.count; f++) {
+			if(dbcache_add_ref(writer, pkg->files.files[f].name) != 0) {
+				return -1;
+			}
+		}
+		rec.files.count = writer->ref_count - rec.files.first;
+		rec.backup.first = writer->ref_count;
+		for(i = pkg->backup; i; i = i->next) {
+			alpm_backup_t *backup = i->data;
+			if(dbcache_add_ref(writer, backup->name) != 0
+					|| dbcache_add_ref(writer, backup->hash) != 0) {
+				return -1;
+			}
+		}
+		rec.backup.count = writer->ref_count - rec.backup.first;
+	}
+
+	if(!dbcache_grow((void **)&writer->pkgs, &writer->pkgs_size,
+				(writer->pkg_count + 1) * sizeof(alpm_dbcache_pkg_t))) {
+		return -1;
+	}
+	writer->pkgs[writer->pkg_count++] = rec;
+	return 0;
+}
+
+#undef ADD_STR
+
+struct owner_sort_t {
+	const char *path;
+	uint64_t offset;
+	uint64_t pkg;
+};
+
+static int owner_sort_cmp(const void *p1, const void *p2)
+{
+	const struct owner_sort_t *o1 = p1, *o2 = p2;
+	int cmp = strcmp(o1->path, o2->path);
+	if(cmp == 0) {
+		cmp = (o1->pkg > o2->pkg) - (o1->pkg < o2->pkg);
+	}
+	return cmp;
+}
+
+/* build the table mapping every file path to the packages owning it */
+static int dbcache_build_owners(alpm_dbcache_writer_t *writer)
+{
+	struct owner_sort_t *entries;
+	size_t i, count = 0;
+
+	for(i = 0; i < writer->pkg_count; i++) {
+		count += writer->pkgs[i].files.count;
+	}
+	if(count == 0) {
+		return 0;
+	}
+
+	MALLOC(entries, count * sizeof(struct owner_sort_t), return -1);
+	MALLOC(writer->owners, count * sizeof(alpm_dbcache_owner_t),
+			free(entries); return -1);
+	count = 0;
+	for(i = 0; i < writer->pkg_count; i++) {
+		const alpm_dbcache_range_t *files = &writer->pkgs[i].files;
+		uint64_t f;
+		for(f = 0; f < files->count; f++) {
+			entries[count].offset = writer->refs[files->first + f];
+			entries[count].path = writer->strtab + entries[count].offset;
+			entries[count].pkg = i;
+			count++;
+		}
+	}
+	qsort(entries, count, sizeof(struct owner_sort_t), owner_sort_cmp);
+	for(i = 0; i < count; i++) {
+		writer->owners[i].path = entries[i].offset;
+		writer->owners[i].pkg = entries[i].pkg;
+	}
+	writer->owner_count = count;
+	free(entries);
+	return 0;
+}
+
+struct name_sort_t {
+	const char *name;
+	uint64_t owner;
+};
+
+static int name_sort_cmp(const void *p1, const void *p2)
+{
+	const struct name_sort_t *n1 = p1, *n2 = p2;
+	int cmp = strcmp(n1->name, n2->name);
+	if(cmp == 0) {
+		cmp = (n1->owner > n2->owner) - (n1->owner < n2->owner);
+	}
+	return cmp;
+}
+
+/* build the index of ownership records by file name */
+static int dbcache_build_names(alpm_dbcache_writer_t *writer)
+{
+	struct name_sort_t *entries;
+	size_t i, count = 0;
+
+	if(writer->owner_count == 0) {
+		return 0;
+	}
+
+	MALLOC(entries, writer->owner_count * sizeof(struct name_sort_t), return -1);
+	for(i = 0; i < writer->owner_count; i++) {
+		const char *path = writer->strtab + writer->owners[i].path;
+		const char *name = strrchr(path, '/');
+		name = name ? name + 1 : path;
+		if(*name) {
+			entries[count].name = name;
+			entries[count].owner = i;
+			count++;
+		}
+	}
+	if(count == 0) {
+		free(entries);
+		return 0;
+	}
+	MALLOC(writer->names, count * sizeof(uint64_t), free(entries); return -1);
+	qsort(entries, count, sizeof(struct name_sort_t), name_sort_cmp);
+	for(i = 0; i < count; i++) {
+		writer->names[i] = entries[i].owner;
+	}
+	writer->name_count = count;
+	free(entries);
+	return 0;
+}
+
+/** Write a cache to disk. The file is replaced atomically.
+ * @param writer the cache writer
+ * @param handle the context handle
+ * @param path path of the cache file
+ * @param stamp stamp of the data the cache was generated from
+ * @return 0 on success, -1 on error
+ */
+int _alpm_dbcache_writer_commit(alpm_dbcache_writer_t *writer,
+		alpm_handle_t *handle, const char *path,
+		const alpm_dbcache_stamp_t *stamp)
+{
+	alpm_dbcache_header_t header;
+	size_t strtab_padded, tmplen;
+	char *tmppath = NULL;
+	FILE *fp = NULL;
+	int fd;
+	uint64_t checksum = DBCACHE_CHECKSUM_INIT;
+
+	if(writer->unsorted) {
+		_alpm_log(handle, ALPM_LOG_DEBUG,
+				"not writing database cache %s: packages are not sorted\n", path);
+		return -1;
+	}
+
+	if(writer->fields & DBCACHE_FIELDS_FILES && writer->owners == NULL
+			&& (dbcache_build_owners(writer) != 0
+				|| dbcache_build_names(writer) != 0)) {
+		return -1;
+	}
+
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, dbcache_magic, sizeof(dbcache_magic));
+	header.version = ALPM_DBCACHE_VERSION;
+	header.fields = writer->fields;
+	header.stamp = *stamp;
+	header.pkg_count = writer->pkg_count;
+	header.pkgs_offset = sizeof(header);
+	header.dep_count = writer->dep_count;
+	header.deps_offset = header.pkgs_offset + writer->pkg_count * sizeof(alpm_dbcache_pkg_t);
+	header.ref_count = writer->ref_count;
+	header.refs_offset = header.deps_offset + writer->dep_count * sizeof(alpm_dbcache_dep_t);
+	header.owner_count = writer->owner_count;
+	header.owners_offset = header.refs_offset + writer->ref_count * sizeof(uint64_t);
+	header.name_count = writer->name_count;
+	header.names_offset = header.owners_offset
+		+ writer->owner_count * sizeof(alpm_dbcache_owner_t);
+	header.strtab_size = writer->strtab_len;
+	header.strtab_offset = header.names_offset + writer->name_count * sizeof(uint64_t);
+	strtab_padded = dbcache_pad(writer->strtab_len);
+	header.file_size = header.strtab_offset + strtab_padded;
+
+	/* the string table buffer always has room for the padding */
+	if(!dbcache_grow((void **)&writer->strtab, &writer->strtab_size,
+				strtab_padded)) {
+		return -1;
+	}
+	memset(writer->strtab + writer->strtab_len, 0, strtab_padded - writer->strtab_len);
+
+	checksum = dbcache_checksum(checksum, writer->pkgs,
+			writer->pkg_count * sizeof(alpm_dbcache_pkg_t));
+	checksum = dbcache_checksum(checksum, writer->deps,
+			writer->dep_count * sizeof(alpm_dbcache_dep_t));
+	checksum = dbcache_checksum(checksum, writer->refs,
+			writer->ref_count * sizeof(uint64_t));
+	checksum = dbcache_checksum(checksum, writer->owners,
+			writer->owner_count * sizeof(alpm_dbcache_owner_t));
+	checksum = dbcache_checksum(checksum, writer->names,
+			writer->name_count * sizeof(uint64_t));
+	checksum = dbcache_checksum(checksum, writer->strtab, strtab_padded);
+	header.checksum = checksum;
+
+	tmplen = strlen(path) + 8;
+	MALLOC(tmppath, tmplen, RET_ERR(handle, ALPM_ERR_MEMORY, -1));
+	snprintf(tmppath, tmplen, "%s.XXXXXX", path);
+
+	/* the cache is read by unprivileged processes as well */
+	if((fd = mkstemp(tmppath)) < 0 || fchmod(fd, 0644) != 0
+			|| (fp = fdopen(fd, "wb")) == NULL) {
+		_alpm_log(handle, ALPM_LOG_DEBUG, "could not create database cache %s: %s\n",
+				tmppath, strerror(errno));
+		if(fd >= 0) {
+			close(fd);
+			unlink(tmppath);
+		}
+		free(tmppath);
+		return -1;
+	}
+	if(fwrite(&header, sizeof(header), 1, fp) != 1
+			|| (writer->pkg_count && fwrite(writer->pkgs, sizeof(alpm_dbcache_pkg_t),
+					writer->pkg_count, fp) != writer->pkg_count)
+			|| (writer->dep_count && fwrite(writer->deps, sizeof(alpm_dbcache_dep_t),
+					writer->dep_count, fp) != writer->dep_count)
+			|| (writer->ref_count && fwrite(writer->refs, sizeof(uint64_t),
+					writer->ref_count, fp) != writer->ref_count)
+			|| (writer->owner_count && fwrite(writer->owners, sizeof(alpm_dbcache_owner_t),
+					writer->owner_count, fp) != writer->owner_count)
+			|| (writer->name_count && fwrite(writer->names, sizeof(uint64_t),
+					writer->name_count, fp) != writer->name_count)
+			|| fwrite(writer->strtab, 1, strtab_padded, fp) != strtab_padded) {
+		_alpm_log(handle, ALPM_LOG_DEBUG, "could not write database cache %s: %s\n",
+				tmppath, strerror(errno));
+		fclose(fp);
+		goto error;
+	}
+	if(fclose(fp) != 0) {
+		goto error;
+	}
+	if(rename(tmppath, path) != 0) {
+		_alpm_log(handle, ALPM_LOG_DEBUG, "could not rename %s to %s: %s\n",
+				tmppath, path, strerror(errno));
+		goto error;
+	}
+
+	_alpm_log(handle, ALPM_LOG_DEBUG, "wrote database cache %s (%zu packages)\n",
+			path, writer->pkg_count);
+	free(tmppath);
+	return 0;
+
+error:
+	unlink(tmppath);
+	free(tmppath);
+	return -1;
+}
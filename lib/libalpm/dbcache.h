@@ -0,0 +1,175 @@
+/*
+ *  dbcache.h
+ *
+ *  Copyright (c) 2024 Pacman Development Team <pacman-dev@lists.archlinux.org>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef ALPM_DBCACHE_H
+#define ALPM_DBCACHE_H
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#include "alpm.h"
+
+/* binary database cache format version */
+#define ALPM_DBCACHE_VERSION 4
+
+/** Groups of package fields stored in a cache record. */
+typedef enum _alpm_dbcache_fields_t {
+	/** filename, checksums, signature, arch, sizes, groups and all
+	 * dependency lists; everything needed to resolve and fetch a package */
+	DBCACHE_FIELDS_META = (1 << 0),
+	/** base, description, url, packager, dates, reason, validation,
+	 * licenses, extended data and scriptlet flag */
+	DBCACHE_FIELDS_DESC = (1 << 1),
+	/** file list and backup entries */
+	DBCACHE_FIELDS_FILES = (1 << 2),
+	DBCACHE_FIELDS_ALL = DBCACHE_FIELDS_META | DBCACHE_FIELDS_DESC |
+		DBCACHE_FIELDS_FILES
+} alpm_dbcache_fields_t;
+
+/** Identifies the data a cache was generated from. A cache is only
+ * used if the stamp stored in it matches the current source, see
+ * _alpm_dbcache_open(). */
+typedef struct _alpm_dbcache_stamp_t {
+	int64_t mtime;
+	int64_t mtime_nsec;
+	uint64_t size;
+	uint64_t ino;
+	unsigned char digest[32];
+} alpm_dbcache_stamp_t;
+
+/** A slice of one of the record arrays */
+typedef struct _alpm_dbcache_range_t {
+	uint64_t first;
+	uint64_t count;
+} alpm_dbcache_range_t;
+
+/** On-disk dependency record; strings are string table offsets */
+typedef struct _alpm_dbcache_dep_t {
+	uint64_t name;
+	uint64_t version;
+	uint64_t desc;
+	uint64_t name_hash;
+	uint32_t mod;
+	uint32_t pad;
+} alpm_dbcache_dep_t;
+
+/** On-disk package record; strings are string table offsets, lists of
+ * strings are ranges in the reference array, dependency lists are ranges
+ * in the dependency array */
+typedef struct _alpm_dbcache_pkg_t {
+	uint64_t name;
+	uint64_t version;
+	uint64_t name_hash;
+	uint64_t filename;
+	uint64_t base;
+	uint64_t desc;
+	uint64_t url;
+	uint64_t packager;
+	uint64_t md5sum;
+	uint64_t sha256sum;
+	uint64_t base64_sig;
+	uint64_t arch;
+	int64_t builddate;
+	int64_t installdate;
+	int64_t size;
+	int64_t isize;
+	uint32_t reason;
+	uint32_t validation;
+	uint32_t scriptlet;
+	uint32_t pad;
+	alpm_dbcache_range_t licenses;
+	alpm_dbcache_range_t groups;
+	alpm_dbcache_range_t xdata;
+	alpm_dbcache_range_t backup;
+	alpm_dbcache_range_t files;
+	alpm_dbcache_range_t replaces;
+	alpm_dbcache_range_t depends;
+	alpm_dbcache_range_t optdepends;
+	alpm_dbcache_range_t makedepends;
+	alpm_dbcache_range_t checkdepends;
+	alpm_dbcache_range_t conflicts;
+	alpm_dbcache_range_t provides;
+} alpm_dbcache_pkg_t;
+
+/** On-disk file ownership record, sorted by path and then package index.
+ * Only present in caches holding file lists. */
+typedef struct _alpm_dbcache_owner_t {
+	uint64_t path;
+	uint64_t pkg;
+} alpm_dbcache_owner_t;
+
+/* The file name index is an array of indexes into the ownership records,
+ * sorted by the last path component and then by index. Directories are
+ * not part of it. */
+
+typedef struct _alpm_dbcache_header_t {
+	char magic[8];
+	uint32_t version;
+	uint32_t fields;
+	alpm_dbcache_stamp_t stamp;
+	uint64_t checksum;
+	uint64_t file_size;
+	uint64_t pkg_count;
+	uint64_t pkgs_offset;
+	uint64_t dep_count;
+	uint64_t deps_offset;
+	uint64_t ref_count;
+	uint64_t refs_offset;
+	uint64_t owner_count;
+	uint64_t owners_offset;
+	uint64_t name_count;
+	uint64_t names_offset;
+	uint64_t strtab_size;
+	uint64_t strtab_offset;
+} alpm_dbcache_header_t;
+
+/** A read-only, memory mapped binary database cache */
+typedef struct _alpm_dbcache_t {
+	void *map;
+	size_t map_size;
+	const alpm_dbcache_header_t *header;
+	const alpm_dbcache_pkg_t *pkgs;
+	const alpm_dbcache_dep_t *deps;
+	const uint64_t *refs;
+	const alpm_dbcache_owner_t *owners;
+	const uint64_t *names;
+	const char *strtab;
+} alpm_dbcache_t;
+
+typedef struct _alpm_dbcache_writer_t alpm_dbcache_writer_t;
+
+alpm_dbcache_t *_alpm_dbcache_open(alpm_handle_t *handle, const char *path,
+		const alpm_dbcache_stamp_t *stamp, const char *source, int fields);
+void _alpm_dbcache_close(alpm_dbcache_t *cache);
+const char *_alpm_dbcache_str(alpm_dbcache_t *cache, uint64_t offset);
+const alpm_dbcache_pkg_t *_alpm_dbcache_find(alpm_dbcache_t *cache,
+		const char *name);
+int _alpm_dbcache_read_pkg(alpm_dbcache_t *cache,
+		const alpm_dbcache_pkg_t *rec, alpm_pkg_t *pkg, int fields);
+
+alpm_dbcache_writer_t *_alpm_dbcache_writer_new(int fields);
+int _alpm_dbcache_writer_add(alpm_dbcache_writer_t *writer, alpm_pkg_t *pkg);
+int _alpm_dbcache_writer_commit(alpm_dbcache_writer_t *writer,
+		alpm_handle_t *handle, const char *path,
+		const alpm_dbcache_stamp_t *stamp);
+void _alpm_dbcache_writer_free(alpm_dbcache_writer_t *writer);
+
+int _alpm_dbcache_stamp_file(const char *path, alpm_dbcache_stamp_t *stamp,
+		int digest);
+
+#endif /* ALPM_DBCACHE_H */
@@ -96,16 +96,151 @@ static alpm_pkg_t *find_dep_satisfier(alpm_list_t *pkgs, alpm_depend_t *dep)
 	return NULL;
 }
 
+static int provision_satisfies(alpm_depend_t *dep, alpm_depend_t *provision);
+
+/* The packages of a list by their names and the names they provide, for
+ * finding the same satisfiers as find_dep_satisfier() without a scan. */
+typedef struct _satisfier_index_t {
+	/* dep is NULL for the name of the package itself */
+	alpm_pkgdep_t *entries;
+	size_t count;
+	alpm_list_t *pkgs;
+} satisfier_index_t;
+
+static const char *satisfier_name(const alpm_pkgdep_t *entry)
+{
+	return entry->dep ? entry->dep->name : entry->pkg->name;
+}
+
+static int satisfier_cmp(const void *p1, const void *p2)
+{
+	const alpm_pkgdep_t *e1 = p1, *e2 = p2;
+	int cmp = strcmp(satisfier_name(e1), satisfier_name(e2));
+	if(cmp == 0) {
+		cmp = (e1->index > e2->index) - (e1->index < e2->index);
+	}
+	return cmp;
+}
+
+/* If the index cannot be allocated, lookups fall back to scanning pkgs. */
+static void satisfier_index_init(satisfier_index_t *idx, alpm_list_t *pkgs)
+{
+	alpm_list_t *i, *j;
+	size_t size = 0, index = 0;
+
+	idx->entries = NULL;
+	idx->count = 0;
+	idx->pkgs = pkgs;
+
+	for(i = pkgs; i; i = i->next) {
+		size += 1 + alpm_list_count(alpm_pkg_get_provides(i->data));
+	}
+	CALLOC(idx->entries, size + 1, sizeof(alpm_pkgdep_t), return);
+
+	for(i = pkgs; i; i = i->next, index++) {
+		alpm_pkg_t *pkg = i->data;
+		idx->entries[idx->count].pkg = pkg;
+		idx->entries[idx->count].index = index;
+		idx->count++;
+		for(j = alpm_pkg_get_provides(pkg); j; j = j->next) {
+			idx->entries[idx->count].dep = j->data;
+			idx->entries[idx->count].pkg = pkg;
+			idx->entries[idx->count].index = index;
+			idx->count++;
+		}
+	}
+	if(idx->count > 0) {
+		qsort(idx->entries, idx->count, sizeof(alpm_pkgdep_t), satisfier_cmp);
+	}
+}
+
+static void satisfier_index_free(satisfier_index_t *idx)
+{
+	FREE(idx->entries);
+	idx->count = 0;
+}
+
+/* Returns the first of count entries of the index named name */
+static alpm_pkgdep_t *satisfier_index_lookup(satisfier_index_t *idx,
+		const char *name, size_t *count)
+{
+	size_t lo = 0, hi = idx->count, end;
+
+	while(lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+		if(strcmp(satisfier_name(idx->entries + mid), name) < 0) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+	end = lo;
+	while(end < idx->count && strcmp(satisfier_name(idx->entries + end), name) == 0) {
+		end++;
+	}
+	*count = end - lo;
+	return idx->entries + lo;
+}
+
+static int satisfier_match(alpm_pkgdep_t *entry, alpm_depend_t *dep)
+{
+	return entry->dep ? provision_satisfies(dep, entry->dep)
+		: _alpm_depcmp_literal(entry->pkg, dep);
+}
+
+/* Returns the first package of the indexed list satisfying dep, like
+ * find_dep_satisfier(). The candidates named dep->name are ordered like
+ * the list, so the first matching one belongs to the first satisfier. */
+static alpm_pkg_t *satisfier_index_find(satisfier_index_t *idx,
+		alpm_depend_t *dep)
+{
+	alpm_pkgdep_t *entry;
+	size_t n;
+
+	if(idx->entries == NULL) {
+		return find_dep_satisfier(idx->pkgs, dep);
+	}
+
+	for(entry = satisfier_index_lookup(idx, dep->name, &n); n > 0; entry++, n--) {
+		if(satisfier_match(entry, dep)) {
+			return entry->pkg;
+		}
+	}
+	return NULL;
+}
+
+static int size_cmp(const void *p1, const void *p2)
+{
+	size_t s1 = *(const size_t *)p1, s2 = *(const size_t *)p2;
+	return (s1 > s2) - (s1 < s2);
+}
+
+static int pkgdep_ptr_cmp(const void *p1, const void *p2)
+{
+	const alpm_pkgdep_t *e1 = *(alpm_pkgdep_t * const *)p1;
+	const alpm_pkgdep_t *e2 = *(alpm_pkgdep_t * const *)p2;
+	return (e1->index > e2->index) - (e1->index < e2->index);
+}
+
 /* Convert a list of alpm_pkg_t * to a graph structure,
  * with a edge for each dependency.
- * Returns a list of vertices (one vertex = one package)
+ * Returns an array of count vertices (one vertex = one package): the
+ * targets in order, followed by the local packages they depend on
  * (used by alpm_sortbydeps)
  */
-static alpm_list_t *dep_graph_init(alpm_handle_t *handle,
-		alpm_list_t *targets, alpm_list_t *ignore)
+static alpm_graph_t *dep_graph_init(alpm_handle_t *handle,
+		alpm_list_t *targets, alpm_list_t *ignore, size_t *count)
 {
-	alpm_list_t *i, *j;
-	alpm_list_t *vertices = NULL;
+	alpm_list_t *i, *j, *pkgs;
+	alpm_graph_t *vertices = NULL;
+	satisfier_index_t idx;
+	/* package index -> vertex index + 1, or 0 if it has no vertex yet */
+	size_t *vertex_of = NULL;
+	/* package index -> last vertex index + 1 whose dependencies matched it */
+	size_t *seen = NULL;
+	size_t *old_children = NULL;
+	alpm_pkgdep_t **new_children = NULL;
+	size_t npkgs, nvertices, v;
 	alpm_list_t *localpkgs = alpm_list_diff(
 			alpm_db_get_pkgcache(handle->db_local), targets, _alpm_pkg_cmp);
 
@@ -115,61 +250,112 @@ static alpm_list_t *dep_graph_init(alpm_handle_t *handle,
 		alpm_list_free(oldlocal);
 	}
 
+	/* targets and local packages share one index; local packages only get
+	 * a vertex once a target depends on them, so they don't get resolved
+	 * unnecessarily */
+	pkgs = alpm_list_join(alpm_list_copy(targets), localpkgs);
+	npkgs = alpm_list_count(pkgs);
+	satisfier_index_init(&idx, pkgs);
+	if(idx.entries == NULL) {
+		goto error;
+	}
+	CALLOC(vertex_of, npkgs + 1, sizeof(size_t), goto error);
+	CALLOC(seen, npkgs + 1, sizeof(size_t), goto error);
+	CALLOC(old_children, npkgs + 1, sizeof(size_t), goto error);
+	CALLOC(new_children, npkgs + 1, sizeof(alpm_pkgdep_t *), goto error);
+	if((vertices = _alpm_graph_new(npkgs)) == NULL) {
+		goto error;
+	}
+
 	/* We create the vertices */
+	nvertices = 0;
 	for(i = targets; i; i = i->next) {
-		alpm_graph_t *vertex = _alpm_graph_new();
-		vertex->data = (void *)i->data;
-		vertices = alpm_list_add(vertices, vertex);
+		vertices[nvertices].data = i->data;
+		vertex_of[nvertices] = nvertices + 1;
+		nvertices++;
 	}
 
 	/* We compute the edges */
-	for(i = vertices; i; i = i->next) {
-		alpm_graph_t *vertex_i = i->data;
-		alpm_pkg_t *p_i = vertex_i->data;
-		/* TODO this should be somehow combined with alpm_checkdeps */
-		for(j = vertices; j; j = j->next) {
-			alpm_graph_t *vertex_j = j->data;
-			alpm_pkg_t *p_j = vertex_j->data;
-			if(_alpm_pkg_depends_on(p_i, p_j)) {
-				vertex_i->children =
-					alpm_list_add(vertex_i->children, vertex_j);
+	for(v = 0; v < nvertices; v++) {
+		alpm_graph_t *vertex_i = vertices + v;
+		size_t nold = 0, nnew = 0, k;
+
+		for(j = alpm_pkg_get_depends(vertex_i->data); j; j = j->next) {
+			alpm_depend_t *dep = j->data;
+			alpm_pkgdep_t *entry;
+			size_t n;
+
+			for(entry = satisfier_index_lookup(&idx, dep->name, &n); n > 0; entry++, n--) {
+				if(seen[entry->index] == v + 1 || !satisfier_match(entry, dep)) {
+					continue;
+				}
+				seen[entry->index] = v + 1;
+				if(vertex_of[entry->index]) {
+					old_children[nold++] = vertex_of[entry->index] - 1;
+				} else {
+					new_children[nnew++] = entry;
+				}
 			}
 		}
 
-		/* lazily add local packages to the dep graph so they don't
-		 * get resolved unnecessarily */
-		j = localpkgs;
-		while(j) {
-			alpm_list_t *next = j->next;
-			if(_alpm_pkg_depends_on(p_i, j->data)) {
-				alpm_graph_t *vertex_j = _alpm_graph_new();
-				vertex_j->data = (void *)j->data;
-				vertices = alpm_list_add(vertices, vertex_j);
-				vertex_i->children = alpm_list_add(vertex_i->children, vertex_j);
-				localpkgs = alpm_list_remove_item(localpkgs, j);
-				free(j);
+		/* children which already have a vertex come first in vertex order,
+		 * followed by newly added local packages in package cache order */
+		qsort(old_children, nold, sizeof(size_t), size_cmp);
+		for(k = 0; k < nold; k++) {
+			if(_alpm_graph_add_child(vertex_i, vertices + old_children[k]) != 0) {
+				goto error;
+			}
+		}
+		qsort(new_children, nnew, sizeof(alpm_pkgdep_t *), pkgdep_ptr_cmp);
+		for(k = 0; k < nnew; k++) {
+			alpm_graph_t *vertex_j = vertices + nvertices;
+			vertex_j->data = new_children[k]->pkg;
+			vertex_of[new_children[k]->index] = ++nvertices;
+			if(_alpm_graph_add_child(vertex_i, vertex_j) != 0) {
+				goto error;
 			}
-			j = next;
 		}
-
-		vertex_i->iterator = vertex_i->children;
 	}
-	alpm_list_free(localpkgs);
+
+	*count = nvertices;
+	satisfier_index_free(&idx);
+	alpm_list_free(pkgs);
+	free(vertex_of);
+	free(seen);
+	free(old_children);
+	free(new_children);
 	return vertices;
+
+error:
+	_alpm_graph_free(vertices, npkgs);
+	satisfier_index_free(&idx);
+	alpm_list_free(pkgs);
+	free(vertex_of);
+	free(seen);
+	free(old_children);
+	free(new_children);
+	RET_ERR(handle, ALPM_ERR_MEMORY, NULL);
 }
 
-static void _alpm_warn_dep_cycle(alpm_handle_t *handle, alpm_list_t *targets,
-		alpm_graph_t *ancestor, alpm_graph_t *vertex, int reverse)
+/* the targets are the first vertices of the graph */
+static int is_target_vertex(alpm_graph_t *vertices, size_t ntargets,
+		alpm_graph_t *vertex)
+{
+	return vertex >= vertices && vertex < vertices + ntargets;
+}
+
+static void _alpm_warn_dep_cycle(alpm_handle_t *handle, alpm_graph_t *vertices,
+		size_t ntargets, alpm_graph_t *ancestor, alpm_graph_t *vertex, int reverse)
 {
 	/* vertex depends on and is required by ancestor */
-	if(!alpm_list_find_ptr(targets, vertex->data)) {
+	if(!is_target_vertex(vertices, ntargets, vertex)) {
 		/* child is not part of the transaction, not a problem */
 		return;
 	}
 
 	/* find the nearest ancestor that's part of the transaction */
 	while(ancestor) {
-		if(alpm_list_find_ptr(targets, ancestor->data)) {
+		if(is_target_vertex(vertices, ntargets, ancestor)) {
 			break;
 		}
 		ancestor = ancestor->parent;
@@ -207,16 +393,17 @@ static void _alpm_warn_dep_cycle(alpm_handle_t *handle, alpm_list_t *targets,
  *
  * if reverse is > 0, the dependency order will be reversed.
  *
- * This function returns the new alpm_list_t* target list.
+ * This function returns the new alpm_list_t* target list, or NULL with
+ * pm_errno set if the dependency graph could not be built.
  *
  */
 alpm_list_t *_alpm_sortbydeps(alpm_handle_t *handle,
 		alpm_list_t *targets, alpm_list_t *ignore, int reverse)
 {
 	alpm_list_t *newtargs = NULL;
-	alpm_list_t *vertices = NULL;
-	alpm_list_t *i;
+	alpm_graph_t *vertices;
 	alpm_graph_t *vertex;
+	size_t count, ntargets, v;
 
 	if(targets == NULL) {
 		return NULL;
@@ -224,27 +411,33 @@ alpm_list_t *_alpm_sortbydeps(alpm_handle_t *handle,
 
 	_alpm_log(handle, ALPM_LOG_DEBUG, "started sorting dependencies\n");
 
-	vertices = dep_graph_init(handle, targets, ignore);
+	vertices = dep_graph_init(handle, targets, ignore, &count);
+	if(vertices == NULL) {
+		/* pm_errno is set by dep_graph_init() */
+		_alpm_log(handle, ALPM_LOG_ERROR,
+				_("could not sort packages by their dependencies\n"));
+		return NULL;
+	}
+	ntargets = alpm_list_count(targets);
 
-	i = vertices;
-	vertex = vertices->data;
-	while(i) {
+	v = 0;
+	vertex = vertices;
+	while(v < count) {
 		/* mark that we touched the vertex */
 		vertex->state = ALPM_GRAPH_STATE_PROCESSING;
 		int switched_to_child = 0;
-		while(vertex->iterator && !switched_to_child) {
-			alpm_graph_t *nextchild = vertex->iterator->data;
-			vertex->iterator = vertex->iterator->next;
+		while(vertex->iterator < vertex->children_count && !switched_to_child) {
+			alpm_graph_t *nextchild = vertex->children[vertex->iterator++];
 			if(nextchild->state == ALPM_GRAPH_STATE_UNPROCESSED) {
 				switched_to_child = 1;
 				nextchild->parent = vertex;
 				vertex = nextchild;
 			} else if(nextchild->state == ALPM_GRAPH_STATE_PROCESSING) {
-				_alpm_warn_dep_cycle(handle, targets, vertex, nextchild, reverse);
+				_alpm_warn_dep_cycle(handle, vertices, ntargets, vertex, nextchild, reverse);
 			}
 		}
 		if(!switched_to_child) {
-			if(alpm_list_find_ptr(targets, vertex->data)) {
+			if(is_target_vertex(vertices, ntargets, vertex)) {
 				newtargs = alpm_list_add(newtargs, vertex->data);
 			}
 			/* mark that we've left this vertex */
@@ -252,8 +445,8 @@ alpm_list_t *_alpm_sortbydeps(alpm_handle_t *handle,
 			vertex = vertex->parent;
 			if(!vertex) {
 				/* top level vertex reached, move to the next unprocessed vertex */
-				for(i = i->next; i; i = i->next) {
-					vertex = i->data;
+				for(v++; v < count; v++) {
+					vertex = vertices + v;
 					if(vertex->state == ALPM_GRAPH_STATE_UNPROCESSED) {
 						break;
 					}
@@ -262,6 +455,15 @@ alpm_list_t *_alpm_sortbydeps(alpm_handle_t *handle,
 		}
 	}
 
+	_alpm_graph_free(vertices, count);
+
+	/* every target is added exactly once, unless a list node could not be
+	 * allocated */
+	if(alpm_list_count(newtargs) != ntargets) {
+		alpm_list_free(newtargs);
+		RET_ERR(handle, ALPM_ERR_MEMORY, NULL);
+	}
+
 	_alpm_log(handle, ALPM_LOG_DEBUG, "sorting dependencies finished\n");
 
 	if(reverse) {
@@ -270,11 +472,11 @@ alpm_list_t *_alpm_sortbydeps(alpm_handle_t *handle,
 		/* free the old one */
 		alpm_list_free(newtargs);
 		newtargs = tmptargs;
+		if(newtargs == NULL) {
+			RET_ERR(handle, ALPM_ERR_MEMORY, NULL);
+		}
 	}
 
-	alpm_list_free_inner(vertices, _alpm_graph_free);
-	alpm_list_free(vertices);
-
 	return newtargs;
 }
 
@@ -304,20 +506,41 @@ alpm_list_t SYMEXPORT *alpm_checkdeps(alpm_handle_t *handle,
 	alpm_list_t *i, *j;
 	alpm_list_t *dblist = NULL, *modified = NULL;
 	alpm_list_t *baddeps = NULL;
+	alpm_pkghash_t *changed;
+	satisfier_index_t upgrade_idx, dblist_idx, modified_idx;
 	int nodepversion;
 
 	CHECK_HANDLE(handle, return NULL);
 
+	changed = _alpm_pkghash_create(alpm_list_count(rem) + alpm_list_count(upgrade));
+	if(changed == NULL) {
+		RET_ERR(handle, ALPM_ERR_MEMORY, NULL);
+	}
+
+	for(i = rem; i; i = i->next) {
+		if(_alpm_pkghash_add(&changed, i->data) == NULL) {
+			goto error;
+		}
+	}
+	for(i = upgrade; i; i = i->next) {
+		if(_alpm_pkghash_add(&changed, i->data) == NULL) {
+			goto error;
+		}
+	}
+
 	for(i = pkglist; i; i = i->next) {
 		alpm_pkg_t *pkg = i->data;
-		if(alpm_pkg_find(rem, pkg->name) || alpm_pkg_find(upgrade, pkg->name)) {
+		if(_alpm_pkghash_find(changed, pkg->name)) {
 			modified = alpm_list_add(modified, pkg);
 		} else {
 			dblist = alpm_list_add(dblist, pkg);
 		}
 	}
+	_alpm_pkghash_free(changed);
 
 	nodepversion = no_dep_version(handle);
+	satisfier_index_init(&upgrade_idx, upgrade);
+	satisfier_index_init(&dblist_idx, dblist);
 
 	/* look for unsatisfied dependencies of the upgrade list */
 	for(i = upgrade; i; i = i->next) {
@@ -334,8 +557,8 @@ alpm_list_t SYMEXPORT *alpm_checkdeps(alpm_handle_t *handle,
 			/* 1. we check the upgrade list */
 			/* 2. we check database for untouched satisfying packages */
 			/* 3. we check the dependency ignore list */
-			if(!find_dep_satisfier(upgrade, depend) &&
-					!find_dep_satisfier(dblist, depend) &&
+			if(!satisfier_index_find(&upgrade_idx, depend) &&
+					!satisfier_index_find(&dblist_idx, depend) &&
 					!_alpm_depcmp_provides(depend, handle->assumeinstalled)) {
 				/* Unsatisfied dependency in the upgrade list */
 				alpm_depmissing_t *miss;
@@ -353,6 +576,7 @@ alpm_list_t SYMEXPORT *alpm_checkdeps(alpm_handle_t *handle,
 	if(reversedeps) {
 		/* reversedeps handles the backwards dependencies, ie,
 		 * the packages listed in the requiredby field. */
+		satisfier_index_init(&modified_idx, modified);
 		for(i = dblist; i; i = i->next) {
 			alpm_pkg_t *lp = i->data;
 			for(j = alpm_pkg_get_depends(lp); j; j = j->next) {
@@ -361,14 +585,14 @@ alpm_list_t SYMEXPORT *alpm_checkdeps(alpm_handle_t *handle,
 				if(nodepversion) {
 					depend->mod = ALPM_DEP_MOD_ANY;
 				}
-				alpm_pkg_t *causingpkg = find_dep_satisfier(modified, depend);
+				alpm_pkg_t *causingpkg = satisfier_index_find(&modified_idx, depend);
 				/* we won't break this depend, if it is already broken, we ignore it */
 				/* 1. check upgrade list for satisfiers */
 				/* 2. check dblist for satisfiers */
 				/* 3. we check the dependency ignore list */
 				if(causingpkg &&
-						!find_dep_satisfier(upgrade, depend) &&
-						!find_dep_satisfier(dblist, depend) &&
+						!satisfier_index_find(&upgrade_idx, depend) &&
+						!satisfier_index_find(&dblist_idx, depend) &&
 						!_alpm_depcmp_provides(depend, handle->assumeinstalled)) {
 					alpm_depmissing_t *miss;
 					char *missdepstring = alpm_dep_compute_string(depend);
@@ -381,33 +605,40 @@ alpm_list_t SYMEXPORT *alpm_checkdeps(alpm_handle_t *handle,
 				depend->mod = orig_mod;
 			}
 		}
+		satisfier_index_free(&modified_idx);
 	}
 
+	satisfier_index_free(&upgrade_idx);
+	satisfier_index_free(&dblist_idx);
 	alpm_list_free(modified);
 	alpm_list_free(dblist);
 
 	return baddeps;
+
+error:
+	_alpm_pkghash_free(changed);
+	RET_ERR(handle, ALPM_ERR_MEMORY, NULL);
+}
+
+static int dep_modcmp(int cmp, alpm_depmod_t mod)
+{
+	switch(mod) {
+		case ALPM_DEP_MOD_EQ: return (cmp == 0);
+		case ALPM_DEP_MOD_GE: return (cmp >= 0);
+		case ALPM_DEP_MOD_LE: return (cmp <= 0);
+		case ALPM_DEP_MOD_LT: return (cmp < 0);
+		case ALPM_DEP_MOD_GT: return (cmp > 0);
+		default: return 1;
+	}
 }
 
 static int dep_vercmp(const char *version1, alpm_depmod_t mod,
 		const char *version2)
 {
-	int equal = 0;
-
 	if(mod == ALPM_DEP_MOD_ANY) {
-		equal = 1;
-	} else {
-		int cmp = alpm_pkg_vercmp(version1, version2);
-		switch(mod) {
-			case ALPM_DEP_MOD_EQ: equal = (cmp == 0); break;
-			case ALPM_DEP_MOD_GE: equal = (cmp >= 0); break;
-			case ALPM_DEP_MOD_LE: equal = (cmp <= 0); break;
-			case ALPM_DEP_MOD_LT: equal = (cmp < 0); break;
-			case ALPM_DEP_MOD_GT: equal = (cmp > 0); break;
-			default: equal = 1; break;
-		}
+		return 1;
 	}
-	return equal;
+	return dep_modcmp(alpm_pkg_vercmp(version1, version2), mod);
 }
 
 int _alpm_depcmp_literal(alpm_pkg_t *pkg, alpm_depend_t *dep)
@@ -417,7 +648,26 @@ int _alpm_depcmp_literal(alpm_pkg_t *pkg, alpm_depend_t *dep)
 		/* skip more expensive checks */
 		return 0;
 	}
-	return dep_vercmp(pkg->version, dep->mod, dep->version);
+	if(dep->mod == ALPM_DEP_MOD_ANY) {
+		return 1;
+	}
+	/* the package keeps its parsed version between checks */
+	return dep_modcmp(_alpm_pkg_vercmp(pkg, dep->version), dep->mod);
+}
+
+static int provision_satisfies(alpm_depend_t *dep, alpm_depend_t *provision)
+{
+	if(provision->name_hash != dep->name_hash
+			|| strcmp(provision->name, dep->name) != 0) {
+		return 0;
+	}
+	if(dep->mod == ALPM_DEP_MOD_ANY) {
+		/* any version will satisfy the requirement */
+		return 1;
+	}
+	/* only a provision specifying a version can satisfy a versioned dep */
+	return provision->mod == ALPM_DEP_MOD_EQ
+		&& dep_vercmp(provision->version, dep->mod, dep->version);
 }
 
 /**
@@ -432,18 +682,7 @@ int _alpm_depcmp_provides(alpm_depend_t *dep, alpm_list_t *provisions)
 
 	/* check provisions, name and version if available */
 	for(i = provisions; i && !satisfy; i = i->next) {
-		alpm_depend_t *provision = i->data;
-
-		if(dep->mod == ALPM_DEP_MOD_ANY) {
-			/* any version will satisfy the requirement */
-			satisfy = (provision->name_hash == dep->name_hash
-					&& strcmp(provision->name, dep->name) == 0);
-		} else if(provision->mod == ALPM_DEP_MOD_EQ) {
-			/* provision specifies a version, so try it out */
-			satisfy = (provision->name_hash == dep->name_hash
-					&& strcmp(provision->name, dep->name) == 0
-					&& dep_vercmp(provision->version, dep->mod, dep->version));
-		}
+		satisfy = provision_satisfies(dep, i->data);
 	}
 
 	return satisfy;
@@ -631,12 +870,13 @@ int _alpm_recursedeps(alpm_db_t *db, alpm_list_t **targs, int include_explicit)
  * @param prompt if true, ask an alpm_question_install_ignorepkg_t to decide
  *        if ignored packages should be installed; if false, skip ignored
  *        packages.
- * @return the resolved package
+ * @return the resolved package, or NULL with pm_errno set to
+ *         ALPM_ERR_PKG_NOT_FOUND, ALPM_ERR_PKG_IGNORED or an error
  **/
 static alpm_pkg_t *resolvedep(alpm_handle_t *handle, alpm_depend_t *dep,
 		alpm_list_t *dbs, alpm_list_t *excluding, int prompt)
 {
-	alpm_list_t *i, *j;
+	alpm_list_t *i;
 	int ignored = 0;
 
 	alpm_list_t *providers = NULL;
@@ -677,13 +917,27 @@ static alpm_pkg_t *resolvedep(alpm_handle_t *handle, alpm_depend_t *dep,
 	/* 2. satisfiers (skip literals here) */
 	for(i = dbs; i; i = i->next) {
 		alpm_db_t *db = i->data;
+		alpm_pkgdep_t *provider;
+		alpm_pkg_t *last = NULL;
+		size_t n;
+
 		if(!(db->usage & (ALPM_DB_USAGE_INSTALL|ALPM_DB_USAGE_UPGRADE))) {
 			continue;
 		}
-		for(j = _alpm_db_get_pkgcache(db); j; j = j->next) {
-			alpm_pkg_t *pkg = j->data;
+		/* the provisions are in package cache order, with those of a single
+		 * package next to each other */
+		if(_alpm_db_find_deps(db, DEPLIST_PROVIDES, dep->name, &provider, &n) != 0) {
+			/* pm_errno is set by the failed lookup */
+			alpm_list_free(providers);
+			return NULL;
+		}
+		for(; n > 0; provider++, n--) {
+			alpm_pkg_t *pkg = provider->pkg;
+			if(pkg == last || !provision_satisfies(dep, provider->dep)) {
+				continue;
+			}
+			last = pkg;
 			if((pkg->name_hash != dep->name_hash || strcmp(pkg->name, dep->name) != 0)
-					&& _alpm_depcmp_provides(dep, alpm_pkg_get_provides(pkg))
 					&& !alpm_pkg_find(excluding, pkg->name)) {
 				if(alpm_pkg_should_ignore(handle, pkg)) {
 					alpm_question_install_ignorepkg_t question = {
@@ -782,8 +1036,9 @@ alpm_pkg_t SYMEXPORT *alpm_find_dbs_satisfier(alpm_handle_t *handle,
  *        event of an error
  * @return 0 on success, with [pkg] and all of its dependencies not already on
  *         the [*packages] list added to that list, or -1 on failure due to an
- *         unresolvable dependency, in which case the [*packages] list will be
- *         unmodified by this function
+ *         unresolvable dependency or an error (pm_errno is set accordingly),
+ *         in which case the [*packages] list will be unmodified by this
+ *         function
  */
 int _alpm_resolvedeps(alpm_handle_t *handle, alpm_list_t *localpkgs,
 		alpm_pkg_t *pkg, alpm_list_t *preferred, alpm_list_t **packages,
@@ -833,8 +1088,15 @@ int _alpm_resolvedeps(alpm_handle_t *handle, alpm_list_t *localpkgs,
 					"pulling dependency %s (needed by %s)\n",
 					spkg->name, pkg->name);
 			alpm_depmissing_free(miss);
+		} else if(handle->pm_errno == ALPM_ERR_MEMORY) {
+			/* not a missing dependency, the transaction has to be aborted */
+			ret = -1;
+			break;
 		} else if(resolvedep(handle, missdep, (targ = alpm_list_add(NULL, handle->db_local)), rem, 0)) {
 			alpm_depmissing_free(miss);
+		} else if(handle->pm_errno == ALPM_ERR_MEMORY) {
+			ret = -1;
+			break;
 		} else {
 			handle->pm_errno = ALPM_ERR_UNSATISFIED_DEPS;
 			char *missdepstring = alpm_dep_compute_string(missdep);
@@ -850,6 +1112,11 @@ int _alpm_resolvedeps(alpm_handle_t *handle, alpm_list_t *localpkgs,
 		alpm_list_free(targ);
 		targ = NULL;
 	}
+	/* dependencies not looked at after running out of memory */
+	for(; j; j = j->next) {
+		alpm_depmissing_free(j->data);
+	}
+	alpm_list_free(targ);
 	alpm_list_free(deps);
 
 	if(ret != 0) {
@@ -368,6 +368,73 @@ static size_t dload_parseheader_cb(void *ptr, size_t size, size_t nmemb, void *u
 	return realsize;
 }
 
+static size_t dload_write_cb(char *ptr, size_t size, size_t nmemb, void *user)
+{
+	struct dload_payload *payload = (struct dload_payload *)user;
+	size_t written = fwrite(ptr, 1, size * nmemb, payload->localf);
+
+	if(payload->sha256) {
+		_alpm_sha256_update(payload->sha256, ptr, written);
+	}
+	return written;
+}
+
+/* (Re)start the digest of a payload with an expected checksum. When a
+ * download is resumed the part of the file already on disk is hashed
+ * first, so the file is never read back once it is complete. */
+static void payload_sha256_start(struct dload_payload *payload, off_t offset)
+{
+	alpm_handle_t *handle = payload->handle;
+	unsigned char *buf;
+	ssize_t n;
+	int fd;
+
+	_alpm_sha256_final(payload->sha256, NULL);
+	payload->sha256 = NULL;
+
+	/* a sandboxed downloader can not vouch for the files it writes */
+	if(payload->sha256sum == NULL || handle->sandboxuser) {
+		return;
+	}
+	if((payload->sha256 = _alpm_sha256_new()) == NULL) {
+		return;
+	}
+	if(offset == 0) {
+		return;
+	}
+
+	MALLOC(buf, (size_t)ALPM_BUFFER_SIZE, goto error);
+	OPEN(fd, payload->tempfile_name, O_RDONLY | O_CLOEXEC);
+	if(fd < 0) {
+		free(buf);
+		goto error;
+	}
+	while(offset > 0) {
+		n = read(fd, buf, offset < ALPM_BUFFER_SIZE ? (size_t)offset : ALPM_BUFFER_SIZE);
+		if(n < 0 && errno == EINTR) {
+			continue;
+		}
+		if(n <= 0) {
+			break;
+		}
+		_alpm_sha256_update(payload->sha256, buf, n);
+		offset -= n;
+	}
+	close(fd);
+	free(buf);
+
+	if(offset == 0) {
+		return;
+	}
+
+error:
+	_alpm_log(handle, ALPM_LOG_DEBUG,
+			"%s: could not hash partial download, checksum will be verified later\n",
+			payload->remote_name);
+	_alpm_sha256_final(payload->sha256, NULL);
+	payload->sha256 = NULL;
+}
+
 static void curl_set_handle_opts(CURL *curl, struct dload_payload *payload)
 {
 	alpm_handle_t *handle = payload->handle;
@@ -464,12 +531,14 @@ static int curl_retry_next_server(CURLM *curlm, CURL *curl, struct dload_payload
 				"%s: tempfile found, attempting continuation from %jd bytes\n",
 				payload->remote_name, (intmax_t)st.st_size);
 		payload->initial_size = st.st_size;
+		payload_sha256_start(payload, st.st_size);
 	} else {
 		/* we keep the file for a new retry but remove its data if any */
 		if(ftruncate(fileno(payload->localf), 0)) {
 			RET_ERR(handle, ALPM_ERR_SYSTEM, -1);
 		}
 		fseek(payload->localf, 0, SEEK_SET);
+		payload_sha256_start(payload, 0);
 	}
 
 	if(handle->dlcb) {
@@ -711,6 +780,15 @@ cleanup:
 		}
 	}
 
+	if(ret == 0 && payload->sha256) {
+		payload->sha256_verified = (_alpm_sha256_test(payload->sha256, payload->sha256sum) == 0);
+		payload->sha256 = NULL;
+		_alpm_log(handle, ALPM_LOG_DEBUG, "%s: sha256sum %s while downloading\n",
+				payload->remote_name, payload->sha256_verified ? "verified" : "mismatched");
+	}
+	_alpm_sha256_final(payload->sha256, NULL);
+	payload->sha256 = NULL;
+
 	if((ret == -1 || dload_interrupted) && payload->unlink_on_fail &&
 			payload->tempfile_name) {
 		unlink(payload->tempfile_name);
@@ -801,7 +879,11 @@ static int curl_add_payload(alpm_handle_t *handle, CURLM *curlm,
 			payload->tempfile_name,
 			payload->tempfile_openmode);
 
-	curl_easy_setopt(curl, CURLOPT_WRITEDATA, payload->localf);
+	payload_sha256_start(payload,
+			strcmp(payload->tempfile_openmode, "ab") == 0 ? payload->initial_size : 0);
+
+	curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, dload_write_cb);
+	curl_easy_setopt(curl, CURLOPT_WRITEDATA, (void *)payload);
 	curl_multi_add_handle(curlm, curl);
 
 	if(handle->dlcb) {
@@ -1413,5 +1495,9 @@ void _alpm_dload_payload_reset(struct dload_payload *payload)
 	FREE(payload->destfile_name);
 	FREE(payload->fileurl);
 	FREE(payload->filepath);
+	FREE(payload->sha256sum);
+#ifdef HAVE_LIBCURL
+	_alpm_sha256_final(payload->sha256, NULL);
+#endif
 	*payload = (struct dload_payload){0};
 }
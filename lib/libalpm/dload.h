@@ -53,11 +53,15 @@ struct dload_payload {
 	int unlink_on_fail;
 	int download_signature; /* specifies if an accompanion *.sig file need to be downloaded*/
 	int signature_optional; /* *.sig file is optional */
+	/* expected SHA-256 digest of the file, checked while it is written */
+	char *sha256sum;
+	int sha256_verified; /* the downloaded file matched sha256sum */
 #ifdef HAVE_LIBCURL
 	CURL *curl;
 	char error_buffer[CURL_ERROR_SIZE];
 	int signature; /* specifies if this payload is for a signature file */
 	int request_errors_ok; /* per-request errors-ok */
+	struct _alpm_sha256_t *sha256; /* digest of the data written so far */
 #endif
 	FILE *localf; /* temp download file */
 };
@@ -61,54 +61,6 @@ alpm_list_t *_alpm_filelist_difference(alpm_filelist_t *filesA,
 	return ret;
 }
 
-static int _alpm_filelist_pathcmp(const char *p1, const char *p2)
-{
-	while(*p1 && *p1 == *p2) {
-		p1++;
-		p2++;
-	}
-
-	/* skip trailing '/' */
-	if(*p1 == '\0' && *p2 == '/') {
-		p2++;
-	} else if(*p2 == '\0' && *p1 == '/') {
-		p1++;
-	}
-
-	return *p1 - *p2;
-}
-
-/* Returns the intersection of the provided two lists of files.
- * Pre-condition: both lists are sorted!
- * When done, free the list but NOT the contained data.
- */
-alpm_list_t *_alpm_filelist_intersection(alpm_filelist_t *filesA,
-		alpm_filelist_t *filesB)
-{
-	alpm_list_t *ret = NULL;
-	size_t ctrA = 0, ctrB = 0;
-	alpm_file_t *arrA = filesA->files, *arrB = filesB->files;
-
-	while(ctrA < filesA->count && ctrB < filesB->count) {
-		const char *strA = arrA[ctrA].name, *strB = arrB[ctrB].name;
-		int cmp = _alpm_filelist_pathcmp(strA, strB);
-		if(cmp < 0) {
-			ctrA++;
-		} else if(cmp > 0) {
-			ctrB++;
-		} else {
-			/* when not directories, item in both qualifies as an intersect */
-			if(strA[strlen(strA) - 1] != '/' || strB[strlen(strB) - 1] != '/') {
-				ret = alpm_list_add(ret, arrA[ctrA].name);
-			}
-			ctrA++;
-			ctrB++;
-		}
-	}
-
-	return ret;
-}
-
 /* Helper function for comparing files list entries
  */
 static int _alpm_files_cmp(const void *f1, const void *f2)
@@ -21,18 +21,35 @@
 #include "util.h"
 #include "log.h"
 
-alpm_graph_t *_alpm_graph_new(void)
+/* Allocates an array of count unconnected vertices. Edges point into the
+ * array, so it cannot be grown later on. */
+alpm_graph_t *_alpm_graph_new(size_t count)
 {
-	alpm_graph_t *graph = NULL;
+	alpm_graph_t *vertices = NULL;
 
-	CALLOC(graph, 1, sizeof(alpm_graph_t), return NULL);
-	return graph;
+	CALLOC(vertices, count + 1, sizeof(alpm_graph_t), return NULL);
+	return vertices;
 }
 
-void _alpm_graph_free(void *data)
+int _alpm_graph_add_child(alpm_graph_t *vertex, alpm_graph_t *child)
 {
-	ASSERT(data != NULL, return);
-	alpm_graph_t *graph = data;
-	alpm_list_free(graph->children);
-	free(graph);
+	if(!_alpm_greedy_grow((void **)&vertex->children, &vertex->children_size,
+				(vertex->children_count + 1) * sizeof(alpm_graph_t *))) {
+		return -1;
+	}
+	vertex->children[vertex->children_count++] = child;
+	return 0;
+}
+
+void _alpm_graph_free(alpm_graph_t *vertices, size_t count)
+{
+	size_t i;
+
+	if(vertices == NULL) {
+		return;
+	}
+	for(i = 0; i < count; i++) {
+		free(vertices[i].children);
+	}
+	free(vertices);
 }
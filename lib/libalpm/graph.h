@@ -19,10 +19,9 @@
 #ifndef ALPM_GRAPH_H
 #define ALPM_GRAPH_H
 
+#include <stddef.h>
 #include <sys/types.h> /* off_t */
 
-#include "alpm_list.h"
-
 enum _alpm_graph_vertex_state {
 	ALPM_GRAPH_STATE_UNPROCESSED,
 	ALPM_GRAPH_STATE_PROCESSING,
@@ -32,13 +31,16 @@ enum _alpm_graph_vertex_state {
 typedef struct _alpm_graph_t {
 	void *data;
 	struct _alpm_graph_t *parent; /* where did we come from? */
-	alpm_list_t *children;
-	alpm_list_t *iterator; /* used for DFS without recursion */
+	struct _alpm_graph_t **children;
+	size_t children_count;
+	size_t children_size; /* allocated size of children in bytes */
+	size_t iterator; /* next child to visit, used for DFS without recursion */
 	off_t weight; /* weight of the node */
 	enum _alpm_graph_vertex_state state;
 } alpm_graph_t;
 
-alpm_graph_t *_alpm_graph_new(void);
-void _alpm_graph_free(void *data);
+alpm_graph_t *_alpm_graph_new(size_t count);
+int _alpm_graph_add_child(alpm_graph_t *vertex, alpm_graph_t *child);
+void _alpm_graph_free(alpm_graph_t *vertices, size_t count);
 
 #endif /* ALPM_GRAPH_H */
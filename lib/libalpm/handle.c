@@ -37,6 +37,8 @@
 #include "trans.h"
 #include "alpm.h"
 #include "deps.h"
+#include "hook.h"
+#include "signing.h"
 
 alpm_handle_t *_alpm_handle_new(void)
 {
@@ -44,6 +46,8 @@ alpm_handle_t *_alpm_handle_new(void)
 
 	CALLOC(handle, 1, sizeof(alpm_handle_t), return NULL);
 	handle->lockfd = -1;
+	handle->logmask = ALPM_LOG_ERROR | ALPM_LOG_WARNING | ALPM_LOG_DEBUG
+		| ALPM_LOG_FUNCTION;
 
 	return handle;
 }
@@ -80,9 +84,7 @@ void _alpm_handle_free(alpm_handle_t *handle)
 		closelog();
 	}
 
-#ifdef HAVE_LIBGPGME
-	FREELIST(handle->known_keys);
-#endif
+	_alpm_signing_release(handle);
 
 #ifdef HAVE_LIBCURL
 	curl_multi_cleanup(handle->curlm);
@@ -97,16 +99,21 @@ void _alpm_handle_free(alpm_handle_t *handle)
 	FREE(handle->dbext);
 	FREELIST(handle->cachedirs);
 	FREELIST(handle->hookdirs);
+	_alpm_hook_cache_invalidate(handle);
 	FREE(handle->logfile);
 	FREE(handle->lockfile);
 	FREELIST(handle->architectures);
 	FREE(handle->gpgdir);
+	FREE(handle->keyring_snapshot);
 	FREE(handle->sandboxuser);
 	FREELIST(handle->noupgrade);
 	FREELIST(handle->noextract);
 	FREELIST(handle->ignorepkg);
 	FREELIST(handle->ignoregroup);
 	FREELIST(handle->overwrite_files);
+	_alpm_patterns_free(handle->noupgrade_patterns);
+	_alpm_patterns_free(handle->noextract_patterns);
+	_alpm_patterns_free(handle->overwrite_patterns);
 
 	alpm_list_free_inner(handle->assumeinstalled, (alpm_list_fn_free)alpm_dep_free);
 	alpm_list_free(handle->assumeinstalled);
@@ -191,6 +198,12 @@ void SYMEXPORT *alpm_option_get_logcb_ctx(alpm_handle_t *handle)
 	return handle->logcb_ctx;
 }
 
+int SYMEXPORT alpm_option_get_logmask(alpm_handle_t *handle)
+{
+	CHECK_HANDLE(handle, return -1);
+	return handle->logmask;
+}
+
 alpm_cb_download SYMEXPORT alpm_option_get_dlcb(alpm_handle_t *handle)
 {
 	CHECK_HANDLE(handle, return NULL);
@@ -293,6 +306,12 @@ const char SYMEXPORT *alpm_option_get_gpgdir(alpm_handle_t *handle)
 	return handle->gpgdir;
 }
 
+const char SYMEXPORT *alpm_option_get_keyring_snapshot(alpm_handle_t *handle)
+{
+	CHECK_HANDLE(handle, return NULL);
+	return handle->keyring_snapshot;
+}
+
 const char SYMEXPORT *alpm_option_get_sandboxuser(alpm_handle_t *handle)
 {
 	CHECK_HANDLE(handle, return NULL);
@@ -365,6 +384,24 @@ int SYMEXPORT alpm_option_get_parallel_downloads(alpm_handle_t *handle)
 	return handle->parallel_downloads;
 }
 
+int SYMEXPORT alpm_option_get_verify_threads(alpm_handle_t *handle)
+{
+	CHECK_HANDLE(handle, return -1);
+	return handle->verify_threads;
+}
+
+int SYMEXPORT alpm_option_get_extract_threads(alpm_handle_t *handle)
+{
+	CHECK_HANDLE(handle, return -1);
+	return handle->extract_threads;
+}
+
+int SYMEXPORT alpm_option_get_pipeline_downloads(alpm_handle_t *handle)
+{
+	CHECK_HANDLE(handle, return -1);
+	return handle->pipeline_downloads;
+}
+
 int SYMEXPORT alpm_option_set_logcb(alpm_handle_t *handle, alpm_cb_log cb, void *ctx)
 {
 	CHECK_HANDLE(handle, return -1);
@@ -373,6 +410,13 @@ int SYMEXPORT alpm_option_set_logcb(alpm_handle_t *handle, alpm_cb_log cb, void
 	return 0;
 }
 
+int SYMEXPORT alpm_option_set_logmask(alpm_handle_t *handle, int mask)
+{
+	CHECK_HANDLE(handle, return -1);
+	handle->logmask = mask;
+	return 0;
+}
+
 int SYMEXPORT alpm_option_set_dlcb(alpm_handle_t *handle, alpm_cb_download cb, void *ctx)
 {
 	CHECK_HANDLE(handle, return -1);
@@ -602,6 +646,22 @@ int SYMEXPORT alpm_option_set_gpgdir(alpm_handle_t *handle, const char *gpgdir)
 	return 0;
 }
 
+int SYMEXPORT alpm_option_set_keyring_snapshot(alpm_handle_t *handle,
+		const char *keyring_snapshot)
+{
+	CHECK_HANDLE(handle, return -1);
+	/* drop keys read from the old snapshot */
+	_alpm_signing_release(handle);
+	FREE(handle->keyring_snapshot);
+	if(keyring_snapshot) {
+		STRDUP(handle->keyring_snapshot, keyring_snapshot,
+				RET_ERR(handle, ALPM_ERR_MEMORY, -1));
+	}
+	_alpm_log(handle, ALPM_LOG_DEBUG, "option 'keyring_snapshot' = %s\n",
+			handle->keyring_snapshot ? handle->keyring_snapshot : "(none)");
+	return 0;
+}
+
 int SYMEXPORT alpm_option_set_sandboxuser(alpm_handle_t *handle, const char *sandboxuser)
 {
 	CHECK_HANDLE(handle, return -1);
@@ -651,44 +711,100 @@ static int _alpm_option_strlist_rem(alpm_handle_t *handle, alpm_list_t **list, c
 	return 0;
 }
 
+static void _alpm_option_patterns_reset(alpm_patterns_t **compiled)
+{
+	_alpm_patterns_free(*compiled);
+	*compiled = NULL;
+}
+
+static int _alpm_option_patterns_compile(alpm_patterns_t **compiled,
+		alpm_list_t *patterns)
+{
+	if(*compiled == NULL && patterns) {
+		*compiled = _alpm_patterns_compile(patterns);
+		return *compiled ? 0 : -1;
+	}
+	return 0;
+}
+
+static int _alpm_option_patterns_match(alpm_patterns_t **compiled,
+		alpm_list_t *patterns, const char *string)
+{
+	if(_alpm_option_patterns_compile(compiled, patterns) != 0) {
+		/* not enough memory, fall back to matching the list itself */
+		return _alpm_fnmatch_patterns(patterns, string);
+	}
+	return _alpm_patterns_match(*compiled, string);
+}
+
+/** Compile all pattern options of a handle ahead of time, so they can be
+ * matched from worker threads.
+ * @param handle the context handle
+ * @return 0 on success, -1 on error (pm_errno is set accordingly)
+ */
+int _alpm_handle_compile_patterns(alpm_handle_t *handle)
+{
+	if(_alpm_option_patterns_compile(&(handle->noupgrade_patterns), handle->noupgrade)
+			|| _alpm_option_patterns_compile(&(handle->noextract_patterns), handle->noextract)
+			|| _alpm_option_patterns_compile(&(handle->overwrite_patterns),
+				handle->overwrite_files)) {
+		RET_ERR(handle, ALPM_ERR_MEMORY, -1);
+	}
+	return 0;
+}
+
 int SYMEXPORT alpm_option_add_noupgrade(alpm_handle_t *handle, const char *pkg)
 {
+	CHECK_HANDLE(handle, return -1);
+	_alpm_option_patterns_reset(&(handle->noupgrade_patterns));
 	return _alpm_option_strlist_add(handle, &(handle->noupgrade), pkg);
 }
 
 int SYMEXPORT alpm_option_set_noupgrades(alpm_handle_t *handle, alpm_list_t *noupgrade)
 {
+	CHECK_HANDLE(handle, return -1);
+	_alpm_option_patterns_reset(&(handle->noupgrade_patterns));
 	return _alpm_option_strlist_set(handle, &(handle->noupgrade), noupgrade);
 }
 
 int SYMEXPORT alpm_option_remove_noupgrade(alpm_handle_t *handle, const char *pkg)
 {
+	CHECK_HANDLE(handle, return -1);
+	_alpm_option_patterns_reset(&(handle->noupgrade_patterns));
 	return _alpm_option_strlist_rem(handle, &(handle->noupgrade), pkg);
 }
 
 int SYMEXPORT alpm_option_match_noupgrade(alpm_handle_t *handle, const char *path)
 {
-	return _alpm_fnmatch_patterns(handle->noupgrade, path);
+	return _alpm_option_patterns_match(&(handle->noupgrade_patterns),
+			handle->noupgrade, path);
 }
 
 int SYMEXPORT alpm_option_add_noextract(alpm_handle_t *handle, const char *path)
 {
+	CHECK_HANDLE(handle, return -1);
+	_alpm_option_patterns_reset(&(handle->noextract_patterns));
 	return _alpm_option_strlist_add(handle, &(handle->noextract), path);
 }
 
 int SYMEXPORT alpm_option_set_noextracts(alpm_handle_t *handle, alpm_list_t *noextract)
 {
+	CHECK_HANDLE(handle, return -1);
+	_alpm_option_patterns_reset(&(handle->noextract_patterns));
 	return _alpm_option_strlist_set(handle, &(handle->noextract), noextract);
 }
 
 int SYMEXPORT alpm_option_remove_noextract(alpm_handle_t *handle, const char *path)
 {
+	CHECK_HANDLE(handle, return -1);
+	_alpm_option_patterns_reset(&(handle->noextract_patterns));
 	return _alpm_option_strlist_rem(handle, &(handle->noextract), path);
 }
 
 int SYMEXPORT alpm_option_match_noextract(alpm_handle_t *handle, const char *path)
 {
-	return _alpm_fnmatch_patterns(handle->noextract, path);
+	return _alpm_option_patterns_match(&(handle->noextract_patterns),
+			handle->noextract, path);
 }
 
 int SYMEXPORT alpm_option_add_ignorepkg(alpm_handle_t *handle, const char *pkg)
@@ -723,19 +839,31 @@ int SYMEXPORT alpm_option_remove_ignoregroup(alpm_handle_t *handle, const char *
 
 int SYMEXPORT alpm_option_add_overwrite_file(alpm_handle_t *handle, const char *glob)
 {
+	CHECK_HANDLE(handle, return -1);
+	_alpm_option_patterns_reset(&(handle->overwrite_patterns));
 	return _alpm_option_strlist_add(handle, &(handle->overwrite_files), glob);
 }
 
 int SYMEXPORT alpm_option_set_overwrite_files(alpm_handle_t *handle, alpm_list_t *globs)
 {
+	CHECK_HANDLE(handle, return -1);
+	_alpm_option_patterns_reset(&(handle->overwrite_patterns));
 	return _alpm_option_strlist_set(handle, &(handle->overwrite_files), globs);
 }
 
 int SYMEXPORT alpm_option_remove_overwrite_file(alpm_handle_t *handle, const char *glob)
 {
+	CHECK_HANDLE(handle, return -1);
+	_alpm_option_patterns_reset(&(handle->overwrite_patterns));
 	return _alpm_option_strlist_rem(handle, &(handle->overwrite_files), glob);
 }
 
+int _alpm_option_match_overwrite_file(alpm_handle_t *handle, const char *path)
+{
+	return _alpm_option_patterns_match(&(handle->overwrite_patterns),
+			handle->overwrite_files, path);
+}
+
 int SYMEXPORT alpm_option_add_assumeinstalled(alpm_handle_t *handle, const alpm_depend_t *dep)
 {
 	alpm_depend_t *depcpy;
@@ -871,13 +999,10 @@ int SYMEXPORT alpm_option_set_default_siglevel(alpm_handle_t *handle,
 	if(level == ALPM_SIG_USE_DEFAULT) {
 		RET_ERR(handle, ALPM_ERR_WRONG_ARGS, -1);
 	}
-#ifdef HAVE_LIBGPGME
-	handle->siglevel = level;
-#else
-	if(level != 0) {
+	if(level != 0 && !_alpm_signing_available(handle)) {
 		RET_ERR(handle, ALPM_ERR_MISSING_CAPABILITY_SIGNATURES, -1);
 	}
-#endif
+	handle->siglevel = level;
 	return 0;
 }
 
@@ -891,13 +1016,11 @@ int SYMEXPORT alpm_option_set_local_file_siglevel(alpm_handle_t *handle,
 		int level)
 {
 	CHECK_HANDLE(handle, return -1);
-#ifdef HAVE_LIBGPGME
-	handle->localfilesiglevel = level;
-#else
-	if(level != 0 && level != ALPM_SIG_USE_DEFAULT) {
+	if(level != 0 && level != ALPM_SIG_USE_DEFAULT
+			&& !_alpm_signing_available(handle)) {
 		RET_ERR(handle, ALPM_ERR_MISSING_CAPABILITY_SIGNATURES, -1);
 	}
-#endif
+	handle->localfilesiglevel = level;
 	return 0;
 }
 
@@ -915,13 +1038,11 @@ int SYMEXPORT alpm_option_set_remote_file_siglevel(alpm_handle_t *handle,
 		int level)
 {
 	CHECK_HANDLE(handle, return -1);
-#ifdef HAVE_LIBGPGME
-	handle->remotefilesiglevel = level;
-#else
-	if(level != 0 && level != ALPM_SIG_USE_DEFAULT) {
+	if(level != 0 && level != ALPM_SIG_USE_DEFAULT
+			&& !_alpm_signing_available(handle)) {
 		RET_ERR(handle, ALPM_ERR_MISSING_CAPABILITY_SIGNATURES, -1);
 	}
-#endif
+	handle->remotefilesiglevel = level;
 	return 0;
 }
 
@@ -952,6 +1073,32 @@ int SYMEXPORT alpm_option_set_parallel_downloads(alpm_handle_t *handle,
 	return 0;
 }
 
+int SYMEXPORT alpm_option_set_verify_threads(alpm_handle_t *handle,
+		unsigned int num_threads)
+{
+	CHECK_HANDLE(handle, return -1);
+	ASSERT(num_threads >= 1, RET_ERR(handle, ALPM_ERR_WRONG_ARGS, -1));
+	handle->verify_threads = num_threads;
+	return 0;
+}
+
+int SYMEXPORT alpm_option_set_extract_threads(alpm_handle_t *handle,
+		unsigned int num_threads)
+{
+	CHECK_HANDLE(handle, return -1);
+	ASSERT(num_threads >= 1, RET_ERR(handle, ALPM_ERR_WRONG_ARGS, -1));
+	handle->extract_threads = num_threads;
+	return 0;
+}
+
+int SYMEXPORT alpm_option_set_pipeline_downloads(alpm_handle_t *handle,
+		int pipeline_downloads)
+{
+	CHECK_HANDLE(handle, return -1);
+	handle->pipeline_downloads = pipeline_downloads;
+	return 0;
+}
+
 int SYMEXPORT alpm_option_set_disable_sandbox(alpm_handle_t *handle,
 		unsigned short disable_sandbox)
 {
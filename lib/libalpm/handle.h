@@ -26,6 +26,7 @@
 
 #include "alpm_list.h"
 #include "alpm.h"
+#include "patterns.h"
 #include "trans.h"
 
 #ifdef HAVE_LIBCURL
@@ -57,6 +58,7 @@ struct _alpm_handle_t {
 	alpm_list_t *dbs_sync;  /* List of (alpm_db_t *) */
 	FILE *logstream;        /* log file stream pointer */
 	alpm_trans_t *trans;
+	struct _alpm_hook_cache_t *hook_cache; /* hooks parsed by _alpm_hook_run() */
 
 #ifdef HAVE_LIBCURL
 	/* libcurl handle */
@@ -67,14 +69,19 @@ struct _alpm_handle_t {
 	unsigned short disable_dl_timeout;
 	unsigned short disable_sandbox;
 	unsigned int parallel_downloads; /* number of download streams */
+	unsigned int verify_threads; /* number of package verification threads */
+	int pipeline_downloads; /* verify and load packages while downloading */
+	unsigned int extract_threads; /* number of package extraction threads */
 
-#ifdef HAVE_LIBGPGME
-	alpm_list_t *known_keys;  /* keys verified to be in our keychain */
-#endif
+	/* GPGME contexts and key lookups shared by signature checks */
+	struct _alpm_sigsession_t *sigsession;
+	/* keys read from keyring_snapshot by the native verifier */
+	struct _alpm_pgpkeyring_t *pgpkeyring;
 
 	/* callback functions */
 	alpm_cb_log logcb;          /* Log callback function */
 	void *logcb_ctx;
+	int logmask;                /* levels passed to logcb */
 	alpm_cb_download dlcb;      /* Download callback function */
 	void *dlcb_ctx;
 	alpm_cb_fetch fetchcb;      /* Download file callback function */
@@ -92,6 +99,7 @@ struct _alpm_handle_t {
 	char *logfile;           /* Name of the log file */
 	char *lockfile;          /* Name of the lock file */
 	char *gpgdir;            /* Directory where GnuPG files are stored */
+	char *keyring_snapshot;  /* Exported keyring for the native verifier */
 	char *sandboxuser;       /* User to switch to for sensitive operations */
 	alpm_list_t *cachedirs;  /* Paths to pacman cache directories */
 	alpm_list_t *hookdirs;   /* Paths to hook directories */
@@ -104,6 +112,12 @@ struct _alpm_handle_t {
 	alpm_list_t *ignoregroup; /* List of groups to ignore */
 	alpm_list_t *assumeinstalled;   /* List of virtual packages used to satisfy dependencies */
 
+	/* compiled forms of noupgrade, noextract and overwrite_files, built on
+	 * first use and dropped whenever the list changes */
+	alpm_patterns_t *noupgrade_patterns;
+	alpm_patterns_t *noextract_patterns;
+	alpm_patterns_t *overwrite_patterns;
+
 	/* options */
 	alpm_list_t *architectures; /* Architectures of packages we should allow */
 	int usesyslog;           /* Use syslog instead of logfile? */ /* TODO move to frontend */
@@ -120,6 +134,11 @@ struct _alpm_handle_t {
 
 	/* lock file descriptor */
 	int lockfd;
+
+	/* set on worker thread copies, which hold back log messages, log file
+	 * entries and events, see workers.c */
+	int worker;
+	alpm_list_t *worker_log;
 };
 
 alpm_handle_t *_alpm_handle_new(void);
@@ -127,6 +146,8 @@ void _alpm_handle_free(alpm_handle_t *handle);
 
 int _alpm_handle_lock(alpm_handle_t *handle);
 int _alpm_handle_unlock(alpm_handle_t *handle);
+int _alpm_handle_compile_patterns(alpm_handle_t *handle);
+int _alpm_option_match_overwrite_file(alpm_handle_t *handle, const char *path);
 
 alpm_errno_t _alpm_set_directory_option(const char *value,
 		char **storage, int must_exist);
@@ -20,7 +20,10 @@
 #include <dirent.h>
 #include <errno.h>
 #include <limits.h>
+#include <stdlib.h>
 #include <string.h>
+#include <time.h>
+#include <sys/stat.h>
 
 #include "handle.h"
 #include "hook.h"
@@ -44,6 +47,10 @@ struct _alpm_trigger_t {
 	enum _alpm_hook_op_t op;
 	enum _alpm_trigger_type_t type;
 	alpm_list_t *targets;
+	/* Package targets compiled for matching, NULL if that failed */
+	alpm_patterns_t *patterns;
+	/* set by _alpm_hook_match_paths() for Path triggers */
+	int matched;
 };
 
 struct _alpm_hook_t {
@@ -57,6 +64,24 @@ struct _alpm_hook_t {
 	int abort_on_fail, needs_targets;
 };
 
+/* A hook directory as it was when its hooks were loaded */
+struct _alpm_hook_dir {
+	char *path;
+	/* 1 if it exists, 0 if it does not, -1 if that could not be checked */
+	int exists;
+	struct stat stat;
+};
+
+/* Parsed hooks, kept on the handle between runs */
+struct _alpm_hook_cache_t {
+	/* in the order of handle->hookdirs */
+	struct _alpm_hook_dir *dirs;
+	size_t dir_count;
+	time_t loaded;
+	/* sorted by name */
+	alpm_list_t *hooks;
+};
+
 struct _alpm_hook_cb_ctx {
 	alpm_handle_t *handle;
 	struct _alpm_hook_t *hook;
@@ -66,6 +91,7 @@ static void _alpm_trigger_free(struct _alpm_trigger_t *trigger)
 {
 	if(trigger) {
 		FREELIST(trigger->targets);
+		_alpm_patterns_free(trigger->patterns);
 		free(trigger);
 	}
 }
@@ -255,108 +281,177 @@ static int _alpm_hook_parse_cb(const char *file, int line,
 	return 0;
 }
 
-static int _alpm_hook_trigger_match_file(alpm_handle_t *handle,
-		struct _alpm_hook_t *hook, struct _alpm_trigger_t *t)
+static int _alpm_trigger_match_target(struct _alpm_trigger_t *t,
+		const char *string)
 {
-	alpm_list_t *i, *j, *install = NULL, *upgrade = NULL, *remove = NULL;
-	size_t isize = 0, rsize = 0;
-	int ret = 0;
+	if(t->patterns) {
+		return _alpm_patterns_match(t->patterns, string);
+	}
+	return _alpm_fnmatch_patterns(t->targets, string);
+}
 
-	/* check if file will be installed */
-	for(i = handle->trans->add; i; i = i->next) {
-		alpm_pkg_t *pkg = i->data;
-		alpm_filelist_t filelist = pkg->files;
-		size_t f;
-		for(f = 0; f < filelist.count; f++) {
-			if(alpm_option_match_noextract(handle, filelist.files[f].name) == 0) {
-				continue;
-			}
-			if(_alpm_fnmatch_patterns(t->targets, filelist.files[f].name) == 0) {
-				install = alpm_list_add(install, filelist.files[f].name);
-				isize++;
-			}
+static int _alpm_hook_path_cmp(const void *p1, const void *p2)
+{
+	return strcmp(*(const char **)p1, *(const char **)p2);
+}
+
+/* Add the files of a package to an array of paths, skipping NoExtract
+ * files if the package is going to be installed */
+static size_t _alpm_hook_add_paths(alpm_handle_t *handle, const char **paths,
+		size_t count, alpm_pkg_t *pkg, int installed)
+{
+	size_t f;
+
+	for(f = 0; f < pkg->files.count; f++) {
+		const char *path = pkg->files.files[f].name;
+		if(installed && alpm_option_match_noextract(handle, path) == 0) {
+			continue;
 		}
+		paths[count++] = path;
 	}
+	return count;
+}
 
-	/* check if file will be removed due to package upgrade */
-	for(i = handle->trans->add; i; i = i->next) {
-		alpm_pkg_t *spkg = i->data;
-		alpm_pkg_t *pkg = spkg->oldpkg;
-		if(pkg) {
-			alpm_filelist_t filelist = pkg->files;
-			size_t f;
-			for(f = 0; f < filelist.count; f++) {
-				if(_alpm_fnmatch_patterns(t->targets, filelist.files[f].name) == 0) {
-					remove = alpm_list_add(remove, filelist.files[f].name);
-					rsize++;
-				}
-			}
+/* Sort an array of paths and drop the duplicates */
+static size_t _alpm_hook_sort_paths(const char **paths, size_t count)
+{
+	size_t i, n = 0;
+
+	qsort(paths, count, sizeof(const char *), _alpm_hook_path_cmp);
+	for(i = 0; i < count; i++) {
+		if(n == 0 || strcmp(paths[n - 1], paths[i]) != 0) {
+			paths[n++] = paths[i];
 		}
 	}
+	return n;
+}
 
-	/* check if file will be removed due to package removal */
-	for(i = handle->trans->remove; i; i = i->next) {
-		alpm_pkg_t *pkg = i->data;
-		alpm_filelist_t filelist = pkg->files;
-		size_t f;
-		for(f = 0; f < filelist.count; f++) {
-			if(_alpm_fnmatch_patterns(t->targets, filelist.files[f].name) == 0) {
-				remove = alpm_list_add(remove, filelist.files[f].name);
-				rsize++;
+/* Match the Path triggers of all hooks run at a time against the files of
+ * the transaction. All triggers are compiled into one matcher, so every
+ * file is only looked at once. A file that is both installed and removed
+ * is upgraded. */
+static int _alpm_hook_match_paths(alpm_handle_t *handle, alpm_list_t *hooks,
+		alpm_hook_when_t when)
+{
+	struct _alpm_trigger_t **triggers = NULL;
+	struct _alpm_hook_t **owners = NULL;
+	const char **install = NULL, **remove = NULL;
+	size_t *matched = NULL, *best = NULL;
+	size_t tcount = 0, icount = 0, rcount = 0, i, r;
+	alpm_patterns_t *patterns = NULL;
+	alpm_list_t *j, *k;
+	int ret = -1;
+
+	for(j = hooks; j; j = j->next) {
+		struct _alpm_hook_t *hook = j->data;
+		if(hook && hook->when == when) {
+			for(k = hook->triggers; k; k = k->next) {
+				struct _alpm_trigger_t *t = k->data;
+				tcount += t->type == ALPM_HOOK_TYPE_PATH;
 			}
 		}
 	}
+	if(tcount == 0) {
+		return 0;
+	}
 
-	i = install = alpm_list_msort(install, isize, (alpm_list_fn_cmp)strcmp);
-	j = remove = alpm_list_msort(remove, rsize, (alpm_list_fn_cmp)strcmp);
-	while(i) {
-		while(j && strcmp(i->data, j->data) > 0) {
-			j = j->next;
-		}
-		if(j == NULL) {
-			break;
+	CALLOC(triggers, tcount, sizeof(*triggers), goto cleanup);
+	CALLOC(owners, tcount, sizeof(*owners), goto cleanup);
+	CALLOC(matched, tcount, sizeof(size_t), goto cleanup);
+	CALLOC(best, tcount, sizeof(size_t), goto cleanup);
+	if((patterns = _alpm_patterns_new()) == NULL) {
+		goto cleanup;
+	}
+	for(tcount = 0, j = hooks; j; j = j->next) {
+		struct _alpm_hook_t *hook = j->data;
+		if(hook == NULL || hook->when != when) {
+			continue;
 		}
-		if(strcmp(i->data, j->data) == 0) {
-			char *path = i->data;
-			upgrade = alpm_list_add(upgrade, path);
-			while(i && strcmp(i->data, path) == 0) {
-				alpm_list_t *next = i->next;
-				install = alpm_list_remove_item(install, i);
-				free(i);
-				i = next;
-			}
-			while(j && strcmp(j->data, path) == 0) {
-				alpm_list_t *next = j->next;
-				remove = alpm_list_remove_item(remove, j);
-				free(j);
-				j = next;
+		for(k = hook->triggers; k; k = k->next) {
+			struct _alpm_trigger_t *t = k->data;
+			if(t->type == ALPM_HOOK_TYPE_PATH) {
+				if(_alpm_patterns_add(patterns, t->targets) != 0) {
+					goto cleanup;
+				}
+				triggers[tcount] = t;
+				owners[tcount] = hook;
+				tcount++;
 			}
-		} else {
-			i = i->next;
 		}
 	}
 
-	ret = (t->op & ALPM_HOOK_OP_INSTALL && install)
-			|| (t->op & ALPM_HOOK_OP_UPGRADE && upgrade)
-			|| (t->op & ALPM_HOOK_OP_REMOVE && remove);
+	for(j = handle->trans->add; j; j = j->next) {
+		alpm_pkg_t *pkg = j->data;
+		icount += pkg->files.count;
+		if(pkg->oldpkg) {
+			rcount += pkg->oldpkg->files.count;
+		}
+	}
+	for(j = handle->trans->remove; j; j = j->next) {
+		alpm_pkg_t *pkg = j->data;
+		rcount += pkg->files.count;
+	}
+	CALLOC(install, icount + 1, sizeof(const char *), goto cleanup);
+	CALLOC(remove, rcount + 1, sizeof(const char *), goto cleanup);
+
+	/* files that will be installed, and files that will be removed due to a
+	 * package upgrade or removal */
+	for(icount = 0, rcount = 0, j = handle->trans->add; j; j = j->next) {
+		alpm_pkg_t *pkg = j->data;
+		icount = _alpm_hook_add_paths(handle, install, icount, pkg, 1);
+		if(pkg->oldpkg) {
+			rcount = _alpm_hook_add_paths(handle, remove, rcount, pkg->oldpkg, 0);
+		}
+	}
+	for(j = handle->trans->remove; j; j = j->next) {
+		rcount = _alpm_hook_add_paths(handle, remove, rcount, j->data, 0);
+	}
+	icount = _alpm_hook_sort_paths(install, icount);
+	rcount = _alpm_hook_sort_paths(remove, rcount);
+
+	for(i = 0, r = 0; i < icount || r < rcount;) {
+		enum _alpm_hook_op_t op;
+		const char *path;
+		size_t m, n;
+		int cmp = i == icount ? 1 : r == rcount ? -1 : strcmp(install[i], remove[r]);
+
+		if(cmp < 0) {
+			path = install[i++];
+			op = ALPM_HOOK_OP_INSTALL;
+		} else if(cmp > 0) {
+			path = remove[r++];
+			op = ALPM_HOOK_OP_REMOVE;
+		} else {
+			path = install[i++];
+			r++;
+			op = ALPM_HOOK_OP_UPGRADE;
+		}
 
-	if(hook->needs_targets) {
-#define _save_matches(_op, _matches) \
-	if(t->op & _op && _matches) { \
-		hook->matches = alpm_list_join(hook->matches, _matches); \
-	} else { \
-		alpm_list_free(_matches); \
-	}
-		_save_matches(ALPM_HOOK_OP_INSTALL, install);
-		_save_matches(ALPM_HOOK_OP_UPGRADE, upgrade);
-		_save_matches(ALPM_HOOK_OP_REMOVE, remove);
-#undef _save_matches
-	} else {
-		alpm_list_free(install);
-		alpm_list_free(upgrade);
-		alpm_list_free(remove);
+		n = _alpm_patterns_match_lists(patterns, path, matched, best);
+		for(m = 0; m < n; m++) {
+			struct _alpm_trigger_t *t = triggers[matched[m]];
+			struct _alpm_hook_t *hook = owners[matched[m]];
+			if(t->op & op) {
+				t->matched = 1;
+				if(hook->needs_targets) {
+					hook->matches = alpm_list_add(hook->matches, (char *)path);
+				}
+			}
+		}
 	}
+	ret = 0;
 
+cleanup:
+	if(ret != 0) {
+		handle->pm_errno = ALPM_ERR_MEMORY;
+	}
+	_alpm_patterns_free(patterns);
+	free(install);
+	free(remove);
+	free(matched);
+	free(best);
+	free(owners);
+	free(triggers);
 	return ret;
 }
 
@@ -369,7 +464,7 @@ static int _alpm_hook_trigger_match_pkg(alpm_handle_t *handle,
 		alpm_list_t *i;
 		for(i = handle->trans->add; i; i = i->next) {
 			alpm_pkg_t *pkg = i->data;
-			if(_alpm_fnmatch_patterns(t->targets, pkg->name) == 0) {
+			if(_alpm_trigger_match_target(t, pkg->name) == 0) {
 				if(pkg->oldpkg) {
 					if(t->op & ALPM_HOOK_OP_UPGRADE) {
 						if(hook->needs_targets) {
@@ -395,7 +490,7 @@ static int _alpm_hook_trigger_match_pkg(alpm_handle_t *handle,
 		alpm_list_t *i;
 		for(i = handle->trans->remove; i; i = i->next) {
 			alpm_pkg_t *pkg = i->data;
-			if(pkg && _alpm_fnmatch_patterns(t->targets, pkg->name) == 0) {
+			if(pkg && _alpm_trigger_match_target(t, pkg->name) == 0) {
 				if(!alpm_list_find(handle->trans->add, pkg, _alpm_pkg_cmp)) {
 					if(hook->needs_targets) {
 						remove = alpm_list_add(remove, pkg->name);
@@ -419,9 +514,14 @@ static int _alpm_hook_trigger_match_pkg(alpm_handle_t *handle,
 static int _alpm_hook_trigger_match(alpm_handle_t *handle,
 		struct _alpm_hook_t *hook, struct _alpm_trigger_t *t)
 {
-	return t->type == ALPM_HOOK_TYPE_PACKAGE
-		? _alpm_hook_trigger_match_pkg(handle, hook, t)
-		: _alpm_hook_trigger_match_file(handle, hook, t);
+	if(t->type == ALPM_HOOK_TYPE_PATH) {
+		/* already matched by _alpm_hook_match_paths() */
+		return t->matched;
+	}
+	if(t->patterns == NULL) {
+		t->patterns = _alpm_patterns_compile(t->targets);
+	}
+	return _alpm_hook_trigger_match_pkg(handle, hook, t);
 }
 
 static int _alpm_hook_triggered(alpm_handle_t *handle, struct _alpm_hook_t *hook)
@@ -529,20 +629,108 @@ static int _alpm_hook_run_hook(alpm_handle_t *handle, struct _alpm_hook_t *hook)
 	}
 }
 
-int _alpm_hook_run(alpm_handle_t *handle, alpm_hook_when_t when)
+/* Clear what a run found out about the current transaction */
+static void _alpm_hook_reset(alpm_list_t *hooks)
 {
-	alpm_event_hook_t event = { .when = when };
-	alpm_event_hook_run_t hook_event;
-	alpm_list_t *i, *hooks = NULL, *hooks_triggered = NULL;
-	size_t suflen = strlen(ALPM_HOOK_SUFFIX), triggered = 0;
+	alpm_list_t *i, *j;
+
+	for(i = hooks; i; i = i->next) {
+		struct _alpm_hook_t *hook = i->data;
+		alpm_list_free(hook->matches);
+		hook->matches = NULL;
+		for(j = hook->triggers; j; j = j->next) {
+			struct _alpm_trigger_t *t = j->data;
+			t->matched = 0;
+		}
+	}
+}
+
+static void _alpm_hook_cache_free(struct _alpm_hook_cache_t *cache)
+{
+	size_t i;
+
+	if(cache == NULL) {
+		return;
+	}
+	for(i = 0; i < cache->dir_count; i++) {
+		free(cache->dirs[i].path);
+	}
+	free(cache->dirs);
+	alpm_list_free_inner(cache->hooks, (alpm_list_fn_free) _alpm_hook_free);
+	alpm_list_free(cache->hooks);
+	free(cache);
+}
+
+void _alpm_hook_cache_invalidate(alpm_handle_t *handle)
+{
+	_alpm_hook_cache_free(handle->hook_cache);
+	handle->hook_cache = NULL;
+}
+
+/* Check if the hook directories are still the ones a cache was loaded
+ * from. A directory is modified whenever a hook is added, removed or
+ * replaced. Directories modified around the time they were read are not
+ * trusted, as a later change could leave their mtime unchanged. */
+static int _alpm_hook_cache_valid(alpm_handle_t *handle,
+		struct _alpm_hook_cache_t *cache)
+{
+	alpm_list_t *i;
+	size_t n = 0;
+
+	if(alpm_list_count(handle->hookdirs) != cache->dir_count) {
+		return 0;
+	}
+	for(i = handle->hookdirs; i; i = i->next) {
+		struct _alpm_hook_dir *dir = &cache->dirs[n++];
+		struct stat buf;
+
+		if(strcmp(dir->path, i->data) != 0) {
+			return 0;
+		}
+		if(stat(dir->path, &buf) != 0) {
+			if(errno == ENOENT && dir->exists == 0) {
+				continue;
+			}
+			return 0;
+		}
+		if(dir->exists != 1
+				|| buf.st_dev != dir->stat.st_dev
+				|| buf.st_ino != dir->stat.st_ino
+				|| buf.st_mtim.tv_sec != dir->stat.st_mtim.tv_sec
+				|| buf.st_mtim.tv_nsec != dir->stat.st_mtim.tv_nsec
+				|| buf.st_mtim.tv_sec >= cache->loaded - 1) {
+			return 0;
+		}
+	}
+	return 1;
+}
+
+/* Parse the hooks of all hook directories. Hooks in later directories
+ * override those with the same name in earlier ones. */
+static int _alpm_hook_load(alpm_handle_t *handle,
+		struct _alpm_hook_cache_t **hook_cache)
+{
+	struct _alpm_hook_cache_t *cache;
+	alpm_list_t *i;
+	size_t suflen = strlen(ALPM_HOOK_SUFFIX), dir_index;
 	int ret = 0;
 
+	CALLOC(cache, 1, sizeof(struct _alpm_hook_cache_t),
+			RET_ERR(handle, ALPM_ERR_MEMORY, -1));
+	cache->loaded = time(NULL);
+	dir_index = alpm_list_count(handle->hookdirs);
+	CALLOC(cache->dirs, dir_index + 1, sizeof(struct _alpm_hook_dir),
+			free(cache); RET_ERR(handle, ALPM_ERR_MEMORY, -1));
+	cache->dir_count = dir_index;
+
 	for(i = alpm_list_last(handle->hookdirs); i; i = alpm_list_previous(i)) {
 		char path[PATH_MAX];
 		size_t dirlen;
 		struct dirent *entry;
+		struct _alpm_hook_dir *dir = &cache->dirs[--dir_index];
 		DIR *d;
 
+		STRDUP(dir->path, i->data, goto cleanup);
 		if((dirlen = strlen(i->data)) >= PATH_MAX) {
 			_alpm_log(handle, ALPM_LOG_ERROR, _("could not open directory: %s: %s\n"),
 					(char *)i->data, strerror(ENAMETOOLONG));
@@ -551,6 +739,12 @@ int _alpm_hook_run(alpm_handle_t *handle, alpm_hook_when_t when)
 		}
 		memcpy(path, i->data, dirlen + 1);
 
+		if(stat(path, &dir->stat) == 0) {
+			dir->exists = 1;
+		} else if(errno != ENOENT) {
+			dir->exists = -1;
+		}
+
 		if(!(d = opendir(path))) {
 			if(errno == ENOENT) {
 				continue;
@@ -585,7 +779,7 @@ int _alpm_hook_run(alpm_handle_t *handle, alpm_hook_when_t when)
 				continue;
 			}
 
-			if(find_hook(hooks, entry->d_name)) {
+			if(find_hook(cache->hooks, entry->d_name)) {
 				_alpm_log(handle, ALPM_LOG_DEBUG, "skipping overridden hook %s\n", path);
 				continue;
 			}
@@ -603,7 +797,7 @@ int _alpm_hook_run(alpm_handle_t *handle, alpm_hook_when_t when)
 			}
 
 			CALLOC(ctx.hook, sizeof(struct _alpm_hook_t), 1,
-					ret = -1; closedir(d); goto cleanup);
+					closedir(d); goto cleanup);
 
 			_alpm_log(handle, ALPM_LOG_DEBUG, "parsing hook file %s\n", path);
 			if(parse_ini(path, _alpm_hook_parse_cb, &ctx) != 0
@@ -614,8 +808,8 @@ int _alpm_hook_run(alpm_handle_t *handle, alpm_hook_when_t when)
 				continue;
 			}
 
-			STRDUP(ctx.hook->name, entry->d_name, ret = -1; closedir(d); goto cleanup);
-			hooks = alpm_list_add(hooks, ctx.hook);
+			STRDUP(ctx.hook->name, entry->d_name, closedir(d); goto cleanup);
+			cache->hooks = alpm_list_add(cache->hooks, ctx.hook);
 		}
 		if(errno != 0) {
 			_alpm_log(handle, ALPM_LOG_ERROR, _("could not read directory: %s: %s\n"),
@@ -626,12 +820,46 @@ int _alpm_hook_run(alpm_handle_t *handle, alpm_hook_when_t when)
 		closedir(d);
 	}
 
-	if(ret != 0 && when == ALPM_HOOK_PRE_TRANSACTION) {
+	cache->hooks = alpm_list_msort(cache->hooks, alpm_list_count(cache->hooks),
+			(alpm_list_fn_cmp)_alpm_hook_cmp);
+	*hook_cache = cache;
+	return ret;
+
+cleanup:
+	_alpm_hook_cache_free(cache);
+	return -1;
+}
+
+int _alpm_hook_run(alpm_handle_t *handle, alpm_hook_when_t when)
+{
+	alpm_event_hook_t event = { .when = when };
+	alpm_event_hook_run_t hook_event;
+	alpm_list_t *i, *hooks = NULL, *hooks_triggered = NULL;
+	struct _alpm_hook_cache_t *cache = handle->hook_cache;
+	size_t triggered = 0;
+	int ret = 0;
+
+	if(cache && !_alpm_hook_cache_valid(handle, cache)) {
+		_alpm_log(handle, ALPM_LOG_DEBUG, "hook directories changed, reloading hooks\n");
+		_alpm_hook_cache_invalidate(handle);
+		cache = NULL;
+	}
+
+	if(cache == NULL) {
+		ret = _alpm_hook_load(handle, &cache);
+		if(cache && ret == 0) {
+			handle->hook_cache = cache;
+		}
+	}
+	if(cache == NULL || (ret != 0 && when == ALPM_HOOK_PRE_TRANSACTION)) {
 		goto cleanup;
 	}
+	hooks = cache->hooks;
 
-	hooks = alpm_list_msort(hooks, alpm_list_count(hooks),
-			(alpm_list_fn_cmp)_alpm_hook_cmp);
+	if(_alpm_hook_match_paths(handle, hooks, when) != 0) {
+		ret = -1;
+		goto cleanup;
+	}
 
 	for(i = hooks; i; i = i->next) {
 		struct _alpm_hook_t *hook = i->data;
@@ -676,8 +904,12 @@ int _alpm_hook_run(alpm_handle_t *handle, alpm_hook_when_t when)
 	}
 
 cleanup:
-	alpm_list_free_inner(hooks, (alpm_list_fn_free) _alpm_hook_free);
-	alpm_list_free(hooks);
+	/* only hooks loaded without errors are kept for the next run */
+	if(cache != handle->hook_cache) {
+		_alpm_hook_cache_free(cache);
+	} else if(cache) {
+		_alpm_hook_reset(cache->hooks);
+	}
 
 	return ret;
 }
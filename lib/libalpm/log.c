@@ -28,6 +28,7 @@
 #include "log.h"
 #include "handle.h"
 #include "util.h"
+#include "workers.h"
 #include "alpm.h"
 
 static int _alpm_log_leader(FILE *f, const char *prefix)
@@ -54,6 +55,14 @@ int SYMEXPORT alpm_logaction(alpm_handle_t *handle, const char *prefix,
 		prefix = "UNKNOWN";
 	}
 
+	/* worker threads leave writing the log to the original handle */
+	if(handle->worker) {
+		va_start(args, fmt);
+		ret = _alpm_worker_logaction(handle, prefix, fmt, args);
+		va_end(args);
+		return ret;
+	}
+
 	/* check if the logstream is open already, opening it if needed */
 	if(handle->logstream == NULL && handle->logfile != NULL) {
 		int fd;
@@ -98,11 +107,11 @@ int SYMEXPORT alpm_logaction(alpm_handle_t *handle, const char *prefix,
 	return ret;
 }
 
-void _alpm_log(alpm_handle_t *handle, alpm_loglevel_t flag, const char *fmt, ...)
+void _alpm_log_message(alpm_handle_t *handle, alpm_loglevel_t flag, const char *fmt, ...)
 {
 	va_list args;
 
-	if(handle == NULL || handle->logcb == NULL) {
+	if(!_alpm_log_enabled(handle, flag)) {
 		return;
 	}
 
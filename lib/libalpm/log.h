@@ -24,7 +24,20 @@
 
 #define ALPM_CALLER_PREFIX "ALPM"
 
-void _alpm_log(alpm_handle_t *handle, alpm_loglevel_t flag,
+void _alpm_log_message(alpm_handle_t *handle, alpm_loglevel_t flag,
 		const char *fmt, ...) __attribute__((format(printf,3,4)));
 
+/* whether a message of level flag would reach the log callback; callers
+ * need handle.h */
+#define _alpm_log_enabled(handle, flag) \
+	((handle) != NULL && (handle)->logcb != NULL && ((handle)->logmask & (flag)))
+
+/* The arguments are only evaluated if the message is logged, so messages
+ * the frontend does not want cost a single test. handle is evaluated
+ * more than once. */
+#define _alpm_log(handle, flag, ...) do { \
+	if(_alpm_log_enabled(handle, flag)) { \
+		_alpm_log_message(handle, flag, __VA_ARGS__); \
+	} } while(0)
+
 #endif /* ALPM_LOG_H */
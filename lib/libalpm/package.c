@@ -495,70 +495,112 @@ alpm_list_t SYMEXPORT *alpm_pkg_get_xdata(alpm_pkg_t *pkg)
 	return pkg->ops->get_xdata(pkg);
 }
 
-static void find_requiredby(alpm_pkg_t *pkg, alpm_db_t *db, alpm_list_t **reqs,
+static int pkgdep_index_cmp(const void *p1, const void *p2)
+{
+	const alpm_pkgdep_t *d1 = p1, *d2 = p2;
+	return (d1->index > d2->index) - (d1->index < d2->index);
+}
+
+/* collects the entries of a dependency list of db named name which pkg
+ * satisfies */
+static int add_dependents(alpm_pkg_t *pkg, alpm_db_t *db, alpm_deplist_t list,
+		const char *name, alpm_list_t **found)
+{
+	alpm_pkgdep_t *entry;
+	size_t n;
+
+	if(_alpm_db_find_deps(db, list, name, &entry, &n) != 0) {
+		return -1;
+	}
+	for(; n > 0; entry++, n--) {
+		if(_alpm_depcmp(pkg, entry->dep)) {
+			*found = alpm_list_add(*found, entry);
+		}
+	}
+	return 0;
+}
+
+static int find_requiredby(alpm_pkg_t *pkg, alpm_db_t *db, alpm_list_t **reqs,
 		int optional)
 {
+	alpm_deplist_t list = optional ? DEPLIST_OPTDEPENDS : DEPLIST_DEPENDS;
+	alpm_list_t *found = NULL;
 	const alpm_list_t *i;
+	alpm_pkg_t *last = NULL;
+	int ret = 0;
 	pkg->handle->pm_errno = ALPM_ERR_OK;
 
-	for(i = _alpm_db_get_pkgcache(db); i; i = i->next) {
-		alpm_pkg_t *cachepkg = i->data;
-		alpm_list_t *j;
+	/* only dependencies on the name of pkg or one of its provisions can be
+	 * satisfied by it */
+	ret = add_dependents(pkg, db, list, pkg->name, &found);
+	for(i = alpm_pkg_get_provides(pkg); i && ret == 0; i = i->next) {
+		alpm_depend_t *provision = i->data;
+		ret = add_dependents(pkg, db, list, provision->name, &found);
+	}
+	if(ret != 0) {
+		alpm_list_free(found);
+		return -1;
+	}
 
-		if(optional == 0) {
-			j = alpm_pkg_get_depends(cachepkg);
-		} else {
-			j = alpm_pkg_get_optdepends(cachepkg);
+	/* report the dependent packages in package cache order */
+	found = alpm_list_msort(found, alpm_list_count(found), pkgdep_index_cmp);
+	for(i = found; i; i = i->next) {
+		alpm_pkgdep_t *entry = i->data;
+		const char *cachepkgname = entry->pkg->name;
+		if(entry->pkg == last) {
+			continue;
 		}
-
-		for(; j; j = j->next) {
-			if(_alpm_depcmp(pkg, j->data)) {
-				const char *cachepkgname = cachepkg->name;
-				if(alpm_list_find_str(*reqs, cachepkgname) == NULL) {
-					*reqs = alpm_list_add(*reqs, strdup(cachepkgname));
-				}
-			}
+		last = entry->pkg;
+		if(alpm_list_find_str(*reqs, cachepkgname) == NULL) {
+			*reqs = alpm_list_add(*reqs, strdup(cachepkgname));
 		}
 	}
+	alpm_list_free(found);
+	return 0;
 }
 
-static alpm_list_t *compute_requiredby(alpm_pkg_t *pkg, int optional)
+alpm_list_t *_alpm_pkg_compute_requiredby(alpm_pkg_t *pkg, int optional)
 {
 	const alpm_list_t *i;
 	alpm_list_t *reqs = NULL;
 	alpm_db_t *db;
+	int ret = 0;
 
 	ASSERT(pkg != NULL, return NULL);
 	pkg->handle->pm_errno = ALPM_ERR_OK;
 
 	if(pkg->origin == ALPM_PKG_FROM_FILE) {
 		/* The sane option; search locally for things that require this. */
-		find_requiredby(pkg, pkg->handle->db_local, &reqs, optional);
+		ret = find_requiredby(pkg, pkg->handle->db_local, &reqs, optional);
 	} else {
 		/* We have a DB package. if it is a local package, then we should
 		 * only search the local DB; else search all known sync databases. */
 		db = pkg->origin_data.db;
 		if(db->status & DB_STATUS_LOCAL) {
-			find_requiredby(pkg, db, &reqs, optional);
+			ret = find_requiredby(pkg, db, &reqs, optional);
 		} else {
-			for(i = pkg->handle->dbs_sync; i; i = i->next) {
+			for(i = pkg->handle->dbs_sync; i && ret == 0; i = i->next) {
 				db = i->data;
-				find_requiredby(pkg, db, &reqs, optional);
+				ret = find_requiredby(pkg, db, &reqs, optional);
 			}
 			reqs = alpm_list_msort(reqs, alpm_list_count(reqs), _alpm_str_cmp);
 		}
 	}
+	if(ret != 0) {
+		/* pm_errno is set by the failed lookup */
+		FREELIST(reqs);
+	}
 	return reqs;
 }
 
 alpm_list_t SYMEXPORT *alpm_pkg_compute_requiredby(alpm_pkg_t *pkg)
 {
-	return compute_requiredby(pkg, 0);
+	return _alpm_pkg_compute_requiredby(pkg, 0);
 }
 
 alpm_list_t SYMEXPORT *alpm_pkg_compute_optionalfor(alpm_pkg_t *pkg)
 {
-	return compute_requiredby(pkg, 1);
+	return _alpm_pkg_compute_requiredby(pkg, 1);
 }
 
 alpm_file_t *_alpm_file_copy(alpm_file_t *dest,
@@ -755,6 +797,7 @@ void _alpm_pkg_free(alpm_pkg_t *pkg)
 	if(pkg->origin == ALPM_PKG_FROM_FILE) {
 		FREE(pkg->origin_data.file);
 	}
+	_alpm_pkgsession_free(pkg->session);
 	FREE(pkg);
 }
 
@@ -780,10 +823,39 @@ void _alpm_pkg_free_trans(alpm_pkg_t *pkg)
 	pkg->oldpkg = NULL;
 }
 
+static const alpm_evr_t *pkg_get_evr(alpm_pkg_t *pkg)
+{
+	if(pkg->evr.version == NULL) {
+		_alpm_evr_parse(pkg->version, &pkg->evr);
+	}
+	return &pkg->evr;
+}
+
 /* Is spkg an upgrade for localpkg? */
 int _alpm_pkg_compare_versions(alpm_pkg_t *spkg, alpm_pkg_t *localpkg)
 {
-	return alpm_pkg_vercmp(spkg->version, localpkg->version);
+	if(spkg->version == NULL || localpkg->version == NULL
+			|| strcmp(spkg->version, localpkg->version) == 0) {
+		return alpm_pkg_vercmp(spkg->version, localpkg->version);
+	}
+	return _alpm_evr_cmp(pkg_get_evr(spkg), pkg_get_evr(localpkg));
+}
+
+/** Compare the version of a package with a version string.
+ * @param pkg the package
+ * @param version the version to compare against
+ * @return the same as alpm_pkg_vercmp(pkg->version, version)
+ */
+int _alpm_pkg_vercmp(alpm_pkg_t *pkg, const char *version)
+{
+	alpm_evr_t evr;
+
+	if(pkg->version == NULL || version == NULL
+			|| strcmp(pkg->version, version) == 0) {
+		return alpm_pkg_vercmp(pkg->version, version);
+	}
+	_alpm_evr_parse(version, &evr);
+	return _alpm_evr_cmp(pkg_get_evr(pkg), &evr);
 }
 
 /* Helper function for comparing packages
@@ -34,6 +34,7 @@
 #include "backup.h"
 #include "db.h"
 #include "signing.h"
+#include "version.h"
 
 /** Package operations struct. This struct contains function pointers to
  * all methods used to access data in a package to allow for things such
@@ -87,6 +88,18 @@ struct pkg_operations {
  */
 extern const struct pkg_operations default_pkg_ops;
 
+/** Metadata entries of a package file. They are read in the same pass
+ * that loads the package, so running the pre_install scriptlet or reading
+ * the changelog later in the transaction does not decompress the archive
+ * again.
+ */
+typedef struct _alpm_pkgsession_t {
+	char *install;
+	size_t install_len;
+	char *changelog;
+	size_t changelog_len;
+} alpm_pkgsession_t;
+
 struct _alpm_pkg_t {
 	unsigned long name_hash;
 	char *filename;
@@ -144,6 +157,12 @@ struct _alpm_pkg_t {
 	int infolevel;
 	/* Bitfield from alpm_pkgvalidation_t */
 	int validation;
+	/* sha256sum was verified while downloading, in transaction targets only */
+	int download_verified;
+	/* origin == PKG_FROM_FILE only */
+	alpm_pkgsession_t *session;
+	/* version split up on first comparison, see _alpm_pkg_vercmp() */
+	alpm_evr_t evr;
 };
 
 alpm_file_t *_alpm_file_copy(alpm_file_t *dest, const alpm_file_t *src);
@@ -158,9 +177,13 @@ int _alpm_pkg_validate_internal(alpm_handle_t *handle,
 		alpm_siglist_t **sigdata, int *validation);
 alpm_pkg_t *_alpm_pkg_load_internal(alpm_handle_t *handle,
 		const char *pkgfile, int full);
+void _alpm_pkgsession_free(alpm_pkgsession_t *session);
+int _alpm_pkg_extract_scriptlet(alpm_pkg_t *pkg, const char *prefix);
 
 int _alpm_pkg_cmp(const void *p1, const void *p2);
 int _alpm_pkg_compare_versions(alpm_pkg_t *local_pkg, alpm_pkg_t *pkg);
+int _alpm_pkg_vercmp(alpm_pkg_t *pkg, const char *version);
+alpm_list_t *_alpm_pkg_compute_requiredby(alpm_pkg_t *pkg, int optional);
 
 alpm_pkg_xdata_t *_alpm_pkg_parse_xdata(const char *string);
 void _alpm_pkg_xdata_free(alpm_pkg_xdata_t *pd);
@@ -0,0 +1,466 @@
+/*
+ *  patterns.c
+ *
+ *  Copyright (c) 2024 Pacman Development Team <pacman-dev@lists.archlinux.org>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <fnmatch.h>
+
+/* libalpm */
+#include "patterns.h"
+#include "alpm_list.h"
+#include "util.h"
+
+struct strset_entry {
+	char *str;
+	size_t len;
+	unsigned long hash;
+	/* payload used by compiled patterns */
+	size_t value;
+};
+
+struct _alpm_strset_t {
+	/* open addressing, the size is a power of two */
+	struct strset_entry *entries;
+	size_t size;
+	size_t count;
+	/* lengths[n] is set if a string of length n is in the set */
+	char *lengths;
+	size_t lengths_size;
+};
+
+/* A pattern, reachable from the hash table entry of its key */
+struct pattern_entry {
+	/* list the pattern belongs to */
+	size_t list;
+	/* 1-based position in the list, shifted left by one, with the lowest
+	 * bit set for an inverted pattern */
+	size_t value;
+	/* pattern to pass to fnmatch(), NULL if matching the key is enough */
+	char *glob;
+	/* next pattern with the same key, 1-based, 0 ends the chain */
+	size_t next;
+};
+
+/* Patterns are found through a literal part of them, so only a few of
+ * them need to be checked for any string:
+ *  - patterns without wildcards are keyed by the whole pattern,
+ *  - patterns starting with a literal are keyed by it; "foo*" needs no
+ *    fnmatch() call,
+ *  - patterns starting with a wildcard and ending with a literal are keyed
+ *    by that, hashed back to front; "*foo" needs no fnmatch() call,
+ *  - the remaining patterns are checked for every string.
+ * The value of a hash table entry is the 1-based index of the first
+ * pattern in its chain. The last matching pattern of a list decides, so
+ * for each list the match with the highest position wins. */
+struct _alpm_patterns_t {
+	alpm_strset_t *literals;
+	alpm_strset_t *prefixes;
+	alpm_strset_t *suffixes;
+	size_t unanchored;
+	struct pattern_entry *entries;
+	size_t entry_count;
+	size_t entries_size;
+	size_t list_count;
+};
+
+static unsigned long hash_step(unsigned long hash, unsigned char c)
+{
+	return c + hash * 65599;
+}
+
+static unsigned long hash_forward(const char *str, size_t len)
+{
+	unsigned long hash = 0;
+	size_t i;
+
+	for(i = 0; i < len; i++) {
+		hash = hash_step(hash, str[i]);
+	}
+	return hash;
+}
+
+static unsigned long hash_backward(const char *str, size_t len)
+{
+	unsigned long hash = 0;
+
+	while(len > 0) {
+		hash = hash_step(hash, str[--len]);
+	}
+	return hash;
+}
+
+static struct strset_entry *strset_find(const alpm_strset_t *set,
+		const char *str, size_t len, unsigned long hash)
+{
+	size_t i = hash & (set->size - 1);
+
+	while(set->entries[i].str) {
+		const struct strset_entry *entry = &set->entries[i];
+		if(entry->hash == hash && entry->len == len
+				&& memcmp(entry->str, str, len) == 0) {
+			return &set->entries[i];
+		}
+		i = (i + 1) & (set->size - 1);
+	}
+	return &set->entries[i];
+}
+
+static int strset_grow(alpm_strset_t *set)
+{
+	struct strset_entry *old = set->entries;
+	size_t oldsize = set->size, i;
+
+	CALLOC(set->entries, oldsize * 2, sizeof(struct strset_entry),
+			set->entries = old; return -1);
+	set->size = oldsize * 2;
+	for(i = 0; i < oldsize; i++) {
+		if(old[i].str) {
+			*strset_find(set, old[i].str, old[i].len, old[i].hash) = old[i];
+		}
+	}
+	free(old);
+	return 0;
+}
+
+static struct strset_entry *strset_insert(alpm_strset_t *set,
+		const char *str, size_t len, unsigned long hash)
+{
+	struct strset_entry *entry;
+
+	if((set->count + 1) * 2 > set->size && strset_grow(set) != 0) {
+		return NULL;
+	}
+	if(len >= set->lengths_size && !_alpm_realloc((void **)&set->lengths,
+				&set->lengths_size, len + 1)) {
+		return NULL;
+	}
+	entry = strset_find(set, str, len, hash);
+	if(entry->str == NULL) {
+		MALLOC(entry->str, len + 1, return NULL);
+		memcpy(entry->str, str, len);
+		entry->str[len] = '\0';
+		entry->len = len;
+		entry->hash = hash;
+		set->lengths[len] = 1;
+		set->count++;
+	}
+	return entry;
+}
+
+/** Create an empty string set.
+ * @return the set, or NULL on error
+ */
+alpm_strset_t *_alpm_strset_new(void)
+{
+	alpm_strset_t *set;
+
+	CALLOC(set, 1, sizeof(alpm_strset_t), return NULL);
+	set->size = 16;
+	CALLOC(set->entries, set->size, sizeof(struct strset_entry),
+			free(set); return NULL);
+	return set;
+}
+
+/** Add a copy of a string to a set.
+ * @param set the set
+ * @param str the string
+ * @return 0 on success, -1 on error
+ */
+int _alpm_strset_add(alpm_strset_t *set, const char *str)
+{
+	size_t len = strlen(str);
+	return strset_insert(set, str, len, hash_forward(str, len)) ? 0 : -1;
+}
+
+/** Check if a string is in a set.
+ * @param set the set, may be NULL
+ * @param str the string
+ * @return 1 if the string is in the set, 0 otherwise
+ */
+int _alpm_strset_contains(const alpm_strset_t *set, const char *str)
+{
+	size_t len;
+
+	if(set == NULL || set->count == 0) {
+		return 0;
+	}
+	len = strlen(str);
+	return strset_find(set, str, len, hash_forward(str, len))->str != NULL;
+}
+
+void _alpm_strset_free(alpm_strset_t *set)
+{
+	size_t i;
+
+	if(set == NULL) {
+		return;
+	}
+	for(i = 0; i < set->size; i++) {
+		free(set->entries[i].str);
+	}
+	free(set->entries);
+	free(set->lengths);
+	free(set);
+}
+
+/* Characters that make a pattern more than a literal string */
+#define PATTERN_SPECIAL "*?[\\"
+
+static size_t literal_prefix_len(const char *str, size_t len)
+{
+	size_t i;
+
+	for(i = 0; i < len && !strchr(PATTERN_SPECIAL, str[i]); i++);
+	return i;
+}
+
+static size_t literal_suffix_len(const char *str, size_t len)
+{
+	size_t i;
+
+	/* a ']' may close a bracket expression */
+	for(i = 0; i < len && !strchr(PATTERN_SPECIAL "]", str[len - i - 1]); i++);
+	return i;
+}
+
+static int add_entry(alpm_patterns_t *set, size_t *chain, size_t list,
+		size_t value, const char *glob)
+{
+	struct pattern_entry *entry;
+
+	if(!_alpm_greedy_grow((void **)&set->entries, &set->entries_size,
+				(set->entry_count + 1) * sizeof(struct pattern_entry))) {
+		return -1;
+	}
+	entry = &set->entries[set->entry_count];
+	entry->list = list;
+	entry->value = value;
+	entry->glob = NULL;
+	if(glob) {
+		STRDUP(entry->glob, glob, return -1);
+	}
+	entry->next = *chain;
+	*chain = ++set->entry_count;
+	return 0;
+}
+
+static int add_keyed(alpm_patterns_t *set, alpm_strset_t *table,
+		const char *key, size_t len, unsigned long hash, size_t list,
+		size_t value, const char *glob)
+{
+	struct strset_entry *entry = strset_insert(table, key, len, hash);
+	if(entry == NULL) {
+		return -1;
+	}
+	return add_entry(set, &entry->value, list, value, glob);
+}
+
+/** Create an empty set of pattern lists.
+ * @return the set, or NULL on error
+ */
+alpm_patterns_t *_alpm_patterns_new(void)
+{
+	alpm_patterns_t *set;
+
+	CALLOC(set, 1, sizeof(alpm_patterns_t), return NULL);
+	if((set->literals = _alpm_strset_new()) == NULL
+			|| (set->prefixes = _alpm_strset_new()) == NULL
+			|| (set->suffixes = _alpm_strset_new()) == NULL) {
+		_alpm_patterns_free(set);
+		return NULL;
+	}
+	return set;
+}
+
+/** Add a list of patterns to a set.
+ * Lists are numbered from 0 in the order they are added.
+ * @param set the set
+ * @param patterns list of patterns, as for _alpm_fnmatch_patterns()
+ * @return 0 on success, -1 on error
+ */
+int _alpm_patterns_add(alpm_patterns_t *set, alpm_list_t *patterns)
+{
+	size_t list = set->list_count, pos;
+	alpm_list_t *i;
+
+	for(pos = 1, i = patterns; i; i = i->next, pos++) {
+		const char *pattern = i->data;
+		int inverted = pattern[0] == '!';
+		size_t value, len, plen, slen;
+		int ret;
+
+		if(inverted || pattern[0] == '\\') {
+			pattern++;
+		}
+		len = strlen(pattern);
+		value = (pos << 1) | inverted;
+		plen = literal_prefix_len(pattern, len);
+
+		if(plen == len) {
+			ret = add_keyed(set, set->literals, pattern, len,
+					hash_forward(pattern, len), list, value, NULL);
+		} else if(plen > 0) {
+			int plain = plen == len - 1 && pattern[plen] == '*';
+			ret = add_keyed(set, set->prefixes, pattern, plen,
+					hash_forward(pattern, plen), list, value, plain ? NULL : pattern);
+		} else if((slen = literal_suffix_len(pattern, len)) > 0) {
+			int plain = slen == len - 1 && pattern[0] == '*';
+			const char *suffix = pattern + len - slen;
+			ret = add_keyed(set, set->suffixes, suffix, slen,
+					hash_backward(suffix, slen), list, value, plain ? NULL : pattern);
+		} else {
+			ret = add_entry(set, &set->unanchored, list, value, pattern);
+		}
+		if(ret != 0) {
+			return -1;
+		}
+	}
+
+	set->list_count++;
+	return 0;
+}
+
+/** Compile a list of patterns for repeated matching.
+ * @param patterns list of patterns, as for _alpm_fnmatch_patterns()
+ * @return the compiled patterns, or NULL on error
+ */
+alpm_patterns_t *_alpm_patterns_compile(alpm_list_t *patterns)
+{
+	alpm_patterns_t *set = _alpm_patterns_new();
+
+	if(set && _alpm_patterns_add(set, patterns) != 0) {
+		_alpm_patterns_free(set);
+		return NULL;
+	}
+	return set;
+}
+
+/* best[] holds the value of the best match so far for each list */
+static void match_chain(const alpm_patterns_t *set, size_t chain,
+		const char *string, size_t *best)
+{
+	while(chain) {
+		const struct pattern_entry *entry = &set->entries[chain - 1];
+		/* only a pattern later in the list can override a match */
+		if(entry->value >> 1 > best[entry->list] >> 1
+				&& (entry->glob == NULL || fnmatch(entry->glob, string, 0) == 0)) {
+			best[entry->list] = entry->value;
+		}
+		chain = entry->next;
+	}
+}
+
+static void match_best(const alpm_patterns_t *set, const char *string,
+		size_t *best)
+{
+	const alpm_strset_t *table;
+	const struct strset_entry *entry;
+	unsigned long hash;
+	size_t len = strlen(string), n;
+
+	table = set->literals;
+	if(table->count && len < table->lengths_size && table->lengths[len]) {
+		entry = strset_find(table, string, len, hash_forward(string, len));
+		if(entry->str) {
+			match_chain(set, entry->value, string, best);
+		}
+	}
+
+	/* hash the string front to back, probing every length a key has */
+	table = set->prefixes;
+	for(hash = 0, n = 1; n <= len && n < table->lengths_size; n++) {
+		hash = hash_step(hash, string[n - 1]);
+		if(table->lengths[n]) {
+			entry = strset_find(table, string, n, hash);
+			if(entry->str) {
+				match_chain(set, entry->value, string, best);
+			}
+		}
+	}
+
+	table = set->suffixes;
+	for(hash = 0, n = 1; n <= len && n < table->lengths_size; n++) {
+		hash = hash_step(hash, string[len - n]);
+		if(table->lengths[n]) {
+			entry = strset_find(table, string + len - n, n, hash);
+			if(entry->str) {
+				match_chain(set, entry->value, string, best);
+			}
+		}
+	}
+
+	match_chain(set, set->unanchored, string, best);
+}
+
+/** Match a string against a compiled list of patterns.
+ * @param set patterns from _alpm_patterns_compile(), NULL matches nothing
+ * @param string the string to match
+ * @return 0 if the last matching pattern is a normal pattern, 1 if it is an
+ * inverted pattern, -1 if no pattern matches
+ */
+int _alpm_patterns_match(const alpm_patterns_t *set, const char *string)
+{
+	size_t best = 0;
+
+	if(set == NULL) {
+		return -1;
+	}
+	match_best(set, string, &best);
+	return best ? (int)(best & 1) : -1;
+}
+
+/** Match a string against every list of a set at once.
+ * @param set the set
+ * @param string the string to match
+ * @param matched set to the indexes of the lists matching \a string, as
+ * _alpm_patterns_match() returning 0; must have room for all lists
+ * @param best scratch space with room for all lists
+ * @return the number of indexes stored in \a matched
+ */
+size_t _alpm_patterns_match_lists(const alpm_patterns_t *set,
+		const char *string, size_t *matched, size_t *best)
+{
+	size_t i, count = 0;
+
+	memset(best, 0, set->list_count * sizeof(size_t));
+	match_best(set, string, best);
+	for(i = 0; i < set->list_count; i++) {
+		if(best[i] && !(best[i] & 1)) {
+			matched[count++] = i;
+		}
+	}
+	return count;
+}
+
+void _alpm_patterns_free(alpm_patterns_t *set)
+{
+	size_t i;
+
+	if(set == NULL) {
+		return;
+	}
+	_alpm_strset_free(set->literals);
+	_alpm_strset_free(set->prefixes);
+	_alpm_strset_free(set->suffixes);
+	for(i = 0; i < set->entry_count; i++) {
+		free(set->entries[i].glob);
+	}
+	free(set->entries);
+	free(set);
+}
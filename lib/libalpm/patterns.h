@@ -0,0 +1,45 @@
+/*
+ *  patterns.h
+ *
+ *  Copyright (c) 2024 Pacman Development Team <pacman-dev@lists.archlinux.org>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef ALPM_PATTERNS_H
+#define ALPM_PATTERNS_H
+
+#include "alpm_list.h"
+
+/** A hashed set of strings */
+typedef struct _alpm_strset_t alpm_strset_t;
+
+alpm_strset_t *_alpm_strset_new(void);
+int _alpm_strset_add(alpm_strset_t *set, const char *str);
+int _alpm_strset_contains(const alpm_strset_t *set, const char *str);
+void _alpm_strset_free(alpm_strset_t *set);
+
+/** Compiled lists of fnmatch patterns, see _alpm_fnmatch_patterns() */
+typedef struct _alpm_patterns_t alpm_patterns_t;
+
+alpm_patterns_t *_alpm_patterns_compile(alpm_list_t *patterns);
+int _alpm_patterns_match(const alpm_patterns_t *set, const char *string);
+void _alpm_patterns_free(alpm_patterns_t *set);
+
+/* several lists of patterns matched in one go */
+alpm_patterns_t *_alpm_patterns_new(void);
+int _alpm_patterns_add(alpm_patterns_t *set, alpm_list_t *patterns);
+size_t _alpm_patterns_match_lists(const alpm_patterns_t *set,
+		const char *string, size_t *matched, size_t *best);
+
+#endif /* ALPM_PATTERNS_H */
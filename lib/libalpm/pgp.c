@@ -0,0 +1,1603 @@
+/*
+ *  pgp.c
+ *
+ *  Copyright (c) 2024 Pacman Development Team <pacman-dev@lists.archlinux.org>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* In-process verification of OpenPGP detached signatures (RFC 4880 version 4
+ * signatures made by RSA or Ed25519 keys). Keys are read from a binary
+ * keyring snapshot as written by 'gpg --export'. Every key in the snapshot is
+ * trusted; there is no web of trust, key import or revocation checking beyond
+ * what the snapshot itself contains. */
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/types.h>
+
+#ifdef HAVE_LIBSSL
+#include <openssl/evp.h>
+#include <openssl/rsa.h>
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+#include <openssl/core_names.h>
+#include <openssl/param_build.h>
+#endif
+#endif
+
+#ifdef HAVE_LIBNETTLE
+#include <nettle/bignum.h>
+#include <nettle/eddsa.h>
+#include <nettle/nettle-meta.h>
+#include <nettle/rsa.h>
+#endif
+
+/* libalpm */
+#include "pgp.h"
+#include "signing.h"
+#include "util.h"
+#include "log.h"
+#include "alpm.h"
+#include "handle.h"
+
+/* packet tags */
+#define PGP_TAG_SIGNATURE       2
+#define PGP_TAG_PUBLIC_KEY      6
+#define PGP_TAG_USER_ID         13
+#define PGP_TAG_PUBLIC_SUBKEY   14
+#define PGP_TAG_USER_ATTRIBUTE  17
+
+/* signature types */
+#define PGP_SIG_BINARY          0x00
+#define PGP_SIG_CERT_GENERIC    0x10
+#define PGP_SIG_CERT_POSITIVE   0x13
+#define PGP_SIG_SUBKEY_BINDING  0x18
+#define PGP_SIG_PRIMARY_BINDING 0x19
+#define PGP_SIG_KEY_REVOKE      0x20
+#define PGP_SIG_SUBKEY_REVOKE   0x28
+
+/* public key algorithms */
+#define PGP_PK_RSA              1
+#define PGP_PK_RSA_SIGN         3
+#define PGP_PK_EDDSA            22
+#define PGP_PK_ED25519          27
+
+/* hash algorithms */
+#define PGP_HASH_SHA1           2
+#define PGP_HASH_SHA256         8
+#define PGP_HASH_SHA384         9
+#define PGP_HASH_SHA512         10
+#define PGP_HASH_SHA224         11
+
+/* signature subpackets */
+#define PGP_SUB_CREATED         2
+#define PGP_SUB_SIG_EXPIRES     3
+#define PGP_SUB_KEY_EXPIRES     9
+#define PGP_SUB_ISSUER          16
+#define PGP_SUB_PRIMARY_UID     25
+#define PGP_SUB_KEY_FLAGS       27
+#define PGP_SUB_EMBEDDED_SIG    32
+#define PGP_SUB_ISSUER_FPR      33
+
+#define PGP_KEY_FLAG_SIGN       0x02
+
+#define PGP_FPR_SIZE            20
+#define PGP_KEYID_SIZE          8
+#define PGP_MAX_DIGEST          64
+#define PGP_ED25519_SIZE        32
+/* smallest RSA modulus accepted, in bits */
+#define PGP_RSA_MIN_BITS        2048
+
+/* OID of the Ed25519 curve for legacy EdDSA keys */
+static const unsigned char ed25519_oid[] = {
+	0x2b, 0x06, 0x01, 0x04, 0x01, 0xda, 0x47, 0x0f, 0x01
+};
+
+typedef struct _pgp_pubkey_t {
+	/* PGP_PK_RSA or PGP_PK_ED25519 */
+	int algo;
+	/* modulus length of RSA keys in bytes */
+	size_t size;
+#if HAVE_LIBSSL
+	EVP_PKEY *pkey;
+#else /* HAVE_LIBNETTLE */
+	struct rsa_public_key rsa;
+	unsigned char ed25519[PGP_ED25519_SIZE];
+#endif
+} pgp_pubkey_t;
+
+typedef struct _pgp_key_t {
+	unsigned char fpr[PGP_FPR_SIZE];
+	time_t created;
+	/* 0 if the key does not expire */
+	time_t expires;
+	int revoked;
+	/* the key carries a valid self-signature allowing it to sign data */
+	int can_sign;
+	/* user ID of the certificate the key belongs to */
+	char *uid;
+	pgp_pubkey_t pub;
+} pgp_key_t;
+
+/* sorted by key ID, the last eight bytes of the fingerprint */
+struct _alpm_pgpkeyring_t {
+	pgp_key_t *keys;
+	size_t count;
+};
+
+typedef struct _pgp_sig_t {
+	int type;
+	int pkalgo;
+	int hashalgo;
+	/* from the version octet up to the end of the hashed subpackets */
+	const unsigned char *hashed;
+	size_t hashed_len;
+	const unsigned char *left16;
+	const unsigned char *mpi[2];
+	size_t mpi_len[2];
+	time_t created;
+	/* seconds after creation, 0 if the signature/key does not expire */
+	time_t expires;
+	time_t key_expires;
+	/* -1 if the signature does not state key flags */
+	int key_flags;
+	int primary_uid;
+	int has_issuer;
+	int has_issuer_fpr;
+	unsigned char issuer[PGP_KEYID_SIZE];
+	unsigned char issuer_fpr[PGP_FPR_SIZE];
+	const unsigned char *embedded;
+	size_t embedded_len;
+	/* a critical subpacket we do not understand was found */
+	int critical;
+} pgp_sig_t;
+
+typedef struct _pgp_hash_t {
+#if HAVE_LIBSSL
+	EVP_MD_CTX *ctx;
+#else /* HAVE_LIBNETTLE */
+	const struct nettle_hash *hash;
+	void *ctx;
+#endif
+} pgp_hash_t;
+
+static uint32_t read32(const unsigned char *p)
+{
+	return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16)
+		| ((uint32_t)p[2] << 8) | p[3];
+}
+
+/**
+ * Read the header of the packet at the given position.
+ * @param buf packet data
+ * @param len length of the data
+ * @param pos position of the packet, moved past it on success
+ * @param tag storage for the packet tag
+ * @param body storage for the start of the packet body
+ * @param blen storage for the length of the packet body
+ * @return 0 on success, -1 on malformed or truncated packets
+ */
+static int read_packet(const unsigned char *buf, size_t len, size_t *pos,
+		int *tag, const unsigned char **body, size_t *blen)
+{
+	size_t p = *pos, n;
+
+	if(p >= len || !(buf[p] & 0x80)) {
+		return -1;
+	}
+
+	if(buf[p] & 0x40) {
+		/* new packet format */
+		*tag = buf[p] & 0x3f;
+		p++;
+		if(p >= len) {
+			return -1;
+		}
+		if(buf[p] < 192) {
+			n = buf[p];
+			p += 1;
+		} else if(buf[p] < 224) {
+			if(len - p < 2) {
+				return -1;
+			}
+			n = ((buf[p] - 192) << 8) + buf[p + 1] + 192;
+			p += 2;
+		} else if(buf[p] == 255) {
+			if(len - p < 5) {
+				return -1;
+			}
+			n = read32(buf + p + 1);
+			p += 5;
+		} else {
+			/* partial body lengths are not used for keys and signatures */
+			return -1;
+		}
+	} else {
+		/* old packet format */
+		*tag = (buf[p] >> 2) & 0x0f;
+		switch(buf[p] & 0x03) {
+			case 0:
+				if(len - p < 2) {
+					return -1;
+				}
+				n = buf[p + 1];
+				p += 2;
+				break;
+			case 1:
+				if(len - p < 3) {
+					return -1;
+				}
+				n = (buf[p + 1] << 8) | buf[p + 2];
+				p += 3;
+				break;
+			case 2:
+				if(len - p < 5) {
+					return -1;
+				}
+				n = read32(buf + p + 1);
+				p += 5;
+				break;
+			default:
+				/* indeterminate length, the packet extends to the end */
+				p += 1;
+				n = len - p;
+				break;
+		}
+	}
+
+	if(n > len - p) {
+		return -1;
+	}
+	*body = buf + p;
+	*blen = n;
+	*pos = p + n;
+	return 0;
+}
+
+static int read_mpi(const unsigned char *buf, size_t len, size_t *pos,
+		const unsigned char **mpi, size_t *mpi_len)
+{
+	size_t n;
+
+	if(*pos > len || len - *pos < 2) {
+		return -1;
+	}
+	n = (((size_t)buf[*pos] << 8 | buf[*pos + 1]) + 7) / 8;
+	if(n > len - *pos - 2) {
+		return -1;
+	}
+	*mpi = buf + *pos + 2;
+	*mpi_len = n;
+	*pos += 2 + n;
+	return 0;
+}
+
+static int parse_subpackets(const unsigned char *buf, size_t len, int hashed,
+		pgp_sig_t *sig)
+{
+	size_t pos = 0, n;
+
+	while(pos < len) {
+		const unsigned char *data;
+		int type, critical;
+
+		if(buf[pos] < 192) {
+			n = buf[pos];
+			pos += 1;
+		} else if(buf[pos] < 255) {
+			if(len - pos < 2) {
+				return -1;
+			}
+			n = ((buf[pos] - 192) << 8) + buf[pos + 1] + 192;
+			pos += 2;
+		} else {
+			if(len - pos < 5) {
+				return -1;
+			}
+			n = read32(buf + pos + 1);
+			pos += 5;
+		}
+		if(n == 0 || n > len - pos) {
+			return -1;
+		}
+
+		type = buf[pos] & 0x7f;
+		critical = buf[pos] & 0x80;
+		data = buf + pos + 1;
+		pos += n;
+		n--;
+
+		/* information in the unhashed area is not covered by the signature,
+		 * only use it to find the key */
+		switch(type) {
+			case PGP_SUB_CREATED:
+				if(n != 4) {
+					return -1;
+				}
+				if(hashed) {
+					sig->created = read32(data);
+				}
+				break;
+			case PGP_SUB_SIG_EXPIRES:
+				if(n != 4) {
+					return -1;
+				}
+				if(hashed) {
+					sig->expires = read32(data);
+				}
+				break;
+			case PGP_SUB_KEY_EXPIRES:
+				if(n != 4) {
+					return -1;
+				}
+				if(hashed) {
+					sig->key_expires = read32(data);
+				}
+				break;
+			case PGP_SUB_ISSUER:
+				if(n != PGP_KEYID_SIZE) {
+					return -1;
+				}
+				memcpy(sig->issuer, data, PGP_KEYID_SIZE);
+				sig->has_issuer = 1;
+				break;
+			case PGP_SUB_ISSUER_FPR:
+				/* only version 4 fingerprints are of interest */
+				if(n == PGP_FPR_SIZE + 1 && data[0] == 4) {
+					memcpy(sig->issuer_fpr, data + 1, PGP_FPR_SIZE);
+					sig->has_issuer_fpr = 1;
+				}
+				break;
+			case PGP_SUB_PRIMARY_UID:
+				if(hashed && n == 1) {
+					sig->primary_uid = data[0];
+				}
+				break;
+			case PGP_SUB_KEY_FLAGS:
+				if(hashed && n >= 1) {
+					sig->key_flags = data[0];
+				}
+				break;
+			case PGP_SUB_EMBEDDED_SIG:
+				sig->embedded = data;
+				sig->embedded_len = n;
+				break;
+			default:
+				if(hashed && critical) {
+					sig->critical = 1;
+				}
+				break;
+		}
+	}
+	return 0;
+}
+
+/**
+ * Parse the body of a version 4 signature packet. The result points into the
+ * packet data.
+ * @return 0 on success, -1 on malformed or unsupported signatures
+ */
+static int parse_sig(const unsigned char *body, size_t len, pgp_sig_t *sig)
+{
+	size_t pos = 6, hlen, ulen;
+
+	memset(sig, 0, sizeof(pgp_sig_t));
+	sig->key_flags = -1;
+
+	if(len < 6 || body[0] != 4) {
+		return -1;
+	}
+	sig->type = body[1];
+	sig->pkalgo = body[2];
+	sig->hashalgo = body[3];
+
+	hlen = (body[4] << 8) | body[5];
+	if(hlen > len - pos || parse_subpackets(body + pos, hlen, 1, sig) != 0) {
+		return -1;
+	}
+	pos += hlen;
+	sig->hashed = body;
+	sig->hashed_len = pos;
+
+	if(len - pos < 2) {
+		return -1;
+	}
+	ulen = (body[pos] << 8) | body[pos + 1];
+	pos += 2;
+	if(ulen > len - pos || parse_subpackets(body + pos, ulen, 0, sig) != 0) {
+		return -1;
+	}
+	pos += ulen;
+
+	if(len - pos < 2) {
+		return -1;
+	}
+	sig->left16 = body + pos;
+	pos += 2;
+
+	switch(sig->pkalgo) {
+		case PGP_PK_RSA:
+		case PGP_PK_RSA_SIGN:
+			return read_mpi(body, len, &pos, &sig->mpi[0], &sig->mpi_len[0]);
+		case PGP_PK_EDDSA:
+			if(read_mpi(body, len, &pos, &sig->mpi[0], &sig->mpi_len[0]) != 0
+					|| read_mpi(body, len, &pos, &sig->mpi[1], &sig->mpi_len[1]) != 0
+					|| sig->mpi_len[0] > PGP_ED25519_SIZE
+					|| sig->mpi_len[1] > PGP_ED25519_SIZE) {
+				return -1;
+			}
+			return 0;
+		case PGP_PK_ED25519:
+			if(len - pos < 2 * PGP_ED25519_SIZE) {
+				return -1;
+			}
+			sig->mpi[0] = body + pos;
+			sig->mpi_len[0] = 2 * PGP_ED25519_SIZE;
+			return 0;
+		default:
+			/* keep what we know about the signature for reporting, it will
+			 * never verify */
+			return 0;
+	}
+}
+
+static int hash_allowed(int algo, int keysig)
+{
+	switch(algo) {
+		case PGP_HASH_SHA256:
+		case PGP_HASH_SHA384:
+		case PGP_HASH_SHA512:
+		case PGP_HASH_SHA224:
+			return 1;
+		case PGP_HASH_SHA1:
+			/* still found on self-signatures of older keys */
+			return keysig;
+		default:
+			return 0;
+	}
+}
+
+#if HAVE_LIBSSL
+static const EVP_MD *hash_md(int algo)
+{
+	switch(algo) {
+		case PGP_HASH_SHA1:
+			return EVP_sha1();
+		case PGP_HASH_SHA256:
+			return EVP_sha256();
+		case PGP_HASH_SHA384:
+			return EVP_sha384();
+		case PGP_HASH_SHA512:
+			return EVP_sha512();
+		case PGP_HASH_SHA224:
+			return EVP_sha224();
+		default:
+			return NULL;
+	}
+}
+#else /* HAVE_LIBNETTLE */
+static const struct nettle_hash *hash_meta(int algo)
+{
+	switch(algo) {
+		case PGP_HASH_SHA1:
+			return &nettle_sha1;
+		case PGP_HASH_SHA256:
+			return &nettle_sha256;
+		case PGP_HASH_SHA384:
+			return &nettle_sha384;
+		case PGP_HASH_SHA512:
+			return &nettle_sha512;
+		case PGP_HASH_SHA224:
+			return &nettle_sha224;
+		default:
+			return NULL;
+	}
+}
+#endif
+
+static int hash_init(pgp_hash_t *hash, int algo)
+{
+#if HAVE_LIBSSL
+	const EVP_MD *md = hash_md(algo);
+
+	if(md == NULL || (hash->ctx = EVP_MD_CTX_create()) == NULL) {
+		return -1;
+	}
+	if(EVP_DigestInit_ex(hash->ctx, md, NULL) != 1) {
+		EVP_MD_CTX_destroy(hash->ctx);
+		hash->ctx = NULL;
+		return -1;
+	}
+#else /* HAVE_LIBNETTLE */
+	hash->hash = hash_meta(algo);
+	if(hash->hash == NULL) {
+		return -1;
+	}
+	MALLOC(hash->ctx, hash->hash->context_size, return -1);
+	hash->hash->init(hash->ctx);
+#endif
+	return 0;
+}
+
+static void hash_update(pgp_hash_t *hash, const void *data, size_t len)
+{
+#if HAVE_LIBSSL
+	EVP_DigestUpdate(hash->ctx, data, len);
+#else /* HAVE_LIBNETTLE */
+	hash->hash->update(hash->ctx, len, data);
+#endif
+}
+
+/**
+ * Finish a hash computation and free its context.
+ * @param hash the hash context
+ * @param digest storage for the digest, may be NULL to discard it
+ * @return the length of the digest
+ */
+static size_t hash_final(pgp_hash_t *hash, unsigned char *digest)
+{
+	unsigned char discard[PGP_MAX_DIGEST];
+	size_t len;
+#if HAVE_LIBSSL
+	unsigned int n = 0;
+
+	EVP_DigestFinal_ex(hash->ctx, digest ? digest : discard, &n);
+	EVP_MD_CTX_destroy(hash->ctx);
+	hash->ctx = NULL;
+	len = n;
+#else /* HAVE_LIBNETTLE */
+	len = hash->hash->digest_size;
+	hash->hash->digest(hash->ctx, len, digest ? digest : discard);
+	FREE(hash->ctx);
+#endif
+	return len;
+}
+
+/* keys are hashed the same way for fingerprints and key signatures */
+static void hash_key(pgp_hash_t *hash, const unsigned char *body, size_t len)
+{
+	unsigned char header[3] = { 0x99, (len >> 8) & 0xff, len & 0xff };
+
+	hash_update(hash, header, sizeof(header));
+	hash_update(hash, body, len);
+}
+
+static void hash_trailer(pgp_hash_t *hash, const pgp_sig_t *sig)
+{
+	unsigned char trailer[6] = { 4, 0xff,
+		(sig->hashed_len >> 24) & 0xff, (sig->hashed_len >> 16) & 0xff,
+		(sig->hashed_len >> 8) & 0xff, sig->hashed_len & 0xff };
+
+	hash_update(hash, sig->hashed, sig->hashed_len);
+	hash_update(hash, trailer, sizeof(trailer));
+}
+
+static int pubkey_rsa(pgp_pubkey_t *pub, const unsigned char *n, size_t nlen,
+		const unsigned char *e, size_t elen)
+{
+#if HAVE_LIBSSL
+	BIGNUM *bn_n = BN_bin2bn(n, nlen, NULL);
+	BIGNUM *bn_e = BN_bin2bn(e, elen, NULL);
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+	OSSL_PARAM_BLD *bld = OSSL_PARAM_BLD_new();
+	OSSL_PARAM *params = NULL;
+	EVP_PKEY_CTX *ctx = EVP_PKEY_CTX_new_from_name(NULL, "RSA", NULL);
+
+	if(bn_n && bn_e && bld && ctx
+			&& OSSL_PARAM_BLD_push_BN(bld, OSSL_PKEY_PARAM_RSA_N, bn_n)
+			&& OSSL_PARAM_BLD_push_BN(bld, OSSL_PKEY_PARAM_RSA_E, bn_e)
+			&& (params = OSSL_PARAM_BLD_to_param(bld)) != NULL
+			&& EVP_PKEY_fromdata_init(ctx) > 0) {
+		EVP_PKEY_fromdata(ctx, &pub->pkey, EVP_PKEY_PUBLIC_KEY, params);
+	}
+	OSSL_PARAM_free(params);
+	OSSL_PARAM_BLD_free(bld);
+	EVP_PKEY_CTX_free(ctx);
+	BN_free(bn_n);
+	BN_free(bn_e);
+#else
+	RSA *rsa = RSA_new();
+
+	if(bn_n && bn_e && rsa && RSA_set0_key(rsa, bn_n, bn_e, NULL)) {
+		/* now owned by the RSA key */
+		bn_n = bn_e = NULL;
+		if((pub->pkey = EVP_PKEY_new()) != NULL
+				&& EVP_PKEY_assign_RSA(pub->pkey, rsa)) {
+			rsa = NULL;
+		} else {
+			EVP_PKEY_free(pub->pkey);
+			pub->pkey = NULL;
+		}
+	}
+	RSA_free(rsa);
+	BN_free(bn_n);
+	BN_free(bn_e);
+#endif
+	if(pub->pkey == NULL) {
+		return -1;
+	}
+#else /* HAVE_LIBNETTLE */
+	rsa_public_key_init(&pub->rsa);
+	nettle_mpz_set_str_256_u(pub->rsa.n, nlen, n);
+	nettle_mpz_set_str_256_u(pub->rsa.e, elen, e);
+	if(!rsa_public_key_prepare(&pub->rsa)) {
+		rsa_public_key_clear(&pub->rsa);
+		return -1;
+	}
+#endif
+	pub->algo = PGP_PK_RSA;
+	pub->size = nlen;
+	return 0;
+}
+
+static int pubkey_ed25519(pgp_pubkey_t *pub, const unsigned char *q)
+{
+#if HAVE_LIBSSL
+	pub->pkey = EVP_PKEY_new_raw_public_key(EVP_PKEY_ED25519, NULL,
+			q, PGP_ED25519_SIZE);
+	if(pub->pkey == NULL) {
+		return -1;
+	}
+#else /* HAVE_LIBNETTLE */
+	memcpy(pub->ed25519, q, PGP_ED25519_SIZE);
+#endif
+	pub->algo = PGP_PK_ED25519;
+	return 0;
+}
+
+static void pubkey_free(pgp_pubkey_t *pub)
+{
+#if HAVE_LIBSSL
+	EVP_PKEY_free(pub->pkey);
+	pub->pkey = NULL;
+#else /* HAVE_LIBNETTLE */
+	if(pub->algo == PGP_PK_RSA) {
+		rsa_public_key_clear(&pub->rsa);
+	}
+#endif
+	pub->algo = 0;
+}
+
+#ifdef HAVE_LIBNETTLE
+/* DER encoded DigestInfo prefixes for PKCS #1 v1.5 signatures */
+static const unsigned char *digest_info(int algo, size_t *len)
+{
+	static const unsigned char sha1[] = { 0x30, 0x21, 0x30, 0x09, 0x06, 0x05,
+		0x2b, 0x0e, 0x03, 0x02, 0x1a, 0x05, 0x00, 0x04, 0x14 };
+	static const unsigned char sha224[] = { 0x30, 0x2d, 0x30, 0x0d, 0x06, 0x09,
+		0x60, 0x86, 0x48, 0x01, 0x65, 0x03, 0x04, 0x02, 0x04, 0x05, 0x00, 0x04,
+		0x1c };
+	static const unsigned char sha256[] = { 0x30, 0x31, 0x30, 0x0d, 0x06, 0x09,
+		0x60, 0x86, 0x48, 0x01, 0x65, 0x03, 0x04, 0x02, 0x01, 0x05, 0x00, 0x04,
+		0x20 };
+	static const unsigned char sha384[] = { 0x30, 0x41, 0x30, 0x0d, 0x06, 0x09,
+		0x60, 0x86, 0x48, 0x01, 0x65, 0x03, 0x04, 0x02, 0x02, 0x05, 0x00, 0x04,
+		0x30 };
+	static const unsigned char sha512[] = { 0x30, 0x51, 0x30, 0x0d, 0x06, 0x09,
+		0x60, 0x86, 0x48, 0x01, 0x65, 0x03, 0x04, 0x02, 0x03, 0x05, 0x00, 0x04,
+		0x40 };
+
+	switch(algo) {
+		case PGP_HASH_SHA1:
+			*len = sizeof(sha1);
+			return sha1;
+		case PGP_HASH_SHA224:
+			*len = sizeof(sha224);
+			return sha224;
+		case PGP_HASH_SHA256:
+			*len = sizeof(sha256);
+			return sha256;
+		case PGP_HASH_SHA384:
+			*len = sizeof(sha384);
+			return sha384;
+		case PGP_HASH_SHA512:
+			*len = sizeof(sha512);
+			return sha512;
+		default:
+			*len = 0;
+			return NULL;
+	}
+}
+#endif
+
+static int verify_rsa(const pgp_pubkey_t *pub, const pgp_sig_t *sig,
+		int hashalgo, const unsigned char *digest, size_t dlen)
+{
+	int ok = 0;
+#if HAVE_LIBSSL
+	EVP_PKEY_CTX *ctx;
+	unsigned char *s;
+
+	if(sig->mpi_len[0] > pub->size) {
+		return -1;
+	}
+	/* the MPI drops leading zeros, OpenSSL wants the full modulus length */
+	CALLOC(s, pub->size, 1, return -1);
+	memcpy(s + pub->size - sig->mpi_len[0], sig->mpi[0], sig->mpi_len[0]);
+
+	ctx = EVP_PKEY_CTX_new(pub->pkey, NULL);
+	ok = ctx != NULL
+		&& EVP_PKEY_verify_init(ctx) > 0
+		&& EVP_PKEY_CTX_set_rsa_padding(ctx, RSA_PKCS1_PADDING) > 0
+		&& EVP_PKEY_CTX_set_signature_md(ctx, hash_md(hashalgo)) > 0
+		&& EVP_PKEY_verify(ctx, s, pub->size, digest, dlen) == 1;
+	EVP_PKEY_CTX_free(ctx);
+	free(s);
+#else /* HAVE_LIBNETTLE */
+	unsigned char info[32 + PGP_MAX_DIGEST];
+	const unsigned char *prefix;
+	size_t plen;
+	mpz_t s;
+
+	prefix = digest_info(hashalgo, &plen);
+	if(prefix == NULL || plen + dlen > sizeof(info)) {
+		return -1;
+	}
+	memcpy(info, prefix, plen);
+	memcpy(info + plen, digest, dlen);
+
+	nettle_mpz_init_set_str_256_u(s, sig->mpi_len[0], sig->mpi[0]);
+	ok = rsa_pkcs1_verify(&pub->rsa, plen + dlen, info, s);
+	mpz_clear(s);
+#endif
+	return ok ? 0 : -1;
+}
+
+static int verify_ed25519(const pgp_pubkey_t *pub, const pgp_sig_t *sig,
+		const unsigned char *digest, size_t dlen)
+{
+	unsigned char raw[2 * PGP_ED25519_SIZE] = {0};
+#if HAVE_LIBSSL
+	EVP_MD_CTX *ctx;
+#endif
+	int ok;
+
+	if(sig->pkalgo == PGP_PK_EDDSA) {
+		/* R and S are stored as MPIs, without their leading zeros */
+		memcpy(raw + PGP_ED25519_SIZE - sig->mpi_len[0],
+				sig->mpi[0], sig->mpi_len[0]);
+		memcpy(raw + 2 * PGP_ED25519_SIZE - sig->mpi_len[1],
+				sig->mpi[1], sig->mpi_len[1]);
+	} else {
+		memcpy(raw, sig->mpi[0], sizeof(raw));
+	}
+
+#if HAVE_LIBSSL
+	ctx = EVP_MD_CTX_create();
+	ok = ctx != NULL
+		&& EVP_DigestVerifyInit(ctx, NULL, NULL, NULL, pub->pkey) == 1
+		&& EVP_DigestVerify(ctx, raw, sizeof(raw), digest, dlen) == 1;
+	EVP_MD_CTX_destroy(ctx);
+#else /* HAVE_LIBNETTLE */
+	ok = ed25519_sha512_verify(pub->ed25519, dlen, digest, raw);
+#endif
+	return ok ? 0 : -1;
+}
+
+/**
+ * Check a signature against the digest of the signed data.
+ * @return 0 if the signature was made by the key, -1 otherwise
+ */
+static int verify_digest(const pgp_pubkey_t *pub, const pgp_sig_t *sig,
+		const unsigned char *digest, size_t dlen)
+{
+	if(dlen < 2 || memcmp(digest, sig->left16, 2) != 0) {
+		return -1;
+	}
+
+	switch(sig->pkalgo) {
+		case PGP_PK_RSA:
+		case PGP_PK_RSA_SIGN:
+			if(pub->algo != PGP_PK_RSA) {
+				return -1;
+			}
+			return verify_rsa(pub, sig, sig->hashalgo, digest, dlen);
+		case PGP_PK_EDDSA:
+		case PGP_PK_ED25519:
+			if(pub->algo != PGP_PK_ED25519) {
+				return -1;
+			}
+			return verify_ed25519(pub, sig, digest, dlen);
+		default:
+			return -1;
+	}
+}
+
+/**
+ * Parse the body of a version 4 public key or subkey packet.
+ * @return 0 on success, -1 on malformed or unsupported keys
+ */
+static int parse_pubkey(const unsigned char *body, size_t len, pgp_key_t *key)
+{
+	const unsigned char *n, *e, *q;
+	size_t pos = 6, nlen, elen, qlen, bits;
+	unsigned char top;
+	pgp_hash_t hash;
+
+	if(len < 6 || len > 0xffff || body[0] != 4) {
+		return -1;
+	}
+	key->created = read32(body + 1);
+
+	switch(body[5]) {
+		case PGP_PK_RSA:
+		case PGP_PK_RSA_SIGN:
+			if(read_mpi(body, len, &pos, &n, &nlen) != 0
+					|| read_mpi(body, len, &pos, &e, &elen) != 0) {
+				return -1;
+			}
+			/* count the bits of the modulus itself, not the MPI header */
+			while(nlen > 0 && n[0] == 0) {
+				n++;
+				nlen--;
+			}
+			bits = nlen * 8;
+			for(top = nlen ? n[0] : 0x80; !(top & 0x80); top <<= 1) {
+				bits--;
+			}
+			if(bits < PGP_RSA_MIN_BITS) {
+				return -1;
+			}
+			break;
+		case PGP_PK_EDDSA:
+			if(len - pos < 1 + sizeof(ed25519_oid)
+					|| body[pos] != sizeof(ed25519_oid)
+					|| memcmp(body + pos + 1, ed25519_oid, sizeof(ed25519_oid)) != 0) {
+				return -1;
+			}
+			pos += 1 + sizeof(ed25519_oid);
+			/* native point format, prefixed with 0x40 */
+			if(read_mpi(body, len, &pos, &q, &qlen) != 0
+					|| qlen != PGP_ED25519_SIZE + 1 || q[0] != 0x40) {
+				return -1;
+			}
+			q++;
+			break;
+		case PGP_PK_ED25519:
+			if(len - pos < PGP_ED25519_SIZE) {
+				return -1;
+			}
+			q = body + pos;
+			break;
+		default:
+			return -1;
+	}
+
+	if(hash_init(&hash, PGP_HASH_SHA1) != 0) {
+		return -1;
+	}
+	hash_key(&hash, body, len);
+	hash_final(&hash, key->fpr);
+
+	if(body[5] == PGP_PK_RSA || body[5] == PGP_PK_RSA_SIGN) {
+		return pubkey_rsa(&key->pub, n, nlen, e, elen);
+	}
+	return pubkey_ed25519(&key->pub, q);
+}
+
+static void keyring_free(alpm_pgpkeyring_t *keyring)
+{
+	size_t i;
+
+	if(keyring == NULL) {
+		return;
+	}
+	for(i = 0; i < keyring->count; i++) {
+		free(keyring->keys[i].uid);
+		pubkey_free(&keyring->keys[i].pub);
+	}
+	free(keyring->keys);
+	free(keyring);
+}
+
+/* state while reading the certificates of a keyring */
+struct keyring_loader {
+	alpm_pgpkeyring_t *keyring;
+	size_t size;
+	/* index of the primary key of the current certificate, -1 if the
+	 * certificate is skipped */
+	ssize_t primary;
+	const unsigned char *primary_body;
+	size_t primary_len;
+	/* index of the current subkey, -1 if none or skipped */
+	ssize_t subkey;
+	const unsigned char *subkey_body;
+	size_t subkey_len;
+	/* current user ID, NULL outside of a user ID */
+	const unsigned char *uid;
+	size_t uid_len;
+	/* user ID reported for the certificate */
+	const unsigned char *cert_uid;
+	size_t cert_uid_len;
+	int cert_uid_primary;
+	/* the primary key has a valid self-signature */
+	int certified;
+	int revoked;
+	/* creation times of the newest self-signature and subkey binding */
+	time_t selfsig;
+	time_t binding;
+};
+
+static int issued_by(const pgp_sig_t *sig, const pgp_key_t *key)
+{
+	if(sig->has_issuer_fpr) {
+		return memcmp(sig->issuer_fpr, key->fpr, PGP_FPR_SIZE) == 0;
+	}
+	if(sig->has_issuer) {
+		return memcmp(sig->issuer, key->fpr + PGP_FPR_SIZE - PGP_KEYID_SIZE,
+				PGP_KEYID_SIZE) == 0;
+	}
+	return 1;
+}
+
+/**
+ * Check a signature over the primary key of the current certificate and
+ * either its current subkey or user ID.
+ * @return 0 if the signature was made by signer, -1 otherwise
+ */
+static int verify_keysig(struct keyring_loader *l, const pgp_sig_t *sig,
+		const pgp_pubkey_t *signer, int subkey, int uid)
+{
+	unsigned char digest[PGP_MAX_DIGEST];
+	pgp_hash_t hash;
+	size_t dlen;
+
+	if(!hash_allowed(sig->hashalgo, 1) || hash_init(&hash, sig->hashalgo) != 0) {
+		return -1;
+	}
+	hash_key(&hash, l->primary_body, l->primary_len);
+	if(subkey) {
+		hash_key(&hash, l->subkey_body, l->subkey_len);
+	}
+	if(uid) {
+		unsigned char header[5] = { 0xb4,
+			(l->uid_len >> 24) & 0xff, (l->uid_len >> 16) & 0xff,
+			(l->uid_len >> 8) & 0xff, l->uid_len & 0xff };
+		hash_update(&hash, header, sizeof(header));
+		hash_update(&hash, l->uid, l->uid_len);
+	}
+	hash_trailer(&hash, sig);
+	dlen = hash_final(&hash, digest);
+	return verify_digest(signer, sig, digest, dlen);
+}
+
+/* signing subkeys must prove they agree to be bound to the primary key */
+static int verify_backsig(struct keyring_loader *l, const pgp_sig_t *sig,
+		const pgp_key_t *subkey)
+{
+	pgp_sig_t back;
+
+	if(sig->embedded == NULL
+			|| parse_sig(sig->embedded, sig->embedded_len, &back) != 0
+			|| back.critical || back.type != PGP_SIG_PRIMARY_BINDING) {
+		return -1;
+	}
+	return verify_keysig(l, &back, &subkey->pub, 1, 0);
+}
+
+static void load_signature(struct keyring_loader *l,
+		const unsigned char *body, size_t len)
+{
+	pgp_key_t *primary, *subkey;
+	pgp_sig_t sig;
+
+	if(l->primary < 0 || parse_sig(body, len, &sig) != 0 || sig.critical) {
+		return;
+	}
+	primary = l->keyring->keys + l->primary;
+	if(!issued_by(&sig, primary)) {
+		/* certifications by other keys do not matter to us */
+		return;
+	}
+
+	switch(sig.type) {
+		case PGP_SIG_CERT_GENERIC:
+		case PGP_SIG_CERT_GENERIC + 1:
+		case PGP_SIG_CERT_GENERIC + 2:
+		case PGP_SIG_CERT_POSITIVE:
+			if(l->uid == NULL
+					|| verify_keysig(l, &sig, &primary->pub, 0, 1) != 0) {
+				return;
+			}
+			l->certified = 1;
+			if(l->cert_uid == NULL || (sig.primary_uid && !l->cert_uid_primary)) {
+				l->cert_uid = l->uid;
+				l->cert_uid_len = l->uid_len;
+				l->cert_uid_primary = sig.primary_uid;
+			}
+			/* the newest self-signature states the key's current properties */
+			if(sig.created >= l->selfsig) {
+				l->selfsig = sig.created;
+				primary->expires = sig.key_expires ?
+					primary->created + sig.key_expires : 0;
+				primary->can_sign = sig.key_flags < 0
+					|| (sig.key_flags & PGP_KEY_FLAG_SIGN);
+			}
+			break;
+		case PGP_SIG_SUBKEY_BINDING:
+			if(l->subkey < 0 || sig.created < l->binding
+					|| verify_keysig(l, &sig, &primary->pub, 1, 0) != 0) {
+				return;
+			}
+			subkey = l->keyring->keys + l->subkey;
+			l->binding = sig.created;
+			subkey->expires = sig.key_expires ?
+				subkey->created + sig.key_expires : 0;
+			subkey->can_sign = (sig.key_flags < 0
+					|| (sig.key_flags & PGP_KEY_FLAG_SIGN))
+				&& verify_backsig(l, &sig, subkey) == 0;
+			break;
+		case PGP_SIG_KEY_REVOKE:
+			if(verify_keysig(l, &sig, &primary->pub, 0, 0) == 0) {
+				l->revoked = 1;
+			}
+			break;
+		case PGP_SIG_SUBKEY_REVOKE:
+			if(l->subkey >= 0 && verify_keysig(l, &sig, &primary->pub, 1, 0) == 0) {
+				l->keyring->keys[l->subkey].revoked = 1;
+			}
+			break;
+	}
+}
+
+static int load_key(struct keyring_loader *l, const unsigned char *body,
+		size_t len, int primary)
+{
+	alpm_pgpkeyring_t *keyring = l->keyring;
+	pgp_key_t *key;
+
+	if(primary) {
+		l->primary = -1;
+	} else if(l->primary < 0) {
+		return 0;
+	}
+	l->subkey = -1;
+	l->uid = NULL;
+
+	if(!_alpm_greedy_grow((void **)&keyring->keys, &l->size,
+				(keyring->count + 1) * sizeof(pgp_key_t))) {
+		return -1;
+	}
+	key = keyring->keys + keyring->count;
+	memset(key, 0, sizeof(pgp_key_t));
+	if(parse_pubkey(body, len, key) != 0) {
+		/* keys we cannot use are skipped along with their signatures */
+		return 0;
+	}
+
+	if(primary) {
+		l->primary = keyring->count;
+		l->primary_body = body;
+		l->primary_len = len;
+	} else {
+		l->subkey = keyring->count;
+		l->subkey_body = body;
+		l->subkey_len = len;
+		l->binding = 0;
+	}
+	keyring->count++;
+	return 0;
+}
+
+/* apply what we learned about a certificate to all of its keys */
+static int finish_cert(struct keyring_loader *l)
+{
+	alpm_pgpkeyring_t *keyring = l->keyring;
+	pgp_key_t *primary;
+	size_t i;
+	int ret = 0;
+
+	if(l->primary >= 0) {
+		primary = keyring->keys + l->primary;
+		for(i = l->primary; i < keyring->count; i++) {
+			pgp_key_t *key = keyring->keys + i;
+			if(l->revoked) {
+				key->revoked = 1;
+			}
+			if(!l->certified) {
+				key->can_sign = 0;
+			}
+			if(key != primary && primary->expires
+					&& (!key->expires || key->expires > primary->expires)) {
+				key->expires = primary->expires;
+			}
+			if(l->cert_uid) {
+				STRNDUP(key->uid, (const char *)l->cert_uid, l->cert_uid_len,
+						ret = -1);
+			}
+		}
+	}
+
+	l->primary = l->subkey = -1;
+	l->uid = l->cert_uid = NULL;
+	l->cert_uid_primary = l->certified = l->revoked = 0;
+	l->selfsig = l->binding = 0;
+	return ret;
+}
+
+static int key_cmp(const void *p1, const void *p2)
+{
+	const pgp_key_t *k1 = p1, *k2 = p2;
+	return memcmp(k1->fpr + PGP_FPR_SIZE - PGP_KEYID_SIZE,
+			k2->fpr + PGP_FPR_SIZE - PGP_KEYID_SIZE, PGP_KEYID_SIZE);
+}
+
+static alpm_pgpkeyring_t *keyring_load(alpm_handle_t *handle, const char *path)
+{
+	struct keyring_loader loader = {0};
+	unsigned char *data = NULL;
+	size_t len = 0, pos = 0;
+	alpm_errno_t err;
+
+	CALLOC(loader.keyring, 1, sizeof(alpm_pgpkeyring_t),
+			RET_ERR(handle, ALPM_ERR_MEMORY, NULL));
+	loader.primary = loader.subkey = -1;
+
+	if((err = _alpm_read_file(path, &data, &len)) != ALPM_ERR_OK) {
+		_alpm_log(handle, ALPM_LOG_ERROR, _("could not read keyring %s\n"), path);
+		keyring_free(loader.keyring);
+		RET_ERR(handle, err, NULL);
+	}
+
+	while(pos < len) {
+		const unsigned char *body;
+		size_t blen;
+		int tag, ret = 0;
+
+		if(read_packet(data, len, &pos, &tag, &body, &blen) != 0) {
+			_alpm_log(handle, ALPM_LOG_ERROR, _("%s: keyring format error\n"), path);
+			err = ALPM_ERR_NOT_A_FILE;
+			goto error;
+		}
+
+		switch(tag) {
+			case PGP_TAG_PUBLIC_KEY:
+				ret = finish_cert(&loader) || load_key(&loader, body, blen, 1);
+				break;
+			case PGP_TAG_PUBLIC_SUBKEY:
+				ret = load_key(&loader, body, blen, 0);
+				break;
+			case PGP_TAG_USER_ID:
+				loader.uid = body;
+				loader.uid_len = blen;
+				break;
+			case PGP_TAG_USER_ATTRIBUTE:
+				loader.uid = NULL;
+				break;
+			case PGP_TAG_SIGNATURE:
+				load_signature(&loader, body, blen);
+				break;
+		}
+		if(ret != 0) {
+			err = ALPM_ERR_MEMORY;
+			goto error;
+		}
+	}
+	if(finish_cert(&loader) != 0) {
+		err = ALPM_ERR_MEMORY;
+		goto error;
+	}
+	free(data);
+
+	qsort(loader.keyring->keys, loader.keyring->count, sizeof(pgp_key_t), key_cmp);
+	_alpm_log(handle, ALPM_LOG_DEBUG, "loaded %zu keys from %s\n",
+			loader.keyring->count, path);
+	return loader.keyring;
+
+error:
+	free(data);
+	keyring_free(loader.keyring);
+	RET_ERR(handle, err, NULL);
+}
+
+/* index of the first key with the given key ID, or keyring->count */
+static size_t keyring_find(const alpm_pgpkeyring_t *keyring,
+		const unsigned char *keyid)
+{
+	size_t lo = 0, hi = keyring->count;
+
+	while(lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+		if(memcmp(keyring->keys[mid].fpr + PGP_FPR_SIZE - PGP_KEYID_SIZE,
+					keyid, PGP_KEYID_SIZE) < 0) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+	return lo;
+}
+
+static int key_matches(const pgp_key_t *key, const unsigned char *id,
+		size_t idlen)
+{
+	return memcmp(key->fpr + PGP_FPR_SIZE - idlen, id, idlen) == 0;
+}
+
+/**
+ * Get the keyring of the handle, reading the snapshot on first use. Worker
+ * threads do not touch the handle; if _alpm_pgp_init() was not called before
+ * they started, they load a private copy.
+ * @param handle the context handle
+ * @param owned set if the caller must free the keyring
+ * @return the keyring, NULL on error
+ */
+static alpm_pgpkeyring_t *get_keyring(alpm_handle_t *handle, int *owned)
+{
+	*owned = 0;
+	if(handle->pgpkeyring) {
+		return handle->pgpkeyring;
+	}
+	if(handle->worker) {
+		*owned = 1;
+		return keyring_load(handle, handle->keyring_snapshot);
+	}
+	handle->pgpkeyring = keyring_load(handle, handle->keyring_snapshot);
+	return handle->pgpkeyring;
+}
+
+/**
+ * Read the keyring snapshot ahead of signature checks on worker threads.
+ * @param handle the context handle
+ * @return 0 on success, -1 on error
+ */
+int _alpm_pgp_init(alpm_handle_t *handle)
+{
+	int owned;
+	return get_keyring(handle, &owned) ? 0 : -1;
+}
+
+/**
+ * Drop the cached keys so the snapshot is read again on next use.
+ * @param handle the context handle
+ */
+void _alpm_pgp_release(alpm_handle_t *handle)
+{
+	if(handle->worker) {
+		return;
+	}
+	keyring_free(handle->pgpkeyring);
+	handle->pgpkeyring = NULL;
+}
+
+static int unhex(const char *str, unsigned char *out, size_t len)
+{
+	size_t i;
+
+	for(i = 0; i < len * 2; i++) {
+		char c = str[i];
+		int v;
+		if(c >= '0' && c <= '9') {
+			v = c - '0';
+		} else if(c >= 'a' && c <= 'f') {
+			v = c - 'a' + 10;
+		} else if(c >= 'A' && c <= 'F') {
+			v = c - 'A' + 10;
+		} else {
+			return -1;
+		}
+		if(i % 2 == 0) {
+			out[i / 2] = v << 4;
+		} else {
+			out[i / 2] |= v;
+		}
+	}
+	return 0;
+}
+
+static char *hex(const unsigned char *data, size_t len)
+{
+	char *str;
+	size_t i;
+
+	MALLOC(str, len * 2 + 1, return NULL);
+	for(i = 0; i < len; i++) {
+		snprintf(str + i * 2, 3, "%02X", data[i]);
+	}
+	return str;
+}
+
+/**
+ * Determine if a key is part of the keyring snapshot.
+ * @param handle the context handle
+ * @param fpr the fingerprint or long key ID to look up
+ * @return 1 if key is known, 0 if key is unknown, -1 on error
+ */
+int _alpm_pgp_key_known(alpm_handle_t *handle, const char *fpr)
+{
+	alpm_pgpkeyring_t *keyring;
+	unsigned char id[PGP_FPR_SIZE];
+	size_t idlen, i;
+	int owned, ret = 0;
+
+	idlen = strlen(fpr) / 2;
+	if((idlen != PGP_FPR_SIZE && idlen != PGP_KEYID_SIZE)
+			|| strlen(fpr) % 2 || unhex(fpr, id, idlen) != 0) {
+		_alpm_log(handle, ALPM_LOG_DEBUG, "key lookup failed, bad key id %s\n", fpr);
+		return 0;
+	}
+
+	if((keyring = get_keyring(handle, &owned)) == NULL) {
+		return -1;
+	}
+	for(i = keyring_find(keyring, id + idlen - PGP_KEYID_SIZE);
+			i < keyring->count && key_matches(keyring->keys + i,
+				id + idlen - PGP_KEYID_SIZE, PGP_KEYID_SIZE); i++) {
+		if(key_matches(keyring->keys + i, id, idlen)) {
+			ret = 1;
+			break;
+		}
+	}
+	if(owned) {
+		keyring_free(keyring);
+	}
+
+	_alpm_log(handle, ALPM_LOG_DEBUG, "key lookup %s, %s key\n",
+			ret ? "success" : "failed", ret ? "known" : "unknown");
+	return ret;
+}
+
+/* a signature of the checked file and the digest being computed for it */
+struct sigcheck {
+	pgp_sig_t sig;
+	pgp_hash_t hash;
+	int parsed;
+	int hashing;
+};
+
+static int hash_file(const char *path, struct sigcheck *checks, size_t count)
+{
+	unsigned char *buf;
+	ssize_t n;
+	size_t i;
+	int fd;
+
+	MALLOC(buf, (size_t)ALPM_BUFFER_SIZE, return -1);
+	OPEN(fd, path, O_RDONLY | O_CLOEXEC);
+	if(fd < 0) {
+		free(buf);
+		return -1;
+	}
+	while((n = read(fd, buf, ALPM_BUFFER_SIZE)) != 0) {
+		if(n < 0) {
+			if(errno == EINTR) {
+				continue;
+			}
+			break;
+		}
+		for(i = 0; i < count; i++) {
+			if(checks[i].hashing) {
+				hash_update(&checks[i].hash, buf, n);
+			}
+		}
+	}
+	close(fd);
+	free(buf);
+	return n < 0 ? -1 : 0;
+}
+
+static int check_signature(alpm_handle_t *handle, alpm_pgpkeyring_t *keyring,
+		struct sigcheck *check, time_t now, alpm_sigresult_t *result)
+{
+	const pgp_sig_t *sig = &check->sig;
+	const pgp_key_t *key = NULL;
+	const unsigned char *id = NULL;
+	unsigned char digest[PGP_MAX_DIGEST];
+	size_t idlen = 0, dlen = 0, i;
+	int valid = 0;
+
+	if(check->hashing) {
+		hash_trailer(&check->hash, sig);
+		dlen = hash_final(&check->hash, digest);
+		check->hashing = 0;
+	}
+
+	if(check->parsed && sig->has_issuer_fpr) {
+		id = sig->issuer_fpr;
+		idlen = PGP_FPR_SIZE;
+	} else if(check->parsed && sig->has_issuer) {
+		id = sig->issuer;
+		idlen = PGP_KEYID_SIZE;
+	}
+
+	if(id) {
+		const unsigned char *keyid = id + idlen - PGP_KEYID_SIZE;
+		for(i = keyring_find(keyring, keyid); i < keyring->count
+				&& key_matches(keyring->keys + i, keyid, PGP_KEYID_SIZE); i++) {
+			const pgp_key_t *k = keyring->keys + i;
+			if(!key_matches(k, id, idlen)) {
+				continue;
+			}
+			if(key == NULL) {
+				key = k;
+			}
+			if(dlen && verify_digest(&k->pub, sig, digest, dlen) == 0) {
+				key = k;
+				valid = 1;
+				break;
+			}
+		}
+	}
+
+	if(key) {
+		result->key.fingerprint = hex(key->fpr, PGP_FPR_SIZE);
+		if(key->uid) {
+			STRDUP(result->key.uid, key->uid, return -1);
+		}
+		result->key.created = key->created;
+		result->key.expires = key->expires;
+		result->validity = ALPM_SIGVALIDITY_FULL;
+		/* like GnuPG, a signature from a key that expired later is still good,
+		 * but one made after the key expired is not */
+		if(!valid || key->revoked || !key->can_sign || sig->created < key->created
+				|| (key->expires && sig->created >= key->expires)) {
+			result->status = ALPM_SIGSTATUS_INVALID;
+		} else if(sig->expires && sig->created + sig->expires <= now) {
+			result->status = ALPM_SIGSTATUS_SIG_EXPIRED;
+		} else if(key->expires && key->expires <= now) {
+			result->status = ALPM_SIGSTATUS_KEY_EXPIRED;
+		} else {
+			result->status = ALPM_SIGSTATUS_VALID;
+		}
+		_alpm_log(handle, ALPM_LOG_DEBUG,
+				"key: %s, %s, revoked %d, can sign %d\n", result->key.fingerprint,
+				key->uid ? key->uid : "(none)", key->revoked, key->can_sign);
+	} else {
+		result->key.fingerprint = id ? hex(id, idlen) : strdup("");
+		result->validity = ALPM_SIGVALIDITY_UNKNOWN;
+		if(id) {
+			_alpm_log(handle, ALPM_LOG_DEBUG, "key lookup failed, unknown key\n");
+			result->status = ALPM_SIGSTATUS_KEY_UNKNOWN;
+		} else {
+			result->status = ALPM_SIGSTATUS_INVALID;
+		}
+	}
+	if(result->key.fingerprint == NULL) {
+		return -1;
+	}
+	_alpm_log(handle, ALPM_LOG_DEBUG, "signature %s, timestamp %jd, status %d\n",
+			result->key.fingerprint, (intmax_t)sig->created, result->status);
+	return 0;
+}
+
+/**
+ * Check the PGP signature for the given file path against the keyring
+ * snapshot. Behaves like #_alpm_gpgme_checksig.
+ * @param handle the context handle
+ * @param path the full path to a file
+ * @param base64_sig optional PGP signature data in base64 encoding
+ * @param siglist a pointer to storage for signature results
+ * @return 0 in normal cases, -1 if the something failed in the check process
+ */
+int _alpm_pgp_checksig(alpm_handle_t *handle, const char *path,
+		const char *base64_sig, alpm_siglist_t *siglist)
+{
+	alpm_pgpkeyring_t *keyring = NULL;
+	struct sigcheck *checks = NULL;
+	unsigned char *sigdata = NULL;
+	char *sigpath = NULL;
+	size_t siglen = 0, pos, count = 0, i;
+	int ret = -1, owned = 0;
+
+	if(!path || _alpm_access(handle, NULL, path, R_OK) != 0) {
+		RET_ERR(handle, ALPM_ERR_NOT_A_FILE, -1);
+	}
+
+	if(!siglist) {
+		RET_ERR(handle, ALPM_ERR_WRONG_ARGS, -1);
+	}
+	siglist->count = 0;
+
+	if(base64_sig) {
+		/* memory-based, we loaded it from a sync DB */
+		if(alpm_decode_signature(base64_sig, &sigdata, &siglen) != 0) {
+			GOTO_ERR(handle, ALPM_ERR_SIG_INVALID, error);
+		}
+	} else {
+		/* file-based, it is on disk */
+		sigpath = _alpm_sigpath(handle, path);
+		if(_alpm_access(handle, NULL, sigpath, R_OK) != 0
+				|| _alpm_read_file(sigpath, &sigdata, &siglen) != ALPM_ERR_OK) {
+			_alpm_log(handle, ALPM_LOG_DEBUG, "sig path %s could not be opened\n",
+					sigpath);
+			GOTO_ERR(handle, ALPM_ERR_SIG_MISSING, error);
+		}
+	}
+
+	if((keyring = get_keyring(handle, &owned)) == NULL) {
+		/* pm_errno was set while loading */
+		goto error;
+	}
+
+	_alpm_log(handle, ALPM_LOG_DEBUG, "checking signature for %s\n", path);
+
+	for(pos = 0; pos < siglen; ) {
+		const unsigned char *body;
+		size_t blen;
+		int tag;
+		if(read_packet(sigdata, siglen, &pos, &tag, &body, &blen) != 0) {
+			_alpm_log(handle, ALPM_LOG_ERROR,
+					_("%s: signature format error\n"), path);
+			GOTO_ERR(handle, ALPM_ERR_SIG_INVALID, error);
+		}
+		if(tag == PGP_TAG_SIGNATURE) {
+			count++;
+		}
+	}
+	if(count == 0) {
+		_alpm_log(handle, ALPM_LOG_DEBUG, "no signatures returned\n");
+		GOTO_ERR(handle, ALPM_ERR_SIG_MISSING, error);
+	}
+	_alpm_log(handle, ALPM_LOG_DEBUG, "%zu signatures returned\n", count);
+
+	CALLOC(checks, count, sizeof(struct sigcheck),
+			GOTO_ERR(handle, ALPM_ERR_MEMORY, error));
+	CALLOC(siglist->results, count, sizeof(alpm_sigresult_t),
+			GOTO_ERR(handle, ALPM_ERR_MEMORY, error));
+	siglist->count = count;
+
+	for(pos = 0, i = 0; pos < siglen; ) {
+		const unsigned char *body;
+		size_t blen;
+		int tag;
+		read_packet(sigdata, siglen, &pos, &tag, &body, &blen);
+		if(tag != PGP_TAG_SIGNATURE) {
+			continue;
+		}
+		checks[i].parsed = parse_sig(body, blen, &checks[i].sig) == 0;
+		checks[i].hashing = checks[i].parsed && !checks[i].sig.critical
+			&& checks[i].sig.type == PGP_SIG_BINARY
+			&& hash_allowed(checks[i].sig.hashalgo, 0)
+			&& hash_init(&checks[i].hash, checks[i].sig.hashalgo) == 0;
+		i++;
+	}
+
+	if(hash_file(path, checks, count) != 0) {
+		GOTO_ERR(handle, ALPM_ERR_NOT_A_FILE, error);
+	}
+
+	for(i = 0; i < count; i++) {
+		if(check_signature(handle, keyring, checks + i, time(NULL),
+					siglist->results + i) != 0) {
+			GOTO_ERR(handle, ALPM_ERR_MEMORY, error);
+		}
+	}
+
+	ret = 0;
+
+error:
+	if(checks) {
+		for(i = 0; i < count; i++) {
+			if(checks[i].hashing) {
+				hash_final(&checks[i].hash, NULL);
+			}
+		}
+		free(checks);
+	}
+	if(ret != 0 && siglist->count) {
+		alpm_siglist_cleanup(siglist);
+	}
+	if(owned) {
+		keyring_free(keyring);
+	}
+	free(sigpath);
+	free(sigdata);
+	return ret;
+}
@@ -0,0 +1,33 @@
+/*
+ *  pgp.h
+ *
+ *  Copyright (c) 2024 Pacman Development Team <pacman-dev@lists.archlinux.org>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef ALPM_PGP_H
+#define ALPM_PGP_H
+
+#include "alpm.h"
+
+/** Keys read from an exported OpenPGP keyring */
+typedef struct _alpm_pgpkeyring_t alpm_pgpkeyring_t;
+
+int _alpm_pgp_init(alpm_handle_t *handle);
+void _alpm_pgp_release(alpm_handle_t *handle);
+int _alpm_pgp_key_known(alpm_handle_t *handle, const char *fpr);
+int _alpm_pgp_checksig(alpm_handle_t *handle, const char *path,
+		const char *base64_sig, alpm_siglist_t *siglist);
+
+#endif /* ALPM_PGP_H */
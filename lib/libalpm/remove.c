@@ -577,22 +577,58 @@ static int unlink_file(alpm_handle_t *handle, alpm_pkg_t *oldpkg,
 	return 0;
 }
 
+/**
+ * @brief Collect the backup files of a replacement package.
+ *
+ * Backup files also present in the new package are left for the new
+ * package to handle.
+ *
+ * @param newpkg the package replacing the current owner of the files
+ * @param backups set to the backup files of \a newpkg, or NULL if none
+ *
+ * @return 0 on success, -1 on error
+ */
+static int collect_new_backups(alpm_pkg_t *newpkg, alpm_strset_t **backups)
+{
+	alpm_filelist_t *filelist;
+	alpm_list_t *i;
+
+	*backups = NULL;
+	if(newpkg == NULL || alpm_pkg_get_backup(newpkg) == NULL) {
+		return 0;
+	}
+
+	if((*backups = _alpm_strset_new()) == NULL) {
+		return -1;
+	}
+	filelist = alpm_pkg_get_files(newpkg);
+	for(i = alpm_pkg_get_backup(newpkg); i; i = i->next) {
+		alpm_backup_t *backup = i->data;
+		if(alpm_filelist_contains(filelist, backup->name)
+				&& _alpm_strset_add(*backups, backup->name) != 0) {
+			_alpm_strset_free(*backups);
+			*backups = NULL;
+			return -1;
+		}
+	}
+	return 0;
+}
+
 /**
  * @brief Check if a package file should be removed.
  *
  * @param handle the context handle
- * @param newpkg the package replacing the current owner of \a path
+ * @param backups backup files of the replacement package (optional)
  * @param path file to be removed
  *
  * @return 1 if the file should be skipped, 0 if it should be removed
  */
 static int should_skip_file(alpm_handle_t *handle,
-		alpm_pkg_t *newpkg, const char *path)
+		const alpm_strset_t *backups, const char *path)
 {
-	return _alpm_fnmatch_patterns(handle->noupgrade, path) == 0
-		|| alpm_list_find_str(handle->trans->skip_remove, path)
-		|| (newpkg && _alpm_needbackup(path, newpkg)
-				&& alpm_filelist_contains(alpm_pkg_get_files(newpkg), path));
+	return alpm_option_match_noupgrade(handle, path) == 0
+		|| _alpm_strset_contains(handle->trans->skip_remove, path)
+		|| _alpm_strset_contains(backups, path);
 }
 
 /**
@@ -616,18 +652,30 @@ static int remove_package_files(alpm_handle_t *handle,
 	size_t i;
 	int err = 0;
 	int nosave = handle->trans->flags & ALPM_TRANS_FLAG_NOSAVE;
+	alpm_strset_t *backups;
+	char *skip = NULL;
 
 	filelist = alpm_pkg_get_files(oldpkg);
+	if(collect_new_backups(newpkg, &backups) != 0) {
+		RET_ERR(handle, ALPM_ERR_MEMORY, -1);
+	}
+	if(filelist->count) {
+		CALLOC(skip, filelist->count, sizeof(char),
+				_alpm_strset_free(backups); RET_ERR(handle, ALPM_ERR_MEMORY, -1));
+	}
 	for(i = 0; i < filelist->count; i++) {
 		alpm_file_t *file = filelist->files + i;
-		if(!should_skip_file(handle, newpkg, file->name)
-				&& !can_remove_file(handle, file)) {
+		skip[i] = should_skip_file(handle, backups, file->name);
+		if(!skip[i] && !can_remove_file(handle, file)) {
 			_alpm_log(handle, ALPM_LOG_DEBUG,
 					"not removing package '%s', can't remove all files\n",
 					oldpkg->name);
+			_alpm_strset_free(backups);
+			free(skip);
 			RET_ERR(handle, ALPM_ERR_PKG_CANT_REMOVE, -1);
 		}
 	}
+	_alpm_strset_free(backups);
 
 	_alpm_log(handle, ALPM_LOG_DEBUG, "removing %zu files\n", filelist->count);
 
@@ -644,7 +692,7 @@ static int remove_package_files(alpm_handle_t *handle,
 		/* check the remove skip list before removing the file.
 		 * see the big comment block in db_find_fileconflicts() for an
 		 * explanation. */
-		if(should_skip_file(handle, newpkg, file->name)) {
+		if(skip[i - 1]) {
 			_alpm_log(handle, ALPM_LOG_DEBUG,
 					"%s is in skip_remove, skipping removal\n", file->name);
 			continue;
@@ -668,6 +716,7 @@ static int remove_package_files(alpm_handle_t *handle,
 				pkg_count, targ_count);
 	}
 
+	free(skip);
 	return err;
 }
 
@@ -708,7 +757,7 @@ int _alpm_remove_single_package(alpm_handle_t *handle,
 				!(handle->trans->flags & ALPM_TRANS_FLAG_NOSCRIPTLET)) {
 			char *scriptlet = _alpm_local_db_pkgpath(handle->db_local,
 					oldpkg, "install");
-			_alpm_runscriptlet(handle, scriptlet, "pre_remove", pkgver, NULL, 0);
+			_alpm_runscriptlet(handle, scriptlet, "pre_remove", pkgver, NULL, NULL);
 			free(scriptlet);
 		}
 	}
@@ -728,7 +777,7 @@ int _alpm_remove_single_package(alpm_handle_t *handle,
 			!(handle->trans->flags & ALPM_TRANS_FLAG_NOSCRIPTLET)) {
 		char *scriptlet = _alpm_local_db_pkgpath(handle->db_local,
 				oldpkg, "install");
-		_alpm_runscriptlet(handle, scriptlet, "post_remove", pkgver, NULL, 0);
+		_alpm_runscriptlet(handle, scriptlet, "post_remove", pkgver, NULL, NULL);
 		free(scriptlet);
 	}
 
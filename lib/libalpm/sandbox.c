@@ -29,6 +29,7 @@
 #include <unistd.h>
 
 #include "alpm.h"
+#include "handle.h"
 #include "log.h"
 #include "sandbox.h"
 #include "sandbox_fs.h"
@@ -22,6 +22,7 @@
 #include <unistd.h>
 
 #include "config.h"
+#include "handle.h"
 #include "log.h"
 #include "sandbox_fs.h"
 #include "util.h"
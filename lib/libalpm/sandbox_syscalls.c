@@ -20,6 +20,7 @@
 #include <stddef.h>
 
 #include "config.h"
+#include "handle.h"
 #include "log.h"
 #include "sandbox_syscalls.h"
 #include "util.h"
@@ -23,11 +23,13 @@
 
 #ifdef HAVE_LIBGPGME
 #include <locale.h> /* setlocale() */
+#include <pthread.h>
 #include <gpgme.h>
 #endif
 
 /* libalpm */
 #include "signing.h"
+#include "pgp.h"
 #include "package.h"
 #include "base64.h"
 #include "util.h"
@@ -200,41 +202,263 @@ gpg_error:
 	RET_ERR(handle, ALPM_ERR_GPGME, -1);
 }
 
+typedef struct _alpm_sigsession_t alpm_sigsession_t;
+
+/* A key looked up in the keyring; key is NULL if it is not in there */
+struct keycache_entry {
+	char *fpr;
+	gpgme_key_t key;
+	unsigned long hash;
+};
+
+/* State shared by the signature checks of a handle until the transaction is
+ * released: GPGME contexts kept for reuse, so each check does not set up a
+ * new one, and the result of every key lookup, so each key is only looked
+ * up in the keyring once. Worker handles share it with their parent handle,
+ * hence the lock. */
+struct _alpm_sigsession_t {
+	pthread_mutex_t lock;
+	gpgme_ctx_t *idle;
+	size_t idle_count;
+	size_t idle_size;
+	/* open addressing on the fingerprint hash */
+	struct keycache_entry *keys;
+	size_t key_count;
+	size_t key_buckets;
+};
+
+static void session_forget_keys(alpm_sigsession_t *session)
+{
+	size_t i;
+
+	for(i = 0; i < session->key_buckets; i++) {
+		struct keycache_entry *entry = session->keys + i;
+		if(entry->fpr) {
+			free(entry->fpr);
+			if(entry->key) {
+				gpgme_key_unref(entry->key);
+			}
+		}
+	}
+	FREE(session->keys);
+	session->key_count = 0;
+	session->key_buckets = 0;
+}
+
+/* Returns the session of a handle, creating it if needed. Worker handles
+ * cannot create one, as it would not be shared with their parent handle;
+ * they check signatures without one. */
+static alpm_sigsession_t *get_session(alpm_handle_t *handle)
+{
+	alpm_sigsession_t *session;
+
+	if(handle->sigsession || handle->worker) {
+		return handle->sigsession;
+	}
+	CALLOC(session, 1, sizeof(alpm_sigsession_t), return NULL);
+	if(pthread_mutex_init(&session->lock, NULL) != 0) {
+		free(session);
+		return NULL;
+	}
+	handle->sigsession = session;
+	return session;
+}
+
+static gpgme_error_t session_ctx_acquire(alpm_handle_t *handle, gpgme_ctx_t *ctx)
+{
+	alpm_sigsession_t *session = get_session(handle);
+
+	if(session) {
+		pthread_mutex_lock(&session->lock);
+		if(session->idle_count > 0) {
+			*ctx = session->idle[--session->idle_count];
+			pthread_mutex_unlock(&session->lock);
+			return GPG_ERR_NO_ERROR;
+		}
+		pthread_mutex_unlock(&session->lock);
+	}
+	return gpgme_new(ctx);
+}
+
+static void session_ctx_release(alpm_handle_t *handle, gpgme_ctx_t ctx)
+{
+	alpm_sigsession_t *session = handle->sigsession;
+
+	if(ctx == NULL) {
+		return;
+	}
+	if(session) {
+		pthread_mutex_lock(&session->lock);
+		if(_alpm_greedy_grow((void **)&session->idle, &session->idle_size,
+					(session->idle_count + 1) * sizeof(gpgme_ctx_t))) {
+			session->idle[session->idle_count++] = ctx;
+			ctx = NULL;
+		}
+		pthread_mutex_unlock(&session->lock);
+	}
+	if(ctx) {
+		gpgme_release(ctx);
+	}
+}
+
+static struct keycache_entry *session_find_key(alpm_sigsession_t *session,
+		const char *fpr, unsigned long hash)
+{
+	size_t mask = session->key_buckets - 1, i;
+
+	if(session->key_buckets == 0) {
+		return NULL;
+	}
+	for(i = hash & mask; session->keys[i].fpr; i = (i + 1) & mask) {
+		if(session->keys[i].hash == hash && strcmp(session->keys[i].fpr, fpr) == 0) {
+			return session->keys + i;
+		}
+	}
+	/* the empty bucket the key would go in */
+	return session->keys + i;
+}
+
+static void session_add_key(alpm_sigsession_t *session, const char *fpr,
+		unsigned long hash, gpgme_key_t key)
+{
+	struct keycache_entry *entry;
+
+	if((session->key_count + 1) * 2 > session->key_buckets) {
+		struct keycache_entry *old = session->keys;
+		size_t old_buckets = session->key_buckets, i;
+		size_t buckets = old_buckets ? old_buckets * 2 : 64;
+
+		CALLOC(session->keys, buckets, sizeof(struct keycache_entry),
+				session->keys = old; return);
+		session->key_buckets = buckets;
+		for(i = 0; i < old_buckets; i++) {
+			if(old[i].fpr) {
+				*session_find_key(session, old[i].fpr, old[i].hash) = old[i];
+			}
+		}
+		free(old);
+	}
+
+	entry = session_find_key(session, fpr, hash);
+	if(entry->fpr) {
+		/* looked up by another thread in the meantime */
+		return;
+	}
+	STRDUP(entry->fpr, fpr, return);
+	entry->hash = hash;
+	if(key) {
+		gpgme_key_ref(key);
+	}
+	entry->key = key;
+	session->key_count++;
+}
+
+/**
+ * Look up a key in the keyring, answering repeated lookups of a session
+ * from its cache.
+ * @param handle the context handle
+ * @param ctx the GPGME context to use for a lookup
+ * @param fpr the fingerprint of the key
+ * @param key set to a new reference of the key, or NULL if it is unknown
+ * @return the GPGME error, GPG_ERR_EOF if the key is not in the keyring
+ */
+static gpgme_error_t session_get_key(alpm_handle_t *handle, gpgme_ctx_t ctx,
+		const char *fpr, gpgme_key_t *key)
+{
+	alpm_sigsession_t *session = get_session(handle);
+	unsigned long hash = _alpm_hash_sdbm(fpr);
+	struct keycache_entry *entry;
+	gpgme_error_t gpg_err;
+
+	*key = NULL;
+	if(session) {
+		pthread_mutex_lock(&session->lock);
+		entry = session_find_key(session, fpr, hash);
+		if(entry && entry->fpr) {
+			if(entry->key) {
+				gpgme_key_ref(entry->key);
+				*key = entry->key;
+			}
+			pthread_mutex_unlock(&session->lock);
+			_alpm_log(handle, ALPM_LOG_DEBUG, "key %s found in cache\n", fpr);
+			return *key ? GPG_ERR_NO_ERROR : gpg_error(GPG_ERR_EOF);
+		}
+		pthread_mutex_unlock(&session->lock);
+	}
+
+	_alpm_log(handle, ALPM_LOG_DEBUG, "looking up key %s locally\n", fpr);
+	gpg_err = gpgme_get_key(ctx, fpr, key, 0);
+	if(session && (gpg_err_code(gpg_err) == GPG_ERR_NO_ERROR
+				|| gpg_err_code(gpg_err) == GPG_ERR_EOF)) {
+		pthread_mutex_lock(&session->lock);
+		session_add_key(session, fpr, hash,
+				gpg_err_code(gpg_err) == GPG_ERR_NO_ERROR ? *key : NULL);
+		pthread_mutex_unlock(&session->lock);
+	}
+	return gpg_err;
+}
+
+/* The keyring was changed, keys unknown so far may be in it now */
+static void session_keyring_changed(alpm_handle_t *handle)
+{
+	alpm_sigsession_t *session = handle->sigsession;
+
+	if(session) {
+		pthread_mutex_lock(&session->lock);
+		session_forget_keys(session);
+		pthread_mutex_unlock(&session->lock);
+	}
+}
+
+/**
+ * Drop the GPGME signature checking state of a handle.
+ * @param handle the context handle
+ */
+static void gpgme_signing_release(alpm_handle_t *handle)
+{
+	alpm_sigsession_t *session = handle->sigsession;
+	size_t i;
+
+	if(session == NULL || handle->worker) {
+		return;
+	}
+	for(i = 0; i < session->idle_count; i++) {
+		gpgme_release(session->idle[i]);
+	}
+	free(session->idle);
+	session_forget_keys(session);
+	pthread_mutex_destroy(&session->lock);
+	free(session);
+	handle->sigsession = NULL;
+}
+
 /**
  * Determine if we have a key is known in our local keyring.
  * @param handle the context handle
  * @param fpr the fingerprint key ID to look up
  * @return 1 if key is known, 0 if key is unknown, -1 on error
  */
-int _alpm_key_in_keychain(alpm_handle_t *handle, const char *fpr)
+static int gpgme_key_in_keychain(alpm_handle_t *handle, const char *fpr)
 {
 	gpgme_error_t gpg_err;
-	gpgme_ctx_t ctx = {0};
+	gpgme_ctx_t ctx = NULL;
 	gpgme_key_t key;
 	int ret = -1;
 
-	if(alpm_list_find_str(handle->known_keys, fpr)) {
-		_alpm_log(handle, ALPM_LOG_DEBUG, "key %s found in cache\n", fpr);
-		return 1;
-	}
-
 	if(init_gpgme(handle)) {
 		/* pm_errno was set in gpgme_init() */
 		goto error;
 	}
 
-	gpg_err = gpgme_new(&ctx);
+	gpg_err = session_ctx_acquire(handle, &ctx);
 	CHECK_ERR();
 
-	_alpm_log(handle, ALPM_LOG_DEBUG, "looking up key %s locally\n", fpr);
-
-	gpg_err = gpgme_get_key(ctx, fpr, &key, 0);
+	gpg_err = session_get_key(handle, ctx, fpr, &key);
 	if(gpg_err_code(gpg_err) == GPG_ERR_EOF) {
 		_alpm_log(handle, ALPM_LOG_DEBUG, "key lookup failed, unknown key\n");
 		ret = 0;
 	} else if(gpg_err_code(gpg_err) == GPG_ERR_NO_ERROR) {
 		_alpm_log(handle, ALPM_LOG_DEBUG, "key lookup success, key exists\n");
-		handle->known_keys = alpm_list_add(handle->known_keys, strdup(fpr));
 		ret = 1;
 	} else {
 		_alpm_log(handle, ALPM_LOG_DEBUG, "gpg error: %s\n", gpgme_strerror(gpg_err));
@@ -242,7 +466,7 @@ int _alpm_key_in_keychain(alpm_handle_t *handle, const char *fpr)
 	gpgme_key_unref(key);
 
 gpg_error:
-	gpgme_release(ctx);
+	session_ctx_release(handle, ctx);
 
 error:
 	return ret;
@@ -275,6 +499,7 @@ static int key_import_wkd(alpm_handle_t *handle, const char *email, const char *
 	_alpm_log(handle, ALPM_LOG_DEBUG, _("looking up key %s using WKD\n"), email);
 	gpg_err = gpgme_get_key(ctx, email, &key, 0);
 	if(gpg_err_code(gpg_err) == GPG_ERR_NO_ERROR) {
+		session_keyring_changed(handle);
 		/* check if correct key was imported via WKD */
 		if(fpr && _alpm_key_in_keychain(handle, fpr)) {
 			ret = 0;
@@ -502,7 +727,8 @@ static int email_from_uid(const char *uid, char **email)
  * @param fpr the fingerprint key ID to import
  * @return 0 on success, -1 on error
  */
-int _alpm_key_import(alpm_handle_t *handle, const char *uid, const char *fpr)
+static int gpgme_key_import(alpm_handle_t *handle, const char *uid,
+		const char *fpr)
 {
 	int ret = -1;
 	alpm_pgpkey_t fetch_key = {0};
@@ -536,6 +762,7 @@ int _alpm_key_import(alpm_handle_t *handle, const char *uid, const char *fpr)
 				_alpm_log(handle, ALPM_LOG_DEBUG,
 						_("key \"%s\" on keyserver\n"), fetch_key.uid);
 				if(key_import_keyserver(handle, &fetch_key) == 0) {
+					session_keyring_changed(handle);
 					ret = 0;
 				} else {
 					_alpm_log(handle, ALPM_LOG_ERROR,
@@ -573,7 +800,7 @@ int _alpm_gpgme_checksig(alpm_handle_t *handle, const char *path,
 {
 	int ret = -1, sigcount;
 	gpgme_error_t gpg_err = 0;
-	gpgme_ctx_t ctx = {0};
+	gpgme_ctx_t ctx = NULL;
 	gpgme_data_t filedata = {0}, sigdata = {0};
 	gpgme_verify_result_t verify_result;
 	gpgme_signature_t gpgsig;
@@ -613,7 +840,7 @@ int _alpm_gpgme_checksig(alpm_handle_t *handle, const char *path,
 
 	_alpm_log(handle, ALPM_LOG_DEBUG, "checking signature for %s\n", path);
 
-	gpg_err = gpgme_new(&ctx);
+	gpg_err = session_ctx_acquire(handle, &ctx);
 	CHECK_ERR();
 
 	/* create our necessary data objects to verify the signature */
@@ -682,7 +909,7 @@ int _alpm_gpgme_checksig(alpm_handle_t *handle, const char *path,
 				gpgme_strerror(gpgsig->validity_reason));
 
 		result = siglist->results + sigcount;
-		gpg_err = gpgme_get_key(ctx, gpgsig->fpr, &key, 0);
+		gpg_err = session_get_key(handle, ctx, gpgsig->fpr, &key);
 		if(gpg_err_code(gpg_err) == GPG_ERR_EOF) {
 			_alpm_log(handle, ALPM_LOG_DEBUG, "key lookup failed, unknown key\n");
 			gpg_err = GPG_ERR_NO_ERROR;
@@ -758,7 +985,7 @@ int _alpm_gpgme_checksig(alpm_handle_t *handle, const char *path,
 gpg_error:
 	gpgme_data_release(sigdata);
 	gpgme_data_release(filedata);
-	gpgme_release(ctx);
+	session_ctx_release(handle, ctx);
 
 error:
 	if(sigfile) {
@@ -776,14 +1003,29 @@ error:
 	return ret;
 }
 
+/**
+ * Initialize GPGME and the signature checking session up front. Signature
+ * checks running on worker threads must not race to do it.
+ * @param handle the context handle
+ * @return 0 on success, -1 on error
+ */
+static int gpgme_signing_init(alpm_handle_t *handle)
+{
+	if(init_gpgme(handle)) {
+		return -1;
+	}
+	get_session(handle);
+	return 0;
+}
+
 #else /* HAVE_LIBGPGME */
-int _alpm_key_in_keychain(alpm_handle_t *handle, const char UNUSED *fpr)
+static int gpgme_key_in_keychain(alpm_handle_t *handle, const char UNUSED *fpr)
 {
 	handle->pm_errno = ALPM_ERR_MISSING_CAPABILITY_SIGNATURES;
 	return -1;
 }
 
-int _alpm_key_import(alpm_handle_t *handle, const char UNUSED *uid,
+static int gpgme_key_import(alpm_handle_t *handle, const char UNUSED *uid,
 		const char UNUSED *fpr)
 {
 	handle->pm_errno = ALPM_ERR_MISSING_CAPABILITY_SIGNATURES;
@@ -797,8 +1039,108 @@ int _alpm_gpgme_checksig(alpm_handle_t *handle, const char UNUSED *path,
 	handle->pm_errno = ALPM_ERR_MISSING_CAPABILITY_SIGNATURES;
 	return -1;
 }
+
+static int gpgme_signing_init(alpm_handle_t UNUSED *handle)
+{
+	return 0;
+}
+
+static void gpgme_signing_release(alpm_handle_t UNUSED *handle)
+{
+}
 #endif /* HAVE_LIBGPGME */
 
+/**
+ * Determine if signatures can be checked at all. Without GPGME only the
+ * native verifier is available, which needs a keyring snapshot.
+ * @param handle the context handle
+ * @return 1 if signatures can be checked, 0 otherwise
+ */
+int _alpm_signing_available(alpm_handle_t UNUSED *handle)
+{
+#ifdef HAVE_LIBGPGME
+	return 1;
+#else
+	return handle->keyring_snapshot != NULL;
+#endif
+}
+
+/**
+ * Prepare for signature checks up front. Signature checks running on worker
+ * threads must not race to do it.
+ * @param handle the context handle
+ * @return 0 on success, -1 on error
+ */
+int _alpm_signing_init(alpm_handle_t *handle)
+{
+	if(handle->keyring_snapshot) {
+		return _alpm_pgp_init(handle);
+	}
+	return gpgme_signing_init(handle);
+}
+
+/**
+ * Drop the signature checking state of a handle, such as cached keys.
+ * @param handle the context handle
+ */
+void _alpm_signing_release(alpm_handle_t *handle)
+{
+	_alpm_pgp_release(handle);
+	gpgme_signing_release(handle);
+}
+
+/**
+ * Determine if we have a key is known in our local keyring.
+ * @param handle the context handle
+ * @param fpr the fingerprint key ID to look up
+ * @return 1 if key is known, 0 if key is unknown, -1 on error
+ */
+int _alpm_key_in_keychain(alpm_handle_t *handle, const char *fpr)
+{
+	if(handle->keyring_snapshot) {
+		return _alpm_pgp_key_known(handle, fpr);
+	}
+	return gpgme_key_in_keychain(handle, fpr);
+}
+
+/**
+ * Import a key into the local keyring. Keys can not be added to a keyring
+ * snapshot, it is maintained outside of libalpm.
+ * @param handle the context handle
+ * @param uid a user ID of the key to import
+ * @param fpr the fingerprint key ID to import
+ * @return 0 on success, -1 on error
+ */
+int _alpm_key_import(alpm_handle_t *handle, const char *uid, const char *fpr)
+{
+	if(handle->keyring_snapshot) {
+		_alpm_log(handle, ALPM_LOG_ERROR,
+				_("key \"%s\" is not in keyring %s\n"), fpr,
+				handle->keyring_snapshot);
+		return -1;
+	}
+	return gpgme_key_import(handle, uid, fpr);
+}
+
+/**
+ * Check the PGP signature for the given file path, using the native verifier
+ * if a keyring snapshot is set and GPGME otherwise.
+ * See #_alpm_gpgme_checksig for the details.
+ * @param handle the context handle
+ * @param path the full path to a file
+ * @param base64_sig optional PGP signature data in base64 encoding
+ * @param siglist a pointer to storage for signature results
+ * @return 0 in normal cases, -1 if the something failed in the check process
+ */
+int _alpm_checksig(alpm_handle_t *handle, const char *path,
+		const char *base64_sig, alpm_siglist_t *siglist)
+{
+	if(handle->keyring_snapshot) {
+		return _alpm_pgp_checksig(handle, path, base64_sig, siglist);
+	}
+	return _alpm_gpgme_checksig(handle, path, base64_sig, siglist);
+}
+
 /**
  * Form a signature path given a file path.
  * Caller must free the result.
@@ -822,7 +1164,7 @@ char *_alpm_sigpath(alpm_handle_t *handle, const char *path)
 
 /**
  * Helper for checking the PGP signature for the given file path.
- * This wraps #_alpm_gpgme_checksig in a slightly friendlier manner to simplify
+ * This wraps #_alpm_checksig in a slightly friendlier manner to simplify
  * handling of optional signatures and marginal/unknown trust levels and
  * handling the correct error code return values.
  * @param handle the context handle
@@ -844,7 +1186,7 @@ int _alpm_check_pgp_helper(alpm_handle_t *handle, const char *path,
 	CALLOC(siglist, 1, sizeof(alpm_siglist_t),
 			RET_ERR(handle, ALPM_ERR_MEMORY, -1));
 
-	ret = _alpm_gpgme_checksig(handle, path, base64_sig, siglist);
+	ret = _alpm_checksig(handle, path, base64_sig, siglist);
 	if(ret && handle->pm_errno == ALPM_ERR_SIG_MISSING) {
 		if(optional) {
 			_alpm_log(handle, ALPM_LOG_DEBUG, "missing optional signature\n");
@@ -1004,7 +1346,7 @@ int SYMEXPORT alpm_pkg_check_pgp_signature(alpm_pkg_t *pkg,
 	ASSERT(siglist != NULL, RET_ERR(pkg->handle, ALPM_ERR_WRONG_ARGS, -1));
 	pkg->handle->pm_errno = ALPM_ERR_OK;
 
-	return _alpm_gpgme_checksig(pkg->handle, pkg->filename,
+	return _alpm_checksig(pkg->handle, pkg->filename,
 			pkg->base64_sig, siglist);
 }
 
@@ -1015,7 +1357,7 @@ int SYMEXPORT alpm_db_check_pgp_signature(alpm_db_t *db,
 	ASSERT(siglist != NULL, RET_ERR(db->handle, ALPM_ERR_WRONG_ARGS, -1));
 	db->handle->pm_errno = ALPM_ERR_OK;
 
-	return _alpm_gpgme_checksig(db->handle, _alpm_db_path(db), NULL, siglist);
+	return _alpm_checksig(db->handle, _alpm_db_path(db), NULL, siglist);
 }
 
 int SYMEXPORT alpm_siglist_cleanup(alpm_siglist_t *siglist)
@@ -1030,6 +1372,7 @@ int SYMEXPORT alpm_siglist_cleanup(alpm_siglist_t *siglist)
 #endif
 		} else {
 			free(result->key.fingerprint);
+			free(result->key.uid);
 		}
 	}
 	if(siglist->count) {
@@ -22,6 +22,11 @@
 #include "alpm.h"
 
 char *_alpm_sigpath(alpm_handle_t *handle, const char *path);
+int _alpm_signing_available(alpm_handle_t *handle);
+int _alpm_signing_init(alpm_handle_t *handle);
+void _alpm_signing_release(alpm_handle_t *handle);
+int _alpm_checksig(alpm_handle_t *handle, const char *path,
+		const char *base64_sig, alpm_siglist_t *result);
 int _alpm_gpgme_checksig(alpm_handle_t *handle, const char *path,
 		const char *base64_sig, alpm_siglist_t *result);
 
@@ -47,6 +47,7 @@
 #include "remove.h"
 #include "diskspace.h"
 #include "signing.h"
+#include "workers.h"
 
 struct keyinfo_t {
        char* uid;
@@ -428,6 +429,9 @@ int _alpm_sync_prepare(alpm_handle_t *handle, alpm_list_t **data)
 			alpm_pkg_t *pkg = i->data;
 			if(_alpm_resolvedeps(handle, localpkgs, pkg, trans->add,
 						&resolved, remove, data) == -1) {
+				if(handle->pm_errno == ALPM_ERR_MEMORY) {
+					break;
+				}
 				unresolvable = alpm_list_add(unresolvable, pkg);
 			}
 			/* Else, [resolved] now additionally contains [pkg] and all of its
@@ -436,6 +440,14 @@ int _alpm_sync_prepare(alpm_handle_t *handle, alpm_list_t **data)
 		alpm_list_free(localpkgs);
 		alpm_list_free(remove);
 
+		if(i != NULL) {
+			/* ran out of memory */
+			alpm_list_free(resolved);
+			alpm_list_free(unresolvable);
+			ret = -1;
+			goto cleanup;
+		}
+
 		/* If there were unresolvable top-level packages, prompt the user to
 		   see if they'd like to ignore them rather than failing the sync */
 		if(unresolvable != NULL) {
@@ -729,6 +741,7 @@ static int find_dl_candidates(alpm_handle_t *handle, alpm_list_t **files)
 	for(alpm_list_t *i = handle->trans->add; i; i = i->next) {
 		alpm_pkg_t *spkg = i->data;
 
+		spkg->download_verified = 0;
 		if(spkg->origin != ALPM_PKG_FROM_FILE) {
 			alpm_db_t *repo = spkg->origin_data.db;
 			bool need_download;
@@ -770,11 +783,292 @@ static int find_dl_candidates(alpm_handle_t *handle, alpm_list_t **files)
 }
 
 
-static int download_files(alpm_handle_t *handle)
+/* With pipelined downloads, packages are verified and loaded on worker
+ * threads as soon as their files are complete. The results are only picked
+ * up by check_validity() and load_packages(), so a transaction still fails
+ * as a whole before anything is installed. */
+struct pipeline_item {
+	alpm_pkg_t *pkg;
+	/* file the package is processed from */
+	char *path;
+	/* where the file is found once all downloads are complete */
+	char *final_path;
+	/* downloads still needed before processing, -1 if one failed */
+	int waiting;
+	int queued;
+	int siglevel;
+	int validation;
+	alpm_siglist_t *siglist;
+	alpm_pkg_t *pkgfile;
+	alpm_errno_t error;
+	/* private handle used on a worker thread */
+	alpm_handle_t *worker;
+	/* download of the package file, NULL if it was already in the cache */
+	struct dload_payload *payload;
+};
+
+struct pipeline {
+	alpm_handle_t *handle;
+	alpm_workqueue_t *queue;
+	struct pipeline_item *items;
+	size_t count;
+	/* also load the packages after verifying them */
+	int load;
+	/* download callback of the frontend */
+	alpm_cb_download dlcb;
+	void *dlcb_ctx;
+};
+
+static void pipeline_process(void *ctx, size_t index)
+{
+	struct pipeline *pipe = ctx;
+	struct pipeline_item *item = pipe->items + index;
+	alpm_handle_t *handle = item->worker;
+
+	if(_alpm_pkg_validate_internal(handle, item->path, item->pkg,
+				item->siglevel, &item->siglist, &item->validation) == -1) {
+		item->error = handle->pm_errno ? handle->pm_errno : ALPM_ERR_PKG_INVALID;
+		return;
+	}
+	if(pipe->load) {
+		item->pkgfile = _alpm_pkg_load_internal(handle, item->path, 1);
+		if(item->pkgfile == NULL) {
+			item->error = handle->pm_errno ? handle->pm_errno : ALPM_ERR_PKG_INVALID;
+			return;
+		}
+		item->pkgfile->handle = pipe->handle;
+	}
+}
+
+static void pipeline_queue(struct pipeline *pipe, struct pipeline_item *item)
+{
+	/* worker handles are copied here, while the handle is not in use */
+	if((item->worker = _alpm_worker_handle_new(pipe->handle)) == NULL) {
+		return;
+	}
+	item->queued = 1;
+	_alpm_workqueue_add(pipe->queue, item - pipe->items);
+}
+
+static void pipeline_cb_download(void *ctx, const char *filename,
+		alpm_download_event_type_t event, void *data)
+{
+	struct pipeline *pipe = ctx;
+	size_t n;
+
+	if(pipe->dlcb) {
+		pipe->dlcb(pipe->dlcb_ctx, filename, event, data);
+	}
+	if(event != ALPM_DOWNLOAD_COMPLETED) {
+		return;
+	}
+
+	for(n = 0; n < pipe->count; n++) {
+		struct pipeline_item *item = pipe->items + n;
+		alpm_download_event_completed_t *completed = data;
+		size_t len = strlen(item->pkg->filename);
+
+		if(item->waiting <= 0 || strncmp(filename, item->pkg->filename, len) != 0
+				|| (filename[len] != '\0' && strcmp(filename + len, ".sig") != 0)) {
+			continue;
+		}
+		if(completed->result != 0) {
+			item->waiting = -1;
+			break;
+		}
+		if(filename[len] == '\0' && item->payload) {
+			/* the worker validates the file that was just hashed; whether the
+			 * installed file is the same one is settled in download_files() */
+			item->pkg->download_verified = item->payload->sha256_verified;
+		}
+		if(--item->waiting == 0) {
+			pipeline_queue(pipe, item);
+		}
+		break;
+	}
+}
+
+/* Start processing packages, the ones already in the cache right away and
+ * downloaded ones once they and their signature are complete. */
+static int pipeline_start(struct pipeline *pipe, alpm_list_t *files,
+		alpm_list_t *payloads, const char *cachedir, const char *temporary_cachedir)
+{
+	alpm_handle_t *handle = pipe->handle;
+	alpm_list_t *i, *j, *k;
+	size_t n;
+	int need_signing = 0;
+
+	CALLOC(pipe->items, alpm_list_count(handle->trans->add) + 1,
+			sizeof(struct pipeline_item), RET_ERR(handle, ALPM_ERR_MEMORY, -1));
+	for(i = handle->trans->add; i; i = i->next) {
+		alpm_pkg_t *pkg = i->data;
+		struct pipeline_item *item = pipe->items + pipe->count;
+
+		if(pkg->origin == ALPM_PKG_FROM_FILE) {
+			continue;
+		}
+		memset(item, 0, sizeof(struct pipeline_item));
+		item->pkg = pkg;
+		item->siglevel = alpm_db_get_siglevel(alpm_pkg_get_db(pkg));
+		if(alpm_list_find_ptr(files, pkg)) {
+			/* a sandboxed downloader could still change the file */
+			if(handle->sandboxuser) {
+				continue;
+			}
+			/* payloads were created in the order of files */
+			for(k = files, j = payloads; k && j; k = k->next, j = j->next) {
+				if(k->data == pkg) {
+					item->payload = j->data;
+					break;
+				}
+			}
+			item->path = _alpm_get_fullpath(temporary_cachedir, pkg->filename, "");
+			item->final_path = _alpm_get_fullpath(cachedir, pkg->filename, "");
+			item->waiting = (item->siglevel & ALPM_SIG_PACKAGE) ? 2 : 1;
+		} else {
+			item->path = _alpm_filecache_find(handle, pkg->filename);
+			if(item->path) {
+				item->final_path = strdup(item->path);
+			}
+		}
+		if(!item->path || !item->final_path) {
+			free(item->path);
+			free(item->final_path);
+			continue;
+		}
+		if(item->siglevel & ALPM_SIG_PACKAGE) {
+			need_signing = 1;
+		}
+		pipe->count++;
+	}
+
+	if(pipe->count == 0) {
+		return 0;
+	}
+	if(need_signing && _alpm_signing_init(handle) != 0) {
+		/* nothing is queued; the packages are all checked after download */
+		_alpm_log(handle, ALPM_LOG_DEBUG,
+				"could not set up signature checks, not verifying while downloading\n");
+		return 0;
+	}
+	pipe->queue = _alpm_workqueue_new(handle, handle->verify_threads,
+			pipe->count, pipeline_process, pipe);
+	if(pipe->queue == NULL) {
+		return -1;
+	}
+
+	for(n = 0; n < pipe->count; n++) {
+		if(pipe->items[n].waiting == 0) {
+			pipeline_queue(pipe, pipe->items + n);
+		}
+	}
+
+	pipe->dlcb = handle->dlcb;
+	pipe->dlcb_ctx = handle->dlcb_ctx;
+	handle->dlcb = pipeline_cb_download;
+	handle->dlcb_ctx = pipe;
+	return 0;
+}
+
+/* Wait for the packages being processed */
+static void pipeline_stop(struct pipeline *pipe)
+{
+	size_t n;
+
+	if(pipe == NULL || pipe->queue == NULL) {
+		return;
+	}
+	pipe->handle->dlcb = pipe->dlcb;
+	pipe->handle->dlcb_ctx = pipe->dlcb_ctx;
+	_alpm_workqueue_finish(pipe->queue, NULL);
+	pipe->queue = NULL;
+
+	for(n = 0; n < pipe->count; n++) {
+		struct pipeline_item *item = pipe->items + n;
+
+		/* failures are retried and reported once downloads are complete */
+		_alpm_worker_handle_free(item->error ? NULL : pipe->handle, item->worker);
+		item->worker = NULL;
+		if(item->queued) {
+			_alpm_log(pipe->handle, ALPM_LOG_DEBUG, "%s: %s while downloading\n",
+					item->pkg->name, item->error ? "could not be processed" : "processed");
+		}
+	}
+}
+
+/* Find the result for a package processed from the given file */
+static struct pipeline_item *pipeline_find(struct pipeline *pipe,
+		alpm_pkg_t *pkg, const char *path)
+{
+	size_t n;
+
+	if(pipe == NULL) {
+		return NULL;
+	}
+	for(n = 0; n < pipe->count; n++) {
+		struct pipeline_item *item = pipe->items + n;
+		if(item->pkg == pkg) {
+			if(item->queued && item->error == ALPM_ERR_OK
+					&& strcmp(item->final_path, path) == 0) {
+				return item;
+			}
+			return NULL;
+		}
+	}
+	return NULL;
+}
+
+/* Hand over a package loaded while downloading, pointing it at the file
+ * that will be installed */
+static alpm_pkg_t *pipeline_take_pkgfile(struct pipeline_item *item,
+		const char *path)
+{
+	alpm_pkg_t *pkgfile = item->pkgfile;
+	char *filename, *file;
+
+	if(pkgfile == NULL) {
+		return NULL;
+	}
+	filename = strdup(path);
+	file = strdup(path);
+	if(filename == NULL || file == NULL) {
+		free(filename);
+		free(file);
+		return NULL;
+	}
+	free(pkgfile->filename);
+	pkgfile->filename = filename;
+	free(pkgfile->origin_data.file);
+	pkgfile->origin_data.file = file;
+	item->pkgfile = NULL;
+	return pkgfile;
+}
+
+static void pipeline_free(struct pipeline *pipe)
+{
+	size_t n;
+
+	if(pipe == NULL) {
+		return;
+	}
+	pipeline_stop(pipe);
+	for(n = 0; n < pipe->count; n++) {
+		struct pipeline_item *item = pipe->items + n;
+		free(item->path);
+		free(item->final_path);
+		alpm_siglist_cleanup(item->siglist);
+		free(item->siglist);
+		_alpm_pkg_free(item->pkgfile);
+	}
+	FREE(pipe->items);
+	pipe->count = 0;
+}
+
+static int download_files(alpm_handle_t *handle, struct pipeline *pipe)
 {
 	const char *cachedir;
 	char * temporary_cachedir = NULL;
-	alpm_list_t *i, *files = NULL;
+	alpm_list_t *i, *j, *files = NULL;
 	int ret = 0;
 	alpm_event_t event = {0};
 	alpm_list_t *payloads = NULL;
@@ -850,11 +1144,21 @@ static int download_files(alpm_handle_t *handle)
 			payload->allow_resume = 1;
 			payload->download_signature = (siglevel & ALPM_SIG_PACKAGE);
 			payload->signature_optional = (siglevel & ALPM_SIG_PACKAGE_OPTIONAL);
+			if(pkg->sha256sum) {
+				STRDUP(payload->sha256sum, pkg->sha256sum,
+					_alpm_dload_payload_reset(payload); FREE(payload);
+					GOTO_ERR(handle, ALPM_ERR_MEMORY, finish));
+			}
 
 			payloads = alpm_list_add(payloads, payload);
 		}
 
+		if(pipe && pipeline_start(pipe, files, payloads, cachedir, temporary_cachedir) != 0) {
+			ret = -1;
+			goto finish;
+		}
 		ret = _alpm_download(handle, payloads, cachedir, temporary_cachedir);
+		pipeline_stop(pipe);
 		if(ret == -1) {
 			event.type = ALPM_EVENT_PKG_RETRIEVE_FAILED;
 			EVENT(handle, &event);
@@ -863,6 +1167,27 @@ static int download_files(alpm_handle_t *handle)
 		}
 		event.type = ALPM_EVENT_PKG_RETRIEVE_DONE;
 		EVENT(handle, &event);
+
+		/* payloads were created in the order of files */
+		for(i = files, j = payloads; i && j; i = i->next, j = j->next) {
+			alpm_pkg_t *pkg = i->data;
+			struct dload_payload *payload = j->data;
+			char *downloaded, *cached;
+
+			pkg->download_verified = 0;
+			if(!payload->sha256_verified) {
+				continue;
+			}
+			/* only trust the checksum if the file that will be validated is
+			 * the one that was just downloaded */
+			downloaded = _alpm_get_fullpath(cachedir, pkg->filename, "");
+			cached = _alpm_filecache_find(handle, pkg->filename);
+			if(downloaded && cached && strcmp(downloaded, cached) == 0) {
+				pkg->download_verified = 1;
+			}
+			free(downloaded);
+			free(cached);
+		}
 	}
 
 finish:
@@ -880,6 +1205,7 @@ finish:
 		pkg->infolevel &= ~INFRQ_DSIZE;
 		pkg->download_size = 0;
 	}
+	pipeline_stop(pipe);
 	_alpm_remove_temporary_download_dir(temporary_cachedir);
 	FREE(temporary_cachedir);
 
@@ -938,7 +1264,7 @@ static int check_keyring(alpm_handle_t *handle)
 							if(!keyinfo) {
 								break;
 							}
-							keyinfo->uid = strdup(pkg->packager);
+							keyinfo->uid = strdup(alpm_pkg_get_packager(pkg));
 							keyinfo->keyid = strdup(key);
 							errors = alpm_list_add(errors, keyinfo);
 						}
@@ -982,19 +1308,72 @@ static int check_keyring(alpm_handle_t *handle)
 }
 #endif /* HAVE_LIBGPGME */
 
+struct validity {
+	alpm_pkg_t *pkg;
+	char *path;
+	alpm_siglist_t *siglist;
+	int siglevel;
+	int validation;
+	alpm_errno_t error;
+	/* verified while downloading */
+	int done;
+	/* private handle used on a worker thread */
+	alpm_handle_t *worker;
+};
+
+struct validity_batch {
+	alpm_handle_t *handle;
+	struct validity *items;
+	int threaded;
+	size_t total;
+	size_t current;
+	uint64_t total_bytes;
+	uint64_t current_bytes;
+};
+
+static void validate_pkg(void *ctx, size_t index)
+{
+	struct validity_batch *batch = ctx;
+	struct validity *v = batch->items + index;
+	alpm_handle_t *handle = batch->handle;
+
+	if(v->done) {
+		return;
+	}
+	if(batch->threaded) {
+		if((v->worker = _alpm_worker_handle_new(handle)) == NULL) {
+			v->error = ALPM_ERR_MEMORY;
+			return;
+		}
+		handle = v->worker;
+	}
+	if(_alpm_pkg_validate_internal(handle, v->path, v->pkg,
+				v->siglevel, &v->siglist, &v->validation) == -1) {
+		v->error = handle->pm_errno;
+		if(v->error == ALPM_ERR_OK) {
+			v->error = ALPM_ERR_PKG_INVALID;
+		}
+	}
+}
+
+static void validate_pkg_done(void *ctx, size_t index)
+{
+	struct validity_batch *batch = ctx;
+	int percent;
+
+	batch->current++;
+	batch->current_bytes += batch->items[index].pkg->size;
+	percent = (int)(((double)batch->current_bytes / batch->total_bytes) * 100);
+	PROGRESS(batch->handle, ALPM_PROGRESS_INTEGRITY_START, "", percent,
+			batch->total, batch->current);
+}
+
 static int check_validity(alpm_handle_t *handle,
-		size_t total, uint64_t total_bytes)
+		size_t total, uint64_t total_bytes, struct pipeline *pipe)
 {
-	struct validity {
-		alpm_pkg_t *pkg;
-		char *path;
-		alpm_siglist_t *siglist;
-		int siglevel;
-		int validation;
-		alpm_errno_t error;
-	};
-	size_t current = 0;
-	uint64_t current_bytes = 0;
+	struct validity_batch batch = { handle, NULL, 0, total, 0, total_bytes, 0 };
+	size_t count = 0, n;
+	int need_signing = 0;
 	alpm_list_t *i, *errors = NULL;
 	alpm_event_t event;
 
@@ -1002,44 +1381,80 @@ static int check_validity(alpm_handle_t *handle,
 	event.type = ALPM_EVENT_INTEGRITY_START;
 	EVENT(handle, &event);
 
-	for(i = handle->trans->add; i; i = i->next, current++) {
-		struct validity v = { i->data, NULL, NULL, 0, 0, 0 };
-		int percent = (int)(((double)current_bytes / total_bytes) * 100);
+	CALLOC(batch.items, total + 1, sizeof(struct validity),
+			RET_ERR(handle, ALPM_ERR_MEMORY, -1));
+	for(i = handle->trans->add; i; i = i->next) {
+		alpm_pkg_t *pkg = i->data;
+		struct pipeline_item *item;
+		struct validity *v;
 
-		PROGRESS(handle, ALPM_PROGRESS_INTEGRITY_START, "", percent,
-				total, current);
-		if(v.pkg->origin == ALPM_PKG_FROM_FILE) {
-			continue; /* pkg_load() has been already called, this package is valid */
+		if(pkg->origin == ALPM_PKG_FROM_FILE) {
+			/* pkg_load() has been already called, this package is valid */
+			batch.current++;
+			continue;
 		}
 
-		current_bytes += v.pkg->size;
-		v.path = _alpm_filecache_find(handle, v.pkg->filename);
-
-		if(!v.path) {
+		v = batch.items + count;
+		v->pkg = pkg;
+		v->path = _alpm_filecache_find(handle, pkg->filename);
+		if(!v->path) {
 			_alpm_log(handle, ALPM_LOG_ERROR,
-					_("%s: could not find package in cache\n"), v.pkg->name);
+					_("%s: could not find package in cache\n"), pkg->name);
+			for(n = 0; n < count; n++) {
+				free(batch.items[n].path);
+			}
+			free(batch.items);
 			RET_ERR(handle, ALPM_ERR_PKG_NOT_FOUND, -1);
 		}
+		v->siglevel = alpm_db_get_siglevel(alpm_pkg_get_db(pkg));
+		if((item = pipeline_find(pipe, pkg, v->path)) != NULL) {
+			v->validation = item->validation;
+			v->siglist = item->siglist;
+			item->siglist = NULL;
+			v->done = 1;
+		} else if(v->siglevel & ALPM_SIG_PACKAGE) {
+			need_signing = 1;
+		}
+		count++;
+	}
+
+	PROGRESS(handle, ALPM_PROGRESS_INTEGRITY_START, "", 0,
+			total, batch.current);
+
+	batch.threaded = handle->verify_threads > 1 && count > 1;
+	if(batch.threaded && need_signing && _alpm_signing_init(handle) != 0) {
+		/* let each package report the failure instead of every worker
+		 * retrying it at once */
+		batch.threaded = 0;
+	}
+	_alpm_workers_run(handle, batch.threaded ? handle->verify_threads : 1,
+			count, validate_pkg, validate_pkg_done, &batch);
 
-		v.siglevel = alpm_db_get_siglevel(alpm_pkg_get_db(v.pkg));
+	/* report in transaction order, whichever thread finished first */
+	for(n = 0; n < count; n++) {
+		struct validity *v = batch.items + n;
 
-		if(_alpm_pkg_validate_internal(handle, v.path, v.pkg,
-					v.siglevel, &v.siglist, &v.validation) == -1) {
+		_alpm_worker_handle_free(handle, v->worker);
+		v->worker = NULL;
+		if(v->error != ALPM_ERR_OK) {
 			struct validity *invalid;
-			v.error = handle->pm_errno;
-			MALLOC(invalid, sizeof(struct validity), return -1);
-			memcpy(invalid, &v, sizeof(struct validity));
+			MALLOC(invalid, sizeof(struct validity), goto error);
+			memcpy(invalid, v, sizeof(struct validity));
 			errors = alpm_list_add(errors, invalid);
 		} else {
-			alpm_siglist_cleanup(v.siglist);
-			free(v.siglist);
-			free(v.path);
-			v.pkg->validation = v.validation;
+			alpm_siglist_cleanup(v->siglist);
+			free(v->siglist);
+			free(v->path);
+			v->pkg->validation = v->validation;
 		}
+		v->path = NULL;
+		v->siglist = NULL;
 	}
+	free(batch.items);
+	batch.items = NULL;
 
 	PROGRESS(handle, ALPM_PROGRESS_INTEGRITY_START, "", 100,
-			total, current);
+			total, batch.current);
 	event.type = ALPM_EVENT_INTEGRITY_DONE;
 	EVENT(handle, &event);
 
@@ -1083,6 +1498,24 @@ static int check_validity(alpm_handle_t *handle,
 	}
 
 	return 0;
+
+error:
+	for(; n < count; n++) {
+		_alpm_worker_handle_free(handle, batch.items[n].worker);
+		alpm_siglist_cleanup(batch.items[n].siglist);
+		free(batch.items[n].siglist);
+		free(batch.items[n].path);
+	}
+	free(batch.items);
+	for(i = errors; i; i = i->next) {
+		struct validity *v = i->data;
+		alpm_siglist_cleanup(v->siglist);
+		free(v->siglist);
+		free(v->path);
+		free(v);
+	}
+	alpm_list_free(errors);
+	RET_ERR(handle, ALPM_ERR_MEMORY, -1);
 }
 
 static int dep_not_equal(const alpm_depend_t *left, const alpm_depend_t *right)
@@ -1154,10 +1587,68 @@ static int check_pkg_matches_db(alpm_pkg_t *spkg, alpm_pkg_t *pkgfile)
 }
 
 
+struct pkgload {
+	/* target list entry of the sync package */
+	alpm_list_t *target;
+	char *path;
+	alpm_pkg_t *pkgfile;
+	alpm_errno_t error;
+	/* private handle used on a worker thread */
+	alpm_handle_t *worker;
+};
+
+struct pkgload_batch {
+	alpm_handle_t *handle;
+	struct pkgload *items;
+	int threaded;
+	size_t total;
+	size_t current;
+	uint64_t total_bytes;
+	uint64_t current_bytes;
+};
+
+static void load_pkg(void *ctx, size_t index)
+{
+	struct pkgload_batch *batch = ctx;
+	struct pkgload *l = batch->items + index;
+	alpm_handle_t *handle = batch->handle;
+
+	if(l->pkgfile) {
+		return;
+	}
+	if(batch->threaded) {
+		if((l->worker = _alpm_worker_handle_new(handle)) == NULL) {
+			l->error = ALPM_ERR_MEMORY;
+			return;
+		}
+		handle = l->worker;
+	}
+	l->pkgfile = _alpm_pkg_load_internal(handle, l->path, 1);
+	if(l->pkgfile) {
+		l->pkgfile->handle = batch->handle;
+	} else {
+		l->error = handle->pm_errno;
+	}
+}
+
+static void load_pkg_done(void *ctx, size_t index)
+{
+	struct pkgload_batch *batch = ctx;
+	alpm_pkg_t *spkg = batch->items[index].target->data;
+	int percent;
+
+	batch->current++;
+	batch->current_bytes += spkg->size;
+	percent = (int)(((double)batch->current_bytes / batch->total_bytes) * 100);
+	PROGRESS(batch->handle, ALPM_PROGRESS_LOAD_START, "", percent,
+			batch->total, batch->current);
+}
+
 static int load_packages(alpm_handle_t *handle, alpm_list_t **data,
-		size_t total, size_t total_bytes)
+		size_t total, size_t total_bytes, struct pipeline *pipe)
 {
-	size_t current = 0, current_bytes = 0;
+	struct pkgload_batch batch = { handle, NULL, 0, total, 0, total_bytes, 0 };
+	size_t count = 0, n;
 	int errors = 0;
 	alpm_list_t *i, *delete = NULL;
 	alpm_event_t event;
@@ -1166,36 +1657,63 @@ static int load_packages(alpm_handle_t *handle, alpm_list_t **data,
 	event.type = ALPM_EVENT_LOAD_START;
 	EVENT(handle, &event);
 
-	for(i = handle->trans->add; i; i = i->next, current++) {
-		int error = 0;
+	CALLOC(batch.items, total + 1, sizeof(struct pkgload),
+			RET_ERR(handle, ALPM_ERR_MEMORY, -1));
+	for(i = handle->trans->add; i; i = i->next) {
 		alpm_pkg_t *spkg = i->data;
-		char *filepath;
-		int percent = (int)(((double)current_bytes / total_bytes) * 100);
+		struct pipeline_item *item;
+		struct pkgload *l;
 
-		PROGRESS(handle, ALPM_PROGRESS_LOAD_START, "", percent,
-				total, current);
 		if(spkg->origin == ALPM_PKG_FROM_FILE) {
-			continue; /* pkg_load() has been already called, this package is valid */
+			/* pkg_load() has been already called, this package is valid */
+			batch.current++;
+			continue;
 		}
 
-		current_bytes += spkg->size;
-		filepath = _alpm_filecache_find(handle, spkg->filename);
-
-		if(!filepath) {
-			FREELIST(delete);
+		l = batch.items + count;
+		l->target = i;
+		l->path = _alpm_filecache_find(handle, spkg->filename);
+		if(!l->path) {
 			_alpm_log(handle, ALPM_LOG_ERROR,
 					_("%s: could not find package in cache\n"), spkg->name);
+			for(n = 0; n < count; n++) {
+				free(batch.items[n].path);
+			}
+			free(batch.items);
 			RET_ERR(handle, ALPM_ERR_PKG_NOT_FOUND, -1);
 		}
+		if((item = pipeline_find(pipe, spkg, l->path)) != NULL) {
+			l->pkgfile = pipeline_take_pkgfile(item, l->path);
+		}
+		count++;
+	}
+
+	PROGRESS(handle, ALPM_PROGRESS_LOAD_START, "", 0,
+			total, batch.current);
+
+	/* reading the archives is independent of anything else in the
+	 * transaction, comparing them to the sync database is not */
+	batch.threaded = handle->verify_threads > 1 && count > 1;
+	_alpm_workers_run(handle, batch.threaded ? handle->verify_threads : 1,
+			count, load_pkg, load_pkg_done, &batch);
+
+	for(n = 0; n < count; n++) {
+		struct pkgload *l = batch.items + n;
+		alpm_pkg_t *spkg = l->target->data;
+		alpm_pkg_t *pkgfile = l->pkgfile;
+		int error = 0;
+
+		_alpm_worker_handle_free(handle, l->worker);
+		l->worker = NULL;
 
-		/* load the package file and replace pkgcache entry with it in the target list */
+		/* replace pkgcache entry with the package file in the target list */
 		/* TODO: alpm_pkg_get_db() will not work on this target anymore */
 		_alpm_log(handle, ALPM_LOG_DEBUG,
 				"replacing pkgcache entry with package file for target %s\n",
 				spkg->name);
-		alpm_pkg_t *pkgfile =_alpm_pkg_load_internal(handle, filepath, 1);
 		if(!pkgfile) {
 			_alpm_log(handle, ALPM_LOG_DEBUG, "failed to load pkgfile internal\n");
+			handle->pm_errno = l->error;
 			error = 1;
 		} else {
 			error |= check_pkg_matches_db(spkg, pkgfile);
@@ -1203,11 +1721,11 @@ static int load_packages(alpm_handle_t *handle, alpm_list_t **data,
 		if(error != 0) {
 			errors++;
 			*data = alpm_list_add(*data, strdup(spkg->filename));
-			delete = alpm_list_add(delete, filepath);
+			delete = alpm_list_add(delete, l->path);
 			_alpm_pkg_free(pkgfile);
 			continue;
 		}
-		free(filepath);
+		free(l->path);
 		/* copy over the install reason */
 		pkgfile->reason = spkg->reason;
 		/* copy over validation method */
@@ -1215,14 +1733,15 @@ static int load_packages(alpm_handle_t *handle, alpm_list_t **data,
 		/* transfer oldpkg */
 		pkgfile->oldpkg = spkg->oldpkg;
 		spkg->oldpkg = NULL;
-		i->data = pkgfile;
+		l->target->data = pkgfile;
 		/* spkg has been removed from the target list, so we can free the
 		 * sync-specific fields */
 		_alpm_pkg_free_trans(spkg);
 	}
+	free(batch.items);
 
 	PROGRESS(handle, ALPM_PROGRESS_LOAD_START, "", 100,
-			total, current);
+			total, batch.current);
 	event.type = ALPM_EVENT_LOAD_DONE;
 	EVENT(handle, &event);
 
@@ -1247,15 +1766,23 @@ int _alpm_sync_load(alpm_handle_t *handle, alpm_list_t **data)
 	size_t total = 0;
 	uint64_t total_bytes = 0;
 	alpm_trans_t *trans = handle->trans;
+	struct pipeline pipeline = { handle, NULL, NULL, 0, 0, NULL, NULL };
+	struct pipeline *pipe = NULL;
+	int ret = -1;
 
-	if(download_files(handle) == -1) {
-		return -1;
+	if(handle->pipeline_downloads) {
+		pipeline.load = !(trans->flags & ALPM_TRANS_FLAG_DOWNLOADONLY);
+		pipe = &pipeline;
+	}
+
+	if(download_files(handle, pipe) == -1) {
+		goto cleanup;
 	}
 
 #ifdef HAVE_LIBGPGME
 	/* make sure all required signatures are in keyring */
 	if(check_keyring(handle)) {
-		return -1;
+		goto cleanup;
 	}
 #endif
 
@@ -1271,19 +1798,24 @@ int _alpm_sync_load(alpm_handle_t *handle, alpm_list_t **data)
 	/* this can only happen maliciously */
 	total_bytes = total_bytes ? total_bytes : 1;
 
-	if(check_validity(handle, total, total_bytes) != 0) {
-		return -1;
+	if(check_validity(handle, total, total_bytes, pipe) != 0) {
+		goto cleanup;
 	}
 
 	if(trans->flags & ALPM_TRANS_FLAG_DOWNLOADONLY) {
-		return 0;
+		ret = 0;
+		goto cleanup;
 	}
 
-	if(load_packages(handle, data, total, total_bytes)) {
-		return -1;
+	if(load_packages(handle, data, total, total_bytes, pipe)) {
+		goto cleanup;
 	}
 
-	return 0;
+	ret = 0;
+
+cleanup:
+	pipeline_free(pipe);
+	return ret;
 }
 
 int _alpm_sync_check(alpm_handle_t *handle, alpm_list_t **data)
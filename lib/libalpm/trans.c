@@ -41,6 +41,7 @@
 #include "alpm.h"
 #include "deps.h"
 #include "hook.h"
+#include "signing.h"
 
 int SYMEXPORT alpm_trans_init(alpm_handle_t *handle, int flags)
 {
@@ -61,6 +62,17 @@ int SYMEXPORT alpm_trans_init(alpm_handle_t *handle, int flags)
 	trans->flags = flags;
 	trans->state = STATE_INITIALIZED;
 
+	/* the pattern options are matched from worker threads during commit,
+	 * make sure none of them is compiled lazily there */
+	if((trans->skip_remove = _alpm_strset_new()) == NULL
+			|| _alpm_handle_compile_patterns(handle) != 0) {
+		_alpm_trans_free(trans);
+		if(!(flags & ALPM_TRANS_FLAG_NOLOCK)) {
+			_alpm_handle_unlock(handle);
+		}
+		RET_ERR(handle, ALPM_ERR_MEMORY, -1);
+	}
+
 	handle->trans = trans;
 
 	return 0;
@@ -148,14 +160,22 @@ int SYMEXPORT alpm_trans_prepare(alpm_handle_t *handle, alpm_list_t **data)
 	if(!(trans->flags & ALPM_TRANS_FLAG_NODEPS)) {
 		_alpm_log(handle, ALPM_LOG_DEBUG, "sorting by dependencies\n");
 		if(trans->add) {
-			alpm_list_t *add_orig = trans->add;
-			trans->add = _alpm_sortbydeps(handle, add_orig, trans->remove, 0);
-			alpm_list_free(add_orig);
+			alpm_list_t *add_sorted = _alpm_sortbydeps(handle, trans->add, trans->remove, 0);
+			if(add_sorted == NULL) {
+				/* pm_errno is set by _alpm_sortbydeps() */
+				return -1;
+			}
+			alpm_list_free(trans->add);
+			trans->add = add_sorted;
 		}
 		if(trans->remove) {
-			alpm_list_t *rem_orig = trans->remove;
-			trans->remove = _alpm_sortbydeps(handle, rem_orig, NULL, 1);
-			alpm_list_free(rem_orig);
+			alpm_list_t *rem_sorted = _alpm_sortbydeps(handle, trans->remove, NULL, 1);
+			if(rem_sorted == NULL) {
+				/* pm_errno is set by _alpm_sortbydeps() */
+				return -1;
+			}
+			alpm_list_free(trans->remove);
+			trans->remove = rem_sorted;
 		}
 	}
 
@@ -274,8 +294,17 @@ int SYMEXPORT alpm_trans_release(alpm_handle_t *handle)
 
 	int nolock_flag = trans->flags & ALPM_TRANS_FLAG_NOLOCK;
 
+	/* bring the local database index up to date, unless the database may have
+	 * been left half-modified or is not ours to write */
+	if(!nolock_flag && trans->state != STATE_COMMITING
+			&& trans->state != STATE_INTERRUPTED) {
+		_alpm_local_db_write_index(handle->db_local);
+	}
+
 	_alpm_trans_free(trans);
 	handle->trans = NULL;
+	/* pick up keyring changes made before the next transaction */
+	_alpm_signing_release(handle);
 
 	/* unlock db */
 	if(!nolock_flag) {
@@ -299,7 +328,7 @@ void _alpm_trans_free(alpm_trans_t *trans)
 	alpm_list_free_inner(trans->remove, (alpm_list_fn_free)_alpm_pkg_free);
 	alpm_list_free(trans->remove);
 
-	FREELIST(trans->skip_remove);
+	_alpm_strset_free(trans->skip_remove);
 
 	FREE(trans);
 }
@@ -335,7 +364,7 @@ static int grep(const char *fn, const char *needle)
 }
 
 int _alpm_runscriptlet(alpm_handle_t *handle, const char *filepath,
-		const char *script, const char *ver, const char *oldver, int is_archive)
+		const char *script, const char *ver, const char *oldver, alpm_pkg_t *pkgfile)
 {
 	char arg0[PATH_MAX], arg1[3], cmdline[PATH_MAX];
 	char *argv[] = { arg0, arg1, cmdline, NULL };
@@ -348,7 +377,7 @@ int _alpm_runscriptlet(alpm_handle_t *handle, const char *filepath,
 		return 0;
 	}
 
-	if(!is_archive && !grep(filepath, script)) {
+	if(!pkgfile && !grep(filepath, script)) {
 		/* script not found in scriptlet file; we can only short-circuit this early
 		 * if it is an actual scriptlet file and not an archive. */
 		return 0;
@@ -375,8 +404,8 @@ int _alpm_runscriptlet(alpm_handle_t *handle, const char *filepath,
 	len += strlen("/.INSTALL");
 	MALLOC(scriptfn, len, free(tmpdir); RET_ERR(handle, ALPM_ERR_MEMORY, -1));
 	snprintf(scriptfn, len, "%s/.INSTALL", tmpdir);
-	if(is_archive) {
-		if(_alpm_unpack_single(handle, filepath, tmpdir, ".INSTALL")) {
+	if(pkgfile) {
+		if(_alpm_pkg_extract_scriptlet(pkgfile, tmpdir)) {
 			retval = 1;
 		}
 	} else {
@@ -389,7 +418,7 @@ int _alpm_runscriptlet(alpm_handle_t *handle, const char *filepath,
 		goto cleanup;
 	}
 
-	if(is_archive && !grep(scriptfn, script)) {
+	if(pkgfile && !grep(scriptfn, script)) {
 		/* script not found in extracted scriptlet file */
 		goto cleanup;
 	}
@@ -24,6 +24,7 @@
 #define ALPM_TRANS_H
 
 #include "alpm.h"
+#include "patterns.h"
 
 typedef enum _alpm_transstate_t {
 	STATE_IDLE = 0,
@@ -43,13 +44,13 @@ typedef struct _alpm_trans_t {
 	alpm_list_t *unresolvable;  /* list of (alpm_pkg_t *) */
 	alpm_list_t *add;           /* list of (alpm_pkg_t *) */
 	alpm_list_t *remove;        /* list of (alpm_pkg_t *) */
-	alpm_list_t *skip_remove;   /* list of (char *) */
+	alpm_strset_t *skip_remove;
 } alpm_trans_t;
 
 void _alpm_trans_free(alpm_trans_t *trans);
 /* flags is a bitfield of alpm_transflag_t flags */
 int _alpm_trans_init(alpm_trans_t *trans, int flags);
 int _alpm_runscriptlet(alpm_handle_t *handle, const char *filepath,
-		const char *script, const char *ver, const char *oldver, int is_archive);
+		const char *script, const char *ver, const char *oldver, alpm_pkg_t *pkgfile);
 
 #endif /* ALPM_TRANS_H */
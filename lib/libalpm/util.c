@@ -1078,19 +1078,78 @@ static int md5_file(const char *path, unsigned char output[16])
 	return 0;
 }
 
+struct _alpm_sha256_t {
+#if HAVE_LIBSSL
+	EVP_MD_CTX *ctx;
+#else /* HAVE_LIBNETTLE */
+	struct sha256_ctx ctx;
+#endif
+};
+
+/** Start an incremental SHA-256 computation.
+ * @return the digest context, or NULL on error
+ */
+alpm_sha256_t *_alpm_sha256_new(void)
+{
+	alpm_sha256_t *sha;
+
+	MALLOC(sha, sizeof(alpm_sha256_t), return NULL);
+#if HAVE_LIBSSL
+	sha->ctx = EVP_MD_CTX_create();
+	if(sha->ctx == NULL) {
+		free(sha);
+		return NULL;
+	}
+	EVP_DigestInit_ex(sha->ctx, EVP_get_digestbyname("SHA256"), NULL);
+#else /* HAVE_LIBNETTLE */
+	sha256_init(&sha->ctx);
+#endif
+	return sha;
+}
+
+/** Add data to an incremental SHA-256 computation.
+ * @param sha the digest context
+ * @param buf data to add
+ * @param len length of the data
+ */
+void _alpm_sha256_update(alpm_sha256_t *sha, const void *buf, size_t len)
+{
+#if HAVE_LIBSSL
+	EVP_DigestUpdate(sha->ctx, buf, len);
+#else /* HAVE_LIBNETTLE */
+	sha256_update(&sha->ctx, len, buf);
+#endif
+}
+
+/** Finish an incremental SHA-256 computation and free its context.
+ * @param sha the digest context
+ * @param output string to hold computed SHA256 digest, may be NULL to
+ * discard the result
+ */
+void _alpm_sha256_final(alpm_sha256_t *sha, unsigned char output[32])
+{
+	unsigned char discard[32];
+
+	if(sha == NULL) {
+		return;
+	}
+#if HAVE_LIBSSL
+	EVP_DigestFinal_ex(sha->ctx, output ? output : discard, NULL);
+	EVP_MD_CTX_destroy(sha->ctx);
+#else /* HAVE_LIBNETTLE */
+	sha256_digest(&sha->ctx, SHA256_DIGEST_SIZE, output ? output : discard);
+#endif
+	free(sha);
+}
+
 /** Compute the SHA-256 message digest of a file.
  * @param path file path of file to compute SHA256 digest of
  * @param output string to hold computed SHA256 digest
  * @return 0 on success, 1 on file open error, 2 on file read error
  */
-static int sha256_file(const char *path, unsigned char output[32])
+int _alpm_sha256_file(const char *path, unsigned char output[32])
 {
-#if HAVE_LIBSSL
-	EVP_MD_CTX *ctx;
-	const EVP_MD *md = EVP_get_digestbyname("SHA256");
-#else /* HAVE_LIBNETTLE */
-	struct sha256_ctx ctx;
-#endif
+	alpm_sha256_t *sha;
 	unsigned char *buf;
 	ssize_t n;
 	int fd;
@@ -1103,37 +1162,28 @@ static int sha256_file(const char *path, unsigned char output[32])
 		return 1;
 	}
 
-#if HAVE_LIBSSL
-	ctx = EVP_MD_CTX_create();
-	EVP_DigestInit_ex(ctx, md, NULL);
-#else /* HAVE_LIBNETTLE */
-	sha256_init(&ctx);
-#endif
+	if((sha = _alpm_sha256_new()) == NULL) {
+		close(fd);
+		free(buf);
+		return 1;
+	}
 
 	while((n = read(fd, buf, ALPM_BUFFER_SIZE)) > 0 || errno == EINTR) {
 		if(n < 0) {
 			continue;
 		}
-#if HAVE_LIBSSL
-		EVP_DigestUpdate(ctx, buf, n);
-#else /* HAVE_LIBNETTLE */
-		sha256_update(&ctx, n, buf);
-#endif
+		_alpm_sha256_update(sha, buf, n);
 	}
 
 	close(fd);
 	free(buf);
 
 	if(n < 0) {
+		_alpm_sha256_final(sha, NULL);
 		return 2;
 	}
 
-#if HAVE_LIBSSL
-	EVP_DigestFinal_ex(ctx, output, NULL);
-	EVP_MD_CTX_destroy(ctx);
-#else /* HAVE_LIBNETTLE */
-	sha256_digest(&ctx, SHA256_DIGEST_SIZE, output);
-#endif
+	_alpm_sha256_final(sha, output);
 	return 0;
 }
 #endif /* HAVE_LIBSSL || HAVE_LIBNETTLE */
@@ -1157,7 +1207,7 @@ char SYMEXPORT *alpm_compute_sha256sum(const char *filename)
 
 	ASSERT(filename != NULL, return NULL);
 
-	if(sha256_file(filename, output) > 0) {
+	if(_alpm_sha256_file(filename, output) > 0) {
 		return NULL;
 	}
 
@@ -1197,6 +1247,34 @@ int _alpm_test_checksum(const char *filepath, const char *expected,
 	return ret;
 }
 
+/** Finish an incremental SHA-256 computation and compare it to an expected
+ * value. The digest context is freed.
+ * @param sha the digest context
+ * @param expected hash value to compare against
+ * @return 0 if the data matches the expected hash, 1 if it does not, -1 on
+ * error
+ */
+int _alpm_sha256_test(alpm_sha256_t *sha, const char *expected)
+{
+	unsigned char output[32];
+	char *computed;
+	int ret;
+
+	_alpm_sha256_final(sha, output);
+	computed = hex_representation(output, 32);
+
+	if(expected == NULL || computed == NULL) {
+		ret = -1;
+	} else if(strcmp(expected, computed) != 0) {
+		ret = 1;
+	} else {
+		ret = 0;
+	}
+
+	FREE(computed);
+	return ret;
+}
+
 /* Note: does NOT handle sparse files on purpose for speed. */
 /** TODO.
  * Does not handle sparse files on purpose for speed.
@@ -145,6 +145,12 @@ void _alpm_remove_temporary_download_dir(const char *dir);
 /* Unlike many uses of alpm_pkgvalidation_t, _alpm_test_checksum expects
  * an enum value rather than a bitfield. */
 int _alpm_test_checksum(const char *filepath, const char *expected, alpm_pkgvalidation_t type);
+int _alpm_sha256_file(const char *path, unsigned char output[32]);
+typedef struct _alpm_sha256_t alpm_sha256_t;
+alpm_sha256_t *_alpm_sha256_new(void);
+void _alpm_sha256_update(alpm_sha256_t *sha, const void *buf, size_t len);
+void _alpm_sha256_final(alpm_sha256_t *sha, unsigned char output[32]);
+int _alpm_sha256_test(alpm_sha256_t *sha, const char *expected);
 int _alpm_archive_fgets(struct archive *a, struct archive_read_buffer *b);
 int _alpm_splitname(const char *target, char **name, char **version,
 		unsigned long *name_hash);
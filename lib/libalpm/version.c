@@ -20,6 +20,7 @@
 
 /* libalpm */
 #include "util.h"
+#include "version.h"
 
 /**
  * Some functions in this file have been adopted from the rpm source, notably
@@ -32,17 +33,11 @@
 /**
  * Split EVR into epoch, version, and release components.
  * @param evr		[epoch:]version[-release] string
- * @retval *ep		pointer to epoch
- * @retval *vp		pointer to version
- * @retval *rp		pointer to release
+ * @param parsed	where to store the components
  */
-static void parseEVR(char *evr, const char **ep, const char **vp,
-		const char **rp)
+void _alpm_evr_parse(const char *evr, alpm_evr_t *parsed)
 {
-	const char *epoch;
-	const char *version;
-	const char *release;
-	char *s, *se;
+	const char *s, *se;
 
 	s = evr;
 	/* s points to epoch terminator */
@@ -51,66 +46,66 @@ static void parseEVR(char *evr, const char **ep, const char **vp,
 	se = strrchr(s, '-');
 
 	if(*s == ':') {
-		epoch = evr;
-		*s++ = '\0';
-		version = s;
-		if(*epoch == '\0') {
-			epoch = "0";
+		if(s == evr) {
+			parsed->epoch = "0";
+			parsed->epoch_len = 1;
+		} else {
+			parsed->epoch = evr;
+			parsed->epoch_len = s - evr;
 		}
+		parsed->version = s + 1;
 	} else {
 		/* different from RPM- always assume 0 epoch */
-		epoch = "0";
-		version = evr;
+		parsed->epoch = "0";
+		parsed->epoch_len = 1;
+		parsed->version = evr;
 	}
 	if(se) {
-		*se++ = '\0';
-		release = se;
+		parsed->version_len = se - parsed->version;
+		parsed->release = se + 1;
+		parsed->release_len = strlen(parsed->release);
 	} else {
-		release = NULL;
+		parsed->version_len = strlen(parsed->version);
+		parsed->release = NULL;
+		parsed->release_len = 0;
 	}
-
-	if(ep) *ep = epoch;
-	if(vp) *vp = version;
-	if(rp) *rp = release;
 }
 
 /**
- * Compare alpha and numeric segments of two versions.
+ * Compare alpha and numeric segments of two versions. The versions are
+ * given as pointer and length, so no copies have to be made to terminate
+ * the segments.
  * return 1: a is newer than b
  *        0: a and b are the same version
  *       -1: b is newer than a
  */
-static int rpmvercmp(const char *a, const char *b)
+static int rpmvercmp(const char *a, size_t alen, const char *b, size_t blen)
 {
-	char oldch1, oldch2;
-	char *str1, *str2;
-	char *ptr1, *ptr2;
-	char *one, *two;
+	const char *end1 = a + alen, *end2 = b + blen;
+	const char *ptr1, *ptr2;
+	const char *one, *two;
+	char ch1, ch2;
+	size_t len1, len2;
 	int rc;
 	int isnum;
-	int ret = 0;
 
 	/* easy comparison to see if versions are identical */
-	if(strcmp(a, b) == 0) return 0;
-
-	str1 = strdup(a);
-	str2 = strdup(b);
+	if(alen == blen && memcmp(a, b, alen) == 0) return 0;
 
-	one = ptr1 = str1;
-	two = ptr2 = str2;
+	one = ptr1 = a;
+	two = ptr2 = b;
 
-	/* loop through each version segment of str1 and str2 and compare them */
-	while (*one && *two) {
-		while (*one && !isalnum((int)*one)) one++;
-		while (*two && !isalnum((int)*two)) two++;
+	/* loop through each version segment of a and b and compare them */
+	while (one < end1 && two < end2) {
+		while (one < end1 && !isalnum((int)*one)) one++;
+		while (two < end2 && !isalnum((int)*two)) two++;
 
 		/* If we ran to the end of either, we are finished with the loop */
-		if (!(*one && *two)) break;
+		if (!(one < end1 && two < end2)) break;
 
 		/* If the separator lengths were different, we are also finished */
 		if ((one - ptr1) != (two - ptr2)) {
-			ret = (one - ptr1) < (two - ptr2) ? -1 : 1;
-			goto cleanup;
+			return (one - ptr1) < (two - ptr2) ? -1 : 1;
 		}
 
 		ptr1 = one;
@@ -120,27 +115,19 @@ static int rpmvercmp(const char *a, const char *b)
 		/* leave one and two pointing to the start of the alpha or numeric */
 		/* segment and walk ptr1 and ptr2 to end of segment */
 		if (isdigit((int)*ptr1)) {
-			while (*ptr1 && isdigit((int)*ptr1)) ptr1++;
-			while (*ptr2 && isdigit((int)*ptr2)) ptr2++;
+			while (ptr1 < end1 && isdigit((int)*ptr1)) ptr1++;
+			while (ptr2 < end2 && isdigit((int)*ptr2)) ptr2++;
 			isnum = 1;
 		} else {
-			while (*ptr1 && isalpha((int)*ptr1)) ptr1++;
-			while (*ptr2 && isalpha((int)*ptr2)) ptr2++;
+			while (ptr1 < end1 && isalpha((int)*ptr1)) ptr1++;
+			while (ptr2 < end2 && isalpha((int)*ptr2)) ptr2++;
 			isnum = 0;
 		}
 
-		/* save character at the end of the alpha or numeric segment */
-		/* so that they can be restored after the comparison */
-		oldch1 = *ptr1;
-		*ptr1 = '\0';
-		oldch2 = *ptr2;
-		*ptr2 = '\0';
-
 		/* this cannot happen, as we previously tested to make sure that */
 		/* the first string has a non-null segment */
 		if (one == ptr1) {
-			ret = -1;	/* arbitrary */
-			goto cleanup;
+			return -1;	/* arbitrary */
 		}
 
 		/* take care of the case where the two version segments are */
@@ -148,8 +135,7 @@ static int rpmvercmp(const char *a, const char *b)
 		/* numeric segments are always newer than alpha segments */
 		/* XXX See patch #60884 (and details) from bugzilla #50977. */
 		if (two == ptr2) {
-			ret = isnum ? 1 : -1;
-			goto cleanup;
+			return isnum ? 1 : -1;
 		}
 
 		if (isnum) {
@@ -158,43 +144,41 @@ static int rpmvercmp(const char *a, const char *b)
 			/* digit segments can overflow an int - this should fix that. */
 
 			/* throw away any leading zeros - it's a number, right? */
-			while (*one == '0') one++;
-			while (*two == '0') two++;
+			while (one < ptr1 && *one == '0') one++;
+			while (two < ptr2 && *two == '0') two++;
 
 			/* whichever number has more digits wins */
-			if (strlen(one) > strlen(two)) {
-				ret = 1;
-				goto cleanup;
+			if ((ptr1 - one) > (ptr2 - two)) {
+				return 1;
 			}
-			if (strlen(two) > strlen(one)) {
-				ret = -1;
-				goto cleanup;
+			if ((ptr2 - two) > (ptr1 - one)) {
+				return -1;
 			}
 		}
 
-		/* strcmp will return which one is greater - even if the two */
+		/* compare the segments like strcmp would - even if the two */
 		/* segments are alpha or if they are numeric.  don't return  */
 		/* if they are equal because there might be more segments to */
 		/* compare */
-		rc = strcmp(one, two);
+		len1 = ptr1 - one;
+		len2 = ptr2 - two;
+		rc = memcmp(one, two, len1 < len2 ? len1 : len2);
+		if (rc == 0 && len1 != len2) {
+			rc = len1 < len2 ? -1 : 1;
+		}
 		if (rc) {
-			ret = rc < 1 ? -1 : 1;
-			goto cleanup;
+			return rc < 1 ? -1 : 1;
 		}
 
-		/* restore character that was replaced by null above */
-		*ptr1 = oldch1;
 		one = ptr1;
-		*ptr2 = oldch2;
 		two = ptr2;
 	}
 
 	/* this catches the case where all numeric and alpha segments have */
 	/* compared identically but the segment separating characters were */
 	/* different */
-	if ((!*one) && (!*two)) {
-		ret = 0;
-		goto cleanup;
+	if (one == end1 && two == end2) {
+		return 0;
 	}
 
 	/* the final showdown. we never want a remaining alpha string to
@@ -203,25 +187,39 @@ static int rpmvercmp(const char *a, const char *b)
 	 * - if one is an alpha, two is newer.
 	 * - otherwise one is newer.
 	 * */
-	if ( (!*one && !isalpha((int)*two))
-			|| isalpha((int)*one) ) {
-		ret = -1;
+	ch1 = one < end1 ? *one : '\0';
+	ch2 = two < end2 ? *two : '\0';
+	if ( (!ch1 && !isalpha((int)ch2))
+			|| isalpha((int)ch1) ) {
+		return -1;
 	} else {
-		ret = 1;
+		return 1;
 	}
+}
+
+/**
+ * Compare two parsed versions.
+ * @param a first version
+ * @param b second version
+ * @return the same as alpm_pkg_vercmp() on the unparsed strings
+ */
+int _alpm_evr_cmp(const alpm_evr_t *a, const alpm_evr_t *b)
+{
+	int ret;
 
-cleanup:
-	free(str1);
-	free(str2);
+	ret = rpmvercmp(a->epoch, a->epoch_len, b->epoch, b->epoch_len);
+	if(ret == 0) {
+		ret = rpmvercmp(a->version, a->version_len, b->version, b->version_len);
+		if(ret == 0 && a->release && b->release) {
+			ret = rpmvercmp(a->release, a->release_len, b->release, b->release_len);
+		}
+	}
 	return ret;
 }
 
 int SYMEXPORT alpm_pkg_vercmp(const char *a, const char *b)
 {
-	char *full1, *full2;
-	const char *epoch1, *ver1, *rel1;
-	const char *epoch2, *ver2, *rel2;
-	int ret;
+	alpm_evr_t evr1, evr2;
 
 	/* ensure our strings are not null */
 	if(!a && !b) {
@@ -239,22 +237,8 @@ int SYMEXPORT alpm_pkg_vercmp(const char *a, const char *b)
 	/* Parse both versions into [epoch:]version[-release] triplets. We probably
 	 * don't need epoch and release to support all the same magic, but it is
 	 * easier to just run it all through the same code. */
-	full1 = strdup(a);
-	full2 = strdup(b);
+	_alpm_evr_parse(a, &evr1);
+	_alpm_evr_parse(b, &evr2);
 
-	/* parseEVR modifies passed in version, so have to dupe it first */
-	parseEVR(full1, &epoch1, &ver1, &rel1);
-	parseEVR(full2, &epoch2, &ver2, &rel2);
-
-	ret = rpmvercmp(epoch1, epoch2);
-	if(ret == 0) {
-		ret = rpmvercmp(ver1, ver2);
-		if(ret == 0 && rel1 && rel2) {
-			ret = rpmvercmp(rel1, rel2);
-		}
-	}
-
-	free(full1);
-	free(full2);
-	return ret;
+	return _alpm_evr_cmp(&evr1, &evr2);
 }
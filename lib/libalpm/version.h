@@ -0,0 +1,39 @@
+/*
+ *  version.h
+ *
+ *  Copyright (c) 2024 Pacman Development Team <pacman-dev@lists.archlinux.org>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef ALPM_VERSION_H
+#define ALPM_VERSION_H
+
+#include <stddef.h>
+
+/** A [epoch:]version[-release] string split into its parts. The parts
+ * point into the parsed string and are not NUL terminated. */
+typedef struct _alpm_evr_t {
+	const char *epoch;
+	const char *version;
+	/* NULL if the string has no release */
+	const char *release;
+	size_t epoch_len;
+	size_t version_len;
+	size_t release_len;
+} alpm_evr_t;
+
+void _alpm_evr_parse(const char *evr, alpm_evr_t *parsed);
+int _alpm_evr_cmp(const alpm_evr_t *a, const alpm_evr_t *b);
+
+#endif /* ALPM_VERSION_H */
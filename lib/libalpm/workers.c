@@ -0,0 +1,384 @@
+/*
+ *  workers.c
+ *
+ *  Copyright (c) 2024 Pacman Development Team <pacman-dev@lists.archlinux.org>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* libalpm */
+#include "workers.h"
+#include "alpm_list.h"
+#include "handle.h"
+#include "log.h"
+#include "util.h"
+
+/* Nothing in libalpm is thread safe; a batch run on worker threads must only
+ * touch the item it is given and a private handle obtained from
+ * _alpm_worker_handle_new(). Callbacks of the real handle are only ever
+ * invoked from the calling thread. */
+
+struct _alpm_workqueue_t {
+	pthread_mutex_t lock;
+	/* signalled when an item is queued or the queue is closed */
+	pthread_cond_t queued_cond;
+	/* signalled when an item is processed */
+	pthread_cond_t finished_cond;
+	alpm_worker_fn work;
+	void *ctx;
+	size_t capacity;
+	int closed;
+	/* items not yet picked up by a worker */
+	size_t *queued;
+	size_t queued_head;
+	size_t queued_tail;
+	/* processed items not yet passed to the done callback */
+	size_t *finished;
+	size_t finished_head;
+	size_t finished_tail;
+	pthread_t *tids;
+	unsigned int started;
+};
+
+/* Something a worker held back for the original handle */
+struct worker_log_t {
+	enum {
+		WORKER_LOG,
+		WORKER_LOGACTION,
+		WORKER_EVENT
+	} type;
+	alpm_loglevel_t level;
+	/* caller prefix of a logaction entry */
+	char *prefix;
+	/* log message, or file name of a pacnew/pacsave event */
+	char *message;
+	alpm_event_t event;
+};
+
+static void *worker_main(void *arg)
+{
+	alpm_workqueue_t *queue = arg;
+
+	pthread_mutex_lock(&queue->lock);
+	while(1) {
+		size_t index;
+
+		while(queue->queued_head == queue->queued_tail && !queue->closed) {
+			pthread_cond_wait(&queue->queued_cond, &queue->lock);
+		}
+		if(queue->queued_head == queue->queued_tail) {
+			break;
+		}
+		index = queue->queued[queue->queued_head++];
+		pthread_mutex_unlock(&queue->lock);
+
+		queue->work(queue->ctx, index);
+
+		pthread_mutex_lock(&queue->lock);
+		queue->finished[queue->finished_tail++] = index;
+		pthread_cond_signal(&queue->finished_cond);
+	}
+	pthread_mutex_unlock(&queue->lock);
+	return NULL;
+}
+
+/** Start a number of threads processing items as they are queued.
+ * If no thread can be started the items are processed on the calling thread
+ * once the queue is finished.
+ * @param handle the context handle
+ * @param threads number of threads to start
+ * @param capacity maximum number of items that will be queued
+ * @param work function processing an item, called on a worker thread
+ * @param ctx context passed to the work function and the done callback
+ * @return the queue, or NULL on error
+ */
+alpm_workqueue_t *_alpm_workqueue_new(alpm_handle_t *handle,
+		unsigned int threads, size_t capacity, alpm_worker_fn work, void *ctx)
+{
+	alpm_workqueue_t *queue;
+
+	CALLOC(queue, 1, sizeof(alpm_workqueue_t),
+			RET_ERR(handle, ALPM_ERR_MEMORY, NULL));
+	MALLOC(queue->queued, (capacity + 1) * sizeof(size_t), goto error);
+	MALLOC(queue->finished, (capacity + 1) * sizeof(size_t), goto error);
+	MALLOC(queue->tids, (threads + 1) * sizeof(pthread_t), goto error);
+	queue->work = work;
+	queue->ctx = ctx;
+	queue->capacity = capacity;
+	pthread_mutex_init(&queue->lock, NULL);
+	pthread_cond_init(&queue->queued_cond, NULL);
+	pthread_cond_init(&queue->finished_cond, NULL);
+
+	for(queue->started = 0; queue->started < threads; queue->started++) {
+		if(pthread_create(&queue->tids[queue->started], NULL, worker_main, queue) != 0) {
+			_alpm_log(handle, ALPM_LOG_DEBUG,
+					"could only start %u of %u worker threads\n", queue->started, threads);
+			break;
+		}
+	}
+	return queue;
+
+error:
+	free(queue->queued);
+	free(queue->finished);
+	free(queue);
+	RET_ERR(handle, ALPM_ERR_MEMORY, NULL);
+}
+
+/** Queue an item for processing.
+ * @param queue the work queue
+ * @param index the item to process
+ */
+void _alpm_workqueue_add(alpm_workqueue_t *queue, size_t index)
+{
+	pthread_mutex_lock(&queue->lock);
+	if(queue->queued_tail < queue->capacity) {
+		queue->queued[queue->queued_tail++] = index;
+		pthread_cond_signal(&queue->queued_cond);
+	}
+	pthread_mutex_unlock(&queue->lock);
+}
+
+/** Wait for all queued items to be processed and free the queue.
+ * @param queue the work queue
+ * @param done optional function called on the calling thread once an item
+ * is processed, in order of completion
+ */
+void _alpm_workqueue_finish(alpm_workqueue_t *queue, alpm_worker_done_fn done)
+{
+	size_t i, reported = 0;
+
+	if(queue == NULL) {
+		return;
+	}
+
+	if(queue->started == 0) {
+		for(i = 0; i < queue->queued_tail; i++) {
+			queue->work(queue->ctx, queue->queued[i]);
+			if(done) {
+				done(queue->ctx, queue->queued[i]);
+			}
+		}
+	} else {
+		pthread_mutex_lock(&queue->lock);
+		queue->closed = 1;
+		pthread_cond_broadcast(&queue->queued_cond);
+		while(reported < queue->queued_tail) {
+			while(queue->finished_head == queue->finished_tail) {
+				pthread_cond_wait(&queue->finished_cond, &queue->lock);
+			}
+			i = queue->finished[queue->finished_head++];
+			pthread_mutex_unlock(&queue->lock);
+			if(done) {
+				done(queue->ctx, i);
+			}
+			reported++;
+			pthread_mutex_lock(&queue->lock);
+		}
+		pthread_mutex_unlock(&queue->lock);
+
+		for(i = 0; i < queue->started; i++) {
+			pthread_join(queue->tids[i], NULL);
+		}
+	}
+
+	pthread_cond_destroy(&queue->finished_cond);
+	pthread_cond_destroy(&queue->queued_cond);
+	pthread_mutex_destroy(&queue->lock);
+	free(queue->tids);
+	free(queue->finished);
+	free(queue->queued);
+	free(queue);
+}
+
+/** Process a batch of items on a number of threads.
+ * Falls back to processing the items on the calling thread if there is only
+ * one thread to use or threads can not be created.
+ * @param handle the context handle
+ * @param threads maximum number of threads to use
+ * @param count number of items
+ * @param work function processing an item, called on a worker thread
+ * @param done optional function called on the calling thread once an item
+ * is processed, in order of completion
+ * @param ctx context passed to both functions
+ * @return 0, every item is always processed
+ */
+int _alpm_workers_run(alpm_handle_t *handle, unsigned int threads,
+		size_t count, alpm_worker_fn work, alpm_worker_done_fn done, void *ctx)
+{
+	alpm_workqueue_t *queue = NULL;
+	size_t i;
+
+	if(threads > count) {
+		threads = count;
+	}
+	if(threads > 1) {
+		queue = _alpm_workqueue_new(handle, threads, count, work, ctx);
+	}
+	if(queue) {
+		for(i = 0; i < count; i++) {
+			_alpm_workqueue_add(queue, i);
+		}
+		_alpm_workqueue_finish(queue, done);
+		return 0;
+	}
+
+	for(i = 0; i < count; i++) {
+		work(ctx, i);
+		if(done) {
+			done(ctx, i);
+		}
+	}
+	return 0;
+}
+
+static void worker_log_free(struct worker_log_t *entry)
+{
+	free(entry->prefix);
+	free(entry->message);
+	free(entry);
+}
+
+__attribute__((format(printf, 3, 0)))
+static void worker_cb_log(void *ctx, alpm_loglevel_t level, const char *fmt,
+		va_list args)
+{
+	alpm_handle_t *worker = ctx;
+	struct worker_log_t *entry;
+
+	CALLOC(entry, 1, sizeof(struct worker_log_t), return);
+	entry->type = WORKER_LOG;
+	entry->level = level;
+	if(vasprintf(&entry->message, fmt, args) < 0) {
+		free(entry);
+		return;
+	}
+	worker->worker_log = alpm_list_add(worker->worker_log, entry);
+}
+
+/* Events are passed on as they are, except for the file names of pacnew and
+ * pacsave events which are copied. Any other data an event points to has to
+ * outlive the worker. */
+static void worker_cb_event(void *ctx, alpm_event_t *event)
+{
+	alpm_handle_t *worker = ctx;
+	struct worker_log_t *entry;
+
+	CALLOC(entry, 1, sizeof(struct worker_log_t), return);
+	entry->type = WORKER_EVENT;
+	entry->event = *event;
+	if(event->type == ALPM_EVENT_PACNEW_CREATED) {
+		STRDUP(entry->message, event->pacnew_created.file,
+				free(entry); return);
+	} else if(event->type == ALPM_EVENT_PACSAVE_CREATED) {
+		STRDUP(entry->message, event->pacsave_created.file,
+				free(entry); return);
+	}
+	worker->worker_log = alpm_list_add(worker->worker_log, entry);
+}
+
+/** Hold back an entry for the log file written by a worker.
+ * @param worker the worker copy of a handle
+ * @param prefix caller prefix
+ * @param fmt format string
+ * @param args arguments for the format string
+ * @return 0 on success, -1 on error
+ */
+int _alpm_worker_logaction(alpm_handle_t *worker, const char *prefix,
+		const char *fmt, va_list args)
+{
+	struct worker_log_t *entry;
+
+	CALLOC(entry, 1, sizeof(struct worker_log_t), return -1);
+	entry->type = WORKER_LOGACTION;
+	if(vasprintf(&entry->message, fmt, args) < 0) {
+		free(entry);
+		return -1;
+	}
+	STRDUP(entry->prefix, prefix, worker_log_free(entry); return -1);
+	worker->worker_log = alpm_list_add(worker->worker_log, entry);
+	return 0;
+}
+
+/** Create a private copy of a handle for use on a worker thread.
+ * It shares all options with the original handle but keeps its own error
+ * state. Log messages, log file entries and events are held back until the
+ * copy is freed, progress is left to the caller.
+ * @param handle the context handle
+ * @return the copy, or NULL on error
+ */
+alpm_handle_t *_alpm_worker_handle_new(alpm_handle_t *handle)
+{
+	alpm_handle_t *worker;
+
+	MALLOC(worker, sizeof(alpm_handle_t), return NULL);
+	memcpy(worker, handle, sizeof(alpm_handle_t));
+	worker->pm_errno = ALPM_ERR_OK;
+	worker->worker = 1;
+	worker->worker_log = NULL;
+	worker->progresscb = NULL;
+	if(handle->logcb) {
+		worker->logcb = worker_cb_log;
+		worker->logcb_ctx = worker;
+	}
+	if(handle->eventcb) {
+		worker->eventcb = worker_cb_event;
+		worker->eventcb_ctx = worker;
+	}
+	return worker;
+}
+
+/** Free a worker copy of a handle, passing everything it held back on to
+ * the original handle. Must be called on the thread owning the handle.
+ * @param handle the context handle, or NULL to drop what was held back
+ * @param worker the copy to free
+ */
+void _alpm_worker_handle_free(alpm_handle_t *handle, alpm_handle_t *worker)
+{
+	alpm_list_t *i;
+
+	if(worker == NULL) {
+		return;
+	}
+	for(i = worker->worker_log; i; i = i->next) {
+		struct worker_log_t *entry = i->data;
+		if(handle) {
+			switch(entry->type) {
+				case WORKER_LOG:
+					_alpm_log(handle, entry->level, "%s", entry->message);
+					break;
+				case WORKER_LOGACTION:
+					alpm_logaction(handle, entry->prefix, "%s", entry->message);
+					break;
+				case WORKER_EVENT:
+					if(entry->event.type == ALPM_EVENT_PACNEW_CREATED) {
+						entry->event.pacnew_created.file = entry->message;
+					} else if(entry->event.type == ALPM_EVENT_PACSAVE_CREATED) {
+						entry->event.pacsave_created.file = entry->message;
+					}
+					EVENT(handle, &entry->event);
+					break;
+			}
+		}
+		worker_log_free(entry);
+	}
+	alpm_list_free(worker->worker_log);
+	free(worker);
+}
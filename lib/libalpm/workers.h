@@ -0,0 +1,47 @@
+/*
+ *  workers.h
+ *
+ *  Copyright (c) 2024 Pacman Development Team <pacman-dev@lists.archlinux.org>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef ALPM_WORKERS_H
+#define ALPM_WORKERS_H
+
+#include <stdarg.h>
+#include <stddef.h>
+
+#include "alpm.h"
+
+/** Processes one item of a batch; runs on a worker thread */
+typedef void (*alpm_worker_fn)(void *ctx, size_t index);
+/** Called on the calling thread whenever an item is processed */
+typedef void (*alpm_worker_done_fn)(void *ctx, size_t index);
+
+typedef struct _alpm_workqueue_t alpm_workqueue_t;
+
+alpm_workqueue_t *_alpm_workqueue_new(alpm_handle_t *handle,
+		unsigned int threads, size_t capacity, alpm_worker_fn work, void *ctx);
+void _alpm_workqueue_add(alpm_workqueue_t *queue, size_t index);
+void _alpm_workqueue_finish(alpm_workqueue_t *queue, alpm_worker_done_fn done);
+
+int _alpm_workers_run(alpm_handle_t *handle, unsigned int threads,
+		size_t count, alpm_worker_fn work, alpm_worker_done_fn done, void *ctx);
+
+alpm_handle_t *_alpm_worker_handle_new(alpm_handle_t *handle);
+void _alpm_worker_handle_free(alpm_handle_t *handle, alpm_handle_t *worker);
+int _alpm_worker_logaction(alpm_handle_t *worker, const char *prefix,
+		const char *fmt, va_list args);
+
+#endif /* ALPM_WORKERS_H */
@@ -117,6 +117,8 @@ config_t *config_new(void)
 
 	/* by default use 1 download stream */
 	newconfig->parallel_downloads = 1;
+	newconfig->verify_threads = 1;
+	newconfig->extract_threads = 1;
 	newconfig->colstr.colon   = ":: ";
 	newconfig->colstr.title   = "";
 	newconfig->colstr.repo    = "";
@@ -156,6 +158,7 @@ int config_free(config_t *oldconfig)
 	free(oldconfig->dbpath);
 	free(oldconfig->logfile);
 	free(oldconfig->gpgdir);
+	free(oldconfig->keyring_snapshot);
 	free(oldconfig->sandboxuser);
 	FREELIST(oldconfig->hookdirs);
 	FREELIST(oldconfig->cachedirs);
@@ -537,15 +540,6 @@ static int process_siglevel(alpm_list_t *values, int *storage,
 #undef SLSET
 #undef SLUNSET
 
-	/* ensure we have sig checking ability and are actually turning it on */
-	if(!(alpm_capabilities() & ALPM_CAPABILITY_SIGNATURES) &&
-			level & (ALPM_SIG_PACKAGE | ALPM_SIG_DATABASE)) {
-		pm_printf(ALPM_LOG_ERROR,
-				_("config file %s, line %d: '%s' option invalid, no signature support\n"),
-				file, linenum, "SigLevel");
-		ret = 1;
-	}
-
 	if(!ret) {
 		*storage = level;
 		*storage_mask = mask;
@@ -631,6 +625,8 @@ static int _parse_options(const char *key, char *value,
 			config->disable_dl_timeout = 1;
 		} else if(strcmp(key, "DisableSandbox") == 0) {
 			config->disable_sandbox = 1;
+		} else if(strcmp(key, "PipelineDownloads") == 0) {
+			config->pipeline_downloads = 1;
 		} else {
 			pm_printf(ALPM_LOG_WARNING,
 					_("config file %s, line %d: directive '%s' in section '%s' not recognized.\n"),
@@ -676,6 +672,11 @@ static int _parse_options(const char *key, char *value,
 				config->gpgdir = strdup(value);
 				pm_printf(ALPM_LOG_DEBUG, "config: gpgdir: %s\n", value);
 			}
+		} else if(strcmp(key, "KeyringSnapshot") == 0) {
+			if(!config->keyring_snapshot) {
+				config->keyring_snapshot = strdup(value);
+				pm_printf(ALPM_LOG_DEBUG, "config: keyring_snapshot: %s\n", value);
+			}
 		} else if(strcmp(key, "LogFile") == 0) {
 			if(!config->logfile) {
 				config->logfile = strdup(value);
@@ -762,6 +763,60 @@ static int _parse_options(const char *key, char *value,
 			}
 
 			config->parallel_downloads = number;
+		} else if(strcmp(key, "VerifyThreads") == 0) {
+			long number;
+			int err;
+
+			err = parse_number(value, &number);
+			if(err) {
+				pm_printf(ALPM_LOG_ERROR,
+						_("config file %s, line %d: invalid value for '%s' : '%s'\n"),
+						file, linenum, "VerifyThreads", value);
+				return 1;
+			}
+
+			if(number < 1) {
+				pm_printf(ALPM_LOG_ERROR,
+						_("config file %s, line %d: value for '%s' has to be positive : '%s'\n"),
+						file, linenum, "VerifyThreads", value);
+				return 1;
+			}
+
+			if(number > INT_MAX) {
+				pm_printf(ALPM_LOG_ERROR,
+						_("config file %s, line %d: value for '%s' is too large : '%s'\n"),
+						file, linenum, "VerifyThreads", value);
+				return 1;
+			}
+
+			config->verify_threads = number;
+		} else if(strcmp(key, "ExtractThreads") == 0) {
+			long number;
+			int err;
+
+			err = parse_number(value, &number);
+			if(err) {
+				pm_printf(ALPM_LOG_ERROR,
+						_("config file %s, line %d: invalid value for '%s' : '%s'\n"),
+						file, linenum, "ExtractThreads", value);
+				return 1;
+			}
+
+			if(number < 1) {
+				pm_printf(ALPM_LOG_ERROR,
+						_("config file %s, line %d: value for '%s' has to be positive : '%s'\n"),
+						file, linenum, "ExtractThreads", value);
+				return 1;
+			}
+
+			if(number > INT_MAX) {
+				pm_printf(ALPM_LOG_ERROR,
+						_("config file %s, line %d: value for '%s' is too large : '%s'\n"),
+						file, linenum, "ExtractThreads", value);
+				return 1;
+			}
+
+			config->extract_threads = number;
 		} else {
 			pm_printf(ALPM_LOG_WARNING,
 					_("config file %s, line %d: directive '%s' in section '%s' not recognized.\n"),
@@ -880,6 +935,7 @@ static int setup_libalpm(void)
 	config->handle = handle;
 
 	alpm_option_set_logcb(handle, cb_log, NULL);
+	alpm_option_set_logmask(handle, config->logmask);
 	alpm_option_set_dlcb(handle, cb_download, NULL);
 	alpm_option_set_eventcb(handle, cb_event, NULL);
 	alpm_option_set_questioncb(handle, cb_question, NULL);
@@ -905,6 +961,15 @@ static int setup_libalpm(void)
 		return ret;
 	}
 
+	if(config->keyring_snapshot) {
+		ret = alpm_option_set_keyring_snapshot(handle, config->keyring_snapshot);
+		if(ret != 0) {
+			pm_printf(ALPM_LOG_ERROR, _("problem setting keyring snapshot '%s' (%s)\n"),
+					config->keyring_snapshot, alpm_strerror(alpm_errno(handle)));
+			return ret;
+		}
+	}
+
 	/* Set user hook directory. This is not relative to rootdir, even if
 	 * rootdir is defined. Reasoning: hookdir contains configuration data. */
 	/* add hook directories 1-by-1 to avoid overwriting the system directory */
@@ -940,6 +1005,7 @@ static int setup_libalpm(void)
 	alpm_option_set_usesyslog(handle, config->usesyslog);
 	alpm_option_set_sandboxuser(handle, config->sandboxuser);
 	alpm_option_set_disable_sandbox(handle, config->disable_sandbox);
+	alpm_option_set_pipeline_downloads(handle, config->pipeline_downloads);
 
 	alpm_option_set_ignorepkgs(handle, config->ignorepkg);
 	alpm_option_set_ignoregroups(handle, config->ignoregrp);
@@ -948,6 +1014,8 @@ static int setup_libalpm(void)
 
 	alpm_option_set_disable_dl_timeout(handle, config->disable_dl_timeout);
 	alpm_option_set_parallel_downloads(handle, config->parallel_downloads);
+	alpm_option_set_verify_threads(handle, config->verify_threads);
+	alpm_option_set_extract_threads(handle, config->extract_threads);
 
 	for(i = config->assumeinstalled; i; i = i->next) {
 		char *entry = i->data;
@@ -1289,6 +1357,7 @@ static int prepend_sysroot(config_t *c)
 	SETSYSROOT(c->dbpath);
 	SETSYSROOT(c->logfile);
 	SETSYSROOT(c->gpgdir);
+	SETSYSROOT(c->keyring_snapshot);
 	for(i = c->cachedirs; i; i = i->next) {
 		SETSYSROOT(i->data);
 	}
@@ -1382,6 +1451,22 @@ int setdefaults(config_t *c)
 		}
 	}
 
+	/* ensure we have sig checking ability if it is being turned on; this
+	 * waits until here as a KeyringSnapshot may follow the SigLevel options */
+	if(!(alpm_capabilities() & ALPM_CAPABILITY_SIGNATURES) && !c->keyring_snapshot) {
+		int level = c->siglevel | c->localfilesiglevel | c->remotefilesiglevel;
+		for(i = c->repos; i; i = i->next) {
+			config_repo_t *r = i->data;
+			level |= r->siglevel;
+		}
+		if(level & (ALPM_SIG_PACKAGE | ALPM_SIG_DATABASE)) {
+			pm_printf(ALPM_LOG_ERROR,
+					_("config file %s: '%s' option invalid, no signature support\n"),
+					c->configfile, "SigLevel");
+			return 1;
+		}
+	}
+
 #undef SETDEFAULT
 
 	prepend_sysroot(c);
@@ -59,6 +59,7 @@ typedef struct __config_t {
 	unsigned short color;
 	unsigned short disable_dl_timeout;
 	unsigned short disable_sandbox;
+	unsigned short pipeline_downloads;
 	char *print_format;
 	/* unfortunately, we have to keep track of paths both here and in the library
 	 * because they can come from both the command line or config file, and we
@@ -68,6 +69,7 @@ typedef struct __config_t {
 	char *dbpath;
 	char *logfile;
 	char *gpgdir;
+	char *keyring_snapshot;
 	char *sysroot;
 	char *sandboxuser;
 	alpm_list_t *hookdirs;
@@ -118,6 +120,10 @@ typedef struct __config_t {
 	unsigned short verbosepkglists;
 	/* number of parallel download streams */
 	unsigned int parallel_downloads;
+	/* number of package verification threads */
+	unsigned int verify_threads;
+	/* number of package extraction threads */
+	unsigned int extract_threads;
 	/* select -Sc behavior */
 	unsigned short cleanmethod;
 	alpm_list_t *holdpkg;
@@ -97,11 +97,9 @@ static void print_match(alpm_list_t *match, alpm_db_t *repo, alpm_pkg_t *pkg, in
 struct filetarget {
 	char *targ;
 	int exact_file;
-	regex_t reg;
 };
 
 static void filetarget_free(struct filetarget *ftarg) {
-	regfree(&ftarg->reg);
 	/* do not free ftarg->targ as it is owned by the caller of files_search */
 	free(ftarg);
 }
@@ -123,6 +121,8 @@ static int files_search(alpm_list_t *syncs, alpm_list_t *targets, int regex) {
 			}
 		}
 
+		/* check all expressions before searching, the databases compile
+		 * them again */
 		if(regex) {
 			if(regcomp(&reg, targ, REG_EXTENDED | REG_NOSUB | REG_ICASE | REG_NEWLINE) != 0) {
 				pm_printf(ALPM_LOG_ERROR,
@@ -130,12 +130,12 @@ static int files_search(alpm_list_t *syncs, alpm_list_t *targets, int regex) {
 				ret = 1;
 				continue;
 			}
+			regfree(&reg);
 		}
 
 		struct filetarget *ftarg = malloc(sizeof(struct filetarget));
 		ftarg->targ = targ;
 		ftarg->exact_file = exact_file;
-		ftarg->reg = reg;
 
 		filetargs = alpm_list_add(filetargs, ftarg);
 	}
@@ -146,60 +146,43 @@ static int files_search(alpm_list_t *syncs, alpm_list_t *targets, int regex) {
 
 	for(t = filetargs; t; t = alpm_list_next(t)) {
 		struct filetarget *ftarg = t->data;
-		char *targ = ftarg->targ;
-		regex_t *reg = &ftarg->reg;
 		int exact_file = ftarg->exact_file;
+		int flags = 0;
 		alpm_list_t *s;
 		int found = 0;
 
+		if(exact_file) {
+			flags |= ALPM_FILESEARCH_PATH;
+		}
+		if(regex) {
+			flags |= ALPM_FILESEARCH_REGEX;
+		}
+
 		for(s = syncs; s; s = alpm_list_next(s)) {
-			alpm_list_t *p;
 			alpm_db_t *repo = s->data;
-			alpm_list_t *packages = alpm_db_get_pkgcache(repo);
-			int m;
-
-			for(p = packages; p; p = alpm_list_next(p)) {
-				alpm_pkg_t *pkg = p->data;
-				alpm_filelist_t *files = alpm_pkg_get_files(pkg);
-				alpm_list_t *match = NULL;
-
-				if(exact_file) {
-					if (regex) {
-						for(size_t f = 0; f < files->count; f++) {
-							char *c = files->files[f].name;
-							if(regexec(reg, c, 0, 0, 0) == 0) {
-								match = alpm_list_add(match, files->files[f].name);
-								found = 1;
-							}
-						}
-					} else {
-						if(alpm_filelist_contains(files, targ)) {
-							match = alpm_list_add(match, targ);
-							found = 1;
-						}
-					}
-				} else {
-					for(size_t f = 0; f < files->count; f++) {
-						char *c = strrchr(files->files[f].name, '/');
-						if(c && *(c + 1)) {
-							if(regex) {
-								m = regexec(reg, (c + 1), 0, 0, 0);
-							} else {
-								m = strcmp(c + 1, targ);
-							}
-							if(m == 0) {
-								match = alpm_list_add(match, files->files[f].name);
-								found = 1;
-							}
-						}
-					}
-				}
+			alpm_list_t *matches = NULL, *m, *match = NULL;
+
+			if(alpm_db_find_files(repo, ftarg->targ, flags, &matches) != 0) {
+				pm_printf(ALPM_LOG_ERROR, _("failed to search database '%s' (%s)\n"),
+						alpm_db_get_name(repo), alpm_strerror(alpm_errno(config->handle)));
+				ret = 1;
+				continue;
+			}
+
+			/* matches are grouped by package */
+			for(m = matches; m; m = alpm_list_next(m)) {
+				alpm_fileowner_t *file = m->data;
+				alpm_fileowner_t *next = m->next ? m->next->data : NULL;
 
-				if(match != NULL) {
-					print_match(match, repo, pkg, exact_file);
+				match = alpm_list_add(match, (char *)file->path);
+				if(next == NULL || next->pkg != file->pkg) {
+					print_match(match, repo, file->pkg, exact_file);
 					alpm_list_free(match);
+					match = NULL;
 				}
+				found = 1;
 			}
+			FREELIST(matches);
 		}
 
 		if(!found) {
@@ -261,6 +261,7 @@ static void dump_config(void)
 	show_list_str("CacheDir", config->cachedirs);
 	show_list_str("HookDir", config->hookdirs);
 	show_str("GPGDir", config->gpgdir);
+	show_str("KeyringSnapshot", config->keyring_snapshot);
 	show_str("LogFile", config->logfile);
 	show_str("DownloadUser", config->sandboxuser);
 
@@ -281,8 +282,11 @@ static void dump_config(void)
 	show_bool("ILoveCandy", config->chomp);
 	show_bool("NoProgressBar", config->noprogressbar);
 	show_bool("DisableSandbox", config->disable_sandbox);
+	show_bool("PipelineDownloads", config->pipeline_downloads);
 
 	show_int("ParallelDownloads", config->parallel_downloads);
+	show_int("VerifyThreads", config->verify_threads);
+	show_int("ExtractThreads", config->extract_threads);
 
 	show_cleanmethod("CleanMethod", config->cleanmethod);
 
@@ -362,6 +366,8 @@ static int list_directives(void)
 			show_list_str("HookDir", config->hookdirs);
 		} else if(strcasecmp(i->data, "GPGDir") == 0) {
 			show_str("GPGDir", config->gpgdir);
+		} else if(strcasecmp(i->data, "KeyringSnapshot") == 0) {
+			show_str("KeyringSnapshot", config->keyring_snapshot);
 		} else if(strcasecmp(i->data, "LogFile") == 0) {
 			show_str("LogFile", config->logfile);
 		} else if(strcasecmp(i->data, "DownloadUser") == 0) {
@@ -400,9 +406,15 @@ static int list_directives(void)
 			show_bool("NoProgressBar", config->noprogressbar);
 		} else if(strcasecmp(i->data, "DisableSandbox") == 0) {
 			show_bool("DisableSandbox", config->disable_sandbox);
+		} else if(strcasecmp(i->data, "PipelineDownloads") == 0) {
+			show_bool("PipelineDownloads", config->pipeline_downloads);
 
 		} else if(strcasecmp(i->data, "ParallelDownloads") == 0) {
 			show_int("ParallelDownloads", config->parallel_downloads);
+		} else if(strcasecmp(i->data, "VerifyThreads") == 0) {
+			show_int("VerifyThreads", config->verify_threads);
+		} else if(strcasecmp(i->data, "ExtractThreads") == 0) {
+			show_int("ExtractThreads", config->extract_threads);
 
 		} else if(strcasecmp(i->data, "CleanMethod") == 0) {
 			show_cleanmethod("CleanMethod", config->cleanmethod);
@@ -1243,6 +1243,7 @@ int main(int argc, char *argv[])
 		config->flags |= ALPM_TRANS_FLAG_NOLOCK;
 		/* Display only errors */
 		config->logmask &= ~ALPM_LOG_WARNING;
+		alpm_option_set_logmask(config->handle, config->logmask);
 	}
 
 	if(config->verbose > 0) {
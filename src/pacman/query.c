@@ -142,7 +142,6 @@ static int query_fileowner(alpm_list_t *targets)
 	size_t rootlen = strlen(root);
 	alpm_list_t *t;
 	alpm_db_t *db_local;
-	alpm_list_t *packages;
 
 	/* This code is here for safety only */
 	if(targets == NULL) {
@@ -151,13 +150,12 @@ static int query_fileowner(alpm_list_t *targets)
 	}
 
 	db_local = alpm_get_localdb(config->handle);
-	packages = alpm_db_get_pkgcache(db_local);
 
 	for(t = targets; t; t = alpm_list_next(t)) {
 		char *filename = NULL;
 		char rpath[PATH_MAX], *rel_path;
 		struct stat buf;
-		alpm_list_t *i;
+		alpm_list_t *owners, *i;
 		size_t len;
 		unsigned int found = 0;
 		int is_dir = 0, is_missing = 0;
@@ -209,12 +207,12 @@ static int query_fileowner(alpm_list_t *targets)
 			strcat(rpath + rlen, "/");
 		}
 
-		for(i = packages; i && (!found || is_dir); i = alpm_list_next(i)) {
-			if(alpm_filelist_contains(alpm_pkg_get_files(i->data), rel_path)) {
-				print_query_fileowner(rpath, i->data);
-				found = 1;
-			}
+		owners = alpm_db_find_file_owners(db_local, rel_path);
+		for(i = owners; i && (!found || is_dir); i = alpm_list_next(i)) {
+			print_query_fileowner(rpath, i->data);
+			found = 1;
 		}
+		alpm_list_free(owners);
 		if(!found) {
 			pm_printf(ALPM_LOG_ERROR, _("No package owns %s\n"), filename);
 		}
@@ -258,9 +256,17 @@ static unsigned short pkg_get_locality(alpm_pkg_t *pkg)
 	return PKG_LOCALITY_FOREIGN;
 }
 
-static int is_unrequired(alpm_pkg_t *pkg, unsigned short level)
+static int is_unrequired(alpm_pkg_t *pkg, const alpm_pkg_revdeps_t *revdeps,
+		unsigned short level)
 {
-	alpm_list_t *requiredby = alpm_pkg_compute_requiredby(pkg);
+	alpm_list_t *requiredby;
+
+	if(revdeps) {
+		return revdeps->requiredby == NULL
+			&& (level != 1 || revdeps->optionalfor == NULL);
+	}
+
+	requiredby = alpm_pkg_compute_requiredby(pkg);
 	if(requiredby == NULL) {
 		if(level == 1) {
 			requiredby = alpm_pkg_compute_optionalfor(pkg);
@@ -273,7 +279,8 @@ static int is_unrequired(alpm_pkg_t *pkg, unsigned short level)
 	return 0;
 }
 
-static int filter(alpm_pkg_t *pkg)
+/* revdeps are the reverse dependencies of pkg if already computed, or NULL */
+static int filter(alpm_pkg_t *pkg, const alpm_pkg_revdeps_t *revdeps)
 {
 	/* check if this package was explicitly installed */
 	if(config->op_q_explicit &&
@@ -290,7 +297,8 @@ static int filter(alpm_pkg_t *pkg)
 		return 0;
 	}
 	/* check if this pkg is unrequired */
-	if(config->op_q_unrequired && !is_unrequired(pkg, config->op_q_unrequired)) {
+	if(config->op_q_unrequired
+			&& !is_unrequired(pkg, revdeps, config->op_q_unrequired)) {
 		return 0;
 	}
 	/* check if this pkg is outdated */
@@ -363,7 +371,7 @@ static int query_group(alpm_list_t *targets)
 
 			for(p = grp->packages; p; p = alpm_list_next(p)) {
 				alpm_pkg_t *pkg = p->data;
-				if(!filter(pkg)) {
+				if(!filter(pkg, NULL)) {
 					continue;
 				}
 				printf("%s %s\n", grp->name, alpm_pkg_get_name(pkg));
@@ -377,7 +385,7 @@ static int query_group(alpm_list_t *targets)
 			if(grp) {
 				const alpm_list_t *p;
 				for(p = grp->packages; p; p = alpm_list_next(p)) {
-					if(!filter(p->data)) {
+					if(!filter(p->data, NULL)) {
 						continue;
 					}
 					if(!config->quiet) {
@@ -400,7 +408,7 @@ int pacman_query(alpm_list_t *targets)
 {
 	int ret = 0;
 	int match = 0;
-	alpm_list_t *i;
+	alpm_list_t *i, *j, *revdeps = NULL;
 	alpm_pkg_t *pkg = NULL;
 	alpm_db_t *db_local;
 
@@ -435,9 +443,19 @@ int pacman_query(alpm_list_t *targets)
 			return 1;
 		}
 
-		for(i = alpm_db_get_pkgcache(db_local); i; i = alpm_list_next(i)) {
+		/* look up the dependents of all packages at once */
+		if(config->op_q_unrequired
+				&& alpm_db_compute_revdeps(db_local, &revdeps) != 0) {
+			pm_printf(ALPM_LOG_ERROR, _("could not compute reverse dependencies (%s)\n"),
+					alpm_strerror(alpm_errno(config->handle)));
+			return 1;
+		}
+
+		/* revdeps are in package cache order */
+		for(i = alpm_db_get_pkgcache(db_local), j = revdeps; i;
+				i = alpm_list_next(i), j = alpm_list_next(j)) {
 			pkg = i->data;
-			if(filter(pkg)) {
+			if(filter(pkg, j ? j->data : NULL)) {
 				int value = display(pkg);
 				if(value != 0) {
 					ret = 1;
@@ -448,6 +466,8 @@ int pacman_query(alpm_list_t *targets)
 		if(!match) {
 			ret = 1;
 		}
+		alpm_list_free_inner(revdeps, (alpm_list_fn_free)alpm_pkg_revdeps_free);
+		alpm_list_free(revdeps);
 		return ret;
 	}
 
@@ -499,7 +519,7 @@ int pacman_query(alpm_list_t *targets)
 			continue;
 		}
 
-		if(filter(pkg)) {
+		if(filter(pkg, NULL)) {
 			int value = display(pkg);
 			if(value != 0) {
 				ret = 1;
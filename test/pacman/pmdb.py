@@ -145,6 +145,8 @@ def db_read(self, name):
                     raise
             elif line == "%MD5SUM%":
                 pkg.md5sum = fd.readline().strip("\n")
+            elif line == "%SHA256SUM%":
+                pkg.sha256sum = fd.readline().strip("\n")
             elif line == "%PGPSIG%":
                 pkg.pgpsig = fd.readline().strip("\n")
             elif line == "%REPLACES%":
@@ -214,6 +216,7 @@ def db_write(self, pkg):
             make_section(data, "CSIZE", pkg.csize)
             make_section(data, "ISIZE", pkg.isize)
             make_section(data, "MD5SUM", pkg.md5sum)
+            make_section(data, "SHA256SUM", pkg.sha256sum)
             make_section(data, "PGPSIG", pkg.pgpsig)
 
         entry["desc"] = "\n".join(data)
@@ -44,6 +44,7 @@ def __init__(self, name, version = "1.0-1"):
         self.isize = 0
         self.reason = 0
         self.md5sum = ""      # sync only
+        self.sha256sum = ""   # sync only
         self.pgpsig = ""      # sync only
         self.replaces = []
         self.depends = []
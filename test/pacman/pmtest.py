@@ -85,6 +85,36 @@ def addrule(self, rulename):
         rule = pmrule.pmrule(rulename)
         self.rules.append(rule)
 
+    def add_setup(self, step):
+        """Add a step run before the tested command: either pacman arguments,
+        whose output is discarded, or a function called with the test."""
+        self.setup.append(step)
+
+    def add_signed_fixture(self, sig, tamper=False):
+        """Install the package from tests/signing with -U, verified against
+        the keyring snapshot there and the detached signature sig. With
+        tamper, the package contents are changed after it was signed."""
+        fixtures = os.path.join(os.path.dirname(os.path.abspath(self.name)),
+                "signing")
+        pkgfile = "pkg1-1.0-1-any.pkg.tar"
+
+        self.option["KeyringSnapshot"] = [os.path.join(fixtures, "keyring.gpg")]
+        self.option["LocalFileSigLevel"] = ["Required"]
+
+        def copy_package(test):
+            path = os.path.join(test.root, util.TMPDIR, pkgfile)
+            shutil.copy(os.path.join(fixtures, pkgfile), path)
+            shutil.copy(os.path.join(fixtures, sig), path + ".sig")
+            if tamper:
+                with open(path, "rb") as f:
+                    data = f.read()
+                # same length, so only the signature can tell
+                with open(path, "wb") as f:
+                    f.write(data.replace(b"signed contents", b"signed Contents"))
+
+        self.add_setup(copy_package)
+        self.args = "-U %s" % pkgfile
+
     def load(self):
         # Reset test parameters
         self.result = {
@@ -92,6 +122,8 @@ def load(self):
             "fail": 0
         }
         self.args = ""
+        self.setup = []
+        self.setup_errors = []
         self.retcode = 0
         self.db = {
             "local": pmdb.pmdb("local", self.root)
@@ -284,6 +316,20 @@ def run(self, pacman):
             cmd.append("--confirm")
         if pacman["debug"]:
             cmd.append("--debug=%s" % pacman["debug"])
+
+        for step in self.setup:
+            if callable(step):
+                step(self)
+                continue
+            vprint("\tsetup: pacman %s" % step)
+            retcode = subprocess.call(cmd + shlex.split(step),
+                    stdout=subprocess.DEVNULL, stderr=subprocess.DEVNULL,
+                    cwd=os.path.join(self.root, util.TMPDIR), env={'LC_ALL': 'C'})
+            if retcode != 0:
+                error = "setup 'pacman %s' returned %d" % (step, retcode)
+                tap.diag("\tERROR: %s" % error)
+                self.setup_errors.append(error)
+
         cmd.extend(shlex.split(self.args))
 
         if not (pacman["gdb"] or pacman["nolog"]):
@@ -318,7 +364,10 @@ def run(self, pacman):
             tap.diag("\tERROR: pacman dumped a core file")
 
     def check(self):
-        tap.plan(len(self.rules))
+        tap.plan(len(self.setup_errors) + len(self.rules))
+        for error in self.setup_errors:
+            self.result["fail"] += 1
+            tap.ok(False, error)
         for i in self.rules:
             success = i.check(self)
             if success == 1:
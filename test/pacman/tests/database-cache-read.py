@@ -0,0 +1,34 @@
+self.description = "Packages read from the binary database cache match the database"
+self.require_capability("curl")
+
+p1 = pmpkg('pkg1', '1:2.0.1-3')
+p1.desc = "first package"
+p1.depends = ["pkg2>=1.0", "virtual=2.0"]
+p1.optdepends = ["pkg3: extra support"]
+p1.conflicts = ["oldpkg<1.0"]
+p1.groups = ["grp"]
+self.addpkg2db('sync', p1)
+
+p2 = pmpkg('pkg2', '1.0.r12.gabcdef-1')
+p2.provides = ["virtual=2.0"]
+p2.replaces = ["oldpkg"]
+self.addpkg2db('sync', p2)
+
+# writes the cache, which the tested command then reads from
+self.add_setup("-Syy")
+
+self.args = "--debug -Si pkg1 pkg2"
+
+# rules cannot contain "=", hence the \x3d escapes
+
+self.addrule("PACMAN_RETCODE=0")
+self.addrule("PACMAN_OUTPUT=using database cache .*/sync.db.cache")
+self.addrule("PACMAN_OUTPUT=^Version +: 1:2.0.1-3$")
+self.addrule("PACMAN_OUTPUT=^Description +: first package$")
+self.addrule("PACMAN_OUTPUT=^Groups +: grp$")
+self.addrule("PACMAN_OUTPUT=^Depends On +: pkg2>\\x3d1.0  virtual\\x3d2.0$")
+self.addrule("PACMAN_OUTPUT=^Optional Deps +: pkg3: extra support$")
+self.addrule("PACMAN_OUTPUT=^Conflicts With +: oldpkg<1.0$")
+self.addrule("PACMAN_OUTPUT=^Version +: 1.0.r12.gabcdef-1$")
+self.addrule("PACMAN_OUTPUT=^Provides +: virtual\\x3d2.0$")
+self.addrule("PACMAN_OUTPUT=^Replaces +: oldpkg$")
@@ -0,0 +1,21 @@
+self.description = "Ignore the binary database cache of a replaced database"
+self.require_capability("curl")
+
+p1 = pmpkg('pkg1', '1.0-1')
+p1.desc = "first package"
+self.addpkg2db('sync', p1)
+
+def replace_db(test):
+    p1.version = "1.1-1"
+    p1.desc = "first package, updated"
+    test.db["sync"].generate()
+
+self.add_setup("-Syy")
+self.add_setup(replace_db)
+
+self.args = "--debug -Si pkg1"
+
+self.addrule("PACMAN_RETCODE=0")
+self.addrule("PACMAN_OUTPUT=ignoring outdated database cache .*/sync.db.cache")
+self.addrule("PACMAN_OUTPUT=^Version +: 1.1-1$")
+self.addrule("PACMAN_OUTPUT=^Description +: first package, updated$")
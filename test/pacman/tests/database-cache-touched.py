@@ -0,0 +1,23 @@
+self.description = "Use the binary database cache of a database whose attributes changed"
+self.require_capability("curl")
+
+import os
+
+p1 = pmpkg('pkg1', '1.0-1')
+p1.desc = "first package"
+self.addpkg2db('sync', p1)
+
+def touch_db(test):
+    path = os.path.join(test.dbdir(), "sync", "sync.db")
+    st = os.stat(path)
+    os.utime(path, (st.st_atime + 10, st.st_mtime + 10))
+
+self.add_setup("-Syy")
+self.add_setup(touch_db)
+
+self.args = "--debug -Si pkg1"
+
+self.addrule("PACMAN_RETCODE=0")
+self.addrule("PACMAN_OUTPUT=sync.db changed on disk, comparing contents")
+self.addrule("PACMAN_OUTPUT=using database cache .*/sync.db.cache")
+self.addrule("PACMAN_OUTPUT=^Description +: first package$")
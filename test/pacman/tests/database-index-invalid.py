@@ -0,0 +1,13 @@
+self.description = "Ignore an invalid local database index"
+
+lp = pmpkg("pkg1")
+lp.desc = "package one"
+lp.files = ["bin/pkg1"]
+self.addpkg2db("local", lp)
+
+self.filesystem = ["var/lib/pacman/local.cache"]
+
+self.args = "-Qi pkg1"
+
+self.addrule("PACMAN_RETCODE=0")
+self.addrule("PACMAN_OUTPUT=package one")
@@ -0,0 +1,25 @@
+self.description = "Ignore the local database index after an entry was removed"
+
+import os
+import shutil
+
+lp1 = pmpkg("pkg1")
+lp1.files = ["bin/pkg1"]
+self.addpkg2db("local", lp1)
+
+sp = pmpkg("pkg2")
+sp.files = ["bin/pkg2"]
+self.addpkg2db("sync", sp)
+
+def remove_entry(test):
+    shutil.rmtree(os.path.join(test.dbdir(), "local", lp1.fullname()))
+
+# writes the index, then the entry is removed behind its back
+self.add_setup("-S pkg2")
+self.add_setup(remove_entry)
+
+self.args = "-Q pkg1"
+
+self.addrule("PACMAN_RETCODE=1")
+self.addrule("FILE_EXIST=var/lib/pacman/local.cache")
+self.addrule("PACMAN_OUTPUT=package 'pkg1' was not found")
@@ -0,0 +1,19 @@
+self.description = "Write the local database index after a transaction"
+
+lp1 = pmpkg("pkg1")
+lp1.files = ["bin/pkg1"]
+self.addpkg2db("local", lp1)
+
+lp2 = pmpkg("pkg2")
+lp2.files = ["bin/pkg2"]
+self.addpkg2db("local", lp2)
+
+sp = pmpkg("pkg2", "2.0-1")
+sp.files = ["bin/pkg2", "bin/pkg2-new"]
+self.addpkg2db("sync", sp)
+
+self.args = "-S pkg2"
+
+self.addrule("PACMAN_RETCODE=0")
+self.addrule("PKG_VERSION=pkg2|2.0-1")
+self.addrule("FILE_EXIST=var/lib/pacman/local.cache")
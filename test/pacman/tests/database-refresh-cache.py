@@ -0,0 +1,17 @@
+self.description = "refreshing databases writes the binary database cache"
+self.require_capability("curl")
+
+p1 = pmpkg('pkg1', '1.0-1')
+p1.desc = "first package"
+p1.depends = ["pkg2>=1.0"]
+p1.groups = ["grp"]
+self.addpkg2db('sync', p1)
+
+p2 = pmpkg('pkg2', '1.0-1')
+p2.provides = ["virtual=2.0"]
+self.addpkg2db('sync', p2)
+
+self.args = '-Syy'
+
+self.addrule("PACMAN_RETCODE=0")
+self.addrule("FILE_EXIST=var/lib/pacman/sync/sync.db.cache")
@@ -0,0 +1,19 @@
+self.description = "File/dir conflict between targets with a path sorting in between"
+
+p1 = pmpkg("pkg1")
+p1.files = ["a-b",
+            "a/",
+            "a/file"]
+self.addpkg(p1)
+
+p2 = pmpkg("pkg2")
+p2.files = ["a"]
+self.addpkg(p2)
+
+self.args = "-U %s" % " ".join([p.filename() for p in (p1, p2)])
+
+self.addrule("PACMAN_RETCODE=1")
+self.addrule("!PKG_EXIST=pkg1")
+self.addrule("!PKG_EXIST=pkg2")
+self.addrule("!FILE_EXIST=a-b")
+self.addrule("!FILE_EXIST=a/file")
@@ -0,0 +1,40 @@
+self.description = "PostTransaction hook installed by the transaction"
+
+self.add_hook("existing",
+        """
+        [Trigger]
+        Type = Package
+        Operation = Install
+        Target = foo
+
+        [Action]
+        Description = existing hook
+        When = PreTransaction
+        Exec = bin/true
+        """);
+
+# the shebang add_script() prepends is read as a comment
+self.add_script("new-hook",
+        """
+        [Trigger]
+        Type = Path
+        Operation = Install
+        Target = bin/foo
+
+        [Action]
+        Description = hook installed by foo
+        When = PostTransaction
+        Exec = bin/true
+        """);
+
+sp = pmpkg("foo")
+sp.files = ["bin/foo",
+            "etc/pacman.d/hooks/new.hook -> ../../../bin/new-hook"]
+self.addpkg2db("sync", sp)
+
+self.args = "-S foo"
+
+self.addrule("PACMAN_RETCODE=0")
+self.addrule("PKG_EXIST=foo")
+self.addrule("PACMAN_OUTPUT=existing hook")
+self.addrule("PACMAN_OUTPUT=hook installed by foo")
@@ -0,0 +1,22 @@
+self.description = "Upgrade a package with literal and glob NoUpgrade patterns"
+
+lp = pmpkg("foobar")
+lp.files = ["foo/bar", "foo/baz", "foo/qux"]
+self.addpkg2db("local", lp)
+
+p = pmpkg("foobar", "1.0-2")
+p.files = ["foo/bar", "foo/baz", "foo/qux"]
+self.addpkg(p)
+
+# the last matching pattern wins, whether it is a glob or not
+self.option["NoUpgrade"] = ["!foo/bar", "foo/*", "!foo/baz"]
+
+self.args = "-U %s" % p.filename()
+
+self.addrule("PKG_VERSION=foobar|1.0-2")
+self.addrule("!FILE_MODIFIED=foo/bar")
+self.addrule("FILE_PACNEW=foo/bar")
+self.addrule("FILE_MODIFIED=foo/baz")
+self.addrule("!FILE_PACNEW=foo/baz")
+self.addrule("!FILE_MODIFIED=foo/qux")
+self.addrule("FILE_PACNEW=foo/qux")
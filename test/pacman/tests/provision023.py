@@ -0,0 +1,20 @@
+self.description = "provision>=2.0 dependency satisfied by a later provision"
+
+p = pmpkg("pkg1", "1.0-1")
+p.depends = ["provision>=2.0"]
+self.addpkg2db("sync", p)
+
+p2 = pmpkg("pkg2", "1.0-1")
+p2.provides = ["provision=1.0"]
+self.addpkg2db("sync", p2)
+
+p3 = pmpkg("pkg3", "1.0-1")
+p3.provides = ["provision=1.0", "provision=2.0"]
+self.addpkg2db("sync", p3)
+
+self.args = "-S %s" % p.name
+
+self.addrule("PACMAN_RETCODE=0")
+self.addrule("PKG_EXIST=pkg1")
+self.addrule("!PKG_EXIST=pkg2")
+self.addrule("PKG_EXIST=pkg3")
@@ -0,0 +1,33 @@
+self.description = "List packages not required by any other package"
+
+lp1 = pmpkg("pkg1")
+lp1.depends = ["libfoo"]
+self.addpkg2db("local", lp1)
+
+lp2 = pmpkg("pkg2")
+lp2.provides = ["libfoo=1.0"]
+self.addpkg2db("local", lp2)
+
+lp3 = pmpkg("pkg3")
+lp3.optdepends = ["pkg4: extras"]
+self.addpkg2db("local", lp3)
+
+lp4 = pmpkg("pkg4")
+self.addpkg2db("local", lp4)
+
+lp5 = pmpkg("pkg5")
+lp5.depends = ["pkg6>=2.0"]
+self.addpkg2db("local", lp5)
+
+lp6 = pmpkg("pkg6", "1.0-1")
+self.addpkg2db("local", lp6)
+
+self.args = "-Qqt"
+
+self.addrule("PACMAN_RETCODE=0")
+self.addrule("PACMAN_OUTPUT=^pkg1$")
+self.addrule("!PACMAN_OUTPUT=^pkg2$")
+self.addrule("PACMAN_OUTPUT=^pkg3$")
+self.addrule("!PACMAN_OUTPUT=^pkg4$")
+self.addrule("PACMAN_OUTPUT=^pkg5$")
+self.addrule("PACMAN_OUTPUT=^pkg6$")
@@ -0,0 +1,19 @@
+self.description = "Query ownership of a directory shared by several packages"
+
+lp1 = pmpkg("pkg1")
+lp1.files = ["usr/share/shared/",
+             "usr/share/shared/one"]
+self.addpkg2db("local", lp1)
+
+lp2 = pmpkg("pkg2")
+lp2.files = ["usr/share/shared/",
+             "usr/share/shared/two"]
+self.addpkg2db("local", lp2)
+
+self.args = "-Qo ../usr/share/shared/ ../usr/share/shared/two"
+
+self.addrule("PACMAN_RETCODE=0")
+self.addrule("PACMAN_OUTPUT=shared/ is owned by pkg1")
+self.addrule("PACMAN_OUTPUT=shared/ is owned by pkg2")
+self.addrule("PACMAN_OUTPUT=two is owned by pkg2")
+self.addrule("!PACMAN_OUTPUT=two is owned by pkg1")
@@ -0,0 +1,15 @@
+self.description = "Query info on a package (reverse deps through provisions)"
+
+pkg = pmpkg("dep")
+pkg.provides = ["virt=2.0"]
+self.addpkg2db("local", pkg)
+
+for name, dep in (("a", "virt>=1.0"), ("b", "dep"), ("c", "virt>=3.0")):
+	p = pmpkg(name)
+	p.depends = [dep]
+	self.addpkg2db("local", p)
+
+self.args = "-Qi %s" % pkg.name
+
+self.addrule("PACMAN_RETCODE=0")
+self.addrule("PACMAN_OUTPUT=^Required By +: a  b$")
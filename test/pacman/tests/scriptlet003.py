@@ -0,0 +1,18 @@
+self.description = "Scriptlet test (pre/post upgrade from a sync db)"
+
+lp = pmpkg("dummy")
+lp.files = ['etc/dummy.conf']
+self.addpkg2db("local", lp)
+
+sp = pmpkg("dummy", "2.0-1")
+sp.files = ['etc/dummy.conf']
+sp.install['pre_upgrade'] = "echo $1 $2 > pre_upgrade"
+sp.install['post_upgrade'] = "echo $1 $2 > post_upgrade"
+self.addpkg2db("sync", sp)
+
+self.args = "-S %s" % sp.name
+
+self.addrule("PACMAN_RETCODE=0")
+self.addrule("PKG_VERSION=dummy|2.0-1")
+self.addrule("FILE_CONTENTS=pre_upgrade|2.0-1 1.0-1\n")
+self.addrule("FILE_CONTENTS=post_upgrade|2.0-1 1.0-1\n")
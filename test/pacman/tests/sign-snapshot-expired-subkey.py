@@ -0,0 +1,8 @@
+self.description = "Reject a signature made after the signing subkey expired"
+
+self.add_signed_fixture("expired-subkey.sig")
+
+self.addrule("PACMAN_RETCODE=1")
+self.addrule("PACMAN_OUTPUT=invalid or corrupted package .PGP signature.")
+self.addrule("!PKG_EXIST=pkg1")
+self.addrule("!FILE_EXIST=bin/pkg1")
@@ -0,0 +1,7 @@
+self.description = "Install a package signed by an RSA subkey in the keyring snapshot"
+
+self.add_signed_fixture("rsa.sig")
+
+self.addrule("PACMAN_RETCODE=0")
+self.addrule("PKG_EXIST=pkg1")
+self.addrule("FILE_EXIST=bin/pkg1")
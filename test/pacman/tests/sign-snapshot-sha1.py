@@ -0,0 +1,8 @@
+self.description = "Reject a SHA-1 signature on package data"
+
+self.add_signed_fixture("rsa-sha1.sig")
+
+self.addrule("PACMAN_RETCODE=1")
+self.addrule("PACMAN_OUTPUT=invalid or corrupted package .PGP signature.")
+self.addrule("!PKG_EXIST=pkg1")
+self.addrule("!FILE_EXIST=bin/pkg1")
@@ -0,0 +1,7 @@
+self.description = "Accept a signature made before the signing key expired"
+
+self.add_signed_fixture("signed-before-expiry.sig")
+
+self.addrule("PACMAN_RETCODE=0")
+self.addrule("PKG_EXIST=pkg1")
+self.addrule("FILE_EXIST=bin/pkg1")
@@ -0,0 +1,8 @@
+self.description = "Ignore RSA keys shorter than 2048 bits in the keyring snapshot"
+
+self.add_signed_fixture("weak-key.sig")
+
+self.addrule("PACMAN_RETCODE=1")
+self.addrule("PACMAN_OUTPUT=is not in keyring")
+self.addrule("!PKG_EXIST=pkg1")
+self.addrule("!FILE_EXIST=bin/pkg1")
@@ -0,0 +1,60 @@
+self.description = "Install and upgrade packages extracted on several threads"
+
+self.option['ExtractThreads'] = ['4']
+
+self.filesystem = ["usr/bin/"]
+
+lp1 = pmpkg("pkg1")
+lp1.files = ["usr/bin/pkg1",
+             "usr/share/moved"]
+self.addpkg2db("local", lp1)
+
+lp4 = pmpkg("pkg4")
+lp4.files = ["etc/pkg4.conf"]
+lp4.backup = ["etc/pkg4.conf*"]
+self.addpkg2db("local", lp4)
+
+sp1 = pmpkg("pkg1", "1.0-2")
+sp1.files = ["usr/bin/pkg1"]
+self.addpkg2db("sync", sp1)
+
+sp2 = pmpkg("pkg2")
+sp2.files = ["usr/bin/pkg2",
+             "usr/share/moved"]
+self.addpkg2db("sync", sp2)
+
+sp3 = pmpkg("pkg3")
+sp3.files = ["usr/bin/pkg3"]
+sp3.install['post_install'] = "true"
+self.addpkg2db("sync", sp3)
+
+sp4 = pmpkg("pkg4", "1.0-2")
+sp4.files = ["etc/pkg4.conf**"]
+sp4.backup = ["etc/pkg4.conf"]
+self.addpkg2db("sync", sp4)
+
+sp5 = pmpkg("pkg5")
+sp5.files = ["opt/",
+             "opt/pkg5/",
+             "opt/pkg5/file"]
+self.addpkg2db("sync", sp5)
+
+sp6 = pmpkg("pkg6")
+sp6.files = ["opt/",
+             "opt/pkg6/",
+             "opt/pkg6/file"]
+self.addpkg2db("sync", sp6)
+
+self.args = "-S %s" % " ".join("pkg%d" % i for i in range(1, 7))
+
+self.addrule("PACMAN_RETCODE=0")
+for i in range(1, 7):
+    self.addrule("PKG_EXIST=pkg%d" % i)
+self.addrule("PKG_VERSION=pkg1|1.0-2")
+self.addrule("PKG_VERSION=pkg4|1.0-2")
+self.addrule("FILE_EXIST=usr/bin/pkg1")
+self.addrule("FILE_EXIST=usr/share/moved")
+self.addrule("FILE_PACNEW=etc/pkg4.conf")
+self.addrule("!FILE_MODIFIED=etc/pkg4.conf")
+self.addrule("FILE_EXIST=opt/pkg5/file")
+self.addrule("FILE_EXIST=opt/pkg6/file")
@@ -0,0 +1,32 @@
+self.description = "Packages verified while downloading are not hashed again"
+self.require_capability("curl")
+
+import hashlib
+
+self.option['PipelineDownloads'] = [None]
+self.option['VerifyThreads'] = ['2']
+
+pkgs = []
+files = {}
+for i in range(1, 4):
+    sp = pmpkg("pkg%d" % i)
+    sp.files = ["usr/bin/pkg%d" % i]
+    data = sp.makepkg_bytes()
+    sp.sha256sum = hashlib.sha256(data).hexdigest()
+    files['/{}'.format(sp.filename())] = data
+    self.addpkg2db("sync", sp)
+    pkgs.append(sp)
+
+url = self.add_simple_http_server(files)
+
+self.db['sync'].option['Server'] = [ url ]
+self.db['sync'].syncdir = False
+self.cachepkgs = False
+
+self.args = "--debug -S %s" % " ".join(p.name for p in pkgs)
+
+self.addrule("PACMAN_RETCODE=0")
+for p in pkgs:
+    self.addrule("PKG_EXIST=%s" % p.name)
+    self.addrule("PACMAN_OUTPUT=sha256sum for .*%s verified during download" % p.filename())
+self.addrule("!PACMAN_OUTPUT=checking sha256sum for")
@@ -0,0 +1,27 @@
+self.description = "Install packages verified while they are downloading"
+self.require_capability("curl")
+
+self.option['PipelineDownloads'] = [None]
+self.option['VerifyThreads'] = ['2']
+
+pkgs = []
+for i in range(1, 6):
+    sp = pmpkg("pkg%d" % i)
+    sp.files = ["usr/bin/pkg%d" % i]
+    self.addpkg2db("sync", sp)
+    pkgs.append(sp)
+
+url = self.add_simple_http_server(
+    dict(('/{}'.format(p.filename()), p.makepkg_bytes()) for p in pkgs))
+
+self.db['sync'].option['Server'] = [ url ]
+self.db['sync'].syncdir = False
+self.cachepkgs = False
+
+self.args = "-S %s" % " ".join(p.name for p in pkgs)
+
+self.addrule("PACMAN_RETCODE=0")
+for p in pkgs:
+    self.addrule("PKG_EXIST=%s" % p.name)
+    self.addrule("FILE_EXIST=usr/bin/%s" % p.name)
+    self.addrule("CACHE_EXISTS=%s|1.0-1" % p.name)
@@ -0,0 +1,15 @@
+self.description = "Install packages verified on several threads"
+
+self.option['VerifyThreads'] = ['4']
+
+for i in range(1, 7):
+    sp = pmpkg("pkg%d" % i)
+    sp.files = ["usr/bin/pkg%d" % i]
+    self.addpkg2db("sync", sp)
+
+self.args = "-S %s" % " ".join("pkg%d" % i for i in range(1, 7))
+
+self.addrule("PACMAN_RETCODE=0")
+for i in range(1, 7):
+    self.addrule("PKG_EXIST=pkg%d" % i)
+    self.addrule("FILE_EXIST=usr/bin/pkg%d" % i)
@@ -0,0 +1,34 @@
+self.description = "Install a package from a sync db with mixed NoExtract patterns"
+
+sp = pmpkg("dummy")
+sp.files = ["bin/dummy",
+            "usr/lib/dummy/mod.py",
+            "usr/lib/dummy/mod.pyc",
+            "usr/lib/dummy/keep.pyc",
+            "usr/share/doc/dummy/README",
+            "usr/share/doc/dummy/COPYING",
+            "usr/share/locale/de/dummy.mo",
+            "usr/share/locale/en/dummy.mo"]
+self.addpkg2db("sync", sp)
+
+# later patterns override earlier ones across literal, prefix, suffix and
+# general patterns
+self.option["NoExtract"] = ["*.pyc",
+                            "usr/share/doc/*",
+                            "!usr/share/doc/dummy/COPYING",
+                            "!usr/lib/dummy/keep.pyc",
+                            "usr/share/locale/*",
+                            "!usr/share/locale/[e]*"]
+
+self.args = "-S %s" % sp.name
+
+self.addrule("PACMAN_RETCODE=0")
+self.addrule("PKG_EXIST=dummy")
+self.addrule("FILE_EXIST=bin/dummy")
+self.addrule("FILE_EXIST=usr/lib/dummy/mod.py")
+self.addrule("!FILE_EXIST=usr/lib/dummy/mod.pyc")
+self.addrule("FILE_EXIST=usr/lib/dummy/keep.pyc")
+self.addrule("!FILE_EXIST=usr/share/doc/dummy/README")
+self.addrule("FILE_EXIST=usr/share/doc/dummy/COPYING")
+self.addrule("!FILE_EXIST=usr/share/locale/de/dummy.mo")
+self.addrule("FILE_EXIST=usr/share/locale/en/dummy.mo")
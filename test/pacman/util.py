@@ -114,7 +114,7 @@ def mkcfgfile(filename, root, option, db):
     # Options
     data = ["[options]"]
     for key, value in option.items():
-        data.extend(["%s = %s" % (key, j) for j in value])
+        data.extend([key if j is None else "%s = %s" % (key, j) for j in value])
 
     # Repositories
     # sort by repo name so tests can predict repo order, rather than be